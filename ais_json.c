@@ -77,8 +77,6 @@ int json_ais_read(const char *buf,
 
 #include "ais_json.i"		/* JSON parser template structures */
 
-#undef AIS_HEADER
-
     memset(ais, '\0', sizeof(struct ais_t));
 
     /*@-usedef@*/
@@ -462,6 +460,10 @@ int json_ais_read(const char *buf,
 	    *endptr = NULL;
 	return JSON_ERR_MISC;
     }
+#undef AIS_HEADER
+#define JSON_UNDEF_TABLES
+#include "ais_json.i"		/* this time it only #undefs the tables */
+#undef JSON_UNDEF_TABLES
     return status;
     /*@+compdef +usedef +nullstate@*/
 }
@@ -0,0 +1,64 @@
+/*
+ * benchmark.c -- scaffolding shared by the benchmark test programs
+ *
+ * test_nmea, test_report and test_gpsmm -b all run some operation
+ * over their input a number of times, time only the interesting part,
+ * and finish with a rate.  The -n handling, the clock and the result
+ * line live here so the three report alike.
+ *
+ * This file is Copyright (c) 2014 by the GPSD project
+ * BSD terms apply: see the file COPYING in the distribution root for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark.h"
+
+void benchmark_init(/*@out@*/struct benchmark_t *bench,
+		    const char *progname, int rounds)
+/* start a measurement with nothing timed yet */
+{
+    memset(bench, '\0', sizeof(*bench));
+    bench->progname = progname;
+    bench->rounds = rounds;
+}
+
+void benchmark_rounds(struct benchmark_t *bench, const char *arg)
+/* take the argument of -n */
+{
+    if ((bench->rounds = atoi(arg)) <= 0) {
+	(void)fprintf(stderr, "%s: -n needs a positive count\n",
+		      bench->progname);
+	exit(EXIT_FAILURE);
+    }
+}
+
+void benchmark_start(struct benchmark_t *bench)
+/* open a timed stretch */
+{
+    bench->start = timestamp();
+}
+
+void benchmark_stop(struct benchmark_t *bench, unsigned long done)
+/* close a timed stretch that ran done operations */
+{
+    bench->elapsed += timestamp() - bench->start;
+    bench->count += done;
+}
+
+int benchmark_report(const struct benchmark_t *bench,
+		     const char *label, const char *unit)
+/* print the rate; an exit status, failure if nothing was timed */
+{
+    if (bench->count == 0) {
+	(void)fprintf(stderr, "%s: no %s timed\n", bench->progname, unit);
+	return EXIT_FAILURE;
+    }
+    (void)printf("%s%lu %s in %.3f sec: %.0f %s/sec\n",
+		 label, bench->count, unit, bench->elapsed,
+		 bench->count / bench->elapsed, unit);
+    return EXIT_SUCCESS;
+}
+
+/* benchmark.c ends here */
@@ -0,0 +1,40 @@
+/*
+ * benchmark.h -- scaffolding shared by the benchmark test programs
+ *
+ * This file is Copyright (c) 2014 by the GPSD project
+ * BSD terms apply: see the file COPYING in the distribution root for details.
+ *
+ */
+
+#ifndef _GPSD_BENCHMARK_H_
+#define _GPSD_BENCHMARK_H_
+
+#include "gps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct benchmark_t
+/* one timed measurement */
+{
+    const char *progname;	/* prefixes the messages */
+    int rounds;			/* passes over the input, set with -n */
+    unsigned long count;	/* operations timed so far */
+    timestamp_t elapsed;	/* time spent in the timed stretches */
+    timestamp_t start;		/* when the current stretch began */
+};
+
+extern void benchmark_init(/*@out@*/struct benchmark_t *, const char *, int);
+extern void benchmark_rounds(struct benchmark_t *, const char *);
+extern void benchmark_start(struct benchmark_t *);
+extern void benchmark_stop(struct benchmark_t *, unsigned long);
+extern int benchmark_report(const struct benchmark_t *,
+			    const char *, const char *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GPSD_BENCHMARK_H_ */
+/* benchmark.h ends here */
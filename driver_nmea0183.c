@@ -101,14 +101,20 @@ static void merge_hhmmss(char *hhmmss, struct gps_device_t *session)
 /* update from a UTC time */
 {
     int old_hour = session->nmea.date.tm_hour;
+    long scale;
+    char *cp;
 
     session->nmea.date.tm_hour = DD(hhmmss);
     if (session->nmea.date.tm_hour < old_hour)	/* midnight wrap */
 	session->nmea.date.tm_mday++;
     session->nmea.date.tm_min = DD(hhmmss + 2);
     session->nmea.date.tm_sec = DD(hhmmss + 4);
-    session->nmea.subseconds =
-	safe_atof(hhmmss + 4) - session->nmea.date.tm_sec;
+    /* decimal fraction straight to nanoseconds, with no float rounding */
+    session->nmea.subseconds = 0;
+    if (strlen(hhmmss) > 6 && hhmmss[6] == '.')
+	for (cp = hhmmss + 7, scale = 100000000L;
+	     *cp >= '0' && *cp <= '9' && scale > 0; cp++, scale /= 10)
+	    session->nmea.subseconds += (*cp - '0') * scale;
 }
 
 static void register_fractional_time(const char *tag, const char *fld,
@@ -1193,71 +1199,126 @@ static gps_mask_t processMTK3301(int c UNUSED, char *field[],
  *
  **************************************************************************/
 
-/*@ -mayaliasunique @*/
-gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
-/* parse an NMEA sentence, unpack it into a session structure */
+/*
+ * Sentence dispatch.  Slot numbers double as bit positions in the
+ * cycle_enders mask, so there must never be more than 31 of them;
+ * slot 0 means "no tag".
+ */
+enum nmea_slot {
+    NMEA_NONE,
+    NMEA_PGRMC, NMEA_PGRME, NMEA_PGRMI, NMEA_PGRMO,
+    NMEA_RMC, NMEA_GGA, NMEA_GST, NMEA_GLL, NMEA_GSA, NMEA_GSV,
+    NMEA_VTG, NMEA_ZDA, NMEA_GBS, NMEA_HDT, NMEA_DBT,
+    NMEA_PTNTHTM, NMEA_PASHR, NMEA_OHPR, NMEA_PMTK,
+    NMEA_SLOTS
+};
+
+typedef gps_mask_t(*nmea_decoder) (int count, char *f[],
+				   struct gps_device_t * session);
+static const struct
 {
-    typedef gps_mask_t(*nmea_decoder) (int count, char *f[],
-				       struct gps_device_t * session);
-    static struct
-    {
-	char *name;
-	int nf;			/* minimum number of fields required to parse */
-	bool cycle_continue;	/* cycle continuer? */
-	nmea_decoder decoder;
-    } nmea_phrase[] = {
-	/*@ -nullassign @*/
-	{"PGRMC", 0, false, NULL},	/* ignore Garmin Sensor Config */
-	{"PGRME", 7, false, processPGRME},
-	{"PGRMI", 0, false, NULL},	/* ignore Garmin Sensor Init */
-	{"PGRMO", 0, false, NULL},	/* ignore Garmin Sentence Enable */
-	    /*
-	     * Basic sentences must come after the PG* ones, otherwise
-	     * Garmins can get stuck in a loop that looks like this:
-	     *
-	     * 1. A Garmin GPS in NMEA mode is detected.
-	     *
-	     * 2. PGRMC is sent to reconfigure to Garmin binary mode.
-	     *    If successful, the GPS echoes the phrase.
-	     *
-	     * 3. nmea_parse() sees the echo as RMC because the talker
-	     *    ID is ignored, and fails to recognize the echo as
-	     *    PGRMC and ignore it.
-	     *
-	     * 4. The mode is changed back to NMEA, resulting in an
-	     *    infinite loop.
-	     */
-	{"RMC", 8,  false, processRMC},
-	{"GGA", 13, false, processGGA},
-	{"GST", 8,  false, processGST},
-	{"GLL", 7,  false, processGLL},
-	{"GSA", 17, false, processGSA},
-	{"GSV", 0,  false, processGSV},
-	{"VTG", 0,  false, NULL},	/* ignore Velocity Track made Good */
-	{"ZDA", 4,  false, processZDA},
-	{"GBS", 7,  false, processGBS},
-        {"HDT", 1,  false, processHDT},
-	{"DBT", 7,  true,  processDBT},
+    char *name;
+    int nf;			/* minimum number of fields required to parse */
+    bool cycle_continue;	/* cycle continuer? */
+    nmea_decoder decoder;
+} nmea_phrase[NMEA_SLOTS] = {
+    /*@ -nullassign @*/
+    [NMEA_PGRMC] = {"PGRMC", 0, false, NULL},	/* ignore Garmin Sensor Config */
+    [NMEA_PGRME] = {"PGRME", 7, false, processPGRME},
+    [NMEA_PGRMI] = {"PGRMI", 0, false, NULL},	/* ignore Garmin Sensor Init */
+    [NMEA_PGRMO] = {"PGRMO", 0, false, NULL},	/* ignore Garmin Sentence Enable */
+    [NMEA_RMC] = {"RMC", 8,  false, processRMC},
+    [NMEA_GGA] = {"GGA", 13, false, processGGA},
+    [NMEA_GST] = {"GST", 8,  false, processGST},
+    [NMEA_GLL] = {"GLL", 7,  false, processGLL},
+    [NMEA_GSA] = {"GSA", 17, false, processGSA},
+    [NMEA_GSV] = {"GSV", 0,  false, processGSV},
+    [NMEA_VTG] = {"VTG", 0,  false, NULL},	/* ignore Velocity Track made Good */
+    [NMEA_ZDA] = {"ZDA", 4,  false, processZDA},
+    [NMEA_GBS] = {"GBS", 7,  false, processGBS},
+    [NMEA_HDT] = {"HDT", 1,  false, processHDT},
+    [NMEA_DBT] = {"DBT", 7,  true,  processDBT},
 #ifdef TNT_ENABLE
-	{"PTNTHTM", 9, false, processTNTHTM},
+    [NMEA_PTNTHTM] = {"PTNTHTM", 9, false, processTNTHTM},
 #endif /* TNT_ENABLE */
 #ifdef ASHTECH_ENABLE
-	{"PASHR", 3, false, processPASHR},	/* general handler for Ashtech */
+    [NMEA_PASHR] = {"PASHR", 3, false, processPASHR},	/* general handler for Ashtech */
 #endif /* ASHTECH_ENABLE */
 #ifdef OCEANSERVER_ENABLE
-	{"OHPR", 18, false, processOHPR},
+    [NMEA_OHPR] = {"OHPR", 18, false, processOHPR},
 #endif /* OCEANSERVER_ENABLE */
-	    /*@ +nullassign @*/
 #ifdef MTK3301_ENABLE
-	{"PMTK", 3,  false, processMTK3301},
+    [NMEA_PMTK] = {"PMTK", 3,  false, processMTK3301},
 #endif /* MTK3301_ENABLE */
-    };
+    /*@ +nullassign @*/
+};
+
+#define NMEATYPE(a, b, c)	\
+	((((unsigned int)(a)) << 16) | (((unsigned int)(b)) << 8) \
+	 | ((unsigned int)(c)))
+
+static enum nmea_slot nmea_lookup(const char *tag)
+/* map a sentence tag to its dispatch slot, NMEA_NONE if unknown */
+{
+    size_t len = strlen(tag);
+
+    /*
+     * Proprietary sentences are matched whole, and before any talker
+     * ID is stripped.  Otherwise Garmins can get stuck in a loop that
+     * looks like this:
+     *
+     * 1. A Garmin GPS in NMEA mode is detected.
+     *
+     * 2. PGRMC is sent to reconfigure to Garmin binary mode.
+     *    If successful, the GPS echoes the phrase.
+     *
+     * 3. nmea_parse() sees the echo as RMC because the talker
+     *    ID is ignored, and fails to recognize the echo as
+     *    PGRMC and ignore it.
+     *
+     * 4. The mode is changed back to NMEA, resulting in an
+     *    infinite loop.
+     */
+    if (tag[0] == 'P' || len != 5) {
+	int i;
+	for (i = NMEA_NONE + 1; i < NMEA_SLOTS; i++)
+	    if (nmea_phrase[i].name != NULL
+		&& strlen(nmea_phrase[i].name) != 3
+		&& strcmp(nmea_phrase[i].name, tag) == 0)
+		return (enum nmea_slot)i;
+    }
+    if (len != 5)
+	return NMEA_NONE;
+
+    /* standard sentences: skip the talker ID, switch on the rest */
+    /* *INDENT-OFF* */
+    switch (NMEATYPE(tag[2], tag[3], tag[4])) {
+    case NMEATYPE('R','M','C'): return NMEA_RMC;
+    case NMEATYPE('G','G','A'): return NMEA_GGA;
+    case NMEATYPE('G','S','T'): return NMEA_GST;
+    case NMEATYPE('G','L','L'): return NMEA_GLL;
+    case NMEATYPE('G','S','A'): return NMEA_GSA;
+    case NMEATYPE('G','S','V'): return NMEA_GSV;
+    case NMEATYPE('V','T','G'): return NMEA_VTG;
+    case NMEATYPE('Z','D','A'): return NMEA_ZDA;
+    case NMEATYPE('G','B','S'): return NMEA_GBS;
+    case NMEATYPE('H','D','T'): return NMEA_HDT;
+    case NMEATYPE('D','B','T'): return NMEA_DBT;
+    default: return NMEA_NONE;
+    }
+    /* *INDENT-ON* */
+}
 
+/*@ -mayaliasunique @*/
+gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
+/* parse an NMEA sentence, unpack it into a session structure */
+{
     int count;
     gps_mask_t retval = 0;
     unsigned int i, thistag;
-    char *p, *s, *e;
-    volatile char *t;
+    enum nmea_slot slot;
+    char *s, *e;
+    unsigned char *t;
 
     /*
      * We've had reports that on the Garmin GPS-10 the device sometimes
@@ -1274,33 +1335,31 @@ gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
 	return ONLINE_SET;
     }
 
+    /*
+     * Make an editable copy of the sentence and split it into fields
+     * in the same pass: commas become NULs and each field start is
+     * recorded as we go.  The checksum part is discarded, with the
+     * '*' counted as a final comma; otherwise we drop the last field.
+     * The length check above guarantees the copy fits.
+     */
     /*@ -usedef @*//* splint 3.1.1 seems to have a bug here */
-    /* make an editable copy of the sentence */
-    (void)strlcpy((char *)session->nmea.fieldcopy, sentence, NMEA_MAX);
-    /* discard the checksum part */
-    for (p = (char *)session->nmea.fieldcopy;
-	 (*p != '*') && (*p >= ' ');)
-	++p;
-    if (*p == '*')
-	*p++ = ',';		/* otherwise we drop the last field */
-    *p = '\0';
-    e = p;
-
-    /* split sentence copy on commas, filling the field array */
     count = 0;
-    t = p;			/* end of sentence */
-    p = (char *)session->nmea.fieldcopy + 1;	/* beginning of tag, 'G' not '$' */
-    /* while there is a search string and we haven't run off the buffer... */
-    while ((p != NULL) && (p <= t)) {
-	session->nmea.field[count] = p;	/* we have a field. record it */
-	/*@ -compdef @*/
-	if ((p = strchr(p, ',')) != NULL) {	/* search for the next delimiter */
-	    *p = '\0';		/* replace it with a NUL */
-	    count++;		/* bump the counters and continue */
-	    p++;
-	}
-	/*@ +compdef @*/
+    t = session->nmea.fieldcopy;
+    session->nmea.field[0] = (char *)t;
+    for (s = sentence + 1; *s != '*' && *s >= ' '; s++) {
+	if (*s == ',') {
+	    *t++ = '\0';
+	    session->nmea.field[++count] = (char *)t;
+	} else
+	    *t++ = (unsigned char)*s;
+    }
+    if (*s == '*') {
+	*t++ = '\0';
+	++count;
     }
+    *t = '\0';
+    e = (char *)t;
+    /*@ +usedef @*/
 
     /* point remaining fields at empty string, just in case */
     for (i = (unsigned int)count;
@@ -1313,29 +1372,20 @@ gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
     session->nmea.latch_frac_time = false;
 
     /* dispatch on field zero, the sentence tag */
-    for (thistag = i = 0;
-	 i < (unsigned)(sizeof(nmea_phrase) / sizeof(nmea_phrase[0])); ++i) {
-	s = session->nmea.field[0];
-	if (strlen(nmea_phrase[i].name) == 3)
-	    s += 2;		/* skip talker ID */
-	if (strcmp(nmea_phrase[i].name, s) == 0) {
-	    if (nmea_phrase[i].decoder != NULL
-		&& (count >= nmea_phrase[i].nf)) {
-		retval =
-		    (nmea_phrase[i].decoder) (count,
-					      session->nmea.field,
-					      session);
-		if (nmea_phrase[i].cycle_continue)
-		    session->nmea.cycle_continue = true;
-		/*
-		 * Must force this to be nz, as we're going to rely on a zero
-		 * value to mean "no previous tag" later.
-		 */
-		thistag = i + 1;
-	    } else
-		retval = ONLINE_SET;	/* unknown sentence */
-	    break;
-	}
+    thistag = 0;
+    slot = nmea_lookup(session->nmea.field[0]);
+    if (slot != NMEA_NONE) {
+	if (nmea_phrase[slot].decoder != NULL
+	    && (count >= nmea_phrase[slot].nf)) {
+	    retval =
+		(nmea_phrase[slot].decoder) (count,
+					     session->nmea.field,
+					     session);
+	    if (nmea_phrase[slot].cycle_continue)
+		session->nmea.cycle_continue = true;
+	    thistag = (unsigned int)slot;
+	} else
+	    retval = ONLINE_SET;	/* unknown sentence */
     }
 
     /* prevent overaccumulation of sat reports */
@@ -1350,14 +1400,14 @@ gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
 	 * is a timestamp whenever TIME_SET is set.
 	 */
 	gpsd_report(&session->context->errout, LOG_DATA,
-		    "%s time is %2f = %d-%02d-%02dT%02d:%02d:%02.2fZ\n",
+		    "%s time is %2f = %d-%02d-%02dT%02d:%02d:%02d.%09ldZ\n",
 		    session->nmea.field[0], session->newdata.time,
 		    1900 + session->nmea.date.tm_year,
 		    session->nmea.date.tm_mon + 1,
 		    session->nmea.date.tm_mday,
 		    session->nmea.date.tm_hour,
 		    session->nmea.date.tm_min,
-		    session->nmea.date.tm_sec + session->nmea.subseconds);
+		    session->nmea.date.tm_sec, session->nmea.subseconds);
 	/*
 	 * If we have time and PPS is available, assume we have good time.
 	 * Because this is a generic driver we don't really have enough
@@ -1403,7 +1453,7 @@ gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
 		session->nmea.cycle_enders |= (1 << lasttag);
 		gpsd_report(&session->context->errout, LOG_PROG,
 			    "tagged %s as a cycle ender.\n",
-			    nmea_phrase[lasttag - 1].name);
+			    nmea_phrase[lasttag].name);
 	    }
 	}
     } else {
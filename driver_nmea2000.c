@@ -61,30 +61,30 @@ extern bool __attribute__ ((weak)) gpsd_add_device(const char *device_name, bool
 
 static void print_data(struct gps_context_t *context,
 		       unsigned char *buffer, int len, PGN *pgn)
+/* hex-dump a PGN payload, but only when somebody will see it */
 {
-#ifdef LIBGPS_DEBUG
-    /*@-bufferoverflowhigh@*/
-    if ((libgps_debuglevel >= LOG_IO) != 0) {
-	int   l1, l2, ptr;
-	char  bu[128];
+    int   l1, l2, ptr;
+    char  bu[128];
 
-        ptr = 0;
-        l2 = sprintf(&bu[ptr], "got data:%6u:%3d: ", pgn->pgn, len);
-	ptr += l2;
-        for (l1=0;l1<len;l1++) {
-            if (((l1 % 20) == 0) && (l1 != 0)) {
-	        gpsd_report(&context->errout, LOG_IO,"%s\n", bu);
-		ptr = 0;
-                l2 = sprintf(&bu[ptr], "                   : ");
-		ptr += l2;
-            }
-            l2 = sprintf(&bu[ptr], "%02ux ", (unsigned int)buffer[l1]);
+    if (context->errout.debug < LOG_IO)
+	return;
+
+    /*@-bufferoverflowhigh@*/
+    ptr = 0;
+    l2 = sprintf(&bu[ptr], "got data:%6u:%3d: ", pgn->pgn, len);
+    ptr += l2;
+    for (l1=0;l1<len;l1++) {
+	if (((l1 % 20) == 0) && (l1 != 0)) {
+	    gpsd_report(&context->errout, LOG_IO,"%s\n", bu);
+	    ptr = 0;
+	    l2 = sprintf(&bu[ptr], "                   : ");
 	    ptr += l2;
-        }
-        gpsd_report(&context->errout, LOG_IO,"%s\n", bu);
+	}
+	l2 = sprintf(&bu[ptr], "%02x ", (unsigned int)buffer[l1]);
+	ptr += l2;
     }
+    gpsd_report(&context->errout, LOG_IO,"%s\n", bu);
     /*@+bufferoverflowhigh@*/
-#endif
 }
 
 static gps_mask_t get_mode(struct gps_device_t *session)
@@ -1243,26 +1243,169 @@ static PGN navpgn[] = {{ 59392, 0, 0, hnd_059392, &msg_059392[0]},
 
 /*@+usereleased@*/
 
-/*@-immediatetrans@*/
-static /*@null@*/ PGN *search_pgnlist(unsigned int pgn, PGN *pgnlist)
+/*
+ * The four tables above share their ISO entries, and an unlocked device
+ * may have to try all of them for every frame.  At open time they are
+ * merged into one open-addressed index keyed by PGN; each slot keeps
+ * that PGN's entry in every table, in the order they used to be tried.
+ */
+#define PGN_TABLES	4
+#define PGN_INDEX_SIZE	128	/* power of two, well above the PGN count */
+
+static PGN *pgn_tables[PGN_TABLES] = {gpspgn, aispgn, pwrpgn, navpgn};
+
+static struct {
+    unsigned int pgn;
+    /*@null@*/PGN *entry[PGN_TABLES];
+} pgn_index[PGN_INDEX_SIZE];
+static bool pgn_index_built = false;
+
+static unsigned int pgn_hash(unsigned int pgn)
+/* home slot of a PGN in the index */
 {
-    int l1;
-    PGN *work;
+    return ((pgn * 2654435761U) >> 24) & (PGN_INDEX_SIZE - 1);
+}
 
-    l1 = 0;
-    work = NULL;
-    while (pgnlist[l1].pgn != 0) {
-        if (pgnlist[l1].pgn == pgn) {
-	    work = &pgnlist[l1];
-	    break;
-	} else {
-	    l1 = l1 + 1;
-	    }
+static void pgn_index_build(void)
+/* merge the PGN tables into the lookup index */
+{
+    unsigned int t, h;
+    PGN *p;
+
+    for (t = 0; t < PGN_TABLES; t++)
+	for (p = pgn_tables[t]; p->pgn != 0; p++) {
+	    for (h = pgn_hash(p->pgn);
+		 pgn_index[h].pgn != 0 && pgn_index[h].pgn != p->pgn;
+		 h = (h + 1) & (PGN_INDEX_SIZE - 1))
+		continue;
+	    pgn_index[h].pgn = p->pgn;
+	    pgn_index[h].entry[t] = p;
+	}
+    pgn_index_built = true;
+}
+
+/*@-immediatetrans@*/
+static /*@null@*/ PGN *search_pgnlist(unsigned int pgn, void **pgnlist)
+/* find a PGN in the device's table, or in each table in turn */
+{
+    unsigned int h, t;
+
+    for (h = pgn_hash(pgn);
+	 pgn_index[h].pgn != pgn;
+	 h = (h + 1) & (PGN_INDEX_SIZE - 1))
+	if (pgn_index[h].pgn == 0)
+	    return NULL;
+    for (t = 0; t < PGN_TABLES; t++) {
+	PGN *work = pgn_index[h].entry[t];
+
+	if (*pgnlist != NULL) {
+	    if (*pgnlist == (void *)pgn_tables[t])
+		return work;
+	} else if (work != NULL) {
+	    /* a type-specific PGN tells us what kind of device this is */
+	    if (work->type > 0)
+		*pgnlist = (void *)pgn_tables[t];
+	    return work;
 	}
-    return work;
+    }
+    return NULL;
 }
 /*@+immediatetrans@*/
 
+/*
+ * Fast-packets are spread over up to 32 frames; frame 0 carries the
+ * payload length.  The low five bits of the first data byte count the
+ * frames, the top three are a sequence id.  Transfers from different
+ * sources or for different PGNs may interleave, so each one gets its own
+ * slot keyed by (source, PGN, sequence id).  The table is bounded: a
+ * slot left idle past the timeout is reclaimed, and when every slot is
+ * busy the one idle longest is sacrificed.
+ */
+#define NMEA2000_FAST_TIMEOUT	0.75	/* seconds a transfer may sit idle */
+
+/*@-mustfreeonly@*/
+static bool fast_packet(struct can_frame *frame, PGN *work,
+			unsigned int source_unit,
+			struct gps_device_t *session)
+/* add a frame to its fast-packet; true when the payload is complete */
+{
+    struct nmea2000_fast_t *fast = session->driver.nmea2000.fast;
+    struct nmea2000_fast_t *slot = NULL;
+    /*@i2@*/unsigned int seq = (unsigned int)frame->data[0] >> 5;
+    /*@i2@*/unsigned int counter = (unsigned int)frame->data[0] & 0x1f;
+    timestamp_t now = timestamp();
+    unsigned int l1, from;
+
+    for (l1 = 0; l1 < NMEA2000_FAST_SLOTS; l1++) {
+	if (fast[l1].pgn != 0
+	    && now - fast[l1].last > NMEA2000_FAST_TIMEOUT) {
+	    gpsd_report(&session->context->errout, LOG_WARN,
+			"Fast timeout %6u %2x, %u of %u bytes\n",
+			fast[l1].pgn, fast[l1].source,
+			(unsigned int)fast[l1].got, (unsigned int)fast[l1].len);
+	    fast[l1].pgn = 0;
+	}
+	if (fast[l1].pgn == work->pgn && fast[l1].source == source_unit
+	    && fast[l1].seq == seq)
+	    slot = &fast[l1];
+    }
+
+    if (counter == 0) {
+	if (slot == NULL) {
+	    for (l1 = 0; l1 < NMEA2000_FAST_SLOTS; l1++)
+		if (fast[l1].pgn == 0) {
+		    slot = &fast[l1];
+		    break;
+		} else if (slot == NULL || fast[l1].last < slot->last)
+		    slot = &fast[l1];
+	    if (slot->pgn != 0)
+		gpsd_report(&session->context->errout, LOG_WARN,
+			    "Fast table full, dropping %6u %2x\n",
+			    slot->pgn, slot->source);
+	}
+	slot->pgn = work->pgn;
+	slot->source = source_unit;
+	slot->seq = seq;
+	/*@i1@*/slot->len = MIN((size_t)frame->data[1], sizeof(slot->data));
+	slot->got = 0;
+	from = 2;
+	gpsd_report(&session->context->errout, LOG_DATA,
+		    "pgn %6d:%s \n", work->pgn, work->name);
+    } else if (slot == NULL || counter != slot->next) {
+	gpsd_report(&session->context->errout, LOG_ERROR,
+		    "Fast error %2x %2x %2x %2x %6d\n",
+		    slot != NULL ? slot->next : 0,
+		    /*@i1@*/frame->data[0],
+		    session->driver.nmea2000.unit,
+		    slot != NULL ? (unsigned int)slot->len : 0,
+		    work->pgn);
+	if (slot != NULL)
+	    slot->pgn = 0;
+	return false;
+    } else
+	from = 1;
+
+    /*@i3@*/for (l1 = from; l1 < 8 && slot->got < slot->len; l1++)
+	slot->data[slot->got++] = frame->data[l1];
+    slot->next = counter + 1;
+    slot->last = now;
+    if (slot->got < slot->len)
+	return false;
+
+#if NMEA2000_FAST_DEBUG
+    gpsd_report(&session->context->errout, LOG_ERROR,
+		"Fast done  %2x %2x %2x %2x %6d\n",
+		counter, /*@i1@*/frame->data[0],
+		session->driver.nmea2000.unit,
+		(unsigned int)slot->len, work->pgn);
+#endif /* of #if NMEA2000_FAST_DEBUG */
+    memcpy(session->lexer.outbuffer, slot->data, slot->len);
+    session->lexer.outbuflen = slot->len;
+    slot->pgn = 0;
+    return true;
+}
+/*@+mustfreeonly@*/
+
 /*@-nullstate -branchstate -globstate -mustfreeonly@*/
 static void find_pgn(struct can_frame *frame, struct gps_device_t *session)
 {
@@ -1350,29 +1493,8 @@ static void find_pgn(struct can_frame *frame, struct gps_device_t *session)
 
 	if (source_unit == session->driver.nmea2000.unit) {
 	    PGN *work;
-	    if (session->driver.nmea2000.pgnlist != NULL) {
-	        work = search_pgnlist(source_pgn, session->driver.nmea2000.pgnlist);
-	    } else {
-	        PGN *pgnlist;
 
-		pgnlist = &gpspgn[0];
-		work = search_pgnlist(source_pgn, pgnlist);
-		if (work == NULL) {
-		    pgnlist = &aispgn[0];
-		    work = search_pgnlist(source_pgn, pgnlist);
-		}
-		if (work == NULL) {
-		    pgnlist = &pwrpgn[0];
-		    work = search_pgnlist(source_pgn, pgnlist);
-		}
-		if (work == NULL) {
-		    pgnlist = &navpgn[0];
-		    work = search_pgnlist(source_pgn, pgnlist);
-		}
-		if ((work != NULL) && (work->type > 0)) {
-		    session->driver.nmea2000.pgnlist = pgnlist;
-		}
-	    }
+	    work = search_pgnlist(source_pgn, &session->driver.nmea2000.pgnlist);
 	    if (work != NULL) {
 	        if (work->fast == 0) {
 		    size_t l2;
@@ -1385,62 +1507,8 @@ static void find_pgn(struct can_frame *frame, struct gps_device_t *session)
 		        /*@i3@*/session->lexer.outbuffer[l2]= frame->data[l2];
 		    }
 		}
-		/*@i2@*/else if ((frame->data[0] & 0x1f) == 0) {
-		    unsigned int l2;
-
-		    /*@i2@*/session->driver.nmea2000.fast_packet_len = frame->data[1];
-		    /*@i2@*/session->driver.nmea2000.idx = frame->data[0];
-#if NMEA2000_FAST_DEBUG
-		    gpsd_report(&session->context->errout, LOG_ERROR,
-				"Set idx    %2x    %2x %2x %6d\n",
-				frame->data[0],
-				session->driver.nmea2000.unit,
-				frame->data[1],
-				source_pgn);
-#endif /* of #if NMEA2000_FAST_DEBUG */
-		    session->lexer.inbuflen = 0;
-		    session->driver.nmea2000.idx += 1;
-		    for (l2=2;l2<8;l2++) {
-		        /*@i3@*/session->lexer.inbuffer[session->lexer.inbuflen++] = frame->data[l2];
-		    }
-		    gpsd_report(&session->context->errout, LOG_DATA,
-				"pgn %6d:%s \n", work->pgn, work->name);
-		}
-		/*@i2@*/else if (frame->data[0] == session->driver.nmea2000.idx) {
-		    unsigned int l2;
-
-		    for (l2=1;l2<8;l2++) {
-		        if (session->driver.nmea2000.fast_packet_len > session->lexer.inbuflen) {
-			    /*@i3@*/session->lexer.inbuffer[session->lexer.inbuflen++] = frame->data[l2];
-			}
-		    }
-		    if (session->lexer.inbuflen == session->driver.nmea2000.fast_packet_len) {
-#if NMEA2000_FAST_DEBUG
-		        gpsd_report(&session->context->errout, LOG_ERROR,
-				    "Fast done  %2x %2x %2x %2x %6d\n",
-				    session->driver.nmea2000.idx,
-				                                                   /*@i1@*/frame->data[0],
-				                                                   session->driver.nmea2000.unit,
-				                                                   (unsigned int) session->driver.nmea2000.fast_packet_len,
-				                                                   source_pgn);
-#endif /* of #if  NMEA2000_FAST_DEBUG */
-			session->driver.nmea2000.workpgn = (void *) work;
-		        session->lexer.outbuflen = session->driver.nmea2000.fast_packet_len;
-			for(l2=0;l2 < (unsigned int)session->lexer.outbuflen; l2++) {
-			    session->lexer.outbuffer[l2] = session->lexer.inbuffer[l2];
-			}
-			session->driver.nmea2000.fast_packet_len = 0;
-		    } else {
-		        session->driver.nmea2000.idx += 1;
-		    }
-		} else {
-		    gpsd_report(&session->context->errout, LOG_ERROR,
-				"Fast error %2x %2x %2x %2x %6d\n",
-				session->driver.nmea2000.idx,
-				/*@i2@*/frame->data[0],
-				session->driver.nmea2000.unit,
-				(unsigned int) session->driver.nmea2000.fast_packet_len,
-				                                               source_pgn);
+		else if (fast_packet(frame, work, source_unit, session)) {
+		    session->driver.nmea2000.workpgn = (void *) work;
 		}
 	    } else {
 	        gpsd_report(&session->context->errout, LOG_WARN,
@@ -1469,20 +1537,75 @@ static void find_pgn(struct can_frame *frame, struct gps_device_t *session)
 /*@+nullstate +branchstate +globstate +mustfreeonly@*/
 
 
+/* the batch storage in gpsd.h is sized without <linux/can.h> */
+typedef char nmea2000_frame_fits[sizeof(struct can_frame) == NMEA2000_FRAME
+				 ? 1 : -1];
+
+static unsigned int nmea2000_receive(struct gps_device_t *session)
+/* fetch as many whole CAN frames as are waiting, up to one batch */
+{
+    struct can_frame *frames =
+	(struct can_frame *)session->driver.nmea2000.frames;
+    unsigned int n = 0;
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[NMEA2000_BATCH];
+    struct iovec iov[NMEA2000_BATCH];
+    unsigned int i;
+    int got;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < NMEA2000_BATCH; i++) {
+	iov[i].iov_base = &frames[i];
+	iov[i].iov_len = sizeof(struct can_frame);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    got = recvmmsg(session->gpsdata.gps_fd, msgs, NMEA2000_BATCH,
+		   MSG_DONTWAIT, NULL);
+    /* drop any short frames, keeping the rest in arrival order */
+    for (i = 0; got > 0 && i < (unsigned int)got; i++)
+	if (msgs[i].msg_len == sizeof(struct can_frame)) {
+	    if (n != i)
+		frames[n] = frames[i];
+	    n++;
+	}
+#else
+    if (read(session->gpsdata.gps_fd, &frames[0], sizeof(struct can_frame))
+	== (ssize_t)sizeof(struct can_frame))
+	n = 1;
+#endif /* HAVE_RECVMMSG */
+    return n;
+}
+
 static ssize_t nmea2000_get(struct gps_device_t *session)
+/* hand find_pgn() frames until one completes a packet or the batch runs dry */
 {
-    struct can_frame frame;
-    ssize_t          status;
+    struct can_frame *frames =
+	(struct can_frame *)session->driver.nmea2000.frames;
+    struct can_frame *frame;
 
     session->lexer.outbuflen = 0;
-    status = read(session->gpsdata.gps_fd, &frame, sizeof(frame));
-    if (status == (ssize_t)sizeof(frame)) {
-        session->lexer.type = NMEA2000_PACKET;
-	find_pgn(&frame, session);
-
-        return frame.can_dlc & 0x0f;
+    if (session->driver.nmea2000.frame_next
+	>= session->driver.nmea2000.frame_count) {
+	session->driver.nmea2000.frame_next = 0;
+	session->driver.nmea2000.frame_count = nmea2000_receive(session);
+	if (session->driver.nmea2000.frame_count == 0)
+	    return 0;
     }
-    return 0;
+    /*
+     * gpsd_multipoll() stops calling us after a call that yields no
+     * packet, and the socket may not be readable again until much
+     * later, so don't leave the rest of the batch waiting on it.
+     */
+    do {
+	frame = &frames[session->driver.nmea2000.frame_next++];
+	session->lexer.type = NMEA2000_PACKET;
+	find_pgn(frame, session);
+    } while (session->driver.nmea2000.workpgn == NULL
+	     && session->driver.nmea2000.frame_next
+		< session->driver.nmea2000.frame_count);
+
+    return frame->can_dlc & 0x0f;
 }
 
 /*@-mustfreeonly -nullstate@*/
@@ -1631,6 +1754,12 @@ int nmea2000_open(struct gps_device_t *session)
     session->sourcetype = source_can;
     session->servicetype = service_sensor;
     session->driver.nmea2000.can_net = can_net;
+    session->driver.nmea2000.frame_count = 0;
+    session->driver.nmea2000.frame_next = 0;
+    for (l = 0; l < NMEA2000_FAST_SLOTS; l++)
+	session->driver.nmea2000.fast[l].pgn = 0;
+    if (!pgn_index_built)
+	pgn_index_build();
 
     if (unit_ptr != NULL) {
         nmea2000_units[can_net][unit_number] = session;
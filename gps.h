@@ -42,9 +42,13 @@ extern "C" {
  * 5.2 - AIS type 6 and 8 get 'structured' flag; GPS_PATH_MAX
  *       shortened because devices has moved out of union. Sentence
  *       tag fields dropped from emitted JSON.
+ * 5.3 - gps_dropped() reports updates a shared-memory reader missed.
+ *       Compact per-device shared-memory export, gps_shmdev_*().
+ *       Binary data reports, WATCH_BINARY and the gps_wire_* records.
+ *       Delta SKY reports, WATCH_SKYDELTA.
  */
 #define GPSD_API_MAJOR_VERSION	5	/* bump on incompatible changes */
-#define GPSD_API_MINOR_VERSION	2	/* bump on compatible changes */
+#define GPSD_API_MINOR_VERSION	3	/* bump on compatible changes */
 
 #define MAXCHANNELS	72	/* must be > 12 GPS + 12 GLONASS + 2 WAAS */
 #define GPS_PRNMAX	32	/* above this number are SBAS satellites */
@@ -1875,6 +1879,8 @@ struct policy_t {
     bool scaled;			/* requesting report scaling? */
     bool timing;			/* requesting timing info */
     bool split24;			/* requesting split AIS Type 24s */
+    bool binary;			/* requesting binary data reports */
+    bool skydelta;			/* requesting delta SKY reports */
     int loglevel;			/* requested log level of messages */
     char devpath[GPS_PATH_MAX];		/* specific device to watch */
     char remote[GPS_PATH_MAX];		/* ...if this was passthrough */
@@ -1911,6 +1917,8 @@ typedef int socket_t;
 #define WATCH_DEVICE	0x000800u	/* watch specific device */
 #define WATCH_SPLIT24	0x001000u	/* split AIS Type 24s */
 #define WATCH_PPS	0x002000u	/* enable PPS JSON */
+#define WATCH_BINARY	0x004000u	/* binary data reports */
+#define WATCH_SKYDELTA	0x008000u	/* SKY reports only what changed */
 #define WATCH_NEWSTYLE	0x010000u	/* force JSON streaming */
 #define WATCH_OLDSTYLE	0x020000u	/* force old-style streaming */
 
@@ -2030,6 +2038,7 @@ extern int gps_send(struct gps_data_t *, const char *, ... );
 extern int gps_read(/*@out@*/struct gps_data_t *);
 extern int gps_unpack(char *, struct gps_data_t *);
 extern bool gps_waiting(const struct gps_data_t *, int);
+extern unsigned long gps_dropped(const struct gps_data_t *);
 extern int gps_stream(struct gps_data_t *, unsigned int, /*@null@*/void *);
 extern int gps_mainloop(struct gps_data_t *, int,
 			void (*)(struct gps_data_t *));
@@ -2039,6 +2048,129 @@ extern const char /*@observer@*/ *gps_errstr(const int);
 int json_pps_read(const char *buf, struct gps_data_t *,
 		  /*@null@*/ const char **);
 
+/*
+ * Binary data reports, for watchers that set "binary":true.  TPV, SKY,
+ * GST, ATT, PPS and AIS reports then arrive as frames instead of JSON
+ * lines: a gps_wire_header_t followed by the record it announces.
+ * Everything else is still JSON.  The magic byte never occurs in UTF-8
+ * text, so the two interleave unambiguously.  Records are in the
+ * daemon's byte order, which the order field lets a client check.
+ * AIS records carry the daemon's struct ais_t as is, so they are only
+ * usable by a client built for the same ABI; the length tells.
+ */
+#define GPS_WIRE_MAGIC		0xFE
+#define GPS_WIRE_VERSION	1
+#define GPS_WIRE_ORDER		0x0102
+#define GPS_WIRE_TPV		1	/* struct gps_wire_tpv_t */
+#define GPS_WIRE_SKY		2	/* struct gps_wire_sky_t, cut short */
+#define GPS_WIRE_GST		3	/* struct gps_wire_gst_t */
+#define GPS_WIRE_ATT		4	/* struct gps_wire_att_t */
+#define GPS_WIRE_PPS		5	/* struct gps_wire_pps_t */
+#define GPS_WIRE_AIS		6	/* struct gps_wire_ais_t */
+
+struct gps_wire_header_t {
+    uint8_t magic;		/* GPS_WIRE_MAGIC */
+    uint8_t version;		/* GPS_WIRE_VERSION */
+    uint16_t order;		/* GPS_WIRE_ORDER in the sender's byte order */
+    uint16_t type;		/* GPS_WIRE_* */
+    uint16_t reserved;
+    uint32_t length;		/* of the record that follows */
+};
+
+struct gps_wire_tpv_t {
+    double time, ept;
+    double latitude, longitude, altitude;
+    double epx, epy, epv;
+    double track, speed, climb;
+    double epd, eps, epc;
+    int32_t mode, status;
+    char device[GPS_PATH_MAX];
+};
+
+struct gps_wire_sat_t {
+    double ss;
+    int16_t PRN, elevation, azimuth;
+    uint8_t used;
+    uint8_t reserved;
+};
+
+struct gps_wire_sky_t {
+    double time;
+    double xdop, ydop, vdop, tdop, hdop, pdop, gdop;
+    int32_t satellites_visible, satellites_used;
+    char device[GPS_PATH_MAX];
+    /* only the first satellites_visible entries are sent */
+    struct gps_wire_sat_t sat[MAXCHANNELS];
+};
+
+struct gps_wire_gst_t {
+    double utctime;
+    double rms_deviation;
+    double smajor_deviation, sminor_deviation, smajor_orientation;
+    double lat_err_deviation, lon_err_deviation, alt_err_deviation;
+    char device[GPS_PATH_MAX];
+};
+
+struct gps_wire_att_t {
+    double heading, pitch, roll, yaw, dip;
+    double mag_len, mag_x, mag_y, mag_z;
+    double acc_len, acc_x, acc_y, acc_z;
+    double gyro_x, gyro_y;
+    double temp, depth;
+    char mag_st, pitch_st, roll_st, yaw_st;
+    char device[GPS_PATH_MAX];
+    char reserved[4];
+};
+
+struct gps_wire_pps_t {
+    int64_t real_sec, real_nsec;
+    int64_t clock_sec, clock_nsec;
+    char device[GPS_PATH_MAX];
+};
+
+struct gps_wire_ais_t {
+    char device[GPS_PATH_MAX];
+    struct ais_t ais;
+};
+
+/*
+ * Compact per-device shared-memory export.  Each device the daemon has
+ * open gets its own segment holding a short ring of fixed-layout
+ * records per report class, so a reader copies only what it asked for.
+ */
+#define SHMDEV_TPV	0	/* struct gps_fix_t */
+#define SHMDEV_SKY	1	/* struct shmsky_t */
+#define SHMDEV_TOFF	2	/* struct timedrift_t, serial time offset */
+#define SHMDEV_PPS	3	/* struct timedrift_t, pulse-per-second */
+#define SHMDEV_AIS	4	/* struct ais_t */
+#define SHMDEV_CLASSES	5
+
+struct shmsky_t {
+    timestamp_t time;		/* skyview timestamp */
+    int satellites_visible;
+    int satellites_used;
+    struct dop_t dop;
+    struct satellite_t skyview[MAXCHANNELS];
+};
+
+/* record size of each class, as an initializer indexed by class */
+#define SHMDEV_SIZES { \
+    [SHMDEV_TPV] = sizeof(struct gps_fix_t), \
+    [SHMDEV_SKY] = sizeof(struct shmsky_t), \
+    [SHMDEV_TOFF] = sizeof(struct timedrift_t), \
+    [SHMDEV_PPS] = sizeof(struct timedrift_t), \
+    [SHMDEV_AIS] = sizeof(struct ais_t), \
+}
+
+struct gps_shmdev_t;
+
+extern int gps_shmdev_list(/*@out@*/char (*)[GPS_PATH_MAX], int);
+extern /*@null@*/struct gps_shmdev_t *gps_shmdev_open(/*@null@*/const char *);
+extern bool gps_shmdev_waiting(struct gps_shmdev_t *, unsigned int, int);
+extern int gps_shmdev_read(struct gps_shmdev_t *, int, /*@out@*/void *, size_t);
+extern unsigned long gps_shmdev_dropped(const struct gps_shmdev_t *, int);
+extern void gps_shmdev_close(/*@only@*/struct gps_shmdev_t *);
+
 /* dependencies on struct gpsdata_t end hrere */
 
 extern void libgps_trace(int errlevel, const char *, ...);
@@ -10,6 +10,9 @@
 #define GPS_JSON_COMMAND_MAX	80
 #define GPS_JSON_RESPONSE_MAX	4096
 
+/* number of distinct renderings json_data_report() can produce */
+#define JSON_DATA_VARIANTS	8
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,11 +20,13 @@ void json_data_report(const gps_mask_t,
 		      const struct gps_device_t *,
 		      const struct policy_t *,
 		      /*@out@*/char *, size_t);
+int json_data_variant(const gps_mask_t, const struct policy_t *);
 char *json_stringify(/*@out@*/char *, size_t, /*@in@*/const char *);
 void json_tpv_dump(const struct gps_device_t *,
 		   const struct policy_t *, /*@out@*/char *, size_t);
 void json_noise_dump(const struct gps_data_t *, /*@out@*/char *, size_t);
 void json_sky_dump(const struct gps_data_t *, /*@out@*/char *, size_t);
+void json_sky_commit(struct gps_device_t *);
 void json_att_dump(const struct gps_data_t *, /*@out@*/char *, size_t);
 void json_subframe_dump(const struct gps_data_t *, /*@out@*/ char buf[], size_t);
 void json_device_dump(const struct gps_device_t *, /*@out@*/char *, size_t);
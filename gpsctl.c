@@ -631,7 +631,8 @@ int main(int argc, char **argv)
 	    }
 
 	    gpsd_init(&session, &context, device);
-	    if (gpsd_activate(&session, O_PROBEONLY) < 0) {
+	    if (gpsd_activate(&session, O_PROBEONLY) < 0
+		|| netconn_wait(&session) < 0) {
 		gpsd_report(&context.errout, LOG_ERROR,
 			    "initial GPS device %s open failed\n",
 			    device);
@@ -10,6 +10,8 @@
 #include <sys/types.h>
 #include <sys/time.h>		/* for select() */
 #include <sys/select.h>
+#include <sys/uio.h>		/* for writev() */
+#include <poll.h>
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
@@ -43,6 +45,9 @@
 #endif /* S_SPLINT_S */
 
 #include "gpsd_config.h"
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif /* HAVE_SYS_EPOLL_H */
 
 #include "gpsd.h"
 #include "sockaddr.h"
@@ -70,8 +75,8 @@
  * that open connections and just sit there, not issuing a WATCH or
  * doing anything else that triggers a device assignment.  Clients
  * in watcher or raw mode that don't read their data will get dropped
- * when throttled_write() fills up the outbound buffers and the
- * NOREAD_TIMEOUT expires.
+ * when their output queue has made no progress for NOREAD_TIMEOUT
+ * (or sooner, if the backlog policy says to disconnect).
  *
  * RELEASE_TIMEOUT sets the amount of time we hold a device
  * open after the last subscriber closes it; this is nonzero so a
@@ -132,8 +137,6 @@ static const int af = AF_INET;
 
 #define AFCOUNT 2
 
-static fd_set all_fds;
-static int maxfd;
 #ifndef FORCE_GLOBAL_ENABLE
 static bool listen_global = false;
 #endif /* FORCE_GLOBAL_ENABLE */
@@ -216,7 +219,7 @@ static void typelist(void)
 
 static void usage(void)
 {
-    (void)printf("usage: gpsd [-b] [-n] [-N] [-D n] [-F sockfile] [-G] [-P pidfile] [-S port] [-h] device...\n\
+    (void)printf("usage: gpsd [-b] [-n] [-N] [-D n] [-F sockfile] [-G] [-P pidfile] [-Q policy[:bytes]] [-S port] [-T] [-h] device...\n\
   Options include: \n\
   -b		     	    = bluetooth-safe: open data sources read-only\n\
   -n			    = don't wait for client connects to poll GPS\n\
@@ -227,6 +230,9 @@ static void usage(void)
 #endif /* FORCE_GLOBAL_ENABLE */
 "  -P pidfile	      	    = set file to record process ID \n\
   -D integer (default 0)    = set debug level \n\
+  -Q policy[:bytes]         = what to do with clients that fall behind: \n\
+                              disconnect (default), drop, or coalesce \n\
+  -T                        = read and parse each device in its own thread \n\
   -S integer (default %s) = set port for daemon \n\
   -h		     	    = help message \n\
   -V			    = emit version and exit.\n\
@@ -273,20 +279,6 @@ static socket_t filesock(char *filename)
 }
 #endif /* CONTROL_SOCKET_ENABLE */
 
-/*
- * This hackery is intended to support SBCs that are resource-limited
- * and only need to support one or a few devices each.  It avoids the
- * space overhead of allocating thousands of unused device structures.
- * This array fills from the bottom, so as an extreme case you could
- * reduce LIMITED_MAX_DEVICES to 1.
- */
-#ifdef LIMITED_MAX_DEVICES
-#define MAXDEVICES	LIMITED_MAX_DEVICES
-#else
-/* we used to make this FD_SETSIZE, but that cost 14MB of wasted core! */
-#define MAXDEVICES	4
-#endif
-
 #define sub_index(s) (int)((s) - subscribers)
 #define allocated_device(devp)	 ((devp)->gpsdata.dev.path[0] != '\0')
 #define free_device(devp)	 (devp)->gpsdata.dev.path[0] = '\0'
@@ -294,6 +286,41 @@ static socket_t filesock(char *filename)
 
 static struct gps_device_t devices[MAXDEVICES];
 
+/*
+ * Descriptor dispatch.  Every descriptor the main loop listens on is
+ * registered together with a handler to be called when it goes
+ * readable.  Where epoll(7) is available the kernel hands back the
+ * dispatch records of just the ready descriptors, so the cost of a
+ * wakeup is proportional to the number of ready descriptors rather
+ * than to the size of the device and subscriber tables, and client
+ * descriptors are not limited by FD_SETSIZE.  Elsewhere we fall back
+ * to pselect(2) over an fd_set and a table indexed by descriptor.
+ */
+struct fdwatch_t {
+    int fd;				/* descriptor being watched */
+    bool edge;				/* handler drains fd, edge-trigger it */
+    bool ready;				/* handler has deferred work pending */
+    bool writing;			/* also waiting for fd to go writable */
+    void (*handler)(struct fdwatch_t *);	/* called when fd is readable */
+    /*@null@*/void (*writer)(struct fdwatch_t *);	/* ...when writable */
+    /*@null@*/void *arg;		/* handler's private data */
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+#define MAX_EVENTS	64	/* maximum ready descriptors per wakeup */
+static int epfd = -1;
+/*
+ * epoll refuses plain files, which select(2) would always report as
+ * readable.  Only device sources can be plain files, so a small table
+ * of these suffices; while it is nonempty we poll rather than block.
+ */
+static /*@null@*/struct fdwatch_t *unpollable[MAXDEVICES];
+static int unpollable_count;
+#else
+static fd_set all_fds, write_fds;
+static int maxfd, write_count;
+static /*@null@*/struct fdwatch_t *watched[FD_SETSIZE];
+
 static void adjust_max_fd(int fd, bool on)
 /* track the largest fd currently in use */
 {
@@ -321,6 +348,373 @@ static void adjust_max_fd(int fd, bool on)
     }
 #endif /* !defined(LIMITED_MAX_DEVICES) && !defined(LIMITED_MAX_CLIENT_FD) */
 }
+#endif /* HAVE_SYS_EPOLL_H */
+
+static bool watch_descriptor(struct fdwatch_t *watch)
+/* start dispatching readability of watch->fd to its handler */
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (watch->edge)
+	ev.events |= EPOLLET;
+    if (watch->writing)
+	ev.events |= EPOLLOUT;
+    ev.data.ptr = watch;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, watch->fd, &ev) == 0)
+	return true;
+    else if (errno == EEXIST
+	     && epoll_ctl(epfd, EPOLL_CTL_MOD, watch->fd, &ev) == 0)
+	return true;
+    else if (errno == EPERM && unpollable_count < NITEMS(unpollable)) {
+	int i;
+	for (i = 0; i < unpollable_count; i++)
+	    if (unpollable[i] == watch)
+		return true;
+	unpollable[unpollable_count++] = watch;
+	return true;
+    }
+    gpsd_report(&context.errout, LOG_ERROR,
+		"can't watch descriptor %d: %s\n", watch->fd, strerror(errno));
+    return false;
+#else
+    if (watch->fd < 0 || watch->fd >= FD_SETSIZE) {
+	gpsd_report(&context.errout, LOG_ERROR,
+		    "can't watch descriptor %d: outside FD_SETSIZE\n",
+		    watch->fd);
+	return false;
+    }
+    FD_SET(watch->fd, &all_fds);
+    watched[watch->fd] = watch;
+    adjust_max_fd(watch->fd, true);
+    return true;
+#endif /* HAVE_SYS_EPOLL_H */
+}
+
+static void unwatch_descriptor(struct fdwatch_t *watch)
+/* stop dispatching watch->fd; call before closing it */
+{
+#ifdef HAVE_SYS_EPOLL_H
+    int i;
+
+    /* fails harmlessly if a close has already dropped the registration */
+    (void)epoll_ctl(epfd, EPOLL_CTL_DEL, watch->fd, NULL);
+    for (i = 0; i < unpollable_count; i++)
+	if (unpollable[i] == watch) {
+	    unpollable[i] = unpollable[--unpollable_count];
+	    break;
+	}
+#else
+    if (watch->fd >= 0 && watch->fd < FD_SETSIZE) {
+	FD_CLR(watch->fd, &all_fds);
+	if (watch->writing) {
+	    FD_CLR(watch->fd, &write_fds);
+	    write_count--;
+	}
+	watched[watch->fd] = NULL;
+	adjust_max_fd(watch->fd, false);
+    }
+#endif /* HAVE_SYS_EPOLL_H */
+    watch->ready = false;
+    watch->writing = false;
+}
+
+static void want_writable(struct fdwatch_t *watch, bool on)
+/* start or stop calling watch->writer when watch->fd can take output */
+{
+    if (watch->writing == on)
+	return;
+    watch->writing = on;
+#ifdef HAVE_SYS_EPOLL_H
+    {
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+	if (watch->edge)
+	    ev.events |= EPOLLET;
+	ev.data.ptr = watch;
+	(void)epoll_ctl(epfd, EPOLL_CTL_MOD, watch->fd, &ev);
+    }
+#else
+    if (watch->fd >= 0 && watch->fd < FD_SETSIZE) {
+	if (on) {
+	    FD_SET(watch->fd, &write_fds);
+	    write_count++;
+	} else {
+	    FD_CLR(watch->fd, &write_fds);
+	    write_count--;
+	}
+    }
+#endif /* HAVE_SYS_EPOLL_H */
+}
+
+/* devices just note readiness; the main loop polls each of them in turn */
+static struct fdwatch_t device_watches[MAXDEVICES];
+
+static void device_readable(struct fdwatch_t *watch)
+{
+    watch->ready = true;
+}
+
+/*
+ * Threaded ingestion.  With -T each active device gets a reader thread
+ * that waits on it and runs gpsd_multipoll() itself, so reading and
+ * parsing for different devices proceed in parallel and a chatty
+ * device can't starve the others or the clients.  Reporting stays in
+ * the main thread: each packet is handed over through a one-slot
+ * single-producer/single-consumer mailbox, and the reader waits,
+ * with the session unlocked, until the main thread has shipped it.
+ * (A deeper ring would need a copy of the whole session per packet,
+ * since reporting reads lexer buffers and time state directly.)
+ *
+ * Whichever thread touches a session holds its ingest lock.  Only the
+ * main thread ever holds more than one, so there is no lock order to
+ * get wrong.  Readers are detached; the main thread retires one by
+ * bumping the generation number and closing the write end of the
+ * reader's own wake pipe, after which it exits without touching the
+ * session again.  Each reader makes its own pipe, so however many
+ * retired readers have yet to notice, every one of them sees the
+ * hangup.
+ */
+struct ingest_t {
+    pthread_mutex_t lock;	/* held by whoever is using the session */
+    pthread_cond_t drained;	/* main thread emptied the mailbox */
+    unsigned int generation;	/* bumped to retire the reader */
+    bool running;		/* a reader of this generation exists */
+    bool full;			/* mailbox holds a packet... */
+    gps_mask_t changed;		/* ...with this change mask */
+    int status;			/* DEVICE_ERROR or DEVICE_EOF if reader quit */
+    int kick;			/* closed to get the reader out of poll(2) */
+};
+
+static bool threaded_ingest;
+static struct ingest_t ingest[MAXDEVICES];
+static int ingest_notify[2] = {-1, -1};	/* readers to main loop */
+
+#define threaded(devp)	(threaded_ingest && ingest[(devp) - devices].running)
+
+static void ingest_lock(struct gps_device_t *device)
+{
+    if (threaded_ingest)
+	(void)pthread_mutex_lock(&ingest[device - devices].lock);
+}
+
+static void ingest_unlock(struct gps_device_t *device)
+{
+    if (threaded_ingest)
+	(void)pthread_mutex_unlock(&ingest[device - devices].lock);
+}
+
+static void ingest_lock_all(void)
+/* take every session away from its reader, e.g. to run client commands */
+{
+    int i;
+
+    if (threaded_ingest)
+	for (i = 0; i < MAXDEVICES; i++)
+	    (void)pthread_mutex_lock(&ingest[i].lock);
+}
+
+static void ingest_unlock_all(void)
+{
+    int i;
+
+    if (threaded_ingest)
+	for (i = MAXDEVICES - 1; i >= 0; i--)
+	    (void)pthread_mutex_unlock(&ingest[i].lock);
+}
+
+static void ingest_kick(int fd)
+/* wake whoever polls the other end of a pipe */
+{
+    /* if the pipe is full the reader end is awake already */
+    if (write(fd, "", 1) == -1)
+	return;
+}
+
+static void ingest_handoff(struct gps_device_t *device, gps_mask_t changed)
+/* reader side: post a parsed packet and wait until it has been reported */
+{
+    struct ingest_t *ing = &ingest[device - devices];
+    unsigned int generation = ing->generation;
+
+    ing->changed = changed;
+    ing->full = true;
+    ingest_kick(ingest_notify[1]);
+    while (ing->full && ing->generation == generation)
+	(void)pthread_cond_wait(&ing->drained, &ing->lock);
+    if (ing->generation != generation)
+	/* retired while we waited; the session isn't ours any more */
+	device->poll_stop = true;
+}
+
+static void *ingest_reader(void *arg)
+/* per-device reader thread; arg encodes device slot and generation */
+{
+    uintptr_t token = (uintptr_t)arg;
+    struct gps_device_t *device = devices + token % MAXDEVICES;
+    struct ingest_t *ing = &ingest[token % MAXDEVICES];
+    unsigned int generation = (unsigned int)(token / MAXDEVICES);
+    bool unready = false;
+    int wake[2] = {-1, -1};
+
+    (void)pthread_mutex_lock(&ing->lock);
+    if (ing->generation == generation) {
+	if (pipe(wake) == -1) {
+	    gpsd_report(&context.errout, LOG_ERROR,
+			"can't create reader pipe: %s\n", strerror(errno));
+	    ing->status = DEVICE_ERROR;
+	    ingest_kick(ingest_notify[1]);
+	} else {
+	    (void)fcntl(wake[0], F_SETFD, FD_CLOEXEC);
+	    (void)fcntl(wake[1], F_SETFD, FD_CLOEXEC);
+	    ing->kick = wake[1];
+	}
+    }
+    while (wake[0] != -1 && ing->generation == generation) {
+	struct pollfd pfd[2];
+	int timeout = -1, n, status;
+
+	pfd[0].fd = unready ? -1 : device->gpsdata.gps_fd;
+	/* a network source that is still connecting waits for POLLOUT */
+	pfd[0].events = POLLIN | (netconn_connect_pending(device) ? POLLOUT : 0);
+	pfd[0].revents = 0;
+	pfd[1].fd = wake[0];
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+	if (device->reawake > 0) {
+	    timestamp_t wait = device->reawake - timestamp();
+	    timeout = (wait > 0) ? (int)(wait * 1000) + 1 : 0;
+	}
+	(void)pthread_mutex_unlock(&ing->lock);
+	n = poll(pfd, 2, timeout);
+	(void)pthread_mutex_lock(&ing->lock);
+	if (ing->generation != generation)
+	    break;
+	if (n == -1 && errno != EINTR)
+	    status = DEVICE_ERROR;
+	else
+	    status = gpsd_multipoll(n > 0 && pfd[0].revents != 0,
+				    device, ingest_handoff, DEVICE_REAWAKE);
+	if (status == DEVICE_ERROR || status == DEVICE_EOF) {
+	    /* leave it to the main thread to deactivate the device */
+	    ing->status = status;
+	    ingest_kick(ingest_notify[1]);
+	    break;
+	} else if (status == DEVICE_UNREADY)
+	    unready = true;
+	else if (status == DEVICE_READY)
+	    unready = false;
+    }
+    (void)pthread_mutex_unlock(&ing->lock);
+    if (wake[0] != -1)
+	(void)close(wake[0]);
+    return NULL;
+}
+
+static void ingest_start(struct gps_device_t *device)
+/* give an active device a reader thread; call with its lock held */
+{
+    struct ingest_t *ing = &ingest[device - devices];
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all, old;
+    int err;
+
+    if (ing->running)
+	return;
+    ing->full = false;
+    ing->status = 0;
+    ing->generation++;
+    /* signals belong to the main loop */
+    (void)sigfillset(&all);
+    (void)pthread_sigmask(SIG_BLOCK, &all, &old);
+    (void)pthread_attr_init(&attr);
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&thread, &attr, ingest_reader,
+			 (void *)(uintptr_t)(ing->generation * MAXDEVICES
+					     + (device - devices)));
+    (void)pthread_attr_destroy(&attr);
+    (void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+	gpsd_report(&context.errout, LOG_ERROR,
+		    "can't start reader for %s: %s\n",
+		    device->gpsdata.dev.path, strerror(err));
+	return;
+    }
+    ing->running = true;
+}
+
+static void ingest_stop(struct gps_device_t *device)
+/* retire a device's reader thread; call with its lock held */
+{
+    struct ingest_t *ing = &ingest[device - devices];
+
+    if (!ing->running)
+	return;
+    ing->running = false;
+    ing->full = false;
+    ing->generation++;
+    (void)pthread_cond_signal(&ing->drained);
+    /* the hangup wakes the reader, and stays there until it looks */
+    if (ing->kick != -1) {
+	(void)close(ing->kick);
+	ing->kick = -1;
+    }
+}
+
+static void ingest_init(void)
+/* set up the reader machinery before any device is opened */
+{
+    int i;
+
+    if (!threaded_ingest)
+	return;
+    if (pipe(ingest_notify) == -1) {
+	gpsd_report(&context.errout, LOG_ERROR,
+		    "can't create reader pipe: %s\n", strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < 2; i++)
+	(void)fcntl(ingest_notify[i], F_SETFL,
+		    fcntl(ingest_notify[i], F_GETFL) | O_NONBLOCK);
+    for (i = 0; i < MAXDEVICES; i++) {
+	(void)pthread_mutex_init(&ingest[i].lock, NULL);
+	(void)pthread_cond_init(&ingest[i].drained, NULL);
+	ingest[i].kick = -1;
+    }
+}
+
+static void watch_device(struct gps_device_t *device)
+{
+    struct fdwatch_t *watch = &device_watches[device - devices];
+
+    if (threaded_ingest) {
+	ingest_start(device);
+	return;
+    }
+    if (watch->fd != device->gpsdata.gps_fd)
+	/* the library may have reopened the device behind our back */
+	unwatch_descriptor(watch);
+    watch->fd = device->gpsdata.gps_fd;
+    watch->handler = device_readable;
+    watch->writer = device_readable;
+    watch->arg = device;
+    (void)watch_descriptor(watch);
+    /* a completed non-blocking connect shows up as writability */
+    want_writable(watch, netconn_connect_pending(device));
+}
+
+static void unwatch_device(struct gps_device_t *device)
+{
+    if (threaded_ingest)
+	ingest_stop(device);
+    else
+	unwatch_descriptor(&device_watches[device - devices]);
+}
 
 #ifdef SOCKET_EXPORT_ENABLE
 #ifndef IPTOS_LOWDELAY
@@ -518,16 +912,78 @@ static int passivesocks(char *service, char *tcp_or_udp,
 }
 /* *INDENT-ON* */
 
+/*
+ * Client output.  Whatever a client's socket won't take immediately is
+ * queued and flushed with writev(2) when the socket goes writable, so
+ * one slow reader never stalls the main loop.  Queues hold references
+ * to buffers from a small static pool; a report rendered once for many
+ * clients is shared among all the queues it lands on, and small writes
+ * to one client are packed into the private buffer at its queue's tail.
+ * What happens when a client falls more than backlog_limit bytes behind
+ * is set by backlog_policy.  Only the main thread writes to clients, PPS
+ * reports included, so none of this needs locking.
+ *
+ * The last OUTBUF_RESERVE free buffers go only to clients with nothing
+ * queued, so however many buffers lagging clients tie up, a client
+ * whose socket is briefly full can still queue its overflow.  When a
+ * queue's ring fills up, queued reports are packed together into one
+ * buffer to make room.  Output is only ever lost under the drop and
+ * coalesce policies; where those would discard a report (no buffer to
+ * be had, or a ring that won't pack), the disconnect policy drops the
+ * client instead, so its stream never has holes in it.
+ */
+#define OUTBUF_SIZE	(GPS_JSON_RESPONSE_MAX * 4)	/* largest report */
+#define OUTBUF_POOL	64	/* shared buffers for queued output */
+#define OUTBUF_RESERVE	8	/* of those, kept for clients not behind */
+#define OUTQUEUE_DEPTH	16	/* queued reports per client */
+#define BACKLOG_LIMIT	65536	/* default per-client backlog in bytes */
+
+struct outbuf_t {
+    int refcount;		/* references held; 0 means free */
+    bool tpv;			/* a lone TPV, superseded by the next one */
+    size_t len;
+    char text[OUTBUF_SIZE];
+};
+
+struct outqueue_t {
+    /*@null@*/struct outbuf_t *ring[OUTQUEUE_DEPTH];
+    int head, count;
+    size_t offset;		/* bytes of the head buffer already sent */
+    size_t bytes;		/* bytes waiting to be sent */
+    timestamp_t progress;	/* last time the queue moved */
+    unsigned long queued;	/* bytes ever queued */
+    unsigned long dropped;	/* bytes discarded by the backlog policy */
+    bool lagging;		/* dropped output since the queue last drained */
+};
+
+static enum {
+    backlog_disconnect,		/* drop the client */
+    backlog_drop,		/* discard the oldest queued reports */
+    backlog_coalesce,		/* keep only the newest TPV, then as drop */
+} backlog_policy = backlog_disconnect;
+static size_t backlog_limit = BACKLOG_LIMIT;
+static struct outbuf_t outbufs[OUTBUF_POOL];
+static int outbufs_free = OUTBUF_POOL;
+
 struct subscriber_t
 {
     int fd;			/* client file descriptor. -1 if unused */
     timestamp_t active;		/* when subscriber last polled for data */
     struct policy_t policy;	/* configurable bits */
     pthread_mutex_t mutex;	/* serialize access to fd */
+    struct fdwatch_t watch;	/* dispatch record for fd */
+    struct outqueue_t outq;	/* output the socket hasn't taken yet */
+    /* where a delta SKY watcher's skyview stands, see all_reports() */
+    /*@null@*/const struct gps_device_t *skydevice;
+    unsigned long skyreports;	/* device's SKY count it is current with */
+    unsigned long skydropped;	/* outq.dropped when it was last sent one */
 };
 
 #ifdef LIMITED_MAX_CLIENTS
 #define MAXSUBSCRIBERS LIMITED_MAX_CLIENTS
+#elif defined(HAVE_SYS_EPOLL_H)
+/* no FD_SETSIZE ceiling with epoll; bounded by RLIMIT_NOFILE in practice */
+#define MAXSUBSCRIBERS	4096
 #else
 /* subscriber structure is small enough that there's no need to limit this */
 #define MAXSUBSCRIBERS	FD_SETSIZE
@@ -537,6 +993,21 @@ struct subscriber_t
 
 static struct subscriber_t subscribers[MAXSUBSCRIBERS];	/* indexed by client file descriptor */
 
+/*
+ * Dense list of the subscribers with live connections, so that report
+ * fan-out and housekeeping cost is proportional to the number of
+ * clients actually connected rather than to MAXSUBSCRIBERS.  Detaching
+ * a client only marks its slot free; the list is compacted before the
+ * next allocation, so it is safe to detach while walking it.
+ */
+static struct subscriber_t *active_subscribers[MAXSUBSCRIBERS];
+static int active_count;
+static bool active_stale;
+
+/* clients whose descriptors went readable during the last dispatch */
+static struct subscriber_t *ready_subscribers[MAXSUBSCRIBERS];
+static int ready_count;
+
 static void lock_subscriber(struct subscriber_t *sub)
 {
     (void)pthread_mutex_lock(&sub->mutex);
@@ -547,6 +1018,15 @@ static void unlock_subscriber(struct subscriber_t *sub)
     (void)pthread_mutex_unlock(&sub->mutex);
 }
 
+static void client_readable(struct fdwatch_t *watch)
+/* defer client input until the devices have been polled */
+{
+    if (!watch->ready && ready_count < NITEMS(ready_subscribers)) {
+	watch->ready = true;
+	ready_subscribers[ready_count++] = (struct subscriber_t *)watch->arg;
+    }
+}
+
 static /*@null@*//*@observer@ */ struct subscriber_t *allocate_client(void)
 /* return the address of a subscriber structure allocated for a new session */
 {
@@ -555,6 +1035,14 @@ static /*@null@*//*@observer@ */ struct subscriber_t *allocate_client(void)
 #if UNALLOCATED_FD == 0
 #error client allocation code will fail horribly
 #endif
+    if (active_stale) {
+	int live = 0;
+	for (si = 0; si < active_count; si++)
+	    if (active_subscribers[si]->fd != UNALLOCATED_FD)
+		active_subscribers[live++] = active_subscribers[si];
+	active_count = live;
+	active_stale = false;
+    }
     for (si = 0; si < NITEMS(subscribers); si++) {
 	if (subscribers[si].fd == UNALLOCATED_FD) {
 	    subscribers[si].fd = 0;	/* mark subscriber as allocated */
@@ -564,6 +1052,44 @@ static /*@null@*//*@observer@ */ struct subscriber_t *allocate_client(void)
     return NULL;
 }
 
+static /*@null@*/struct outbuf_t *outbuf_get(bool reserved)
+/* claim a free shared output buffer, dipping into the reserve if allowed */
+{
+    struct outbuf_t *ob;
+
+    if (outbufs_free <= (reserved ? 0 : OUTBUF_RESERVE))
+	return NULL;
+    for (ob = outbufs; ob < outbufs + OUTBUF_POOL; ob++)
+	if (ob->refcount == 0) {
+	    ob->refcount = 1;
+	    ob->tpv = false;
+	    ob->len = 0;
+	    outbufs_free--;
+	    return ob;
+	}
+    return NULL;
+}
+
+static void outbuf_put(/*@null@*/struct outbuf_t *ob)
+/* drop a reference to a shared output buffer */
+{
+    if (ob != NULL && ob->refcount > 0 && --ob->refcount == 0)
+	outbufs_free++;
+}
+
+static void outqueue_clear(struct outqueue_t *q)
+/* release everything on a client's output queue */
+{
+    while (q->count > 0) {
+	outbuf_put(q->ring[q->head]);
+	q->head = (q->head + 1) % OUTQUEUE_DEPTH;
+	q->count--;
+    }
+    q->head = 0;
+    q->offset = 0;
+    q->bytes = 0;
+}
+
 static void detach_client(struct subscriber_t *sub)
 /* detach a client and terminate the session */
 {
@@ -575,15 +1101,17 @@ static void detach_client(struct subscriber_t *sub)
     }
     c_ip = netlib_sock2ip(sub->fd);
     (void)shutdown(sub->fd, SHUT_RDWR);
+    outqueue_clear(&sub->outq);
+    unwatch_descriptor(&sub->watch);
     gpsd_report(&context.errout, LOG_SPIN,
 		"close(%d) in detach_client()\n",
 		sub->fd);
     (void)close(sub->fd);
     gpsd_report(&context.errout, LOG_INF,
-		"detaching %s (sub %d, fd %d) in detach_client\n",
-		c_ip, sub_index(sub), sub->fd);
-    FD_CLR(sub->fd, &all_fds);
-    adjust_max_fd(sub->fd, false);
+		"detaching %s (sub %d, fd %d) in detach_client, "
+		"%lu bytes queued, %lu dropped\n",
+		c_ip, sub_index(sub), sub->fd,
+		sub->outq.queued, sub->outq.dropped);
     sub->active = (timestamp_t)0;
     sub->policy.watcher = false;
     sub->policy.json = false;
@@ -592,24 +1120,139 @@ static void detach_client(struct subscriber_t *sub)
     sub->policy.scaled = false;
     sub->policy.timing = false;
     sub->policy.split24 = false;
+    sub->policy.binary = false;
+    sub->policy.skydelta = false;
+    sub->skydevice = NULL;
     sub->policy.devpath[0] = '\0';
     sub->fd = UNALLOCATED_FD;
+    active_stale = true;
     unlock_subscriber(sub);
     /*@+mustfreeonly@*/
 }
 
-static ssize_t throttled_write(struct subscriber_t *sub, char *buf,
-			       size_t len)
-/* write to client -- throttle if it's gone or we're close to buffer overrun */
+static void outqueue_remove(struct outqueue_t *q, int n)
+/* discard the n'th entry of a queue, counting its bytes as dropped */
 {
-    ssize_t status;
+    int i;
+    struct outbuf_t *ob = q->ring[(q->head + n) % OUTQUEUE_DEPTH];
+
+    q->bytes -= ob->len;
+    q->dropped += ob->len;
+    outbuf_put(ob);
+    for (i = n; i < q->count - 1; i++)
+	q->ring[(q->head + i) % OUTQUEUE_DEPTH] =
+	    q->ring[(q->head + i + 1) % OUTQUEUE_DEPTH];
+    q->count--;
+}
+
+static bool outqueue_pack(struct outqueue_t *q, int first)
+/* merge the first run of queued reports that fits one buffer into it */
+{
+    struct outbuf_t *ob;
+    size_t len = 0;
+    int i, n = first, start;
+
+    /* entries before first are partly sent and have to stay put */
+    for (start = first; start < q->count - 1; start++) {
+	len = 0;
+	for (n = start; n < q->count; n++) {
+	    struct outbuf_t *e = q->ring[(q->head + n) % OUTQUEUE_DEPTH];
+	    if (len + e->len > OUTBUF_SIZE)
+		break;
+	    len += e->len;
+	}
+	if (n - start >= 2)
+	    break;
+    }
+    if (n - start < 2 || (ob = outbuf_get(false)) == NULL)
+	return false;
+    for (i = start; i < n; i++) {
+	struct outbuf_t *e = q->ring[(q->head + i) % OUTQUEUE_DEPTH];
+	(void)memcpy(ob->text + ob->len, e->text, e->len);
+	ob->len += e->len;
+	outbuf_put(e);
+    }
+    q->ring[(q->head + start) % OUTQUEUE_DEPTH] = ob;
+    for (i = n; i < q->count; i++)
+	q->ring[(q->head + start + 1 + i - n) % OUTQUEUE_DEPTH] =
+	    q->ring[(q->head + i) % OUTQUEUE_DEPTH];
+    q->count -= n - start - 1;
+    return true;
+}
+
+static bool outqueue_append(struct outqueue_t *q, struct outbuf_t *ob,
+			    size_t sent)
+/* queue a reference to ob, applying the backpressure policy */
+{
+    /* a report already partly sent has to go out whole */
+    int first = (q->offset > 0) ? 1 : 0;
+    int i;
+
+    if (sent > 0) {
+	/* only happens on an empty queue, so ob becomes its head */
+	ob->refcount++;
+	q->ring[q->head] = ob;
+	q->count = 1;
+	q->offset = sent;
+	q->bytes = ob->len - sent;
+	q->queued += q->bytes;
+	q->progress = timestamp();
+	return true;
+    }
+
+    if (backlog_policy == backlog_coalesce && ob->tpv)
+	/* a client that is behind only needs the latest fix */
+	for (i = q->count - 1; i >= first; i--)
+	    if (q->ring[(q->head + i) % OUTQUEUE_DEPTH]->tpv)
+		outqueue_remove(q, i);
+
+    if (backlog_policy == backlog_disconnect
+	&& q->bytes + ob->len > backlog_limit)
+	return false;
+    while (q->count == OUTQUEUE_DEPTH || q->bytes + ob->len > backlog_limit) {
+	/* a full ring under the byte limit is many small reports; pack them */
+	if (q->count == OUTQUEUE_DEPTH && outqueue_pack(q, first))
+	    continue;
+	if (backlog_policy == backlog_disconnect)
+	    return false;
+	if (q->count <= first) {
+	    /* nothing left we can throw away; lose the new report instead */
+	    q->dropped += ob->len;
+	    return true;
+	}
+	outqueue_remove(q, first);
+    }
+
+    if (q->count == 0)
+	q->progress = timestamp();
+    ob->refcount++;
+    q->ring[(q->head + q->count) % OUTQUEUE_DEPTH] = ob;
+    q->count++;
+    q->bytes += ob->len;
+    q->queued += ob->len;
+    return true;
+}
+
+static ssize_t send_output(struct subscriber_t *sub, const char *buf,
+			   size_t len, /*@null@*/struct outbuf_t *shared)
+/*
+ * Write to a client, queueing whatever the socket won't take now.
+ * If the bytes live in a shared buffer the queue just references it.
+ */
+{
+    struct outqueue_t *q = &sub->outq;
+    ssize_t status = 0;
+    int err = 0;
+    bool keep = true, stalled = false, lagging = false;
+    unsigned long dropped_before;
 
     if (context.errout.debug >= LOG_CLIENT) {
 	if (isprint((unsigned char) buf[0]))
 	    gpsd_report(&context.errout, LOG_CLIENT,
 			"=> client(%d): %s\n", sub_index(sub), buf);
 	else {
-	    char *cp, buf2[MAX_PACKET_LENGTH * 3];
+	    char buf2[MAX_PACKET_LENGTH * 3];
+	    const char *cp;
 	    buf2[0] = '\0';
 	    for (cp = buf; cp < buf + len; cp++)
 		(void)snprintf(buf2 + strlen(buf2),
@@ -620,36 +1263,177 @@ static ssize_t throttled_write(struct subscriber_t *sub, char *buf,
 	}
     }
 
-#if defined(PPS_ENABLE)
-    gpsd_acquire_reporting_lock();
-#endif /* PPS_ENABLE */
-    status = send(sub->fd, buf, len, 0);
-#if defined(PPS_ENABLE)
-    gpsd_release_reporting_lock();
+    if (sub->fd == UNALLOCATED_FD)
+	return 0;
+    dropped_before = q->dropped;
+    /* anything already queued has to go out first */
+    if (q->count == 0) {
+	status = send(sub->fd, buf, len, 0);
+	if (status == (ssize_t) len)
+	    return status;
+	else if (status == -1) {
+	    err = errno;
+	    if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR)
+		status = 0;
+	    else
+		keep = false;
+	}
+    } else if (timestamp() - q->progress > NOREAD_TIMEOUT) {
+	stalled = true;
+	keep = false;
+    }
+    if (keep) {
+	struct outbuf_t *ob = NULL;
+	struct outbuf_t *tail = (q->count > 0)
+	    ? q->ring[(q->head + q->count - 1) % OUTQUEUE_DEPTH] : NULL;
+
+	if (shared == NULL && tail != NULL && tail->refcount == 1
+	    && (!tail->tpv || backlog_policy != backlog_coalesce)
+	    && tail->len + len <= OUTBUF_SIZE
+	    && q->bytes + len <= backlog_limit) {
+	    /*
+	     * Nobody else holds the tail buffer, so pack this in after it;
+	     * only coalescing needs a lone TPV kept apart.
+	     */
+	    (void)memcpy(tail->text + tail->len, buf, len);
+	    tail->len += len;
+	    q->bytes += len;
+	    q->queued += len;
+	    return (ssize_t)len;
+	}
+	if (shared != NULL)
+	    ob = shared;
+	else if (len <= OUTBUF_SIZE
+		 && (ob = outbuf_get(q->count == 0)) != NULL) {
+	    (void)memcpy(ob->text, buf, len);
+	    ob->len = len;
+	}
+	if (ob == NULL) {
+	    /* no buffer for the overflow; lose the report if we may */
+	    if (status > 0 || backlog_policy == backlog_disconnect)
+		keep = false;
+	    else
+		q->dropped += len;
+	} else {
+	    keep = outqueue_append(q, ob, (size_t)status);
+	    if (ob != shared)
+		outbuf_put(ob);
+	}
+	if (keep)
+	    want_writable(&sub->watch, q->count > 0);
+    }
+    if (q->dropped != dropped_before && !q->lagging)
+	lagging = q->lagging = true;
 
-#endif /* PPS_ENABLE */
-    if (status == (ssize_t) len)
-	return status;
-    else if (status > -1) {
-	gpsd_report(&context.errout, LOG_INF,
-		    "short write disconnecting client(%d)\n",
-		    sub_index(sub));
+    if (!keep) {
+	if (err == EBADF)
+	    gpsd_report(&context.errout, LOG_WARN,
+			"client(%d) has vanished.\n", sub_index(sub));
+	else if (err != 0)
+	    gpsd_report(&context.errout, LOG_INF,
+			"client(%d) write: %s\n",
+			sub_index(sub), strerror(err));
+	else {
+	    /* it isn't reading, so don't let the lingering close wait on it */
+	    static struct linger abort = { 1, 0 };
+	    (void)setsockopt(sub->fd, SOL_SOCKET, SO_LINGER, (char *)&abort,
+			     (int)sizeof(struct linger));
+	    if (stalled)
+		gpsd_report(&context.errout, LOG_INF,
+			    "client(%d) timed out.\n", sub_index(sub));
+	    else
+		gpsd_report(&context.errout, LOG_INF,
+			    "client(%d) output won't queue (%zu bytes in "
+			    "%d reports), disconnecting\n",
+			    sub_index(sub), q->bytes, q->count);
+	}
 	detach_client(sub);
-	return 0;
-    } else if (errno == EAGAIN || errno == EINTR)
-	return 0;		/* no data written, and errno says to retry */
-    else if (errno == EBADF)
-	gpsd_report(&context.errout, LOG_WARN, "client(%d) has vanished.\n", sub_index(sub));
-    else if (errno == EWOULDBLOCK
-	     && timestamp() - sub->active > NOREAD_TIMEOUT)
+	return -1;
+    }
+    if (lagging)
 	gpsd_report(&context.errout, LOG_INF,
-		    "client(%d) timed out.\n", sub_index(sub));
-    else
+		    "client(%d) is falling behind, dropping output\n",
+		    sub_index(sub));
+    return (ssize_t)len;
+}
+
+static ssize_t throttled_write(struct subscriber_t *sub, char *buf,
+			       size_t len)
+/* write to client -- queue the output if it can't keep up */
+{
+    return send_output(sub, buf, len, NULL);
+}
+
+static void flush_client(struct fdwatch_t *watch)
+/* the client's socket can take more output; send what's queued */
+{
+    struct subscriber_t *sub = (struct subscriber_t *)watch->arg;
+    struct outqueue_t *q = &sub->outq;
+    struct iovec iov[OUTQUEUE_DEPTH];
+    ssize_t status;
+    int i, err = 0;
+
+    if (sub->fd == UNALLOCATED_FD)
+	return;
+    for (i = 0; i < q->count; i++) {
+	struct outbuf_t *ob = q->ring[(q->head + i) % OUTQUEUE_DEPTH];
+	size_t skip = (i == 0) ? q->offset : 0;
+	iov[i].iov_base = ob->text + skip;
+	iov[i].iov_len = ob->len - skip;
+    }
+    status = (i > 0) ? writev(sub->fd, iov, i) : 0;
+    if (status == -1) {
+	err = errno;
+	if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR)
+	    err = 0;
+    } else {
+	if (status > 0)
+	    q->progress = timestamp();
+	q->bytes -= (size_t)status;
+	status += (ssize_t)q->offset;
+	while (q->count > 0) {
+	    struct outbuf_t *ob = q->ring[q->head];
+	    if ((size_t)status < ob->len)
+		break;
+	    status -= (ssize_t)ob->len;
+	    outbuf_put(ob);
+	    q->head = (q->head + 1) % OUTQUEUE_DEPTH;
+	    q->count--;
+	}
+	q->offset = (q->count > 0) ? (size_t)status : 0;
+    }
+    if (q->count == 0)
+	q->lagging = false;
+    if (err == 0)
+	want_writable(watch, q->count > 0);
+
+    if (err != 0) {
 	gpsd_report(&context.errout, LOG_INF,
-		    "client(%d) write: %s\n", 
-		    sub_index(sub), strerror(errno));
-    detach_client(sub);
-    return status;
+		    "client(%d) write: %s\n", sub_index(sub), strerror(err));
+	detach_client(sub);
+    }
+}
+
+static bool attach_client(struct subscriber_t *sub, socket_t ssock)
+/* bind an allocated subscriber to its connection and start watching it */
+{
+    sub->fd = ssock;
+    sub->watch.fd = ssock;
+    sub->watch.edge = true;	/* client input is drained to EAGAIN */
+    sub->watch.ready = false;
+    sub->watch.writing = false;
+    sub->watch.handler = client_readable;
+    sub->watch.writer = flush_client;
+    sub->watch.arg = sub;
+    sub->outq.queued = sub->outq.dropped = 0;
+    sub->outq.lagging = false;
+    if (!watch_descriptor(&sub->watch)) {
+	sub->fd = UNALLOCATED_FD;
+	return false;
+    }
+    sub->active = timestamp();
+    active_subscribers[active_count++] = sub;
+    return true;
 }
 
 static void notify_watchers(struct gps_device_t *device,
@@ -658,17 +1442,19 @@ static void notify_watchers(struct gps_device_t *device,
 {
     va_list ap;
     char buf[BUFSIZ];
-    struct subscriber_t *sub;
+    int si;
 
     va_start(ap, sentence);
     (void)vsnprintf(buf, sizeof(buf), sentence, ap);
     va_end(ap);
 
-    for (sub = subscribers; sub < subscribers + MAXSUBSCRIBERS; sub++)
+    for (si = 0; si < active_count; si++) {
+	struct subscriber_t *sub = active_subscribers[si];
 	if (sub->active != 0 && subscribed(sub, device)) {
 	    if (sub->policy.json)
 		(void)throttled_write(sub, buf, strlen(buf));
 	}
+    }
 }
 #endif /* SOCKET_EXPORT_ENABLE */
 
@@ -681,13 +1467,15 @@ static void deactivate_device(struct gps_device_t *device)
 		    device->gpsdata.dev.path);
 #endif /* SOCKET_EXPORT_ENABLE */
     if (!BAD_SOCKET(device->gpsdata.gps_fd)) {
-	FD_CLR(device->gpsdata.gps_fd, &all_fds);
-	adjust_max_fd(device->gpsdata.gps_fd, false);
+	unwatch_device(device);
 #if defined(PPS_ENABLE) && defined(TIOCMIWAIT)
 #endif /* defined(PPS_ENABLE) && defined(TIOCMIWAIT) */
 #ifdef NTPSHM_ENABLE
 	ntpshm_link_deactivate(device);
 #endif /* NTPSHM_ENABLE */
+#ifdef SHM_EXPORT_ENABLE
+	shm_device_detach(&context, device);
+#endif /* SHM_EXPORT_ENABLE */
 	gpsd_deactivate(device);
     }
 }
@@ -728,11 +1516,13 @@ static bool open_device( /*@null@*/struct gps_device_t *device)
 		"NTPD ntpshm_link_activate: %d\n",
 		(int)device->shmIndex >= 0);
 #endif /* NTPSHM_ENABLE */
+#ifdef SHM_EXPORT_ENABLE
+    shm_device_attach(&context, device, (int)(device - devices));
+#endif /* SHM_EXPORT_ENABLE */
 
     gpsd_report(&context.errout, LOG_INF, 
 		"device %s activated\n", device->gpsdata.dev.path);
-    FD_SET(device->gpsdata.gps_fd, &all_fds);
-    adjust_max_fd(device->gpsdata.gps_fd, true);
+    watch_device(device);
     return true;
 }
 
@@ -966,8 +1756,11 @@ static bool awaken(struct gps_device_t *device)
 	    gpsd_report(&context.errout, LOG_RAW,
 			"flagging descriptor %d in assign_channel()\n",
 			device->gpsdata.gps_fd);
-	    FD_SET(device->gpsdata.gps_fd, &all_fds);
-	    adjust_max_fd(device->gpsdata.gps_fd, true);
+#ifdef SHM_EXPORT_ENABLE
+	    /* deactivate_device() withdrew the export along with the fd */
+	    shm_device_attach(&context, device, (int)(device - devices));
+#endif /* SHM_EXPORT_ENABLE */
+	    watch_device(device);
 	    return true;
 	}
     }
@@ -978,10 +1771,9 @@ static bool privileged_user(struct gps_device_t *device)
 /* is this channel privileged to change a device's behavior? */
 {
     /* grant user privilege if he's the only one listening to the device */
-    struct subscriber_t *sub;
-    int subcount = 0;
-    for (sub = subscribers; sub < subscribers + MAXSUBSCRIBERS; sub++) {
-	if (subscribed(sub, device))
+    int si, subcount = 0;
+    for (si = 0; si < active_count; si++) {
+	if (subscribed(active_subscribers[si], device))
 	    subcount++;
     }
     /*
@@ -1461,18 +2253,32 @@ static void pseudonmea_report(struct subscriber_t *sub,
 }
 #endif /* SOCKET_EXPORT_ENABLE */
 
+#ifdef SOCKET_EXPORT_ENABLE
+/* binary watchers all get the same rendering, after the JSON variants */
+#define WIRE_VARIANT	JSON_DATA_VARIANTS
+#define REPORT_VARIANTS	(JSON_DATA_VARIANTS + 1)
+#endif /* SOCKET_EXPORT_ENABLE */
+
 static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 /* report on the corrent packet from a specified device */
 {
+#ifdef NTPSHM_ENABLE
+    struct timespec fixtime;
+#endif /* NTPSHM_ENABLE */
 #ifdef SOCKET_EXPORT_ENABLE
+    /* static: too big for the stack, and only the main thread reports */
+    static char json_reports[REPORT_VARIANTS][OUTBUF_SIZE];
+    /*@null@*/struct outbuf_t *json_shared[REPORT_VARIANTS];
+    /*@null@*/char *json_text[REPORT_VARIANTS];
+    size_t json_lengths[REPORT_VARIANTS];
     struct subscriber_t *sub;
+    int si;
 
     /* add any just-identified device to watcher lists */
     if ((changed & DRIVER_IS) != 0) {
 	bool listeners = false;
-	for (sub = subscribers;
-	     sub < subscribers + MAXSUBSCRIBERS; sub++)
-	    if (sub->active != 0
+	for (si = 0; si < active_count; si++)
+	    if ((sub = active_subscribers[si])->active != 0
 		&& sub->policy.watcher
 		&& subscribed(sub, device))
 		listeners = true;
@@ -1504,6 +2310,8 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 	    struct gps_device_t *dp;
 	    for (dp = devices; dp < devices+MAXDEVICES; dp++) {
 		if (allocated_device(dp)) {
+		    if (dp != device)
+			ingest_lock(dp);
 /* *INDENT-OFF* */
 		    if (dp->device_type->rtcm_writer != NULL) {
 			if (dp->device_type->rtcm_writer(dp,
@@ -1518,6 +2326,8 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 			}
 		    }
 /* *INDENT-ON* */
+		    if (dp != device)
+			ingest_unlock(dp);
 		}
 	    }
 	}
@@ -1537,11 +2347,12 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
      * Only update the NTP time if we've seen the leap-seconds data.
      * Else we may be providing GPS time.
      */
+    gpsd_fixtime(device, &fixtime);
     if ((changed & TIME_SET) == 0) {
 	//gpsd_report(&context.errout, LOG_PROG, "NTP: No time this packet\n");
     } else if (isnan(device->newdata.time)) {
 	//gpsd_report(&context.errout, LOG_PROG, "NTP: bad new time\n");
-    } else if (device->newdata.time == device->last_fixtime.real) {
+    } else if (TS_EQ(&fixtime, &device->last_fixtime.real)) {
 	//gpsd_report(&context.errout, LOG_PROG, "NTP: Not a new time\n");
     } else if (!device->ship_to_ntpd) {
 	//gpsd_report(&context.errout, LOG_PROG, "NTP: No precision time report\n");
@@ -1550,6 +2361,9 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 	struct timedrift_t td;
 	ntpshm_latch(device, &td);
 	(void)ntpshm_put(device, device->shmIndex, &td);
+#ifdef SHM_EXPORT_ENABLE
+	shm_device_put(device, SHMDEV_TOFF, &td);
+#endif /* SHM_EXPORT_ENABLE */
 	/*@+compdef@*/
     }
 #endif /* NTPSHM_ENABLE */
@@ -1573,8 +2387,11 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 	     * make filtering decisiona.
 	     */
 	    for (dgnss = devices; dgnss < devices + MAXDEVICES; dgnss++)
-		if (dgnss != device)
+		if (dgnss != device) {
+		    ingest_lock(dgnss);
 		    netgnss_report(&context, device, dgnss);
+		    ingest_unlock(dgnss);
+		}
 	}
 #endif /* NETFEED_ENABLE */
 #if defined(DBUS_EXPORT_ENABLE) && !defined(S_SPLINT_S)
@@ -1585,14 +2402,29 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 
 #ifdef SHM_EXPORT_ENABLE
     if ((changed & (REPORT_IS|GST_SET|SATELLITE_SET|SUBFRAME_SET|
-		    ATTITUDE_SET|RTCM2_SET|RTCM3_SET|AIS_SET)) != 0)
+		    ATTITUDE_SET|RTCM2_SET|RTCM3_SET|AIS_SET)) != 0) {
 	shm_update(&context, &device->gpsdata);
+	shm_device_update(device, changed);
+    }
 #endif /* SHM_EXPORT_ENABLE */
 
 #ifdef SOCKET_EXPORT_ENABLE
+    /*
+     * Most watchers share a policy, so render each distinct JSON
+     * variant of this report at most once and hand the same bytes
+     * to every subscriber that wants it.  The rendering goes into a
+     * pooled buffer so that clients who are behind can queue it
+     * without copying.
+     */
+    for (si = 0; si < REPORT_VARIANTS; si++) {
+	json_shared[si] = NULL;
+	json_text[si] = NULL;
+    }
+
     /* update all subscribers associated with this device */
-    for (sub = subscribers; sub < subscribers + MAXSUBSCRIBERS; sub++) {
+    for (si = 0; si < active_count; si++) {
 	/*@-nullderef@*/
+	sub = active_subscribers[si];
 	if (sub == NULL || sub->active == 0 || !subscribed(sub, device))
 	    continue;
 
@@ -1630,7 +2462,10 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 
 		if (sub->policy.json)
 		{
-		    char buf[GPS_JSON_RESPONSE_MAX * 4];
+		    const struct policy_t *policy = &sub->policy;
+		    struct policy_t resync;
+		    unsigned long dropped;
+		    int v;
 
 		    if ((changed & AIS_SET) != 0)
 			if (device->gpsdata.ais.type == 24
@@ -1638,20 +2473,117 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 			    && !sub->policy.split24)
 			    continue;
 
-		    json_data_report(changed,
-				     device, &sub->policy,
-				     buf, sizeof(buf));
-		    if (buf[0] != '\0')
-			(void)throttled_write(sub, buf, strlen(buf));
+		    /*
+		     * A delta SKY is only good to a client holding the
+		     * previous report from this device; anyone else gets
+		     * a full one to catch up.
+		     */
+		    if ((changed & SATELLITE_SET) != 0 && policy->skydelta
+			&& (sub->skydevice != device
+			    || sub->skyreports != device->skysent.reports
+			    || sub->skydropped != sub->outq.dropped)) {
+			resync = sub->policy;
+			resync.skydelta = false;
+			policy = &resync;
+		    }
 
+		    if (sub->policy.binary)
+			v = WIRE_VARIANT;
+		    else
+			v = json_data_variant(changed, policy);
+		    if (json_text[v] == NULL) {
+			json_shared[v] = outbuf_get(false);
+			if (json_shared[v] != NULL)
+			    json_text[v] = json_shared[v]->text;
+			else
+			    json_text[v] = json_reports[v];
+			if (v == WIRE_VARIANT) {
+			    /*
+			     * Frames for what has a binary form, then
+			     * JSON for the rest; none of the latter
+			     * depends on policy, so one rendering serves.
+			     */
+			    size_t n = wire_data_report(changed, device,
+							json_text[v],
+							OUTBUF_SIZE);
+			    json_data_report(changed & ~WIRE_DATA_MASK,
+					     device, policy,
+					     json_text[v] + n,
+					     OUTBUF_SIZE - n);
+			    json_lengths[v] = n + strlen(json_text[v] + n);
+			} else {
+			    json_data_report(changed,
+					     device, policy,
+					     json_text[v], OUTBUF_SIZE);
+			    json_lengths[v] = strlen(json_text[v]);
+			}
+			if (json_shared[v] != NULL) {
+			    json_shared[v]->len = json_lengths[v];
+			    json_shared[v]->tpv =
+				(changed & (REPORT_IS | GST_SET | SATELLITE_SET
+					    | SUBFRAME_SET | ATTITUDE_SET
+					    | RTCM2_SET | RTCM3_SET
+					    | AIS_SET)) == REPORT_IS;
+			}
+		    }
+		    dropped = sub->outq.dropped;
+		    if (json_lengths[v] > 0)
+			(void)send_output(sub, json_text[v],
+					  json_lengths[v], json_shared[v]);
+		    if ((changed & SATELLITE_SET) != 0 && sub->policy.skydelta) {
+			sub->skydevice = device;
+			sub->skyreports = device->skysent.reports + 1;
+			sub->skydropped = dropped;
+		    }
 		}
 	    }
 	}
 	/*@+nullderef@*/
     } /* subscribers */
+
+    for (si = 0; si < REPORT_VARIANTS; si++)
+	outbuf_put(json_shared[si]);
+
+    /* what went out is the base the next delta SKY is taken against */
+    if ((changed & SATELLITE_SET) != 0)
+	json_sky_commit(device);
 #endif /* SOCKET_EXPORT_ENABLE */
 }
 
+static void ingest_collect(void)
+/* ship whatever the reader threads have parsed since we last looked */
+{
+    struct gps_device_t *device;
+
+    for (device = devices; device < devices + MAXDEVICES; device++) {
+	struct ingest_t *ing = &ingest[device - devices];
+
+	if (!ing->running)
+	    continue;
+	(void)pthread_mutex_lock(&ing->lock);
+	if (ing->full) {
+	    all_reports(device, ing->changed);
+	    ing->full = false;
+	    (void)pthread_cond_signal(&ing->drained);
+	}
+	if (ing->status != 0) {
+	    /* the reader hit an error or EOF and has quit */
+	    ingest_stop(device);
+	    deactivate_device(device);
+	}
+	(void)pthread_mutex_unlock(&ing->lock);
+    }
+}
+
+static void ingest_notified(struct fdwatch_t *watch)
+/* a reader thread has something for us; ingest_collect() will get it */
+{
+    char drain[64];
+
+    while (read(watch->fd, drain, sizeof(drain)) > 0)
+	continue;
+}
+
 #ifdef SOCKET_EXPORT_ENABLE
 static int handle_gpsd_request(struct subscriber_t *sub, const char *buf)
 /* execute GPSD requests from a buffer */
@@ -1674,103 +2606,288 @@ static int handle_gpsd_request(struct subscriber_t *sub, const char *buf)
 #endif /* SOCKET_EXPORT_ENABLE */
 
 #ifdef PPS_ENABLE
+static int pps_wake[2] = {-1, -1};	/* PPS threads to main loop */
+
+static void pps_notified(struct fdwatch_t *watch)
+/* a PPS thread has published an edge; pps_thread_drain() will take it */
+{
+    char drain[64];
+
+    while (read(watch->fd, drain, sizeof(drain)) > 0)
+	continue;
+}
+
 static void ship_pps_drift_message(struct gps_device_t *session,
 				   struct timedrift_t *td)
-/* on PPS interrupt, ship a drift message to all clients */
+/* ship the drift at a PPS edge to all clients, from pps_thread_drain() */
 {
+#ifdef SOCKET_EXPORT_ENABLE
+    char buf[BUFSIZ], frame[sizeof(struct gps_wire_header_t)
+			   + sizeof(struct gps_wire_pps_t)];
+    size_t framelen = 0;
+    int si;
+#endif /* SOCKET_EXPORT_ENABLE */
+
+#ifdef SHM_EXPORT_ENABLE
+    shm_device_put(session, SHMDEV_PPS, td);
+#endif /* SHM_EXPORT_ENABLE */
 #ifdef SOCKET_EXPORT_ENABLE
     /*@-type@*//* splint is confused about struct timespec */
-    notify_watchers(session,
-		    "{\"class\":\"PPS\",\"device\":\"%s\",\"real_sec\":%ld, \"real_nsec\":%ld,\"clock_sec\":%ld,\"clock_nsec\":%ld}\r\n",
-		    session->gpsdata.dev.path,
-		    td->real.tv_sec, td->real.tv_nsec,
-		    td->clock.tv_sec, td->clock.tv_nsec);
+    (void)snprintf(buf, sizeof(buf),
+		   "{\"class\":\"PPS\",\"device\":\"%s\",\"real_sec\":%ld, \"real_nsec\":%ld,\"clock_sec\":%ld,\"clock_nsec\":%ld}\r\n",
+		   session->gpsdata.dev.path,
+		   td->real.tv_sec, td->real.tv_nsec,
+		   td->clock.tv_sec, td->clock.tv_nsec);
     /*@+type@*/
-	return;
+
+    /* as notify_watchers(), but binary watchers get a frame */
+    for (si = 0; si < active_count; si++) {
+	struct subscriber_t *sub = active_subscribers[si];
+	if (sub->active == 0 || !subscribed(sub, session) || !sub->policy.json)
+	    continue;
+	if (sub->policy.binary) {
+	    if (framelen == 0)
+		framelen = wire_pps_report(session, td, frame, sizeof(frame));
+	    (void)throttled_write(sub, frame, framelen);
+	} else
+	    (void)throttled_write(sub, buf, strlen(buf));
+    }
 #endif /* SOCKET_EXPORT_ENABLE */
 }
 #endif /* PPS_ENABLE */
 
+#ifdef SOCKET_EXPORT_ENABLE
+static struct fdwatch_t listen_watches[AFCOUNT];
 
-#ifdef __UNUSED_AUTOCONNECT__
-#define DGPS_THRESHOLD	1600000	/* max. useful dist. from DGPS server (m) */
-#define SERVER_SAMPLE	12	/* # of servers within threshold to check */
-
-struct dgps_server_t
+static void accept_clients(struct fdwatch_t *watch)
+/* accept new client connections on a listening socket */
 {
-    double lat, lon;
-    char server[257];
-    double dist;
-};
+    /*
+     * Listening sockets are non-blocking, so we can take every pending
+     * connection on one wakeup.  They stay level-triggered so that a
+     * connection we couldn't accept (EMFILE) is retried next time round.
+     */
+    for (;;) {
+	sockaddr_t fsin;
+	socklen_t alen = (socklen_t) sizeof(fsin);
+	/*@+matchanyintegral@*/
+	socket_t ssock = accept(watch->fd, (struct sockaddr *)&fsin, &alen);
+	/*@+matchanyintegral@*/
+	struct subscriber_t *client = NULL;
+	int opts;
+	static struct linger linger = { 1, RELEASE_TIMEOUT };
+	char *c_ip;
+
+	if (BAD_SOCKET(ssock)) {
+	    if (errno != EAGAIN && errno != EWOULDBLOCK)
+		gpsd_report(&context.errout, LOG_ERROR,
+			    "accept: %s\n", strerror(errno));
+	    return;
+	}
+
+	opts = fcntl(ssock, F_GETFL);
+	if (opts >= 0)
+	    (void)fcntl(ssock, F_SETFL, opts | O_NONBLOCK);
 
-static int srvcmp(const void *s, const void *t)
+	c_ip = netlib_sock2ip(ssock);
+	client = allocate_client();
+	if (client == NULL) {
+	    gpsd_report(&context.errout, LOG_ERROR,
+			"Client %s connect on fd %d -"
+			"no subscriber slots available\n", c_ip,
+			ssock);
+	    (void)close(ssock);
+	} else if (setsockopt(ssock, SOL_SOCKET, SO_LINGER, (char *)&linger,
+			      (int)sizeof(struct linger)) == -1) {
+	    gpsd_report(&context.errout, LOG_ERROR,
+			"Error: SETSOCKOPT SO_LINGER\n");
+	    client->fd = UNALLOCATED_FD;
+	    (void)close(ssock);
+	} else if (!attach_client(client, ssock)) {
+	    (void)close(ssock);
+	} else {
+	    char announce[GPS_JSON_RESPONSE_MAX];
+	    gpsd_report(&context.errout, LOG_SPIN,
+			"client %s (%d) connect on fd %d\n", c_ip,
+			sub_index(client), ssock);
+	    json_version_dump(announce, sizeof(announce));
+	    (void)throttled_write(client, announce, strlen(announce));
+	}
+    }
+}
+
+static void service_client(struct subscriber_t *sub)
+/* accept and execute commands from a client with pending input */
 {
-    return (int)(((const struct dgps_server_t *)s)->dist - ((const struct dgps_server_t *)t)->dist);	/* fixes: warning: cast discards qualifiers from pointer target type */
+    gpsd_report(&context.errout, LOG_PROG,
+		"checking client(%d)\n",
+		sub_index(sub));
+    /* client descriptors are edge-triggered, so drain to EAGAIN */
+    while (sub->fd != UNALLOCATED_FD) {
+	char buf[BUFSIZ];
+	int buflen = (int)recv(sub->fd, buf, sizeof(buf) - 1, 0);
+
+	if (buflen < 0 && errno == EINTR)
+	    continue;
+	else if (buflen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    break;
+	else if (buflen <= 0) {
+	    detach_client(sub);
+	    break;
+	}
+	if (buf[buflen - 1] != '\n')
+	    buf[buflen++] = '\n';
+	buf[buflen] = '\0';
+	gpsd_report(&context.errout, LOG_CLIENT,
+		    "<= client(%d): %s\n", sub_index(sub), buf);
+
+	/*
+	 * When a command comes in, update subscriber.active to
+	 * timestamp() so we don't close the connection
+	 * after COMMAND_TIMEOUT seconds. This makes
+	 * COMMAND_TIMEOUT useful.
+	 */
+	sub->active = timestamp();
+	if (handle_gpsd_request(sub, buf) < 0)
+	    detach_client(sub);
+    }
 }
+#endif /* SOCKET_EXPORT_ENABLE */
 
-static void netgnss_autoconnect(struct gps_context_t *context,
-			double lat, double lon, const char *serverlist)
-/* tell the library to talk to the nearest DGPSIP server */
+#ifdef CONTROL_SOCKET_ENABLE
+static struct fdwatch_t control_watch;
+
+static void accept_control(struct fdwatch_t *watch)
+/* accept a control-socket connection and run its commands to completion */
 {
-    struct dgps_server_t keep[SERVER_SAMPLE], hold, *sp, *tp;
+    sockaddr_t fsin;
+    socklen_t alen = (socklen_t) sizeof(fsin);
+    /*@+matchanyintegral@*/
+    socket_t cfd = accept(watch->fd, (struct sockaddr *)&fsin, &alen);
+    /*@-matchanyintegral@*/
     char buf[BUFSIZ];
-    FILE *sfp = fopen(serverlist, "r");
+    ssize_t rd;
 
-    if (sfp == NULL) {
-	gpsd_report(&context.errout, LOG_ERROR, "no DGPS server list found.\n");
+    if (BAD_SOCKET(cfd)) {
+	gpsd_report(&context.errout, LOG_ERROR,
+		    "accept: %s\n", strerror(errno));
 	return;
     }
+    gpsd_report(&context.errout, LOG_INF,
+		"control socket connect on fd %d\n",
+		cfd);
+    ingest_lock_all();
+    while ((rd = read(cfd, buf, sizeof(buf) - 1)) > 0) {
+	buf[rd] = '\0';
+	gpsd_report(&context.errout, LOG_CLIENT,
+		    "<= control(%d): %s\n", cfd, buf);
+	/* coverity[tainted_data] Safe, never handed to exec */
+	handle_control(cfd, buf);
+    }
+    ingest_unlock_all();
+    gpsd_report(&context.errout, LOG_SPIN,
+		"close(%d) of control socket\n", cfd);
+    (void)close(cfd);
+}
+
+static void watch_control(socket_t fd)
+/* start accepting connections on the control socket */
+{
+    control_watch.fd = fd;
+    control_watch.edge = false;
+    control_watch.handler = accept_control;
+    (void)watch_descriptor(&control_watch);
+}
+#endif /* CONTROL_SOCKET_ENABLE */
+
+static int await_events(void)
+/* wait for descriptors to go ready and run their handlers */
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[MAX_EVENTS];
+    int i, nfds;
 
-    for (sp = keep; sp < keep + SERVER_SAMPLE; sp++) {
-	sp->dist = DGPS_THRESHOLD;
-	sp->server[0] = '\0';
+    gpsd_report(&context.errout, LOG_RAW + 2, "epoll waits\n");
+    /*
+     * Like pselect() with a NULL timeout, this only wakes when a
+     * descriptor goes ready or a signal arrives; the latter shows up
+     * as EINTR so the main loop can check for it.
+     */
+    nfds = epoll_wait(epfd, events, MAX_EVENTS,
+		      unpollable_count > 0 ? 0 : -1);
+    if (nfds == -1) {
+	if (errno == EINTR)
+	    return AWAIT_NOT_READY;
+	gpsd_report(&context.errout, LOG_ERROR,
+		    "epoll_wait: %s\n", strerror(errno));
+	return AWAIT_FAILED;
     }
-    /*@ -usedef @*/
-    while (fgets(buf, (int)sizeof(buf), sfp)) {
-	char *cp = strchr(buf, '#');
-	if (cp != NULL)
-	    *cp = '\0';
-	if (sscanf(buf, "%32lf %32lf %256s", &hold.lat, &hold.lon, hold.server) ==
-	    3) {
-	    hold.dist = earth_distance(lat, lon, hold.lat, hold.lon);
-	    tp = NULL;
-	    /*
-	     * The idea here is to look for a server in the sample array
-	     * that is (a) closer than the one we're checking, and (b)
-	     * furtherest away of all those that are closer.  Replace it.
-	     * In this way we end up with the closest possible set.
-	     */
-	    for (sp = keep; sp < keep + SERVER_SAMPLE; sp++)
-		if (hold.dist < sp->dist
-		    && (tp == NULL || hold.dist > tp->dist))
-		    tp = sp;
-	    if (tp != NULL)
-		memcpy(tp, &hold, sizeof(struct dgps_server_t));
-	}
+    gpsd_report(&context.errout, LOG_SPIN,
+		"epoll_wait() -> %d events at %f\n", nfds, timestamp());
+    for (i = 0; i < nfds; i++) {
+	struct fdwatch_t *watch = (struct fdwatch_t *)events[i].data.ptr;
+	if ((events[i].events & ~EPOLLOUT) != 0)
+	    watch->handler(watch);
+	if ((events[i].events & EPOLLOUT) != 0 && watch->writer != NULL)
+	    watch->writer(watch);
     }
-    (void)fclose(sfp);
+    for (i = 0; i < unpollable_count; i++)
+	unpollable[i]->handler(unpollable[i]);
+    return AWAIT_GOT_INPUT;
+#else
+    fd_set rfds, efds, wfds;
+    int fd, topfd = maxfd;
 
-    if (keep[0].server[0] == '\0') {
-	gpsd_report(&context.errout, LOG_ERROR,
-		    "no DGPS servers within %dm.\n",
-		    (int)(DGPS_THRESHOLD / 1000));
-	return;
+    /*
+     * gpsd_await_data() only knows about input, so while any client
+     * has output backed up we have to do the waiting ourselves.
+     */
+    FD_ZERO(&wfds);
+    if (write_count > 0) {
+	int status;
+
+	(void)memcpy(&rfds, &all_fds, sizeof(fd_set));
+	(void)memcpy(&wfds, &write_fds, sizeof(fd_set));
+	status = pselect(maxfd + 1, &rfds, &wfds, NULL, NULL, NULL);
+	if (status != -1)
+	    goto dispatch;
+	else if (errno == EINTR)
+	    return AWAIT_NOT_READY;
+	/* otherwise let gpsd_await_data() sort out what went wrong */
+	FD_ZERO(&wfds);
     }
-    /*@ +usedef @*/
 
-    /* sort them and try the closest first */
-    qsort((void *)keep, SERVER_SAMPLE, sizeof(struct dgps_server_t), srvcmp);
-    for (sp = keep; sp < keep + SERVER_SAMPLE; sp++) {
-	if (sp->server[0] != '\0') {
-	    gpsd_report(&context.errout, LOG_INF,
-			"%s is %dkm away.\n", sp->server,
-			(int)(sp->dist / 1000));
-	    if (dgpsip_open(context, sp->server) >= 0)
-		break;
+    switch (gpsd_await_data(&rfds, &efds, maxfd, &all_fds, &context.errout))
+    {
+    case AWAIT_GOT_INPUT:
+	break;
+    case AWAIT_NOT_READY:
+	{
+	    struct gps_device_t *device;
+	    for (device = devices; device < devices + MAXDEVICES; device++)
+		if (allocated_device(device)
+		    && !BAD_SOCKET(device->gpsdata.gps_fd)
+		    && FD_ISSET(device->gpsdata.gps_fd, &efds)) {
+		    deactivate_device(device);
+		    free_device(device);
+		}
 	}
+	return AWAIT_NOT_READY;
+    case AWAIT_FAILED:
+	return AWAIT_FAILED;
     }
+
+  dispatch:
+    for (fd = 0; fd <= topfd; fd++) {
+	if (FD_ISSET(fd, &rfds) && watched[fd] != NULL)
+	    watched[fd]->handler(watched[fd]);
+	if (FD_ISSET(fd, &wfds) && watched[fd] != NULL
+	    && watched[fd]->writer != NULL)
+	    watched[fd]->writer(watched[fd]);
+    }
+    return AWAIT_GOT_INPUT;
+#endif /* HAVE_SYS_EPOLL_H */
 }
-#endif /* __UNUSED_AUTOCONNECT__ */
 
 #ifdef PPS_ENABLE
 #define CONDITIONALLY_UNUSED
@@ -1782,13 +2899,22 @@ static void gpsd_terminate(struct gps_context_t *context CONDITIONALLY_UNUSED)
 {
     int dfd;
 
+    ingest_lock_all();
     for (dfd = 0; dfd < MAXDEVICES; dfd++) {
 	if (allocated_device(&devices[dfd])) {
+	    if (threaded_ingest)
+		ingest_stop(&devices[dfd]);
+#ifdef SHM_EXPORT_ENABLE
+	    /* a restart attaches afresh, and readers should see us go */
+	    shm_device_detach(context, &devices[dfd]);
+#endif /* SHM_EXPORT_ENABLE */
 	    (void)gpsd_wrap(&devices[dfd]);
 	}
     }
+    ingest_unlock_all();
 #ifdef PPS_ENABLE
-    context->pps_hook = NULL;	/* tell any PPS-watcher thread to die */
+    /* pass no more edges to clients; the PPS threads end with the process */
+    context->pps_hook = NULL;
 #endif /* PPS_ENABLE */
 }
 
@@ -1800,18 +2926,10 @@ int main(int argc, char *argv[])
     static char *gpsd_service = NULL;	/* this static pacifies splint */
     struct subscriber_t *sub;
 #endif /* SOCKET_EXPORT_ENABLE */
-    fd_set rfds;
-#ifdef CONTROL_SOCKET_ENABLE
-    fd_set control_fds;
-#endif /* CONTROL_SOCKET_ENABLE */
 #ifdef CONTROL_SOCKET_ENABLE
     static socket_t csock;
-    socket_t cfd;
     static char *control_socket = NULL;
 #endif /* CONTROL_SOCKET_ENABLE */
-#if defined(SOCKET_EXPORT_ENABLE) || defined(CONTROL_SOCKET_ENABLE)
-    sockaddr_t fsin;
-#endif /* defined(SOCKET_EXPORT_ENABLE) || defined(CONTROL_SOCKET_ENABLE) */
     static char *pid_file = NULL;
     struct gps_device_t *device;
     int i, option;
@@ -1828,7 +2946,7 @@ int main(int argc, char *argv[])
     context.pps_hook = ship_pps_drift_message;
 #endif /* PPS_ENABLE */
 
-    while ((option = getopt(argc, argv, "F:D:S:bGhlNnP:V")) != -1) {
+    while ((option = getopt(argc, argv, "F:D:S:bGhlNnP:Q:TV")) != -1) {
 	switch (option) {
 	case 'D':
 	    context.errout.debug = (int)strtol(optarg, 0, 0);
@@ -1868,6 +2986,31 @@ int main(int argc, char *argv[])
 	case 'P':
 	    pid_file = optarg;
 	    break;
+	case 'T':
+	    threaded_ingest = true;
+	    break;
+	case 'Q':
+#ifdef SOCKET_EXPORT_ENABLE
+	    {
+		char *limit = strchr(optarg, ':');
+		if (limit != NULL) {
+		    *limit++ = '\0';
+		    backlog_limit = (size_t)strtoul(limit, NULL, 0);
+		}
+		if (strcmp(optarg, "disconnect") == 0)
+		    backlog_policy = backlog_disconnect;
+		else if (strcmp(optarg, "drop") == 0)
+		    backlog_policy = backlog_drop;
+		else if (strcmp(optarg, "coalesce") == 0)
+		    backlog_policy = backlog_coalesce;
+		else {
+		    gpsd_report(&context.errout, LOG_ERROR,
+				"unknown backlog policy %s\n", optarg);
+		    exit(EXIT_FAILURE);
+		}
+	    }
+#endif /* SOCKET_EXPORT_ENABLE */
+	    break;
 	case 'V':
 	    (void)printf("gpsd: %s (revision %s)\n", VERSION, REVISION);
 	    exit(EXIT_SUCCESS);
@@ -1879,6 +3022,41 @@ int main(int argc, char *argv[])
 	}
     }
 
+#ifdef HAVE_SYS_EPOLL_H
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+	gpsd_report(&context.errout, LOG_ERROR,
+		    "can't create epoll instance: %s\n", strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+#endif /* HAVE_SYS_EPOLL_H */
+    for (i = 0; i < MAXDEVICES; i++)
+	device_watches[i].fd = UNALLOCATED_FD;
+    ingest_init();
+    if (threaded_ingest) {
+	static struct fdwatch_t ingest_watch;
+	ingest_watch.fd = ingest_notify[0];
+	ingest_watch.handler = ingest_notified;
+	(void)watch_descriptor(&ingest_watch);
+    }
+#ifdef PPS_ENABLE
+    if (pipe(pps_wake) == -1) {
+	gpsd_report(&context.errout, LOG_ERROR,
+		    "can't create PPS pipe: %s\n", strerror(errno));
+	exit(EXIT_FAILURE);
+    } else {
+	static struct fdwatch_t pps_watch;
+	for (i = 0; i < 2; i++) {
+	    (void)fcntl(pps_wake[i], F_SETFL,
+			fcntl(pps_wake[i], F_GETFL) | O_NONBLOCK);
+	    (void)fcntl(pps_wake[i], F_SETFD, FD_CLOEXEC);
+	}
+	context.pps_wake = pps_wake[1];
+	pps_watch.fd = pps_wake[0];
+	pps_watch.handler = pps_notified;
+	(void)watch_descriptor(&pps_watch);
+    }
+#endif /* PPS_ENABLE */
+
 #ifdef SYSTEMD_ENABLE
     sd_socket_count = sd_get_socket_count();
     if (sd_socket_count > 0 && control_socket != NULL) {
@@ -1913,8 +3091,7 @@ int main(int argc, char *argv[])
 #ifdef SYSTEMD_ENABLE
     if (sd_socket_count > 0) {
         csock = SD_SOCKET_FDS_START;
-        FD_SET(csock, &all_fds);
-        adjust_max_fd(csock, true);
+        watch_control(csock);
     }
 #endif
 #ifdef CONTROL_SOCKET_ENABLE
@@ -1929,8 +3106,7 @@ int main(int argc, char *argv[])
 	    gpsd_report(&context.errout, LOG_SPIN,
 			"control socket %s is fd %d\n",
 			control_socket, csock);
-	FD_SET(csock, &all_fds);
-	adjust_max_fd(csock, true);
+	watch_control(csock);
 	gpsd_report(&context.errout, LOG_PROG,
 		    "control socket opened at %s\n",
 		    control_socket);
@@ -2135,14 +3311,18 @@ int main(int argc, char *argv[])
 
     signalled = 0;
 
+#ifdef SOCKET_EXPORT_ENABLE
     for (i = 0; i < AFCOUNT; i++)
 	if (msocks[i] >= 0) {
-	    FD_SET(msocks[i], &all_fds);
-	    adjust_max_fd(msocks[i], true);
+	    int opts = fcntl(msocks[i], F_GETFL);
+	    if (opts >= 0)
+		(void)fcntl(msocks[i], F_SETFL, opts | O_NONBLOCK);
+	    listen_watches[i].fd = msocks[i];
+	    listen_watches[i].edge = false;
+	    listen_watches[i].handler = accept_clients;
+	    (void)watch_descriptor(&listen_watches[i]);
 	}
-#ifdef CONTROL_SOCKET_ENABLE
-    FD_ZERO(&control_fds);
-#endif /* CONTROL_SOCKET_ENABLE */
+#endif /* SOCKET_EXPORT_ENABLE */
 
     /* initialize the GPS context's time fields */
     gpsd_time_init(&context, time(NULL));
@@ -2162,135 +3342,33 @@ int main(int argc, char *argv[])
 	}
 
     while (0 == signalled) {
-	fd_set efds;
-	switch(gpsd_await_data(&rfds, &efds, maxfd, &all_fds, &context.errout))
+	switch (await_events())
 	{
 	case AWAIT_GOT_INPUT:
 	    break;
 	case AWAIT_NOT_READY:
-	    for (device = devices; device < devices + MAXDEVICES; device++)
-		if (allocated_device(device) && FD_ISSET(device->gpsdata.gps_fd, &efds)) {
-		    deactivate_device(device);
-		    free_device(device);
-		}
 	    continue;
 	case AWAIT_FAILED:
 	    exit(EXIT_FAILURE);
 	}
 
-#ifdef SOCKET_EXPORT_ENABLE
-	/* always be open to new client connections */
-	for (i = 0; i < AFCOUNT; i++) {
-	    if (msocks[i] >= 0 && FD_ISSET(msocks[i], &rfds)) {
-		socklen_t alen = (socklen_t) sizeof(fsin);
-		/*@+matchanyintegral@*/
-		socket_t ssock =
-		    accept(msocks[i], (struct sockaddr *)&fsin, &alen);
-		/*@+matchanyintegral@*/
-
-		if (BAD_SOCKET(ssock))
-		    gpsd_report(&context.errout, LOG_ERROR,
-				"accept: %s\n", strerror(errno));
-		else {
-		    struct subscriber_t *client = NULL;
-		    int opts = fcntl(ssock, F_GETFL);
-		    static struct linger linger = { 1, RELEASE_TIMEOUT };
-		    char *c_ip;
-
-		    if (opts >= 0)
-			(void)fcntl(ssock, F_SETFL, opts | O_NONBLOCK);
-
-		    c_ip = netlib_sock2ip(ssock);
-		    client = allocate_client();
-		    if (client == NULL) {
-			gpsd_report(&context.errout, LOG_ERROR,
-				    "Client %s connect on fd %d -"
-				    "no subscriber slots available\n", c_ip,
-				    ssock);
-			(void)close(ssock);
-		    } else
-			if (setsockopt
-			    (ssock, SOL_SOCKET, SO_LINGER, (char *)&linger,
-			     (int)sizeof(struct linger)) == -1) {
-			gpsd_report(&context.errout, LOG_ERROR,
-				    "Error: SETSOCKOPT SO_LINGER\n");
-			(void)close(ssock);
-		    } else {
-			char announce[GPS_JSON_RESPONSE_MAX];
-			FD_SET(ssock, &all_fds);
-			adjust_max_fd(ssock, true);
-			client->fd = ssock;
-			client->active = timestamp();
-			gpsd_report(&context.errout, LOG_SPIN,
-				    "client %s (%d) connect on fd %d\n", c_ip,
-				    sub_index(client), ssock);
-			json_version_dump(announce, sizeof(announce));
-			(void)throttled_write(client, announce,
-					      strlen(announce));
-		    }
-		}
-		FD_CLR(msocks[i], &rfds);
-	    }
-	}
-#endif /* SOCKET_EXPORT_ENABLE */
-
-#ifdef CONTROL_SOCKET_ENABLE
-	/* also be open to new control-socket connections */
-	if (csock > -1 && FD_ISSET(csock, &rfds)) {
-	    socklen_t alen = (socklen_t) sizeof(fsin);
-	    /*@+matchanyintegral@*/
-	    socket_t ssock = accept(csock, (struct sockaddr *)&fsin, &alen);
-	    /*@-matchanyintegral@*/
-
-	    if (BAD_SOCKET(ssock))
-		gpsd_report(&context.errout, LOG_ERROR,
-			    "accept: %s\n", strerror(errno));
-	    else {
-		gpsd_report(&context.errout, LOG_INF,
-			    "control socket connect on fd %d\n",
-			    ssock);
-		FD_SET(ssock, &all_fds);
-		FD_SET(ssock, &control_fds);
-		adjust_max_fd(ssock, true);
-	    }
-	    FD_CLR(csock, &rfds);
-	}
-
-	/* read any commands that came in over the control socket */
-	for (cfd = 0; cfd < FD_SETSIZE; cfd++)
-	    if (FD_ISSET(cfd, &control_fds)) {
-		char buf[BUFSIZ];
-		ssize_t rd;
-
-		while ((rd = read(cfd, buf, sizeof(buf) - 1)) > 0) {
-		    buf[rd] = '\0';
-		    gpsd_report(&context.errout, LOG_CLIENT,
-				"<= control(%d): %s\n", cfd, buf);
-		    /* coverity[tainted_data] Safe, never handed to exec */
-		    handle_control(cfd, buf);
-		}
-		gpsd_report(&context.errout, LOG_SPIN,
-			    "close(%d) of control socket\n", cfd);
-		(void)close(cfd);
-		FD_CLR(cfd, &all_fds);
-		FD_CLR(cfd, &control_fds);
-		adjust_max_fd(cfd, false);
-	    }
-#endif /* CONTROL_SOCKET_ENABLE */
-
 	/* poll all active devices */
-	for (device = devices; device < devices + MAXDEVICES; device++)
-	    if (allocated_device(device) && device->gpsdata.gps_fd > 0)
-		switch (gpsd_multipoll(FD_ISSET(device->gpsdata.gps_fd, &rfds),
+	if (threaded_ingest)
+	    ingest_collect();
+	else for (device = devices; device < devices + MAXDEVICES; device++)
+	    if (allocated_device(device) && device->gpsdata.gps_fd > 0) {
+		struct fdwatch_t *watch = &device_watches[device - devices];
+		bool ready = watch->ready;
+
+		watch->ready = false;
+		switch (gpsd_multipoll(ready,
 				       device, all_reports, DEVICE_REAWAKE))
 		{
 		case DEVICE_READY:
-		    FD_SET(device->gpsdata.gps_fd, &all_fds);
-		    adjust_max_fd(device->gpsdata.gps_fd, true);
+		    watch_device(device);
 		    break;
 		case DEVICE_UNREADY:
-		    FD_CLR(device->gpsdata.gps_fd, &all_fds);
-		    adjust_max_fd(device->gpsdata.gps_fd, false);
+		    unwatch_device(device);
 		    break;
 		case DEVICE_ERROR:
 		case DEVICE_EOF:
@@ -2299,62 +3377,39 @@ int main(int argc, char *argv[])
 		default:
 		    break;
 		}
+	    }
 
-#ifdef __UNUSED_AUTOCONNECT__
-	if (context.fixcnt > 0 && !context.autconnect) {
-	    for (device = devices; device < devices + MAXDEVICES; device++) {
-		if (device->gpsdata.fix.mode > MODE_NO_FIX) {
-		    netgnss_autoconnect(&context,
-					device->gpsdata.fix.latitude,
-					device->gpsdata.fix.longitude);
-		    context.autconnect = True;
-		    break;
+#ifdef PPS_ENABLE
+	/* report the PPS edges the device threads have handed over */
+	for (device = devices; device < devices + MAXDEVICES; device++)
+	    if (allocated_device(device))
+		pps_thread_drain(device);
+#endif /* PPS_ENABLE */
+
+#ifdef SOCKET_EXPORT_ENABLE
+	/* accept and execute commands for clients with pending input */
+	if (ready_count > 0) {
+	    ingest_lock_all();
+	    for (i = 0; i < ready_count; i++) {
+		sub = ready_subscribers[i];
+		if (sub->watch.ready) {
+		    sub->watch.ready = false;
+		    service_client(sub);
 		}
 	    }
+	    ingest_unlock_all();
 	}
-#endif /* __UNUSED_AUTOCONNECT__ */
+	ready_count = 0;
 
-#ifdef SOCKET_EXPORT_ENABLE
-	/* accept and execute commands for all clients */
-	for (sub = subscribers; sub < subscribers + MAXSUBSCRIBERS; sub++) {
-	    if (sub->active == 0)
-		continue;
-
-	    lock_subscriber(sub);
-	    if (FD_ISSET(sub->fd, &rfds)) {
-		char buf[BUFSIZ];
-		int buflen;
-
-		unlock_subscriber(sub);
-
-		gpsd_report(&context.errout, LOG_PROG,
-			    "checking client(%d)\n",
-			    sub_index(sub));
-		if ((buflen =
-		     (int)recv(sub->fd, buf, sizeof(buf) - 1, 0)) <= 0) {
-		    detach_client(sub);
-		} else {
-		    if (buf[buflen - 1] != '\n')
-			buf[buflen++] = '\n';
-		    buf[buflen] = '\0';
-		    gpsd_report(&context.errout, LOG_CLIENT,
-				"<= client(%d): %s\n", sub_index(sub), buf);
-
-		    /*
-		     * When a command comes in, update subscriber.active to
-		     * timestamp() so we don't close the connection
-		     * after COMMAND_TIMEOUT seconds. This makes
-		     * COMMAND_TIMEOUT useful.
-		     */
-		    sub->active = timestamp();
-		    if (handle_gpsd_request(sub, buf) < 0)
-			detach_client(sub);
-		}
-	    } else {
-		unlock_subscriber(sub);
+	/* drop clients that connected but never asked for anything */
+	{
+	    timestamp_t now = timestamp();
+	    int si;
 
-		if (!sub->policy.watcher
-		    && timestamp() - sub->active > COMMAND_TIMEOUT) {
+	    for (si = 0; si < active_count; si++) {
+		sub = active_subscribers[si];
+		if (sub->active != 0 && !sub->policy.watcher
+		    && now - sub->active > COMMAND_TIMEOUT) {
 		    gpsd_report(&context.errout, LOG_WARN,
 				"client(%d) timed out on command wait.\n",
 				sub_index(sub));
@@ -2371,6 +3426,7 @@ int main(int argc, char *argv[])
 	 * Re-poll devices that are disconnected, but have potential
 	 * subscribers in the same cycle.
 	 */
+	ingest_lock_all();
 	for (device = devices; device < devices + MAXDEVICES; device++) {
 
 	    bool device_needed = NOWAIT;
@@ -2379,7 +3435,8 @@ int main(int argc, char *argv[])
 		continue;
 
 	    if (!device_needed)
-		for (sub=subscribers; sub<subscribers+MAXSUBSCRIBERS; sub++) {
+		for (i = 0; i < active_count; i++) {
+		    sub = active_subscribers[i];
 		    if (sub->active == 0)
 			continue;
 		    device_needed = subscribed(sub, device);
@@ -2387,6 +3444,12 @@ int main(int argc, char *argv[])
 			break;
 		}
 
+#ifdef NTRIP_ENABLE
+	    /* a caster can go quiet without closing; ask again */
+	    if (ntrip_stalled(device))
+		deactivate_device(device);
+#endif /* NTRIP_ENABLE */
+
 	    if (!device_needed && device->gpsdata.gps_fd > -1 &&
 		    device->lexer.type != BAD_PACKET) {
 		if (device->releasetime == 0) {
@@ -2409,7 +3472,12 @@ int main(int argc, char *argv[])
 
 	    if (device_needed && BAD_SOCKET(device->gpsdata.gps_fd) &&
 		    (device->opentime == 0 ||
-		    timestamp() - device->opentime > DEVICE_RECONNECT)) {
+		    timestamp() - device->opentime > DEVICE_RECONNECT)
+#ifdef NTRIP_ENABLE
+		    /* casters back off further, and may wait for a fix */
+		    && ntrip_reconnect_due(device)
+#endif /* NTRIP_ENABLE */
+		    ) {
 		device->opentime = timestamp();
 		gpsd_report(&context.errout, LOG_INF,
 			    "reconnection attempt on device %d\n",
@@ -2417,6 +3485,7 @@ int main(int argc, char *argv[])
 		(void)awaken(device);
 	    }
 	}
+	ingest_unlock_all();
 #endif /* SOCKET_EXPORT_ENABLE */
     }
 
@@ -2439,7 +3508,8 @@ int main(int argc, char *argv[])
      * This is an attempt to avoid the sporadic race errors at the ends
      * of our regression tests.
      */
-    for (sub = subscribers; sub < subscribers + MAXSUBSCRIBERS; sub++) {
+    for (i = 0; i < active_count; i++) {
+	sub = active_subscribers[i];
 	if (sub->active != 0)
 	    detach_client(sub);
     }
@@ -15,7 +15,9 @@ PERMISSIONS
 ***************************************************************************/
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <math.h>
+#include <float.h>
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
@@ -106,6 +108,172 @@ char *json_stringify( /*@out@*/ char *to,
     /*@+temptrans@*/
 }
 
+/*
+ * Reports are built left to right through a cursor that remembers where
+ * the text ends, so appending a field never rescans what came before.
+ * Keys are string literals whose lengths are known at compile time, and
+ * the common integer and fixed-point fields are formatted by hand rather
+ * than by parsing a printf format for each one.  Output is truncated at
+ * the end of the buffer, as the old snprintf() chains were.
+ */
+struct json_out_t {
+    char *start;	/* start of this report */
+    char *end;		/* the NUL terminating the text so far */
+    char *limit;	/* last byte available, reserved for the NUL */
+};
+
+static void json_out_init(/*@out@*/struct json_out_t *out,
+			  /*@out@*/char *buf, size_t buflen)
+/* point a cursor at an empty buffer */
+{
+    assert(buflen > 0);
+    out->start = out->end = buf;
+    out->limit = buf + buflen - 1;
+    *buf = '\0';
+}
+
+static void json_out_mem(struct json_out_t *out, const char *s, size_t n)
+/* append n bytes, truncating at the end of the buffer */
+{
+    if (n > (size_t)(out->limit - out->end))
+	n = (size_t)(out->limit - out->end);
+    (void)memcpy(out->end, s, n);
+    out->end += n;
+    *out->end = '\0';
+}
+
+static void json_out_str(struct json_out_t *out, const char *s)
+/* append a NUL-terminated string */
+{
+    json_out_mem(out, s, strlen(s));
+}
+
+#if defined(__GNUC__)
+static void json_out_printf(struct json_out_t *, const char *, ...)
+    __attribute__((format(printf, 2, 3)));
+#endif /* __GNUC__ */
+
+static void json_out_printf(struct json_out_t *out, const char *fmt, ...)
+/* append printf-style output, for fields with no specialized formatter */
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(out->end, (size_t)(out->limit - out->end) + 1, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+	out->end += ((size_t)n < (size_t)(out->limit - out->end))
+	    ? (size_t)n : (size_t)(out->limit - out->end);
+}
+
+static void json_out_trim(struct json_out_t *out)
+/* drop a trailing comma */
+{
+    if (out->end > out->start && out->end[-1] == ',')
+	*--out->end = '\0';
+}
+
+static void json_out_uint(struct json_out_t *out,
+			  const char *key, size_t keylen,
+			  unsigned long u, bool negative)
+/* append key, a decimal integer and a comma */
+{
+    char digits[24], *p = digits + sizeof(digits);
+
+    *--p = ',';
+    do {
+	*--p = (char)('0' + u % 10);
+	u /= 10;
+    } while (u != 0);
+    if (negative)
+	*--p = '-';
+    json_out_mem(out, key, keylen);
+    json_out_mem(out, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+static void json_out_real(struct json_out_t *out,
+			  const char *key, size_t keylen,
+			  double v, int places)
+/* append key, v exactly as "%.<places>f" prints it, and a comma */
+{
+    static const double scale[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    };
+    char digits[40], *p = digits + sizeof(digits);
+    double scaled, whole, frac;
+    unsigned long long r;
+    int i;
+
+    json_out_mem(out, key, keylen);
+    if (places >= (int)NITEMS(scale) || isfinite(v) == 0) {
+	json_out_printf(out, "%.*f,", places, v);
+	return;
+    }
+    scaled = fabs(v) * scale[places];
+    whole = floor(scaled);
+    frac = scaled - whole;
+    /*
+     * The product may be off by half a unit in the last place.  If that
+     * could move it across a rounding boundary, or it is too big for the
+     * integer arithmetic below, let printf() decide.
+     */
+    if (scaled >= 1e15 || fabs(frac - 0.5) <= scaled * DBL_EPSILON) {
+	json_out_printf(out, "%.*f,", places, v);
+	return;
+    }
+    r = (unsigned long long)whole + (frac > 0.5 ? 1 : 0);
+
+    *--p = ',';
+    if (places > 0) {
+	for (i = 0; i < places; i++) {
+	    *--p = (char)('0' + r % 10);
+	    r /= 10;
+	}
+	*--p = '.';
+    }
+    do {
+	*--p = (char)('0' + r % 10);
+	r /= 10;
+    } while (r != 0);
+    /* printf() keeps the sign of negative values that round to zero */
+    if (signbit(v) != 0)
+	*--p = '-';
+    json_out_mem(out, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+static void json_out_text(struct json_out_t *out,
+			  const char *key, size_t keylen, const char *s)
+/* append key, a quoted string (not escaped) and a comma */
+{
+    json_out_mem(out, key, keylen);
+    json_out_mem(out, "\"", 1);
+    json_out_str(out, s);
+    json_out_mem(out, "\",", 2);
+}
+
+#define JSON_KEY(tag)		"\"" tag "\":"
+#define JSON_LIT(out, s)	json_out_mem(out, s, sizeof(s) - 1)
+#define JSON_INT(out, tag, v)	do {					\
+	long json_v = (long)(v);					\
+	json_out_uint(out, JSON_KEY(tag), sizeof(JSON_KEY(tag)) - 1,	\
+		      json_v < 0 ? 0UL - (unsigned long)json_v		\
+		      : (unsigned long)json_v, json_v < 0);		\
+    } while (0)
+#define JSON_UINT(out, tag, v)						\
+	json_out_uint(out, JSON_KEY(tag), sizeof(JSON_KEY(tag)) - 1,	\
+		      (unsigned long)(v), false)
+#define JSON_REAL(out, tag, v, places)					\
+	json_out_real(out, JSON_KEY(tag), sizeof(JSON_KEY(tag)) - 1,	\
+		      v, places)
+#define JSON_TEXT(out, tag, s)						\
+	json_out_text(out, JSON_KEY(tag), sizeof(JSON_KEY(tag)) - 1, s)
+#define JSON_TIME(out, tag, t)	do {					\
+	char json_tbuf[JSON_DATE_MAX+1];				\
+	JSON_TEXT(out, tag,						\
+		  unix_to_iso8601(t, json_tbuf, sizeof(json_tbuf)));	\
+    } while (0)
+
 void json_version_dump( /*@out@*/ char *reply, size_t replylen)
 {
     (void)snprintf(reply, replylen,
@@ -121,35 +289,24 @@ void json_version_dump( /*@out@*/ char *reply, size_t replylen)
 #endif /* TIMING_ENABLE */
 
 
-void json_tpv_dump(const struct gps_device_t *session,
-		   const struct policy_t *policy CONDITIONALLY_UNUSED,
-		   /*@out@*/ char *reply, size_t replylen)
+static void json_tpv_write(struct json_out_t *out,
+			   const struct gps_device_t *session,
+			   const struct policy_t *policy CONDITIONALLY_UNUSED)
+/* append a TPV report */
 {
     const struct gps_data_t *gpsdata = &session->gpsdata;
 #ifdef TIMING_ENABLE
     timestamp_t rtime = timestamp();
 #endif /* TIMING_ENABLE */
 
-    assert(replylen > 2);
-    (void)strlcpy(reply, "{\"class\":\"TPV\",", replylen);
+    JSON_LIT(out, "{\"class\":\"TPV\",");
     if (gpsdata->dev.path[0] != '\0')
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"device\":\"%s\",", gpsdata->dev.path);
-    (void)snprintf(reply + strlen(reply),
-		   replylen - strlen(reply),
-		   "\"mode\":%d,", gpsdata->fix.mode);
-    if (isnan(gpsdata->fix.time) == 0) {
-	char tbuf[JSON_DATE_MAX+1];
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"time\":\"%s\",",
-		       unix_to_iso8601(gpsdata->fix.time, tbuf, sizeof(tbuf)));
-    }
+	JSON_TEXT(out, "device", gpsdata->dev.path);
+    JSON_INT(out, "mode", gpsdata->fix.mode);
+    if (isnan(gpsdata->fix.time) == 0)
+	JSON_TIME(out, "time", gpsdata->fix.time);
     if (isnan(gpsdata->fix.ept) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"ept\":%.3f,", gpsdata->fix.ept);
+	JSON_REAL(out, "ept", gpsdata->fix.ept, 3);
     /*
      * Suppressing TPV fields that would be invalid because the fix
      * quality doesn't support them is nice for cutting down on the
@@ -162,64 +319,41 @@ void json_tpv_dump(const struct gps_device_t *session,
      */
     if (gpsdata->fix.mode >= MODE_2D) {
 	if (isnan(gpsdata->fix.latitude) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"lat\":%.9f,", gpsdata->fix.latitude);
+	    JSON_REAL(out, "lat", gpsdata->fix.latitude, 9);
 	if (isnan(gpsdata->fix.longitude) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"lon\":%.9f,", gpsdata->fix.longitude);
+	    JSON_REAL(out, "lon", gpsdata->fix.longitude, 9);
 	if (gpsdata->fix.mode >= MODE_3D && isnan(gpsdata->fix.altitude) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"alt\":%.3f,", gpsdata->fix.altitude);
+	    JSON_REAL(out, "alt", gpsdata->fix.altitude, 3);
 	if (isnan(gpsdata->fix.epx) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"epx\":%.3f,", gpsdata->fix.epx);
+	    JSON_REAL(out, "epx", gpsdata->fix.epx, 3);
 	if (isnan(gpsdata->fix.epy) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"epy\":%.3f,", gpsdata->fix.epy);
+	    JSON_REAL(out, "epy", gpsdata->fix.epy, 3);
 	if ((gpsdata->fix.mode >= MODE_3D) && isnan(gpsdata->fix.epv) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"epv\":%.3f,", gpsdata->fix.epv);
+	    JSON_REAL(out, "epv", gpsdata->fix.epv, 3);
 	if (isnan(gpsdata->fix.track) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"track\":%.4f,", gpsdata->fix.track);
+	    JSON_REAL(out, "track", gpsdata->fix.track, 4);
 	if (isnan(gpsdata->fix.speed) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"speed\":%.3f,", gpsdata->fix.speed);
+	    JSON_REAL(out, "speed", gpsdata->fix.speed, 3);
 	if ((gpsdata->fix.mode >= MODE_3D) && isnan(gpsdata->fix.climb) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"climb\":%.3f,", gpsdata->fix.climb);
+	    JSON_REAL(out, "climb", gpsdata->fix.climb, 3);
 	if (isnan(gpsdata->fix.epd) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"epd\":%.4f,", gpsdata->fix.epd);
+	    JSON_REAL(out, "epd", gpsdata->fix.epd, 4);
 	if (isnan(gpsdata->fix.eps) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"eps\":%.2f,", gpsdata->fix.eps);
+	    JSON_REAL(out, "eps", gpsdata->fix.eps, 2);
 	if ((gpsdata->fix.mode >= MODE_3D) && isnan(gpsdata->fix.epc) == 0)
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"epc\":%.2f,", gpsdata->fix.epc);
+	    JSON_REAL(out, "epc", gpsdata->fix.epc, 2);
 #ifdef TIMING_ENABLE
 	if (policy->timing) {
 #ifdef PPS_ENABLE
+	    struct timedrift_t td;
+
 	    /*@-type -formattype@*/ /* splint is confused about struct timespec */
-	    if (session->ppscount)
-		(void)snprintf(reply + strlen(reply), replylen - strlen(reply),
-			       "\"pps\":%.9f,", 
-			       session->ppslast.clock.tv_sec + session->ppslast.clock.tv_nsec / 1e9);
+	    if (pps_thread_lastpps(session, &td) > 0)
+		json_out_printf(out, "\"pps\":%.9f,", 
+			       td.clock.tv_sec + td.clock.tv_nsec / 1e9);
 	    /*@+type +formattype@*/
 #endif /* PPS_ENABLE */
-	    (void)snprintf(reply + strlen(reply), replylen - strlen(reply),
+	    json_out_printf(out,
 			   "\"sor\":%.9f,\"chars\":%lu,\"sats\":%2d,\"rtime\":%.9f,\"week\":%u,\"tow\":%.3f,\"rollovers\":%d",
 			   session->sor,
 			   session->chars,
@@ -231,31 +365,32 @@ void json_tpv_dump(const struct gps_device_t *session,
 	}
 #endif /* TIMING_ENABLE */
     }
-    if (reply[strlen(reply) - 1] == ',')
-	reply[strlen(reply) - 1] = '\0';	/* trim trailing comma */
-    (void)strlcat(reply, "}\r\n", replylen);
+    json_out_trim(out);
+    JSON_LIT(out, "}\r\n");
 }
 
-void json_noise_dump(const struct gps_data_t *gpsdata,
+void json_tpv_dump(const struct gps_device_t *session,
+		   const struct policy_t *policy CONDITIONALLY_UNUSED,
 		   /*@out@*/ char *reply, size_t replylen)
 {
-    char tbuf[JSON_DATE_MAX+1];
+    struct json_out_t out;
 
     assert(replylen > 2);
-    (void)strlcpy(reply, "{\"class\":\"GST\",", replylen);
+    json_out_init(&out, reply, replylen);
+    json_tpv_write(&out, session, policy);
+}
+
+static void json_noise_write(struct json_out_t *out,
+			     const struct gps_data_t *gpsdata)
+/* append a GST report */
+{
+    JSON_LIT(out, "{\"class\":\"GST\",");
     if (gpsdata->dev.path[0] != '\0')
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"device\":\"%s\",", gpsdata->dev.path);
-    (void)snprintf(reply + strlen(reply),
-		   replylen - strlen(reply),
-		   "\"time\":\"%s\",",
-		   unix_to_iso8601(gpsdata->gst.utctime, tbuf, sizeof(tbuf)));
+	JSON_TEXT(out, "device", gpsdata->dev.path);
+    JSON_TIME(out, "time", gpsdata->gst.utctime);
 #define ADD_GST_FIELD(tag, field) do {                     \
     if (isnan(gpsdata->gst.field) == 0)              \
-	(void)snprintf(reply + strlen(reply),                \
-		       replylen - strlen(reply),             \
-		       "\"" tag "\":%.3f,", gpsdata->gst.field); \
+	JSON_REAL(out, tag, gpsdata->gst.field, 3); \
     } while(0)
 
     ADD_GST_FIELD("rms",    rms_deviation);
@@ -268,82 +403,176 @@ void json_noise_dump(const struct gps_data_t *gpsdata,
 
 #undef ADD_GST_FIELD
 
-    if (reply[strlen(reply) - 1] == ',')
-	reply[strlen(reply) - 1] = '\0';	/* trim trailing comma */
-    (void)strlcat(reply, "}\r\n", replylen);
+    json_out_trim(out);
+    JSON_LIT(out, "}\r\n");
 }
 
-void json_sky_dump(const struct gps_data_t *datap,
+void json_noise_dump(const struct gps_data_t *gpsdata,
 		   /*@out@*/ char *reply, size_t replylen)
 {
-    int i, reported = 0;
+    struct json_out_t out;
 
     assert(replylen > 2);
-    (void)strlcpy(reply, "{\"class\":\"SKY\",", replylen);
+    json_out_init(&out, reply, replylen);
+    json_noise_write(&out, gpsdata);
+}
+
+/* every this many SKY reports, delta watchers get a full one anyway */
+#define SKY_FULL_INTERVAL	10
+
+static void json_sky_head(struct json_out_t *out,
+			  const struct gps_data_t *datap)
+/* append the part of a SKY report before the satellite list */
+{
+    JSON_LIT(out, "{\"class\":\"SKY\",");
     if (datap->dev.path[0] != '\0')
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"device\":\"%s\",", datap->dev.path);
-    if (isnan(datap->skyview_time) == 0) {
-	char tbuf[JSON_DATE_MAX+1];
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"time\":\"%s\",",
-		       unix_to_iso8601(datap->skyview_time, tbuf, sizeof(tbuf)));
-    }
+	JSON_TEXT(out, "device", datap->dev.path);
+    if (isnan(datap->skyview_time) == 0)
+	JSON_TIME(out, "time", datap->skyview_time);
     if (isnan(datap->dop.xdop) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"xdop\":%.2f,", datap->dop.xdop);
+	JSON_REAL(out, "xdop", datap->dop.xdop, 2);
     if (isnan(datap->dop.ydop) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"ydop\":%.2f,", datap->dop.ydop);
+	JSON_REAL(out, "ydop", datap->dop.ydop, 2);
     if (isnan(datap->dop.vdop) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"vdop\":%.2f,", datap->dop.vdop);
+	JSON_REAL(out, "vdop", datap->dop.vdop, 2);
     if (isnan(datap->dop.tdop) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"tdop\":%.2f,", datap->dop.tdop);
+	JSON_REAL(out, "tdop", datap->dop.tdop, 2);
     if (isnan(datap->dop.hdop) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"hdop\":%.2f,", datap->dop.hdop);
+	JSON_REAL(out, "hdop", datap->dop.hdop, 2);
     if (isnan(datap->dop.gdop) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"gdop\":%.2f,", datap->dop.gdop);
+	JSON_REAL(out, "gdop", datap->dop.gdop, 2);
     if (isnan(datap->dop.pdop) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"pdop\":%.2f,", datap->dop.pdop);
+	JSON_REAL(out, "pdop", datap->dop.pdop, 2);
+}
+
+static void json_sat_write(struct json_out_t *out,
+			   const struct satellite_t *sp)
+/* append one entry of a SKY satellite list */
+{
+    JSON_LIT(out, "{");
+    JSON_INT(out, "PRN", sp->PRN);
+    JSON_INT(out, "el", sp->elevation);
+    JSON_INT(out, "az", sp->azimuth);
+    JSON_REAL(out, "ss", sp->ss, 0);
+    if (sp->used)
+	JSON_LIT(out, "\"used\":true},");
+    else
+	JSON_LIT(out, "\"used\":false},");
+}
+
+static void json_sky_write(struct json_out_t *out,
+			   const struct gps_data_t *datap)
+/* append a SKY report */
+{
+    int i, reported = 0;
+
+    json_sky_head(out, datap);
     /* insurance against flaky drivers */
     for (i = 0; i < datap->satellites_visible; i++)
 	if (datap->skyview[i].PRN)
 	    reported++;
     if (reported) {
-	(void)strlcat(reply, "\"satellites\":[", replylen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < reported; i++) {
-	    if (datap->skyview[i].PRN) {
-		(void)snprintf(reply + strlen(reply),
-			       replylen - strlen(reply),
-			       "{\"PRN\":%d,\"el\":%d,\"az\":%d,\"ss\":%.0f,\"used\":%s},",
-			       datap->skyview[i].PRN,
-			       datap->skyview[i].elevation,
-			       datap->skyview[i].azimuth,
-			       datap->skyview[i].ss,
-			       datap->skyview[i].used ? "true" : "false");
-	    }
+	    if (datap->skyview[i].PRN)
+		json_sat_write(out, &datap->skyview[i]);
 	}
-	if (reply[strlen(reply) - 1] == ',')
-	    reply[strlen(reply) - 1] = '\0';	/* trim trailing comma */
-	(void)strlcat(reply, "]", replylen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
     }
-    if (reply[strlen(reply) - 1] == ',')
-	reply[strlen(reply) - 1] = '\0';	/* trim trailing comma */
-    (void)strlcat(reply, "}\r\n", replylen);
+    json_out_trim(out);
+    JSON_LIT(out, "}\r\n");
+}
+
+static bool json_sat_changed(const struct satellite_t *a,
+			     const struct satellite_t *b)
+/* would these two satellites be reported differently? */
+{
+    return a->elevation != b->elevation || a->azimuth != b->azimuth
+	|| a->used != b->used
+	|| (isnan(a->ss) != isnan(b->ss))
+	|| (isnan(a->ss) == 0 && rint(a->ss) != rint(b->ss));
+}
+
+static void json_skydelta_write(struct json_out_t *out,
+				const struct gps_device_t *session)
+/*
+ * Append a SKY report listing only the satellites that are new or
+ * changed since the last report from this device, and the PRNs of
+ * those that have dropped out.  If nothing but the time moved, append
+ * nothing at all.
+ */
+{
+    const struct gps_data_t *datap = &session->gpsdata;
+    const struct satellite_t *base = session->skysent.sats;
+    int changed[MAXCHANNELS], gone[MAXCHANNELS];
+    bool kept[MAXCHANNELS];
+    int i, j, nchanged = 0, ngone = 0;
+
+    memset(kept, '\0', sizeof(kept));
+    for (i = 0; i < datap->satellites_visible && i < MAXCHANNELS; i++) {
+	const struct satellite_t *sp = &datap->skyview[i];
+
+	if (sp->PRN == 0)
+	    continue;
+	/* receivers mostly keep their channel order, so try that first */
+	if (i < session->skysent.count && base[i].PRN == sp->PRN)
+	    j = i;
+	else
+	    for (j = 0; j < session->skysent.count; j++)
+		if (base[j].PRN == sp->PRN)
+		    break;
+	if (j < session->skysent.count) {
+	    kept[j] = true;
+	    if (!json_sat_changed(sp, &base[j]))
+		continue;
+	}
+	changed[nchanged++] = i;
+    }
+    for (j = 0; j < session->skysent.count; j++)
+	if (!kept[j])
+	    gone[ngone++] = base[j].PRN;
+
+    if (nchanged == 0 && ngone == 0
+	&& memcmp(&datap->dop, &session->skysent.dop, sizeof(datap->dop)) == 0)
+	return;
+
+    json_sky_head(out, datap);
+    JSON_LIT(out, "\"delta\":true,\"satellites\":[");
+    for (i = 0; i < nchanged; i++)
+	json_sat_write(out, &datap->skyview[changed[i]]);
+    for (i = 0; i < ngone; i++) {
+	JSON_LIT(out, "{");
+	JSON_INT(out, "PRN", gone[i]);
+	JSON_LIT(out, "\"gone\":true},");
+    }
+    json_out_trim(out);
+    JSON_LIT(out, "]}\r\n");
+}
+
+void json_sky_commit(struct gps_device_t *session)
+/* take the skyview just reported as the base for the next delta */
+{
+    const struct gps_data_t *datap = &session->gpsdata;
+    int i;
+
+    session->skysent.count = 0;
+    for (i = 0; i < datap->satellites_visible && i < MAXCHANNELS; i++)
+	if (datap->skyview[i].PRN != 0)
+	    session->skysent.sats[session->skysent.count++] =
+		datap->skyview[i];
+    session->skysent.dop = datap->dop;
+    session->skysent.reports++;
+}
+
+void json_sky_dump(const struct gps_data_t *datap,
+		   /*@out@*/ char *reply, size_t replylen)
+{
+    struct json_out_t out;
+
+    assert(replylen > 2);
+    json_out_init(&out, reply, replylen);
+    json_sky_write(&out, datap);
 }
 
 void json_device_dump(const struct gps_device_t *device,
@@ -351,73 +580,73 @@ void json_device_dump(const struct gps_device_t *device,
 {
     struct classmap_t *cmp;
     char buf1[JSON_VAL_MAX * 2 + 1];
+    struct json_out_t out;
 
-    (void)strlcpy(reply, "{\"class\":\"DEVICE\",\"path\":\"", replylen);
-    (void)strlcat(reply, device->gpsdata.dev.path, replylen);
-    (void)strlcat(reply, "\",", replylen);
-    if (device->device_type != NULL) {
-	(void)strlcat(reply, "\"driver\":\"", replylen);
-	(void)strlcat(reply, device->device_type->type_name, replylen);
-	(void)strlcat(reply, "\",", replylen);
-    }
+    json_out_init(&out, reply, replylen);
+    JSON_LIT(&out, "{\"class\":\"DEVICE\",");
+    JSON_TEXT(&out, "path", device->gpsdata.dev.path);
+    if (device->device_type != NULL)
+	JSON_TEXT(&out, "driver", device->device_type->type_name);
     /*@-mustfreefresh@*/
-    if (device->subtype[0] != '\0') {
-	(void)strlcat(reply, "\"subtype\":\"", replylen);
-	(void)strlcat(reply,
-		      json_stringify(buf1, sizeof(buf1), device->subtype),
-		      replylen);
-	(void)strlcat(reply, "\",", replylen);
-    }
+    if (device->subtype[0] != '\0')
+	JSON_TEXT(&out, "subtype",
+		  json_stringify(buf1, sizeof(buf1), device->subtype));
     /*@+mustfreefresh@*/
+    /* network sources say how far their connection has got */
+    if (device->netconn.state != netconn_idle) {
+	JSON_TEXT(&out, "connection", netconn_state_name(device));
+	/*@-mustfreefresh@*/
+	if (device->netconn.state == netconn_failed)
+	    JSON_TEXT(&out, "reason",
+		      json_stringify(buf1, sizeof(buf1),
+				     device->netconn.reason));
+	/*@+mustfreefresh@*/
+    }
     /*
      * There's an assumption here: Anything that we type service_sensor is
      * a serial device with the usual control parameters.
      */
     if (device->gpsdata.online > 0) {	
-	(void)snprintf(reply + strlen(reply), replylen - strlen(reply),
-		       "\"activated\":\"%s\",", 
-		       unix_to_iso8601(device->gpsdata.online, buf1, sizeof(buf1)));
+	JSON_TIME(&out, "activated", device->gpsdata.online);
 	if (device->observed != 0) {
 	    int mask = 0;
 	    for (cmp = classmap; cmp < classmap + NITEMS(classmap); cmp++)
 		if ((device->observed & cmp->packetmask) != 0)
 		    mask |= cmp->typemask;
 	    if (mask != 0)
-		(void)snprintf(reply + strlen(reply),
-			       replylen - strlen(reply), "\"flags\":%d,",
-			       mask);
+		JSON_INT(&out, "flags", mask);
 	}
 	if (device->servicetype == service_sensor) {
 	    /* speed can be 0 if the device is not currently active */
 	    speed_t speed = gpsd_get_speed(device);
-	    if (speed != 0)
-		(void)snprintf(reply + strlen(reply), replylen - strlen(reply),
-			       "\"native\":%d,\"bps\":%d,\"parity\":\"%c\",\"stopbits\":%u,\"cycle\":%2.2f,",
-			       device->gpsdata.dev.driver_mode,
-			       (int)speed,
-			       device->gpsdata.dev.parity,
-			       device->gpsdata.dev.stopbits,
-			       device->gpsdata.dev.cycle);
+	    if (speed != 0) {
+		JSON_INT(&out, "native", device->gpsdata.dev.driver_mode);
+		JSON_INT(&out, "bps", (int)speed);
+		JSON_LIT(&out, "\"parity\":\"");
+		json_out_mem(&out, &device->gpsdata.dev.parity, 1);
+		JSON_LIT(&out, "\",");
+		JSON_UINT(&out, "stopbits", device->gpsdata.dev.stopbits);
+		JSON_REAL(&out, "cycle", device->gpsdata.dev.cycle, 2);
+	    }
 #ifdef RECONFIGURE_ENABLE
 	    if (device->device_type != NULL
 		&& device->device_type->rate_switcher != NULL)
-		(void)snprintf(reply + strlen(reply),
-			       replylen - strlen(reply),
-			       "\"mincycle\":%2.2f,",
-			       device->device_type->min_cycle);
+		JSON_REAL(&out, "mincycle", device->device_type->min_cycle, 2);
 #endif /* RECONFIGURE_ENABLE */
 	}
     }
-    if (reply[strlen(reply) - 1] == ',')
-	reply[strlen(reply) - 1] = '\0';	/* trim trailing comma */
-    (void)strlcat(reply, "}\r\n", replylen);
+    json_out_trim(&out);
+    JSON_LIT(&out, "}\r\n");
 }
 
 void json_watch_dump(const struct policy_t *ccp,
 		     /*@out@*/ char *reply, size_t replylen)
 {
+    struct json_out_t out;
+
     /*@-compdef@*/
-    (void)snprintf(reply, replylen,
+    json_out_init(&out, reply, replylen);
+    json_out_printf(&out,
 		   "{\"class\":\"WATCH\",\"enable\":%s,\"json\":%s,\"nmea\":%s,\"raw\":%d,\"scaled\":%s,\"timing\":%s,\"split24\":%s,",
 		   ccp->watcher ? "true" : "false",
 		   ccp->json ? "true" : "false",
@@ -426,35 +655,37 @@ void json_watch_dump(const struct policy_t *ccp,
 		   ccp->scaled ? "true" : "false",
 		   ccp->timing ? "true" : "false",
 		   ccp->split24 ? "true" : "false");
+    /* only when asked for, so older clients never see it */
+    if (ccp->binary)
+	JSON_LIT(&out, "\"binary\":true,");
+    if (ccp->skydelta)
+	JSON_LIT(&out, "\"skydelta\":true,");
     if (ccp->devpath[0] != '\0')
-	(void)snprintf(reply + strlen(reply), replylen - strlen(reply),
-		       "\"device\":\"%s\",", ccp->devpath);
-    if (reply[strlen(reply) - 1] == ',')
-	reply[strlen(reply) - 1] = '\0';
-    (void)strlcat(reply, "}\r\n", replylen);
+	JSON_TEXT(&out, "device", ccp->devpath);
+    json_out_trim(&out);
+    JSON_LIT(&out, "}\r\n");
     /*@+compdef@*/
 }
 
-void json_subframe_dump(const struct gps_data_t *datap,
-			/*@out@*/ char buf[], size_t buflen)
+static void json_subframe_write(struct json_out_t *out,
+				const struct gps_data_t *datap)
+/* append a SUBFRAME report */
 {
-    size_t len = 0;
     const struct subframe_t *subframe = &datap->subframe;
     const bool scaled = datap->policy.scaled;
  
-    (void)snprintf(buf, buflen, "{\"class\":\"SUBFRAME\",\"device\":\"%s\","
+    json_out_printf(out, "{\"class\":\"SUBFRAME\",\"device\":\"%s\","
 		   "\"tSV\":%u,\"TOW17\":%u,\"frame\":%u,\"scaled\":%s",
 		   datap->dev.path,
 		   (unsigned int)subframe->tSVID,
 		   (unsigned int)subframe->TOW17,
 		   (unsigned int)subframe->subframe_num,
 		   JSON_BOOL(scaled));
-    len = strlen(buf);
 
     /*@-type@*/
     if ( 1 == subframe->subframe_num ) {
 	if (scaled) {
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 			",\"EPHEM1\":{\"WN\":%u,\"IODC\":%u,\"L2\":%u,"
 			"\"ura\":%u,\"hlth\":%u,\"L2P\":%u,\"Tgd\":%g,"
 			"\"toc\":%lu,\"af2\":%.4g,\"af1\":%.6e,\"af0\":%.7e}",
@@ -470,7 +701,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
 			subframe->sub1.d_af1,
 			subframe->sub1.d_af0);
 	} else {
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 			",\"EPHEM1\":{\"WN\":%u,\"IODC\":%u,\"L2\":%u,"
 			"\"ura\":%u,\"hlth\":%u,\"L2P\":%u,\"Tgd\":%d,"
 			"\"toc\":%u,\"af2\":%ld,\"af1\":%d,\"af0\":%d}",
@@ -488,7 +719,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
 	}
     } else if ( 2 == subframe->subframe_num ) {
 	if (scaled) {
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 			",\"EPHEM2\":{\"IODE\":%u,\"Crs\":%.6e,\"deltan\":%.6e,"
 			"\"M0\":%.11e,\"Cuc\":%.6e,\"e\":%f,\"Cus\":%.6e,"
 			"\"sqrtA\":%.11g,\"toe\":%lu,\"FIT\":%u,\"AODO\":%u}",
@@ -504,7 +735,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
 			(unsigned int)subframe->sub2.fit,
 			(unsigned int)subframe->sub2.u_AODO);
 	} else {
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 			",\"EPHEM2\":{\"IODE\":%u,\"Crs\":%d,\"deltan\":%d,"
 			"\"M0\":%ld,\"Cuc\":%d,\"e\":%ld,\"Cus\":%d,"
 			"\"sqrtA\":%lu,\"toe\":%lu,\"FIT\":%u,\"AODO\":%u}",
@@ -522,7 +753,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
 	}
     } else if ( 3 == subframe->subframe_num ) {
 	if (scaled) {
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 		",\"EPHEM3\":{\"IODE\":%3u,\"IDOT\":%.6g,\"Cic\":%.6e,"
 		"\"Omega0\":%.11e,\"Cis\":%.7g,\"i0\":%.11e,\"Crc\":%.7g,"
 		"\"omega\":%.11e,\"Omegad\":%.6e}",
@@ -536,7 +767,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
 			subframe->sub3.d_omega,
 			subframe->sub3.d_Omegad );
 	} else {
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 		",\"EPHEM3\":{\"IODE\":%u,\"IDOT\":%u,\"Cic\":%u,"
 		"\"Omega0\":%ld,\"Cis\":%d,\"i0\":%ld,\"Crc\":%d,"
 		"\"omega\":%ld,\"Omegad\":%ld}",
@@ -553,7 +784,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
     } else if ( subframe->is_almanac ) {
 	if (scaled) {
 	    /*@-compdef@*/
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 			",\"ALMANAC\":{\"ID\":%d,\"Health\":%u,"
 			"\"e\":%g,\"toa\":%lu,"
 			"\"deltai\":%.10e,\"Omegad\":%.5e,\"sqrtA\":%.10g,"
@@ -572,7 +803,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
 			subframe->sub5.almanac.d_af0,
 			subframe->sub5.almanac.d_af1);
 	} else {
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 			",\"ALMANAC\":{\"ID\":%d,\"Health\":%u,"
 			"\"e\":%u,\"toa\":%u,"
 			"\"deltai\":%d,\"Omegad\":%d,\"sqrtA\":%lu,"
@@ -592,10 +823,9 @@ void json_subframe_dump(const struct gps_data_t *datap,
 			(int)subframe->sub5.almanac.af1);
 	}
     } else if ( 4 == subframe->subframe_num ) {
-	(void)snprintf(buf + len, buflen - len,
+	json_out_printf(out,
 	    ",\"pageid\":%u",
 		       (unsigned int)subframe->pageid);
-	len = strlen(buf);
 	switch (subframe->pageid ) {
 	case 13:
 	case 52:
@@ -603,18 +833,16 @@ void json_subframe_dump(const struct gps_data_t *datap,
 		int i;
 	    /*@+charint@*/
 		/* decoding of ERD to SV is non trivial and not done yet */
-		(void)snprintf(buf + len, buflen - len,
+		json_out_printf(out,
 		    ",\"ERD\":{\"ai\":%u,", subframe->sub4_13.ai);
 
 		/* 1-index loop to construct json, rather than giant snprintf */
 		for(i = 1 ; i <= 30; i++){
-		    len = strlen(buf);
-		    (void)snprintf(buf + len, buflen - len,
+		    json_out_printf(out,
 			"\"ERD%d\":%d,", i, subframe->sub4_13.ERD[i]);
 		}
-		len = strlen(buf)-1;
-		buf[len] = '\0';
-		(void)snprintf(buf + len, buflen - len, "}");
+		json_out_trim(out);
+		JSON_LIT(out, "}");
 		break;
 	    /*@-charint@*/
 	}
@@ -628,13 +856,13 @@ void json_subframe_dump(const struct gps_data_t *datap,
 	    {
 		char buf1[25 * 6];
 		(void)json_stringify(buf1, sizeof(buf1), subframe->sub4_17.str);
-		(void)snprintf(buf + len, buflen - len,
+		json_out_printf(out,
 			       ",\"system_message\":\"%.144s\"", buf1);
 	    }
 	    break;
 	case 56:
 	    if (scaled) {
-		(void)snprintf(buf + len, buflen - len,
+		json_out_printf(out,
 			",\"IONO\":{\"a0\":%.5g,\"a1\":%.5g,\"a2\":%.5g,"
 			"\"a3\":%.5g,\"b0\":%.5g,\"b1\":%.5g,\"b2\":%.5g,"
 			"\"b3\":%.5g,\"A1\":%.11e,\"A0\":%.11e,\"tot\":%.5g,"
@@ -657,7 +885,7 @@ void json_subframe_dump(const struct gps_data_t *datap,
 			    (unsigned int)subframe->sub4_18.DN,
 			    (int)subframe->sub4_18.lsf);
 	    } else {
-		(void)snprintf(buf + len, buflen - len,
+		json_out_printf(out,
 			",\"IONO\":{\"a0\":%d,\"a1\":%d,\"a2\":%d,\"a3\":%d,"
 			"\"b0\":%d,\"b1\":%d,\"b2\":%d,\"b3\":%d,"
 			"\"A1\":%ld,\"A0\":%ld,\"tot\":%u,\"WNt\":%u,"
@@ -684,76 +912,78 @@ void json_subframe_dump(const struct gps_data_t *datap,
 	case 63:
 	{
 	    int i;
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 			   ",\"HEALTH\":{\"data_id\":%d,",
 			   (int)subframe->data_id);
 
 		/* 1-index loop to construct json, rather than giant snprintf */
 		for(i = 1 ; i <= 32; i++){
-		    len = strlen(buf);
-		    (void)snprintf(buf + len, buflen - len,
+		    json_out_printf(out,
 				   "\"SV%d\":%d,",
 				   i, (int)subframe->sub4_25.svf[i]);
 		}
 		for(i = 0 ; i < 8; i++){ /* 0-index */
-		    len = strlen(buf);
-		    (void)snprintf(buf + len, buflen - len,
+		    json_out_printf(out,
 				   "\"SVH%d\":%d,",
 				   i+25, (int)subframe->sub4_25.svhx[i]);
 		}
-		len = strlen(buf)-1;
-		buf[len] = '\0';
-		(void)snprintf(buf + len, buflen - len, "}");
+		json_out_trim(out);
+		JSON_LIT(out, "}");
 
 	    break;
 	    }
 	}
     } else if ( 5 == subframe->subframe_num ) {
-	(void)snprintf(buf + len, buflen - len,
+	json_out_printf(out,
 	    ",\"pageid\":%u",
 		       (unsigned int)subframe->pageid);
-	len = strlen(buf);
 	if ( 51 == subframe->pageid ) {
 	    int i;
 	    /*@+matchanyintegral@*/
 	    /* subframe5, page 25 */
-	    (void)snprintf(buf + len, buflen - len,
+	    json_out_printf(out,
 		",\"HEALTH2\":{\"toa\":%lu,\"WNa\":%u,",
 			   (unsigned long)subframe->sub5_25.l_toa,
 			   (unsigned int)subframe->sub5_25.WNa);
 		/* 1-index loop to construct json */
 		for(i = 1 ; i <= 24; i++){
-		    len = strlen(buf);
-		    (void)snprintf(buf + len, buflen - len,
+		    json_out_printf(out,
 				   "\"SV%d\":%d,", i, (int)subframe->sub5_25.sv[i]);
 		}
-		len = strlen(buf)-1;
-		buf[len] = '\0';
-		(void)snprintf(buf + len, buflen - len, "}");
+		json_out_trim(out);
+		JSON_LIT(out, "}");
 
 	    /*@-matchanyintegral@*/
 	}
     }
     /*@+type@*/
-    (void)strlcat(buf, "}\r\n", buflen);
+    JSON_LIT(out, "}\r\n");
     /*@+compdef@*/
 }
 
+void json_subframe_dump(const struct gps_data_t *datap,
+			/*@out@*/ char buf[], size_t buflen)
+{
+    struct json_out_t out;
+
+    json_out_init(&out, buf, buflen);
+    json_subframe_write(&out, datap);
+}
+
 #if defined(RTCM104V2_ENABLE)
-void json_rtcm2_dump(const struct rtcm2_t *rtcm,
-		     /*@null@*/const char *device,
-		     /*@out@*/char buf[], size_t buflen)
-/* dump the contents of a parsed RTCM104 message as JSON */
+static void json_rtcm2_write(struct json_out_t *out,
+			     const struct rtcm2_t *rtcm,
+			     /*@null@*/const char *device)
+/* append an RTCM2 report */
 {
     /*@-mustfreefresh@*/
     char buf1[JSON_VAL_MAX * 2 + 1];
     unsigned int n;
 
-    (void)snprintf(buf, buflen, "{\"class\":\"RTCM2\",");
+    JSON_LIT(out, "{\"class\":\"RTCM2\",");
     if (device != NULL && device[0] != '\0')
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
-		       "\"device\":\"%s\",", device);
-    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	JSON_TEXT(out, "device", device);
+    json_out_printf(out,
 		   "\"type\":%u,\"station_id\":%u,\"zcount\":%0.1f,\"seqnum\":%u,\"length\":%u,\"station_health\":%u,",
 		   rtcm->type, rtcm->refstaid, rtcm->zcount, rtcm->seqnum,
 		   rtcm->length, rtcm->stathlth);
@@ -761,23 +991,22 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
     switch (rtcm->type) {
     case 1:
     case 9:
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (n = 0; n < rtcm->gps_ranges.nentries; n++) {
 	    const struct gps_rangesat_t *rsp = &rtcm->gps_ranges.sat[n];
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"udre\":%u,\"iod\":%u,\"prc\":%0.3f,\"rrc\":%0.3f},",
 			   rsp->ident,
 			   rsp->udre, rsp->iod,
 			   rsp->prc, rsp->rrc);
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 3:
 	if (rtcm->ecef.valid)
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"x\":%.2f,\"y\":%.2f,\"z\":%.2f,",
 			   rtcm->ecef.x, rtcm->ecef.y, rtcm->ecef.z);
 	break;
@@ -791,7 +1020,7 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 	     * actually documented in RTCM 2.1.
 	     */
 	    static char *navsysnames[] = { "GPS", "GLONASS", "GALILEO" };
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"system\":\"%s\",\"sense\":%1d,\"datum\":\"%s\",\"dx\":%.1f,\"dy\":%.1f,\"dz\":%.1f,",
 			   rtcm->reference.system >= NITEMS(navsysnames)
 			   ? "UNKNOWN"
@@ -804,10 +1033,10 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 	break;
 
     case 5:
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (n = 0; n < rtcm->conhealth.nentries; n++) {
 	    const struct consat_t *csp = &rtcm->conhealth.sat[n];
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"iodl\":%s,\"health\":%1u,\"snr\":%d,\"health_en\":%s,\"new_data\":%s,\"los_warning\":%s,\"tou\":%u},",
 			   csp->ident,
 			   JSON_BOOL(csp->iodl),
@@ -817,19 +1046,18 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 			   JSON_BOOL(csp->new_data),
 			   JSON_BOOL(csp->los_warning), csp->tou);
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 6:			/* NOP msg */
 	break;
 
     case 7:
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (n = 0; n < rtcm->almanac.nentries; n++) {
 	    const struct station_t *ssp = &rtcm->almanac.station[n];
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"lat\":%.4f,\"lon\":%.4f,\"range\":%u,\"frequency\":%.1f,\"health\":%u,\"station_id\":%u,\"bitrate\":%u},",
 			   ssp->latitude,
 			   ssp->longitude,
@@ -837,13 +1065,12 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 			   ssp->frequency,
 			   ssp->health, ssp->station_id, ssp->bitrate);
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 13:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"status\":%s,\"rangeflag\":%s,"
 		       "\"lat\":%.2f,\"lon\":%.2f,\"range\":%u,",
 		       JSON_BOOL(rtcm->xmitter.status),
@@ -854,7 +1081,7 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 	break;
 
     case 14:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"week\":%u,\"hour\":%u,\"leapsecs\":%u,",
 		       rtcm->gpstime.week,
 		       rtcm->gpstime.hour,
@@ -862,17 +1089,17 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 	break;
 
     case 16:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"message\":\"%s\"", json_stringify(buf1,
 							    sizeof(buf1),
 							    rtcm->message));
 	break;
 
     case 31:
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (n = 0; n < rtcm->glonass_ranges.nentries; n++) {
 	    const struct glonass_rangesat_t *rsp = &rtcm->glonass_ranges.sat[n];
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"udre\":%u,\"change\":%s,\"tod\":%u,\"prc\":%0.3f,\"rrc\":%0.3f},",
 			   rsp->ident,
 			   rsp->udre,
@@ -880,54 +1107,61 @@ void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 			   rsp->tod,
 			   rsp->prc, rsp->rrc);
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     default:
-	(void)strlcat(buf, "\"data\":[", buflen);
+	JSON_LIT(out, "\"data\":[");
 	for (n = 0; n < rtcm->length; n++)
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"0x%08x\",", rtcm->words[n]);
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
     }
 
-    if (buf[strlen(buf) - 1] == ',')
-	buf[strlen(buf) - 1] = '\0';
-    (void)strlcat(buf, "}\r\n", buflen);
+    json_out_trim(out);
+    JSON_LIT(out, "}\r\n");
     /*@+mustfreefresh@*/
 }
-#endif /* defined(RTCM104V2_ENABLE) */
 
-#if defined(RTCM104V3_ENABLE)
-void json_rtcm3_dump(const struct rtcm3_t *rtcm,
+void json_rtcm2_dump(const struct rtcm2_t *rtcm,
 		     /*@null@*/const char *device,
 		     /*@out@*/char buf[], size_t buflen)
-/* dump the contents of a parsed RTCM104v3 message as JSON */
+/* dump the contents of a parsed RTCM104 message as JSON */
+{
+    struct json_out_t out;
+
+    json_out_init(&out, buf, buflen);
+    json_rtcm2_write(&out, rtcm, device);
+}
+#endif /* defined(RTCM104V2_ENABLE) */
+
+#if defined(RTCM104V3_ENABLE)
+static void json_rtcm3_write(struct json_out_t *out,
+			     const struct rtcm3_t *rtcm,
+			     /*@null@*/const char *device)
+/* append an RTCM3 report */
 {
     /*@-mustfreefresh@*/
     char buf1[JSON_VAL_MAX * 2 + 1];
     unsigned short i;
     unsigned int n;
 
-    (void)snprintf(buf, buflen, "{\"class\":\"RTCM3\",");
+    JSON_LIT(out, "{\"class\":\"RTCM3\",");
     if (device != NULL && device[0] != '\0')
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
-		       "\"device\":\"%s\",", device);
-    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	JSON_TEXT(out, "device", device);
+    json_out_printf(out,
 		   "\"type\":%u,", rtcm->type);
-    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+    json_out_printf(out,
 		   "\"length\":%u,", rtcm->length);
 
 #define CODE(x) (unsigned int)(x)
 #define INT(x) (unsigned int)(x)
     switch (rtcm->type) {
     case 1001:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\",",
 		       rtcm->rtcmtypes.rtcm3_1001.header.station_id,
@@ -935,10 +1169,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1001.header.sync),
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1001.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1001.header.interval);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1001.header.satcount; i++) {
 #define R1001 rtcm->rtcmtypes.rtcm3_1001.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"ind\":%u,\"prange\":%8.2f,"
 			   "\"delta\":%6.4f,\"lockt\":%u},",
 			   R1001.ident,
@@ -948,13 +1182,12 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   INT(R1001.L1.locktime));
 #undef R1001
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1002:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\",",
 		       rtcm->rtcmtypes.rtcm3_1002.header.station_id,
@@ -962,10 +1195,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1002.header.sync),
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1002.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1002.header.interval);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1002.header.satcount; i++) {
 #define R1002 rtcm->rtcmtypes.rtcm3_1002.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"ind\":%u,\"prange\":%8.2f,"
 			   "\"delta\":%6.4f,\"lockt\":%u,\"amb\":%u,"
 			   "\"CNR\":%.2f},",
@@ -978,13 +1211,12 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   R1002.L1.CNR);
 #undef R1002
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1003:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\",",
 		       rtcm->rtcmtypes.rtcm3_1003.header.station_id,
@@ -992,10 +1224,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1003.header.sync),
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1003.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1003.header.interval);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1003.header.satcount; i++) {
 #define R1003 rtcm->rtcmtypes.rtcm3_1003.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,"
 			   "\"L1\":{\"ind\":%u,\"prange\":%8.2f,"
 			   "\"delta\":%6.4f,\"lockt\":%u},"
@@ -1013,13 +1245,12 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   INT(R1003.L2.locktime));
 #undef R1003
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1004:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\",",
 		       rtcm->rtcmtypes.rtcm3_1004.header.station_id,
@@ -1027,10 +1258,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1004.header.sync),
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1004.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1004.header.interval);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1004.header.satcount; i++) {
 #define R1004 rtcm->rtcmtypes.rtcm3_1004.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,"
 			   "\"L1\":{\"ind\":%u,\"prange\":%8.2f,"
 			   "\"delta\":%6.4f,\"lockt\":%u,"
@@ -1053,24 +1284,22 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   R1004.L2.CNR);
 #undef R1004
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1005:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"system\":[",
 		       rtcm->rtcmtypes.rtcm3_1005.station_id);
 	if ((rtcm->rtcmtypes.rtcm3_1005.system & 0x04)!=0)
-	    (void)strlcat(buf, "\"GPS\",", buflen);
+	    JSON_LIT(out, "\"GPS\",");
 	if ((rtcm->rtcmtypes.rtcm3_1005.system & 0x02)!=0)
-	    (void)strlcat(buf, "\"GLONASS\",", buflen - strlen(buf));
+	    JSON_LIT(out, "\"GLONASS\",");
 	if ((rtcm->rtcmtypes.rtcm3_1005.system & 0x01)!=0)
-	    (void)strlcat(buf, "\"GALILEO\",", buflen);
-	if (buf[strlen(buf)-1] == ',')
-	    buf[strlen(buf)-1] = '\0';
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    JSON_LIT(out, "\"GALILEO\",");
+	json_out_trim(out);
+	json_out_printf(out,
 		       "],\"refstation\":%s,\"sro\":%s,"
 		       "\"x\":%.4f,\"y\":%.4f,\"z\":%.4f,",
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1005.reference_station),
@@ -1081,18 +1310,17 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 	break;
 
     case 1006:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"system\":[",
 		       rtcm->rtcmtypes.rtcm3_1006.station_id);
 	if ((rtcm->rtcmtypes.rtcm3_1006.system & 0x04)!=0)
-	    (void)strlcat(buf, "\"GPS\",", buflen);
+	    JSON_LIT(out, "\"GPS\",");
 	if ((rtcm->rtcmtypes.rtcm3_1006.system & 0x02)!=0)
-	    (void)strlcat(buf, "\"GLONASS\",", buflen);
+	    JSON_LIT(out, "\"GLONASS\",");
 	if ((rtcm->rtcmtypes.rtcm3_1006.system & 0x01)!=0)
-	    (void)strlcat(buf, "\"GALILEO\",", buflen);
-	if (buf[strlen(buf)-1] == ',')
-	    buf[strlen(buf)-1] = '\0';
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    JSON_LIT(out, "\"GALILEO\",");
+	json_out_trim(out);
+	json_out_printf(out,
 		       "],\"refstation\":%s,\"sro\":%s,"
 		       "\"x\":%.4f,\"y\":%.4f,\"z\":%.4f,",
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1006.reference_station),
@@ -1100,13 +1328,13 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       rtcm->rtcmtypes.rtcm3_1006.ecef_x,
 		       rtcm->rtcmtypes.rtcm3_1006.ecef_y,
 		       rtcm->rtcmtypes.rtcm3_1006.ecef_z);
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"h\":%.4f,",
 		       rtcm->rtcmtypes.rtcm3_1006.height);
 	break;
 
     case 1007:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"desc\":\"%s\",\"setup_id\":%u",
 		       rtcm->rtcmtypes.rtcm3_1007.station_id,
 		       rtcm->rtcmtypes.rtcm3_1007.descriptor,
@@ -1114,7 +1342,7 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 	break;
 
     case 1008:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"desc\":\"%s\","
 		       "\"setup_id\":%u,\"serial\":\"%s\"",
 		       rtcm->rtcmtypes.rtcm3_1008.station_id,
@@ -1124,7 +1352,7 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 	break;
 
     case 1009:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\","
 		       "\"satcount\":\"%u\",",
@@ -1134,10 +1362,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1009.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1009.header.interval,
 		       rtcm->rtcmtypes.rtcm3_1009.header.satcount);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1009.header.satcount; i++) {
 #define R1009 rtcm->rtcmtypes.rtcm3_1009.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"ind\":%u,\"channel\":%u,"
 			   "\"prange\":%8.2f,\"delta\":%6.4f,\"lockt\":%u},",
 			   R1009.ident,
@@ -1148,13 +1376,12 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   INT(R1009.L1.locktime));
 #undef R1009
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1010:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\",",
 		       rtcm->rtcmtypes.rtcm3_1010.header.station_id,
@@ -1162,10 +1389,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1010.header.sync),
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1010.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1010.header.interval);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1010.header.satcount; i++) {
 #define R1010 rtcm->rtcmtypes.rtcm3_1010.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"ind\":%u,\"channel\":%u,"
 			   "\"prange\":%8.2f,\"delta\":%6.4f,\"lockt\":%u,"
 			   "\"amb\":%u,\"CNR\":%.2f},",
@@ -1179,13 +1406,12 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   R1010.L1.CNR);
 #undef R1010
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1011:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\",",
 		       rtcm->rtcmtypes.rtcm3_1011.header.station_id,
@@ -1193,10 +1419,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1011.header.sync),
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1011.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1011.header.interval);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1011.header.satcount; i++) {
 #define R1011 rtcm->rtcmtypes.rtcm3_1011.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"channel\":%u,"
 			   "\"L1\":{\"ind\":%u,"
 			   "\"prange\":%8.2f,\"delta\":%6.4f,\"lockt\":%u},"
@@ -1214,13 +1440,12 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   INT(R1011.L2.locktime));
 #undef R1011
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1012:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"tow\":%d,\"sync\":\"%s\","
 		       "\"smoothing\":\"%s\",\"interval\":\"%u\",",
 		       rtcm->rtcmtypes.rtcm3_1012.header.station_id,
@@ -1228,10 +1453,10 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1012.header.sync),
 		       JSON_BOOL(rtcm->rtcmtypes.rtcm3_1012.header.smoothing),
 		       rtcm->rtcmtypes.rtcm3_1012.header.interval);
-	(void)strlcat(buf, "\"satellites\":[", buflen);
+	JSON_LIT(out, "\"satellites\":[");
 	for (i = 0; i < rtcm->rtcmtypes.rtcm3_1012.header.satcount; i++) {
 #define R1012 rtcm->rtcmtypes.rtcm3_1012.rtk_data[i]
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"ident\":%u,\"channel\":%u,"
 			   "\"L1\":{\"ind\":%u,\"prange\":%8.2f,"
 			   "\"delta\":%6.4f,\"lockt\":%u,\"amb\":%u,"
@@ -1255,13 +1480,12 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 			   R1012.L2.CNR);
 #undef R1012
 	}
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
 
     case 1013:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"mjd\":%u,\"sec\":%u,"
 		       "\"leapsecs\":%u,",
 		       rtcm->rtcmtypes.rtcm3_1013.station_id,
@@ -1269,7 +1493,7 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 		       rtcm->rtcmtypes.rtcm3_1013.sod,
 		       INT(rtcm->rtcmtypes.rtcm3_1013.leapsecs));
 	for (i = 0; i < (unsigned short)rtcm->rtcmtypes.rtcm3_1013.ncount; i++)
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "{\"id\":%u,\"sync\":\"%s\",\"interval\":%u}",
 			   rtcm->rtcmtypes.rtcm3_1013.announcements[i].id,
 			   JSON_BOOL(rtcm->rtcmtypes.rtcm3_1013.
@@ -1279,7 +1503,7 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 	break;
 
     case 1014:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"netid\":%u,\"subnetid\":%u,\"statcount\":%u"
 		       "\"master\":%u,\"aux\":%u,\"lat\":%f,\"lon\":%f,\"alt\":%f,",
 		       rtcm->rtcmtypes.rtcm3_1014.network_id,
@@ -1312,7 +1536,7 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 
     case 1029:
 	/*@-formatcode@*//* splint has a bug */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"mjd\":%u,\"sec\":%u,"
 		       "\"len\":%zd,\"units\":%zd,\"msg\":\"%s\",",
 		       rtcm->rtcmtypes.rtcm3_1029.station_id,
@@ -1326,7 +1550,7 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 	break;
 
     case 1033:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"station_id\":%u,\"desc\":\"%s\","
 		       "\"setup_id\":%u,\"serial\":\"%s\","
 		       "\"receiver\":%s,\"firmware\":\"%s\"",
@@ -1339,29 +1563,39 @@ void json_rtcm3_dump(const struct rtcm3_t *rtcm,
 	break;
 
     default:
-	(void)strlcat(buf, "\"data\":[", buflen);
+	JSON_LIT(out, "\"data\":[");
 	for (n = 0; n < rtcm->length; n++)
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"0x%02x\",",(unsigned int)rtcm->rtcmtypes.data[n]);
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "]", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "]");
 	break;
     }
 
-    if (buf[strlen(buf) - 1] == ',')
-	buf[strlen(buf) - 1] = '\0';
-    (void)strlcat(buf, "}\r\n", buflen);
+    json_out_trim(out);
+    JSON_LIT(out, "}\r\n");
     /*@+mustfreefresh@*/
 #undef CODE
 #undef INT
 }
+
+void json_rtcm3_dump(const struct rtcm3_t *rtcm,
+		     /*@null@*/const char *device,
+		     /*@out@*/char buf[], size_t buflen)
+/* dump the contents of a parsed RTCM104v3 message as JSON */
+{
+    struct json_out_t out;
+
+    json_out_init(&out, buf, buflen);
+    json_rtcm3_write(&out, rtcm, device);
+}
 #endif /* defined(RTCM104V3_ENABLE) */
 
 #if defined(AIVDM_ENABLE)
-void json_aivdm_dump(const struct ais_t *ais,
-		     /*@null@*/const char *device, bool scaled,
-		     /*@out@*/char *buf, size_t buflen)
+static void json_aivdm_write(struct json_out_t *out,
+			     const struct ais_t *ais,
+			     /*@null@*/const char *device, bool scaled)
+/* append an AIS report */
 {
     char buf1[JSON_VAL_MAX * 2 + 1];
     char buf2[JSON_VAL_MAX * 2 + 1];
@@ -1665,11 +1899,10 @@ void json_aivdm_dump(const struct ais_t *ais,
 	"Reserved for future use",
     };
 
-    (void)snprintf(buf, buflen, "{\"class\":\"AIS\",");
+    JSON_LIT(out, "{\"class\":\"AIS\",");
     if (device != NULL && device[0] != '\0')
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
-		       "\"device\":\"%s\",", device);
-    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	JSON_TEXT(out, "device", device);
+    json_out_printf(out,
 		   "\"type\":%u,\"repeat\":%u,\"mmsi\":%u,\"scaled\":%s,",
 		   ais->type, ais->repeat, ais->mmsi, JSON_BOOL(scaled));
     /*@ -formatcode -mustfreefresh @*/
@@ -1710,7 +1943,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 		(void)snprintf(speedlegend, sizeof(speedlegend),
 			       "%.1f", ais->type1.speed / 10.0);
 
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"status\":\"%u\",\"status_text\":\"%s\","
 			   "\"turn\":%s,\"speed\":%s,"
 			   "\"accuracy\":%s,\"lon\":%.4f,\"lat\":%.4f,"
@@ -1729,7 +1962,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   ais->type1.maneuver,
 			   JSON_BOOL(ais->type1.raim), ais->type1.radio);
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"status\":%u,\"status_text\":\"%s\","
 			   "\"turn\":%d,\"speed\":%u,"
 			   "\"accuracy\":%s,\"lon\":%d,\"lat\":%d,"
@@ -1755,7 +1988,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	if (scaled) {
 	    // The use of %u instead of %04u for the year is to allow
 	    // out-of-band year values.
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"timestamp\":\"%04u-%02u-%02uT%02u:%02u:%02uZ\","
 			   "\"accuracy\":%s,\"lon\":%.4f,\"lat\":%.4f,"
 			   "\"epfd\":%u,\"epfd_text\":\"%s\","
@@ -1773,7 +2006,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   EPFD_DISPLAY(ais->type4.epfd),
 			   JSON_BOOL(ais->type4.raim), ais->type4.radio);
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"timestamp\":\"%04u-%02u-%02uT%02u:%02u:%02uZ\","
 			   "\"accuracy\":%s,\"lon\":%d,\"lat\":%d,"
 			   "\"epfd\":%u,\"epfd_text\":\"%s\","
@@ -1796,7 +2029,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	/* some fields have beem merged to an ISO8601 partial date */
 	if (scaled) {
             /* *INDENT-OFF* */
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"imo\":%u,\"ais_version\":%u,\"callsign\":\"%s\","
 			   "\"shipname\":\"%s\","
 			   "\"shiptype\":%u,\"shiptype_text\":\"%s\","
@@ -1827,7 +2060,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   ais->type5.dte);
             /* *INDENT-ON* */
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"imo\":%u,\"ais_version\":%u,\"callsign\":\"%s\","
 			   "\"shipname\":\"%s\","
 			   "\"shiptype\":%u,\"shiptype_text\":\"%s\","
@@ -1862,7 +2095,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	}
 	break;
     case 6:			/* Binary Message */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"seqno\":%u,\"dest_mmsi\":%u,"
 		       "\"retransmit\":%s,\"dac\":%u,\"fid\":%u,",
 		       ais->type6.seqno,
@@ -1871,7 +2104,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 		       ais->type6.dac,
 		       ais->type6.fid);
 	if (!ais->type6.structured) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"data\":\"%zd:%s\"}\r\n",
 			   ais->type6.bitcount,
 			   json_stringify(buf1, sizeof(buf1),
@@ -1883,7 +2116,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	if (ais->type6.dac == 200) {
 	    switch (ais->type6.fid) {
 	    case 21:
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"country\":\"%s\",\"locode\":\"%s\",\"section\":\"%s\",\"terminal\":\"%s\",\"hectometre\":\"%s\",\"eta\":\"%u-%uT%u:%u\",\"tugs\":%u,\"airdraught\":%u}",
 		    ais->type6.dac200fid21.country,
 		    ais->type6.dac200fid21.locode,
@@ -1898,7 +2131,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 		    ais->type6.dac200fid21.airdraught);
 		break;
 	    case 22:
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"country\":\"%s\",\"locode\":\"%s\","
 			       "\"section\":\"%s\","
 			       "\"terminal\":\"%s\",\"hectometre\":\"%s\","
@@ -1917,7 +2150,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       rta_status[ais->type6.dac200fid22.status]);
 		break;
 	    case 55:
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 		    "\"crew\":%u,\"passengers\":%u,\"personnel\":%u}",
 
 		    ais->type6.dac200fid55.crew,
@@ -1929,37 +2162,37 @@ void json_aivdm_dump(const struct ais_t *ais,
 	else if (ais->type6.dac == 235 || ais->type6.dac == 250) {
 	    switch (ais->type6.fid) {
 	    case 10:	/* GLA - AtoN monitoring data */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"off_pos\":%s,\"alarm\":%s,"
 			       "\"stat_ext\":%u,",
 			       JSON_BOOL(ais->type6.dac235fid10.off_pos),
 			       JSON_BOOL(ais->type6.dac235fid10.alarm),
 			       ais->type6.dac235fid10.stat_ext);
 		if (scaled && ais->type6.dac235fid10.ana_int != 0)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"ana_int\":%.2f,",
 				   ais->type6.dac235fid10.ana_int*0.05);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"ana_int\":%u,",
 				   ais->type6.dac235fid10.ana_int);
 		if (scaled && ais->type6.dac235fid10.ana_ext1 != 0)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"ana_ext1\":%.2f,",
 				   ais->type6.dac235fid10.ana_ext1*0.05);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"ana_ext1\":%u,",
 				   ais->type6.dac235fid10.ana_ext1);
 		if (scaled && ais->type6.dac235fid10.ana_ext2 != 0)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"ana_ext2\":%.2f,",
 				   ais->type6.dac235fid10.ana_ext2*0.05);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"ana_ext2\":%u,",
 				   ais->type6.dac235fid10.ana_ext2);
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"racon\":%u,"
 			       "\"racon_text\":\"%s\","
 			       "\"light\":%u,"
@@ -1968,9 +2201,8 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       racon_status[ais->type6.dac235fid10.racon],
 			       ais->type6.dac235fid10.light,
 			       light_status[ais->type6.dac235fid10.light]);
-		if (buf[strlen(buf) - 1] == ',')
-		    buf[strlen(buf)-1] = '\0';
-		(void)strlcat(buf, "}\r\n", buflen);
+		json_out_trim(out);
+		JSON_LIT(out, "}\r\n");
 		break;
 	    }
 	}
@@ -1979,7 +2211,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	    switch (ais->type6.fid) {
 	    case 12:	/* IMO236 -Dangerous cargo indication */
 		/* some fields have beem merged to an ISO8601 partial date */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"lastport\":\"%s\",\"departure\":\"%02u-%02uT%02u:%02uZ\","
 			       "\"nextport\":\"%s\",\"eta\":\"%02u-%02uT%02u:%02uZ\","
 			       "\"dangerous\":\"%s\",\"imdcat\":\"%s\","
@@ -2005,16 +2237,16 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type6.dac1fid12.unit);
 		break;
 	    case 15:	/* IMO236 - Extended Ship Static and Voyage Related Data */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 		    "\"airdraught\":%u}\r\n",
 		    ais->type6.dac1fid15.airdraught);
 		break;
 	    case 16:	/* IMO236 - Number of persons on board */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"persons\":%u}\t\n", ais->type6.dac1fid16.persons);
 		break;
 	    case 18:	/* IMO289 - Clearance time to enter port */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"linkage\":%u,\"arrival\":\"%02u-%02uT%02u:%02uZ\",\"portname\":\"%s\",\"destination\":\"%s\",",
 			       ais->type6.dac1fid18.linkage,
 			       ais->type6.dac1fid18.month,
@@ -2026,18 +2258,18 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       json_stringify(buf2, sizeof(buf2),
 					      ais->type6.dac1fid18.destination));
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"lon\":%.3f,\"lat\":%.3f}\r\n",
 				   ais->type6.dac1fid18.lon/AIS_LATLON3_DIV,
 				   ais->type6.dac1fid18.lat/AIS_LATLON3_DIV);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 			       "\"lon\":%d,\"lat\":%d}\r\n",
 			       ais->type6.dac1fid18.lon,
 			       ais->type6.dac1fid18.lat);
 		break;
 	    case 20:        /* IMO289 - Berthing Data */
-                (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+                json_out_printf(out,
 			       "\"linkage\":%u,\"berth_length\":%u,"
 			       "\"position\":%u,\"position_text\":\"%s\","
 			       "\"arrival\":\"%u-%uT%u:%u\","
@@ -2092,7 +2324,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       json_stringify(buf1, sizeof(buf1),
 					      ais->type6.dac1fid20.berth_name));
             if (scaled)
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"berth_lon\":%.3f,"
 			       "\"berth_lat\":%.3f,"
 			       "\"berth_depth\":%.1f}\r\n",
@@ -2100,7 +2332,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type6.dac1fid20.berth_lat / AIS_LATLON3_DIV,
 			       ais->type6.dac1fid20.berth_depth * 0.1);
             else
-                (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+                json_out_printf(out,
 			       "\"berth_lon\":%d,"
 			       "\"berth_lat\":%d,"
 			       "\"berth_depth\":%u}\r\n",
@@ -2111,22 +2343,21 @@ void json_aivdm_dump(const struct ais_t *ais,
 	    case 23:    /* IMO289 - Area notice - addressed */
 		break;
 	    case 25:	/* IMO289 - Dangerous cargo indication */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"unit\":%u,\"amount\":%u,\"cargos\":[",
 			       ais->type6.dac1fid25.unit,
 			       ais->type6.dac1fid25.amount);
 		for (i = 0; i < (int)ais->type6.dac1fid25.ncargos; i++)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "{\"code\":%u,\"subtype\":%u},",
 
 				   ais->type6.dac1fid25.cargos[i].code,
 				   ais->type6.dac1fid25.cargos[i].subtype);
-		if (buf[strlen(buf) - 1] == ',')
-		    buf[strlen(buf) - 1] = '\0';
-		(void)strlcat(buf, "]}\r\n", buflen);
+		json_out_trim(out);
+		JSON_LIT(out, "]}\r\n");
 		break;
 	    case 28:	/* IMO289 - Route info - addressed */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"linkage\":%u,\"sender\":%u,"
 			       "\"rtype\":%u,"
 			       "\"rtype_text\":\"%s\","
@@ -2143,22 +2374,21 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type6.dac1fid28.duration);
 		for (i = 0; i < ais->type6.dac1fid28.waycount; i++) {
 		    if (scaled)
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "{\"lon\":%.4f,\"lat\":%.4f},",
 			    ais->type6.dac1fid28.waypoints[i].lon / AIS_LATLON4_DIV,
 			    ais->type6.dac1fid28.waypoints[i].lat / AIS_LATLON4_DIV);
 		    else
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "{\"lon\":%d,\"lat\":%d},",
 			    ais->type6.dac1fid28.waypoints[i].lon,
 			    ais->type6.dac1fid28.waypoints[i].lat);
 		}
-		if (buf[strlen(buf) - 1] == ',')
-		    buf[strlen(buf)-1] = '\0';
-		(void)strlcat(buf, "]}\r\n", buflen);
+		json_out_trim(out);
+		JSON_LIT(out, "]}\r\n");
 		break;
 	    case 30:	/* IMO289 - Text description - addressed */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 		       "\"linkage\":%u,\"text\":\"%s\"}\r\n",
 		       ais->type6.dac1fid30.linkage,
 		       json_stringify(buf1, sizeof(buf1),
@@ -2166,23 +2396,23 @@ void json_aivdm_dump(const struct ais_t *ais,
 		break;
 	    case 14:	/* IMO236 - Tidal Window */
 	    case 32:	/* IMO289 - Tidal Window */
-	      (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	      json_out_printf(out,
 		  "\"month\":%u,\"day\":%u,\"tidals\":[",
 		  ais->type6.dac1fid32.month,
 		  ais->type6.dac1fid32.day);
 	      for (i = 0; i < ais->type6.dac1fid32.ntidals; i++) {
 		  const struct tidal_t *tp =  &ais->type6.dac1fid32.tidals[i];
 		  if (scaled)
-		      (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		      json_out_printf(out,
 			  "{\"lon\":%.3f,\"lat\":%.3f,",
 			  tp->lon / AIS_LATLON3_DIV,
 			  tp->lat / AIS_LATLON3_DIV);
 		  else
-		      (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		      json_out_printf(out,
 			  "{\"lon\":%d,\"lat\":%d,",
 			  tp->lon,
 			  tp->lat);
-		  (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		  json_out_printf(out,
 		      "\"from_hour\":%u,\"from_min\":%u,\"to_hour\":%u,\"to_min\":%u,\"cdir\":%u,",
 		      tp->from_hour,
 		      tp->from_min,
@@ -2190,33 +2420,32 @@ void json_aivdm_dump(const struct ais_t *ais,
 		      tp->to_min,
 		      tp->cdir);
 		  if (scaled)
-		      (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		      json_out_printf(out,
 			  "\"cspeed\":%.1f},",
 			  tp->cspeed / 10.0);
 		  else
-		      (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		      json_out_printf(out,
 			  "\"cspeed\":%u},",
 			  tp->cspeed);
 	      }
-	      if (buf[strlen(buf) - 1] == ',')
-		  buf[strlen(buf)-1] = '\0';
-	      (void)strlcat(buf, "]}\r\n", buflen);
+	      json_out_trim(out);
+	      JSON_LIT(out, "]}\r\n");
 	      break;
 	    }
 	}
 	break;
     case 7:			/* Binary Acknowledge */
     case 13:			/* Safety Related Acknowledge */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"mmsi1\":%u,\"mmsi2\":%u,\"mmsi3\":%u,\"mmsi4\":%u}\r\n",
 		       ais->type7.mmsi1,
 		       ais->type7.mmsi2, ais->type7.mmsi3, ais->type7.mmsi4);
 	break;
     case 8:			/* Binary Broadcast Message */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"dac\":%u,\"fid\":%u,",ais->type8.dac, ais->type8.fid);
 	if (!ais->type8.structured) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"data\":\"%zd:%s\"}\r\n",
 			   ais->type8.bitcount,
 			   json_stringify(buf1, sizeof(buf1),
@@ -2254,16 +2483,16 @@ void json_aivdm_dump(const struct ais_t *ais,
 		/* some fields have been merged to an ISO8601 partial date */
 		/* layout is almost identical to FID=31 from IMO289 */
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"lat\":%.3f,\"lon\":%.3f,",
 				   ais->type8.dac1fid11.lat / AIS_LATLON3_DIV,
 				   ais->type8.dac1fid11.lon / AIS_LATLON3_DIV);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"lat\":%d,\"lon\":%d,",
 				   ais->type8.dac1fid11.lat,
 				   ais->type8.dac1fid11.lon);
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"timestamp\":\"%02uT%02u:%02uZ\","
 			       "\"wspeed\":%u,\"wgust\":%u,\"wdir\":%u,"
 			       "\"wgustdir\":%u,\"humidity\":%u,",
@@ -2276,7 +2505,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type8.dac1fid11.wgustdir,
 			       ais->type8.dac1fid11.humidity);
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"airtemp\":%.1f,\"dewpoint\":%.1f,"
 				   "\"pressure\":%u,\"pressuretend\":\"%s\",",
 				   (ais->type8.dac1fid11.airtemp - DAC1FID11_AIRTEMP_OFFSET) / DAC1FID11_AIRTEMP_DIV,
@@ -2284,7 +2513,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   ais->type8.dac1fid11.pressure - DAC1FID11_PRESSURE_OFFSET,
 				   trends[ais->type8.dac1fid11.pressuretend]);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"airtemp\":%u,\"dewpoint\":%u,"
 				   "\"pressure\":%u,\"pressuretend\":%u,",
 				   ais->type8.dac1fid11.airtemp,
@@ -2293,24 +2522,24 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   ais->type8.dac1fid11.pressuretend);
 
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"visibility\":%.1f,",
 				   ais->type8.dac1fid11.visibility / DAC1FID11_VISIBILITY_DIV);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"visibility\":%u,",
 				   ais->type8.dac1fid11.visibility);
 		if (!scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"waterlevel\":%d,",
 				   ais->type8.dac1fid11.waterlevel);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"waterlevel\":%.1f,",
 				   (ais->type8.dac1fid11.waterlevel - DAC1FID11_WATERLEVEL_OFFSET) / DAC1FID11_WATERLEVEL_DIV);
 
 		if (scaled) {
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"leveltrend\":\"%s\","
 				   "\"cspeed\":%.1f,\"cdir\":%u,"
 				   "\"cspeed2\":%.1f,\"cdir2\":%u,\"cdepth2\":%u,"
@@ -2343,7 +2572,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   ais->type8.dac1fid11.ice,
 				   ice[ais->type8.dac1fid11.ice]);
 		} else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"leveltrend\":%u,"
 				   "\"cspeed\":%u,\"cdir\":%u,"
 				   "\"cspeed2\":%u,\"cdir2\":%u,\"cdepth2\":%u,"
@@ -2375,10 +2604,10 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   ais->type8.dac1fid11.salinity,
 				   ais->type8.dac1fid11.ice,
 				   ice[ais->type8.dac1fid11.ice]);
-		(void)strlcat(buf, "}\r\n", buflen);
+		JSON_LIT(out, "}\r\n");
 		break;
 	    case 13:        /* IMO236 - Fairway closed */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"reason\":\"%s\",\"closefrom\":\"%s\","
 			       "\"closeto\":\"%s\",\"radius\":%u,"
 			       "\"extunit\":%u,"
@@ -2402,70 +2631,69 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type8.dac1fid13.tminute);
 		break;
 	    case 15:        /* IMO236 - Extended ship and voyage */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"airdraught\":%u}\r\n",
 			       ais->type8.dac1fid15.airdraught);
 		break;
 	    case 16:	/* IMO289 - Number of persons on board */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"persons\":%u}\t\n", ais->type6.dac1fid16.persons);
 		break;
 	    case 17:        /* IMO289 - VTS-generated/synthetic targets */
-		(void)strlcat(buf, "\"targets\":[", buflen);
+		JSON_LIT(out, "\"targets\":[");
 		for (i = 0; i < ais->type8.dac1fid17.ntargets; i++) {
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "{\"idtype\":%u,\"idtype_text\":\"%s\",",
 				   ais->type8.dac1fid17.targets[i].idtype,
 				   idtypes[ais->type8.dac1fid17.targets[i].idtype]);
 		    switch (ais->type8.dac1fid17.targets[i].idtype) {
 		    case DAC1FID17_IDTYPE_MMSI:
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "\"%s\":\"%u\",",
 			    idtypes[ais->type8.dac1fid17.targets[i].idtype],
 			    ais->type8.dac1fid17.targets[i].id.mmsi);
 			break;
 		    case DAC1FID17_IDTYPE_IMO:
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "\"%s\":\"%u\",",
 			    idtypes[ais->type8.dac1fid17.targets[i].idtype],
 			    ais->type8.dac1fid17.targets[i].id.imo);
 			break;
 		    case DAC1FID17_IDTYPE_CALLSIGN:
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "\"%s\":\"%s\",",
 			    idtypes[ais->type8.dac1fid17.targets[i].idtype],
 			    json_stringify(buf1, sizeof(buf1),
 					   ais->type8.dac1fid17.targets[i].id.callsign));
 			break;
 		    default:
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "\"%s\":\"%s\",",
 			    idtypes[ais->type8.dac1fid17.targets[i].idtype],
 			    json_stringify(buf1, sizeof(buf1),
 					   ais->type8.dac1fid17.targets[i].id.other));
 		    }
 		    if (scaled)
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "\"lat\":%.3f,\"lon\":%.3f,",
 			    ais->type8.dac1fid17.targets[i].lat / AIS_LATLON3_DIV,
 			    ais->type8.dac1fid17.targets[i].lon / AIS_LATLON3_DIV);
 		    else
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "\"lat\":%d,\"lon\":%d,",
 			    ais->type8.dac1fid17.targets[i].lat,
 			    ais->type8.dac1fid17.targets[i].lon);
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 			"\"course\":%u,\"second\":%u,\"speed\":%u},",
 			ais->type8.dac1fid17.targets[i].course,
 			ais->type8.dac1fid17.targets[i].second,
 			ais->type8.dac1fid17.targets[i].speed);
 		}
-		if (buf[strlen(buf) - 1] == ',')
-		    buf[strlen(buf) - 1] = '\0';
-		(void)strlcat(buf, "]}\r\n", buflen);
+		json_out_trim(out);
+		JSON_LIT(out, "]}\r\n");
 		break;
 	    case 19:        /* IMO289 - Marine Traffic Signal */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"linkage\":%u,\"station\":\"%s\","
 			       "\"lon\":%.3f,\"lat\":%.3f,\"status\":%u,"
 			       "\"signal\":%u,\"signal_text\":\"%s\","
@@ -2495,7 +2723,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	    case 25:        /* IMO289 - Dangerous Cargo Indication */
 		break;
 	    case 27:        /* IMO289 - Route information - broadcast */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"linkage\":%u,\"sender\":%u,"
 			       "\"rtype\":%u,"
 			       "\"rtype_text\":\"%s\","
@@ -2512,22 +2740,21 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type8.dac1fid27.duration);
 		for (i = 0; i < ais->type8.dac1fid27.waycount; i++) {
 		    if (scaled)
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "{\"lon\":%.4f,\"lat\":%.4f},",
 			    ais->type8.dac1fid27.waypoints[i].lon / AIS_LATLON4_DIV,
 			    ais->type8.dac1fid27.waypoints[i].lat / AIS_LATLON4_DIV);
 		    else
-			(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+			json_out_printf(out,
 			    "{\"lon\":%d,\"lat\":%d},",
 			    ais->type8.dac1fid27.waypoints[i].lon,
 			    ais->type8.dac1fid27.waypoints[i].lat);
 		}
-		if (buf[strlen(buf) - 1] == ',')
-		    buf[strlen(buf) - 1] = '\0';
-		(void)strlcat(buf, "]}\r\n", buflen);
+		json_out_trim(out);
+		JSON_LIT(out, "]}\r\n");
 		break;
 	    case 29:        /* IMO289 - Text Description - broadcast */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 		       "\"linkage\":%u,\"text\":\"%s\"}\r\n",
 		       ais->type8.dac1fid29.linkage,
 		       json_stringify(buf1, sizeof(buf1),
@@ -2537,19 +2764,19 @@ void json_aivdm_dump(const struct ais_t *ais,
 		/* some fields have been merged to an ISO8601 partial date */
 		/* layout is almost identical to FID=11 from IMO236 */
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"lat\":%.3f,\"lon\":%.3f,",
 				   ais->type8.dac1fid31.lat / AIS_LATLON3_DIV,
 				   ais->type8.dac1fid31.lon / AIS_LATLON3_DIV);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"lat\":%d,\"lon\":%d,",
 				   ais->type8.dac1fid31.lat,
 				   ais->type8.dac1fid31.lon);
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"accuracy\":%s,",
 			       JSON_BOOL(ais->type8.dac1fid31.accuracy));
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"timestamp\":\"%02uT%02u:%02uZ\","
 			       "\"wspeed\":%u,\"wgust\":%u,\"wdir\":%u,"
 			       "\"wgustdir\":%u,\"humidity\":%u,",
@@ -2562,7 +2789,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type8.dac1fid31.wgustdir,
 			       ais->type8.dac1fid31.humidity);
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"airtemp\":%.1f,\"dewpoint\":%.1f,"
 				   "\"pressure\":%u,\"pressuretend\":\"%s\","
 				   "\"visgreater\":%s,",
@@ -2572,7 +2799,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   trends[ais->type8.dac1fid31.pressuretend],
 				   JSON_BOOL(ais->type8.dac1fid31.visgreater));
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"airtemp\":%d,\"dewpoint\":%d,"
 				   "\"pressure\":%u,\"pressuretend\":%u,"
 				   "\"visgreater\":%s,",
@@ -2583,24 +2810,24 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   JSON_BOOL(ais->type8.dac1fid31.visgreater));
 
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"visibility\":%.1f,",
 				   ais->type8.dac1fid31.visibility / DAC1FID31_VISIBILITY_DIV);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"visibility\":%u,",
 				   ais->type8.dac1fid31.visibility);
 		if (!scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"waterlevel\":%d,",
 				   ais->type8.dac1fid31.waterlevel);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"waterlevel\":%.1f,",
 				   (ais->type8.dac1fid31.waterlevel - DAC1FID31_WATERLEVEL_OFFSET) / DAC1FID31_WATERLEVEL_DIV);
 
 		if (scaled) {
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"leveltrend\":\"%s\","
 				   "\"cspeed\":%.1f,\"cdir\":%u,"
 				   "\"cspeed2\":%.1f,\"cdir2\":%u,\"cdepth2\":%u,"
@@ -2630,7 +2857,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   ais->type8.dac1fid31.salinity / DAC1FID31_SALINITY_DIV,
 				   ice[ais->type8.dac1fid31.ice]);
 		} else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 				   "\"leveltrend\":%u,"
 				   "\"cspeed\":%u,\"cdir\":%u,"
 				   "\"cspeed2\":%u,\"cdir2\":%u,\"cdepth2\":%u,"
@@ -2659,7 +2886,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 				   ais->type8.dac1fid31.preciptype,
 				   ais->type8.dac1fid31.salinity,
 				   ais->type8.dac1fid31.ice);
-		(void)strlcat(buf, "}\r\n", buflen);
+		JSON_LIT(out, "}\r\n");
 		break;
 	    }
 	}
@@ -2790,7 +3017,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			|| cp->ais == ais->type8.dac200fid10.shiptype
 			|| cp->code == 0)
 			break;
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"vin\":\"%s\",\"length\":%u,\"beam\":%u,"
 			       "\"shiptype\":%u,\"shiptype_text\":\"%s\","
 			       "\"hazard\":%u,\"hazard_text\":\"%s\","
@@ -2816,7 +3043,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	    case 23:	/* EMMA warning */
 		if (!ais->type8.structured)
 		    break;
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"start\":\"%4u-%02u-%02uT%02u:%02u\","
 			       "\"end\":\"%4u-%02u-%02uT%02u:%02u\",",
 			       ais->type8.dac200fid23.start_year + 2000,
@@ -2830,20 +3057,20 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type8.dac200fid23.end_hour,
 			       ais->type8.dac200fid23.end_minute);
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 			"\"start_lon\":%.4f,\"start_lat\":%.4f,\"end_lon\":%.4f,\"end_lat\":%.4f,",
 			ais->type8.dac200fid23.start_lon / AIS_LATLON_DIV,
 			ais->type8.dac200fid23.start_lat / AIS_LATLON_DIV,
 			ais->type8.dac200fid23.end_lon / AIS_LATLON_DIV,
 			ais->type8.dac200fid23.end_lat / AIS_LATLON_DIV);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 			"\"start_lon\":%d,\"start_lat\":%d,\"end_lon\":%d,\"end_lat\":%d,",
 			ais->type8.dac200fid23.start_lon,
 			ais->type8.dac200fid23.start_lat,
 			ais->type8.dac200fid23.end_lon,
 			ais->type8.dac200fid23.end_lat);
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 		    "\"type\":%u,\"type_text\":\"%s\",\"min\":%d,\"max\":%d,\"class\":%u,\"class_text\":\"%s\",\"wind\":%u,\"wind_text\":\"%s\"}\r\n",
 
 		    ais->type8.dac200fid23.type,
@@ -2856,31 +3083,30 @@ void json_aivdm_dump(const struct ais_t *ais,
 		    EMMA_WIND_DISPLAY(ais->type8.dac200fid23.wind));
 		break;
 	    case 24:	/* Inland AIS Water Levels */
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 		    "\"country\":\"%s\",\"gauges\":[",
 		    ais->type8.dac200fid24.country);
 		for (i = 0; i < ais->type8.dac200fid24.ngauges; i++) {
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 			"{\"id\":%u,\"level\":%d}",
 			ais->type8.dac200fid24.gauges[i].id,
 			ais->type8.dac200fid24.gauges[i].level);
 		}
-		if (buf[strlen(buf)-1] == ',')
-		    buf[strlen(buf)-1] = '\0';
-		(void)strlcat(buf, "]}\r\n", buflen - strlen(buf));
+		json_out_trim(out);
+		JSON_LIT(out, "]}\r\n");
 		break;
 	    case 40:	/* Inland AIS Signal Strength */
 		if (scaled)
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 			"\"lon\":%.4f,\"lat\":%.4f,",
 			ais->type8.dac200fid40.lon / AIS_LATLON_DIV,
 			ais->type8.dac200fid40.lat / AIS_LATLON_DIV);
 		else
-		    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		    json_out_printf(out,
 			"\"lon\":%d,\"lat\":%d,",
 			ais->type8.dac200fid40.lon,
 			ais->type8.dac200fid40.lat);
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 		    "\"form\":%u,\"facing\":%u,\"direction\":%u,\"direction_text\":\"%s\",\"status\":%u,\"status_text\":\"%s\"}\r\n",
 		    ais->type8.dac200fid40.form,
 		    ais->type8.dac200fid40.facing,
@@ -2921,7 +3147,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 		(void)snprintf(speedlegend, sizeof(speedlegend),
 			       "%u", ais->type1.speed);
 
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"alt\":%s,\"speed\":%s,\"accuracy\":%s,"
 			   "\"lon\":%.4f,\"lat\":%.4f,\"course\":%.1f,"
 			   "\"second\":%u,\"regional\":%u,\"dte\":%u,"
@@ -2937,7 +3163,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   ais->type9.dte,
 			   JSON_BOOL(ais->type9.raim), ais->type9.radio);
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"alt\":%u,\"speed\":%u,\"accuracy\":%s,"
 			   "\"lon\":%d,\"lat\":%d,\"course\":%u,"
 			   "\"second\":%u,\"regional\":%u,\"dte\":%u,"
@@ -2955,11 +3181,11 @@ void json_aivdm_dump(const struct ais_t *ais,
 	}
 	break;
     case 10:			/* UTC/Date Inquiry */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"dest_mmsi\":%u}\r\n", ais->type10.dest_mmsi);
 	break;
     case 12:			/* Safety Related Message */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"seqno\":%u,\"dest_mmsi\":%u,\"retransmit\":%s,\"text\":\"%s\"}\r\n",
 		       ais->type12.seqno,
 		       ais->type12.dest_mmsi,
@@ -2967,12 +3193,12 @@ void json_aivdm_dump(const struct ais_t *ais,
 		       json_stringify(buf1, sizeof(buf1), ais->type12.text));
 	break;
     case 14:			/* Safety Related Broadcast Message */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"text\":\"%s\"}\r\n",
 		       json_stringify(buf1, sizeof(buf1), ais->type14.text));
 	break;
     case 15:			/* Interrogation */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"mmsi1\":%u,\"type1_1\":%u,\"offset1_1\":%u,"
 		       "\"type1_2\":%u,\"offset1_2\":%u,\"mmsi2\":%u,"
 		       "\"type2_1\":%u,\"offset2_1\":%u}\r\n",
@@ -2985,7 +3211,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 		       ais->type15.type2_1, ais->type15.offset2_1);
 	break;
     case 16:
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"mmsi1\":%u,\"offset1\":%u,\"increment1\":%u,"
 		       "\"mmsi2\":%u,\"offset2\":%u,\"increment2\":%u}\r\n",
 		       ais->type16.mmsi1,
@@ -2996,7 +3222,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	break;
     case 17:
 	if (scaled) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"lon\":%.1f,\"lat\":%.1f,\"data\":\"%zd:%s\"}\r\n",
 			   ais->type17.lon / AIS_GNSS_LATLON_DIV,
 			   ais->type17.lat / AIS_GNSS_LATLON_DIV,
@@ -3005,7 +3231,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 					(char *)ais->type17.bitdata,
 					BITS_TO_BYTES(ais->type17.bitcount)));
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"lon\":%d,\"lat\":%d,\"data\":\"%zd:%s\"}\r\n",
 			   ais->type17.lon,
 			   ais->type17.lat,
@@ -3017,7 +3243,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	break;
     case 18:
 	if (scaled) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"reserved\":%u,\"speed\":%.1f,\"accuracy\":%s,"
 			   "\"lon\":%.4f,\"lat\":%.4f,\"course\":%.1f,"
 			   "\"heading\":%u,\"second\":%u,\"regional\":%u,"
@@ -3039,7 +3265,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   JSON_BOOL(ais->type18.msg22),
 			   JSON_BOOL(ais->type18.raim), ais->type18.radio);
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"reserved\":%u,\"speed\":%u,\"accuracy\":%s,"
 			   "\"lon\":%d,\"lat\":%d,\"course\":%u,"
 			   "\"heading\":%u,\"second\":%u,\"regional\":%u,"
@@ -3064,7 +3290,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	break;
     case 19:
 	if (scaled) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"reserved\":%u,\"speed\":%.1f,\"accuracy\":%s,"
 			   "\"lon\":%.4f,\"lat\":%.4f,\"course\":%.1f,"
 			   "\"heading\":%u,\"second\":%u,\"regional\":%u,"
@@ -3097,7 +3323,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   ais->type19.dte,
 			   JSON_BOOL(ais->type19.assigned));
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"reserved\":%u,\"speed\":%u,\"accuracy\":%s,"
 			   "\"lon\":%d,\"lat\":%d,\"course\":%u,"
 			   "\"heading\":%u,\"second\":%u,\"regional\":%u,"
@@ -3132,7 +3358,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	}
 	break;
     case 20:			/* Data Link Management Message */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"offset1\":%u,\"number1\":%u,"
 		       "\"timeout1\":%u,\"increment1\":%u,"
 		       "\"offset2\":%u,\"number2\":%u,"
@@ -3159,7 +3385,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	break;
     case 21:			/* Aid to Navigation */
 	if (scaled) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"aid_type\":%u,\"aid_type_text\":\"%s\","
 			   "\"name\":\"%s\",\"lon\":%.4f,"
 			   "\"lat\":%.4f,\"accuracy\":%s,\"to_bow\":%u,"
@@ -3185,7 +3411,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   JSON_BOOL(ais->type21.raim),
 			   JSON_BOOL(ais->type21.virtual_aid));
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"aid_type\":%u,\"aid_type_text\":\"%s\","
 			   "\"name\":\"%s\",\"accuracy\":%s,"
 			   "\"lon\":%d,\"lat\":%d,\"to_bow\":%u,"
@@ -3215,18 +3441,18 @@ void json_aivdm_dump(const struct ais_t *ais,
 	}
 	break;
     case 22:			/* Channel Management */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"channel_a\":%u,\"channel_b\":%u,"
 		       "\"txrx\":%u,\"power\":%s,",
 		       ais->type22.channel_a,
 		       ais->type22.channel_b,
 		       ais->type22.txrx, JSON_BOOL(ais->type22.power));
 	if (ais->type22.addressed) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"dest1\":%u,\"dest2\":%u,",
 			   ais->type22.mmsi.dest1, ais->type22.mmsi.dest2);
 	} else if (scaled) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"ne_lon\":\"%f\",\"ne_lat\":\"%f\","
 			   "\"sw_lon\":\"%f\",\"sw_lat\":\"%f\",",
 			   ais->type22.area.ne_lon / AIS_CHANNEL_LATLON_DIV,
@@ -3235,14 +3461,14 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   ais->type22.area.sw_lat /
 			   AIS_CHANNEL_LATLON_DIV);
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"ne_lon\":%d,\"ne_lat\":%d,"
 			   "\"sw_lon\":%d,\"sw_lat\":%d,",
 			   ais->type22.area.ne_lon,
 			   ais->type22.area.ne_lat,
 			   ais->type22.area.sw_lon, ais->type22.area.sw_lat);
 	}
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"addressed\":%s,\"band_a\":%s,"
 		       "\"band_b\":%s,\"zonesize\":%u}\r\n",
 		       JSON_BOOL(ais->type22.addressed),
@@ -3251,7 +3477,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	break;
     case 23:			/* Group Assignment Command */
 	if (scaled) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"ne_lon\":\"%f\",\"ne_lat\":\"%f\","
 			   "\"sw_lon\":\"%f\",\"sw_lat\":\"%f\","
 			   "\"stationtype\":%u,\"stationtype_text\":\"%s\","
@@ -3267,7 +3493,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   SHIPTYPE_DISPLAY(ais->type23.shiptype),
 			   ais->type23.interval, ais->type23.quiet);
 	} else {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"ne_lon\":%d,\"ne_lat\":%d,"
 			   "\"sw_lon\":%d,\"sw_lat\":%d,"
 			   "\"stationtype\":%u,\"stationtype_text\":\"%s\","
@@ -3287,18 +3513,18 @@ void json_aivdm_dump(const struct ais_t *ais,
     case 24:			/* Class B CS Static Data Report */
 	if (ais->type24.part != both) {
 	    static char *partnames[] = {"AB", "A", "B"};
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"part\":\"%s\",",
 			   json_stringify(buf1, sizeof(buf1),
 					  partnames[ais->type24.part]));
 	}
 	if (ais->type24.part != part_b)
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"shipname\":\"%s\",",
 			   json_stringify(buf1, sizeof(buf1),
 				      ais->type24.shipname));
 	if (ais->type24.part != part_a) {
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"shiptype\":%u,\"shiptype_text\":\"%s\","
 			   "\"vendorid\":\"%s\",\"model\":%u,\"serial\":%u,"
 			   "\"callsign\":\"%s\",",
@@ -3311,11 +3537,11 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   json_stringify(buf2, sizeof(buf2),
 					  ais->type24.callsign));
 	    if (AIS_AUXILIARY_MMSI(ais->mmsi)) {
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"mothership_mmsi\":%u}\r\n",
 			       ais->type24.mothership_mmsi);
 	    } else {
-		(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+		json_out_printf(out,
 			       "\"to_bow\":%u,\"to_stern\":%u,"
 			       "\"to_port\":%u,\"to_starboard\":%u",
 			       ais->type24.dim.to_bow,
@@ -3324,12 +3550,11 @@ void json_aivdm_dump(const struct ais_t *ais,
 			       ais->type24.dim.to_starboard);
 	    }
 	}
-	if (buf[strlen(buf)-1] == ',')
-	    buf[strlen(buf)-1] = '\0';
-	strncat(buf, "}\r\n", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "}\r\n");
 	break;
     case 25:			/* Binary Message, Single Slot */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"addressed\":%s,\"structured\":%s,\"dest_mmsi\":%u,"
 		       "\"app_id\":%u,\"data\":\"%zd:%s\"}\r\n",
 		       JSON_BOOL(ais->type25.addressed),
@@ -3342,7 +3567,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 				    BITS_TO_BYTES(ais->type25.bitcount)));
 	break;
     case 26:			/* Binary Message, Multiple Slot */
-	(void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	json_out_printf(out,
 		       "\"addressed\":%s,\"structured\":%s,\"dest_mmsi\":%u,"
 		       "\"app_id\":%u,\"data\":\"%zd:%s\",\"radio\":%u}\r\n",
 		       JSON_BOOL(ais->type26.addressed),
@@ -3357,7 +3582,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 	break;
     case 27:			/* Long Range AIS Broadcast message */
 	if (scaled)
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"status\":\"%s\","
 			   "\"accuracy\":%s,\"lon\":%.1f,\"lat\":%.1f,"
 			   "\"speed\":%u,\"course\":%u,\"raim\":%s,\"gnss\":%s}\r\n",
@@ -3370,7 +3595,7 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   JSON_BOOL(ais->type27.raim),
 			   JSON_BOOL(ais->type27.gnss));
 	else
-	    (void)snprintf(buf + strlen(buf), buflen - strlen(buf),
+	    json_out_printf(out,
 			   "\"status\":%u,"
 			   "\"accuracy\":%s,\"lon\":%d,\"lat\":%d,"
 			   "\"speed\":%u,\"course\":%u,\"raim\":%s,\"gnss\":%s}\r\n",
@@ -3384,136 +3609,110 @@ void json_aivdm_dump(const struct ais_t *ais,
 			   JSON_BOOL(ais->type27.gnss));
 	break;
     default:
-	if (buf[strlen(buf) - 1] == ',')
-	    buf[strlen(buf) - 1] = '\0';
-	(void)strlcat(buf, "}\r\n", buflen);
+	json_out_trim(out);
+	JSON_LIT(out, "}\r\n");
 	break;
     }
     /*@ +formatcode +mustfreefresh @*/
 }
+
+void json_aivdm_dump(const struct ais_t *ais,
+		     /*@null@*/const char *device, bool scaled,
+		     /*@out@*/char *buf, size_t buflen)
+{
+    struct json_out_t out;
+
+    json_out_init(&out, buf, buflen);
+    json_aivdm_write(&out, ais, device, scaled);
+}
 #endif /* defined(AIVDM_ENABLE) */
 
 #ifdef COMPASS_ENABLE
-void json_att_dump(const struct gps_data_t *gpsdata,
-		   /*@out@*/ char *reply, size_t replylen)
-/* dump the contents of an attitude_t structure as JSON */
+static void json_att_write(struct json_out_t *out,
+			   const struct gps_data_t *gpsdata)
+/* append the contents of an attitude_t structure as JSON */
 {
-    assert(replylen > 2);
-    (void)strlcpy(reply, "{\"class\":\"ATT\",", replylen);
-    (void)snprintf(reply + strlen(reply),
-		   replylen - strlen(reply),
-		   "\"device\":\"%s\",", gpsdata->dev.path);
+    JSON_LIT(out, "{\"class\":\"ATT\",");
+    JSON_TEXT(out, "device", gpsdata->dev.path);
     if (isnan(gpsdata->attitude.heading) == 0) {
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"heading\":%.2f,", gpsdata->attitude.heading);
+	JSON_REAL(out, "heading", gpsdata->attitude.heading, 2);
 	if (gpsdata->attitude.mag_st != '\0')
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"mag_st\":\"%c\",", gpsdata->attitude.mag_st);
+	    json_out_printf(out, "\"mag_st\":\"%c\",",
+			    gpsdata->attitude.mag_st);
 
     }
     if (isnan(gpsdata->attitude.pitch) == 0) {
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"pitch\":%.2f,", gpsdata->attitude.pitch);
+	JSON_REAL(out, "pitch", gpsdata->attitude.pitch, 2);
 	if (gpsdata->attitude.pitch_st != '\0')
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"pitch_st\":\"%c\",",
-			   gpsdata->attitude.pitch_st);
+	    json_out_printf(out, "\"pitch_st\":\"%c\",",
+			    gpsdata->attitude.pitch_st);
 
     }
     if (isnan(gpsdata->attitude.yaw) == 0) {
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"yaw\":%.2f,", gpsdata->attitude.yaw);
+	JSON_REAL(out, "yaw", gpsdata->attitude.yaw, 2);
 	if (gpsdata->attitude.yaw_st != '\0')
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"yaw_st\":\"%c\",", gpsdata->attitude.yaw_st);
+	    json_out_printf(out, "\"yaw_st\":\"%c\",",
+			    gpsdata->attitude.yaw_st);
 
     }
     if (isnan(gpsdata->attitude.roll) == 0) {
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"roll\":%.2f,", gpsdata->attitude.roll);
+	JSON_REAL(out, "roll", gpsdata->attitude.roll, 2);
 	if (gpsdata->attitude.roll_st != '\0')
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"roll_st\":\"%c\",", gpsdata->attitude.roll_st);
+	    json_out_printf(out, "\"roll_st\":\"%c\",",
+			    gpsdata->attitude.roll_st);
 
     }
     if (isnan(gpsdata->attitude.yaw) == 0) {
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"yaw\":%.2f,", gpsdata->attitude.yaw);
+	JSON_REAL(out, "yaw", gpsdata->attitude.yaw, 2);
 	if (gpsdata->attitude.yaw_st != '\0')
-	    (void)snprintf(reply + strlen(reply),
-			   replylen - strlen(reply),
-			   "\"yaw_st\":\"%c\",", gpsdata->attitude.yaw_st);
+	    json_out_printf(out, "\"yaw_st\":\"%c\",",
+			    gpsdata->attitude.yaw_st);
 
     }
     if (isnan(gpsdata->attitude.dip) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"dip\":%.3f,", gpsdata->attitude.dip);
+	JSON_REAL(out, "dip", gpsdata->attitude.dip, 3);
 
     if (isnan(gpsdata->attitude.mag_len) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"mag_len\":%.3f,", gpsdata->attitude.mag_len);
+	JSON_REAL(out, "mag_len", gpsdata->attitude.mag_len, 3);
     if (isnan(gpsdata->attitude.mag_x) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"mag_x\":%.3f,", gpsdata->attitude.mag_x);
+	JSON_REAL(out, "mag_x", gpsdata->attitude.mag_x, 3);
     if (isnan(gpsdata->attitude.mag_y) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"mag_y\":%.3f,", gpsdata->attitude.mag_y);
+	JSON_REAL(out, "mag_y", gpsdata->attitude.mag_y, 3);
     if (isnan(gpsdata->attitude.mag_z) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"mag_z\":%.3f,", gpsdata->attitude.mag_z);
+	JSON_REAL(out, "mag_z", gpsdata->attitude.mag_z, 3);
 
     if (isnan(gpsdata->attitude.acc_len) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"acc_len\":%.3f,", gpsdata->attitude.acc_len);
+	JSON_REAL(out, "acc_len", gpsdata->attitude.acc_len, 3);
     if (isnan(gpsdata->attitude.acc_x) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"acc_x\":%.3f,", gpsdata->attitude.acc_x);
+	JSON_REAL(out, "acc_x", gpsdata->attitude.acc_x, 3);
     if (isnan(gpsdata->attitude.acc_y) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"acc_y\":%.3f,", gpsdata->attitude.acc_y);
+	JSON_REAL(out, "acc_y", gpsdata->attitude.acc_y, 3);
     if (isnan(gpsdata->attitude.acc_z) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"acc_z\":%.3f,", gpsdata->attitude.acc_z);
+	JSON_REAL(out, "acc_z", gpsdata->attitude.acc_z, 3);
 
     if (isnan(gpsdata->attitude.gyro_x) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"gyro_x\":%.3f,", gpsdata->attitude.gyro_x);
+	JSON_REAL(out, "gyro_x", gpsdata->attitude.gyro_x, 3);
     if (isnan(gpsdata->attitude.gyro_y) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"gyro_y\":%.3f,", gpsdata->attitude.gyro_y);
+	JSON_REAL(out, "gyro_y", gpsdata->attitude.gyro_y, 3);
 
     if (isnan(gpsdata->attitude.temp) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"temp\":%.3f,", gpsdata->attitude.temp);
+	JSON_REAL(out, "temp", gpsdata->attitude.temp, 3);
     if (isnan(gpsdata->attitude.depth) == 0)
-	(void)snprintf(reply + strlen(reply),
-		       replylen - strlen(reply),
-		       "\"depth\":%.3f,", gpsdata->attitude.depth);
+	JSON_REAL(out, "depth", gpsdata->attitude.depth, 3);
 
-    if (reply[strlen(reply) - 1] == ',')
-	reply[strlen(reply) - 1] = '\0';	/* trim trailing comma */
-    (void)strlcat(reply, "}\r\n", replylen);
+    json_out_trim(out);
+    JSON_LIT(out, "}\r\n");
+}
+
+void json_att_dump(const struct gps_data_t *gpsdata,
+		   /*@out@*/ char *reply, size_t replylen)
+/* dump the contents of an attitude_t structure as JSON */
+{
+    struct json_out_t out;
+
+    assert(replylen > 2);
+    json_out_init(&out, reply, replylen);
+    json_att_write(&out, gpsdata);
 }
 #endif /* COMPASS_ENABLE */
 
@@ -3524,53 +3723,88 @@ void json_data_report(const gps_mask_t changed,
 /* report a session state in JSON */
 {
     const struct gps_data_t *datap = &session->gpsdata;
-    buf[0] = '\0';
+    struct json_out_t out;
 
+    json_out_init(&out, buf, buflen);
+
+    /* if this starts consulting more policy bits, update json_data_variant() */
     if ((changed & REPORT_IS) != 0) {
-	json_tpv_dump(session, policy, buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	json_tpv_write(&out, session, policy);
     }
 
     if ((changed & GST_SET) != 0) {
-	json_noise_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	json_noise_write(&out, datap);
     }
 
     if ((changed & SATELLITE_SET) != 0) {
-	json_sky_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	if (policy->skydelta
+	    && session->skysent.reports % SKY_FULL_INTERVAL != 0)
+	    json_skydelta_write(&out, session);
+	else
+	    json_sky_write(&out, datap);
     }
 
     if ((changed & SUBFRAME_SET) != 0) {
-	json_subframe_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	json_subframe_write(&out, datap);
     }
 
 #ifdef COMPASS_ENABLE
     if ((changed & ATTITUDE_SET) != 0) {
-	json_att_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	json_att_write(&out, datap);
     }
 #endif /* COMPASS_ENABLE */
 
 #ifdef RTCM104V2_ENABLE
     if ((changed & RTCM2_SET) != 0) {
-	json_rtcm2_dump(&datap->rtcm2, datap->dev.path,
-			buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	json_rtcm2_write(&out, &datap->rtcm2, datap->dev.path);
     }
 #endif /* RTCM104V2_ENABLE */
 
 #ifdef RTCM104V3_ENABLE
     if ((changed & RTCM3_SET) != 0) {
-	json_rtcm3_dump(&datap->rtcm3, datap->dev.path,
-			buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	json_rtcm3_write(&out, &datap->rtcm3, datap->dev.path);
     }
 #endif /* RTCM104V3_ENABLE */
 
 #ifdef AIVDM_ENABLE
     if ((changed & AIS_SET) != 0) {
-	json_aivdm_dump(&datap->ais, datap->dev.path,
-			policy->scaled,
-			buf+strlen(buf), buflen-strlen(buf));
+	out.start = out.end;
+	json_aivdm_write(&out, &datap->ais, datap->dev.path, policy->scaled);
     }
 #endif /* AIVDM_ENABLE */
 }
 
+int json_data_variant(const gps_mask_t changed,
+		      const struct policy_t *policy)
+/*
+ * Reduce a policy to the bits json_data_report() consults for this
+ * mask.  Subscribers that map to the same variant get byte-identical
+ * reports, so the daemon need render each variant only once.
+ */
+{
+    int variant = 0;
+
+#ifdef TIMING_ENABLE
+    if ((changed & REPORT_IS) != 0 && policy->timing)
+	variant |= 1;
+#endif /* TIMING_ENABLE */
+#ifdef AIVDM_ENABLE
+    if ((changed & AIS_SET) != 0 && policy->scaled)
+	variant |= 2;
+#endif /* AIVDM_ENABLE */
+    if ((changed & SATELLITE_SET) != 0 && policy->skydelta)
+	variant |= 4;
+    assert(variant < JSON_DATA_VARIANTS);
+    return variant;
+}
+
 #undef JSON_BOOL
 #endif /* SOCKET_EXPORT_ENABLE */
 
@@ -0,0 +1,259 @@
+/****************************************************************************
+
+NAME
+   gpsd_wire.c - render reports as binary frames
+
+DESCRIPTION
+   These are functions (used only by the daemon) to dump the data
+reports a watcher asked for with "binary":true as the fixed-layout
+records described in gps.h.  Filling a record is a handful of
+assignments, where the JSON equivalent formats every number as text.
+
+PERMISSIONS
+  This file is Copyright (c) 2014 by the GPSD project
+  BSD terms apply: see the file COPYING in the distribution root for details.
+
+***************************************************************************/
+
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+
+#include "gpsd.h"
+
+#ifdef SOCKET_EXPORT_ENABLE
+
+/*@-mustdefine@*/
+static /*@null@*/void *wire_frame(char *buf, size_t buflen, size_t *used,
+				  int type, size_t length)
+/* append a frame header, return where its record goes or NULL if full */
+{
+    struct gps_wire_header_t header;
+
+    if (*used + sizeof(header) + length > buflen)
+	return NULL;
+    header.magic = GPS_WIRE_MAGIC;
+    header.version = GPS_WIRE_VERSION;
+    header.order = GPS_WIRE_ORDER;
+    header.type = (uint16_t)type;
+    header.reserved = 0;
+    header.length = (uint32_t)length;
+    memcpy(buf + *used, &header, sizeof(header));
+    *used += sizeof(header) + length;
+    return buf + *used - length;
+}
+/*@+mustdefine@*/
+
+static void wire_tpv_write(char *buf, size_t buflen, size_t *used,
+			   const struct gps_data_t *gpsdata)
+/* append a TPV record */
+{
+    struct gps_wire_tpv_t tpv;
+    void *record = wire_frame(buf, buflen, used, GPS_WIRE_TPV, sizeof(tpv));
+
+    if (record == NULL)
+	return;
+    memset(&tpv, '\0', sizeof(tpv));
+    tpv.time = gpsdata->fix.time;
+    tpv.ept = gpsdata->fix.ept;
+    tpv.mode = gpsdata->fix.mode;
+    tpv.status = gpsdata->status;
+    /* withhold what the fix doesn't support, as the JSON report does */
+    tpv.latitude = tpv.longitude = tpv.altitude = NAN;
+    tpv.epx = tpv.epy = tpv.epv = NAN;
+    tpv.track = tpv.speed = tpv.climb = NAN;
+    tpv.epd = tpv.eps = tpv.epc = NAN;
+    if (gpsdata->fix.mode >= MODE_2D) {
+	tpv.latitude = gpsdata->fix.latitude;
+	tpv.longitude = gpsdata->fix.longitude;
+	tpv.epx = gpsdata->fix.epx;
+	tpv.epy = gpsdata->fix.epy;
+	tpv.track = gpsdata->fix.track;
+	tpv.speed = gpsdata->fix.speed;
+	tpv.epd = gpsdata->fix.epd;
+	tpv.eps = gpsdata->fix.eps;
+	if (gpsdata->fix.mode >= MODE_3D) {
+	    tpv.altitude = gpsdata->fix.altitude;
+	    tpv.epv = gpsdata->fix.epv;
+	    tpv.climb = gpsdata->fix.climb;
+	    tpv.epc = gpsdata->fix.epc;
+	}
+    }
+    (void)strlcpy(tpv.device, gpsdata->dev.path, sizeof(tpv.device));
+    memcpy(record, &tpv, sizeof(tpv));
+}
+
+static void wire_sky_write(char *buf, size_t buflen, size_t *used,
+			   const struct gps_data_t *gpsdata)
+/* append a SKY record, cut off after the satellites in view */
+{
+    struct gps_wire_sky_t sky;
+    void *record;
+    int i, reported = 0;
+
+    memset(&sky, '\0', offsetof(struct gps_wire_sky_t, sat));
+    sky.time = gpsdata->skyview_time;
+    sky.xdop = gpsdata->dop.xdop;
+    sky.ydop = gpsdata->dop.ydop;
+    sky.vdop = gpsdata->dop.vdop;
+    sky.tdop = gpsdata->dop.tdop;
+    sky.hdop = gpsdata->dop.hdop;
+    sky.pdop = gpsdata->dop.pdop;
+    sky.gdop = gpsdata->dop.gdop;
+    /* insurance against flaky drivers, as in the JSON report */
+    for (i = 0; i < gpsdata->satellites_visible && i < MAXCHANNELS; i++) {
+	const struct satellite_t *sp = &gpsdata->skyview[i];
+	struct gps_wire_sat_t *wp = &sky.sat[reported];
+
+	if (sp->PRN == 0)
+	    continue;
+	wp->ss = sp->ss;
+	wp->PRN = sp->PRN;
+	wp->elevation = sp->elevation;
+	wp->azimuth = sp->azimuth;
+	wp->used = (uint8_t)sp->used;
+	wp->reserved = 0;
+	if (sp->used)
+	    sky.satellites_used++;
+	reported++;
+    }
+    sky.satellites_visible = reported;
+    (void)strlcpy(sky.device, gpsdata->dev.path, sizeof(sky.device));
+
+    record = wire_frame(buf, buflen, used, GPS_WIRE_SKY,
+			offsetof(struct gps_wire_sky_t, sat)
+			+ reported * sizeof(struct gps_wire_sat_t));
+    if (record != NULL)
+	memcpy(record, &sky, offsetof(struct gps_wire_sky_t, sat)
+	       + reported * sizeof(struct gps_wire_sat_t));
+}
+
+static void wire_gst_write(char *buf, size_t buflen, size_t *used,
+			   const struct gps_data_t *gpsdata)
+/* append a GST record */
+{
+    struct gps_wire_gst_t gst;
+    void *record = wire_frame(buf, buflen, used, GPS_WIRE_GST, sizeof(gst));
+
+    if (record == NULL)
+	return;
+    memset(&gst, '\0', sizeof(gst));
+    gst.utctime = gpsdata->gst.utctime;
+    gst.rms_deviation = gpsdata->gst.rms_deviation;
+    gst.smajor_deviation = gpsdata->gst.smajor_deviation;
+    gst.sminor_deviation = gpsdata->gst.sminor_deviation;
+    gst.smajor_orientation = gpsdata->gst.smajor_orientation;
+    gst.lat_err_deviation = gpsdata->gst.lat_err_deviation;
+    gst.lon_err_deviation = gpsdata->gst.lon_err_deviation;
+    gst.alt_err_deviation = gpsdata->gst.alt_err_deviation;
+    (void)strlcpy(gst.device, gpsdata->dev.path, sizeof(gst.device));
+    memcpy(record, &gst, sizeof(gst));
+}
+
+#ifdef COMPASS_ENABLE
+static void wire_att_write(char *buf, size_t buflen, size_t *used,
+			   const struct gps_data_t *gpsdata)
+/* append an ATT record */
+{
+    const struct attitude_t *att = &gpsdata->attitude;
+    struct gps_wire_att_t wa;
+    void *record = wire_frame(buf, buflen, used, GPS_WIRE_ATT, sizeof(wa));
+
+    if (record == NULL)
+	return;
+    memset(&wa, '\0', sizeof(wa));
+    wa.heading = att->heading;
+    wa.pitch = att->pitch;
+    wa.roll = att->roll;
+    wa.yaw = att->yaw;
+    wa.dip = att->dip;
+    wa.mag_len = att->mag_len;
+    wa.mag_x = att->mag_x;
+    wa.mag_y = att->mag_y;
+    wa.mag_z = att->mag_z;
+    wa.acc_len = att->acc_len;
+    wa.acc_x = att->acc_x;
+    wa.acc_y = att->acc_y;
+    wa.acc_z = att->acc_z;
+    wa.gyro_x = att->gyro_x;
+    wa.gyro_y = att->gyro_y;
+    wa.temp = att->temp;
+    wa.depth = att->depth;
+    wa.mag_st = att->mag_st;
+    wa.pitch_st = att->pitch_st;
+    wa.roll_st = att->roll_st;
+    wa.yaw_st = att->yaw_st;
+    (void)strlcpy(wa.device, gpsdata->dev.path, sizeof(wa.device));
+    memcpy(record, &wa, sizeof(wa));
+}
+#endif /* COMPASS_ENABLE */
+
+#ifdef AIVDM_ENABLE
+static void wire_ais_write(char *buf, size_t buflen, size_t *used,
+			   const struct gps_data_t *gpsdata)
+/* append an AIS record */
+{
+    char *record = (char *)wire_frame(buf, buflen, used, GPS_WIRE_AIS,
+				      sizeof(struct gps_wire_ais_t));
+
+    if (record == NULL)
+	return;
+    memset(record, '\0', GPS_PATH_MAX);
+    (void)strlcpy(record, gpsdata->dev.path, GPS_PATH_MAX);
+    memcpy(record + offsetof(struct gps_wire_ais_t, ais),
+	   &gpsdata->ais, sizeof(struct ais_t));
+}
+#endif /* AIVDM_ENABLE */
+
+size_t wire_data_report(const gps_mask_t changed,
+			const struct gps_device_t *session,
+			/*@out@*/char *buf, size_t buflen)
+/* report the binary-capable parts of a session state, return the length */
+{
+    const struct gps_data_t *datap = &session->gpsdata;
+    size_t used = 0;
+
+    /* keep to the order json_data_report() uses */
+    if ((changed & REPORT_IS) != 0)
+	wire_tpv_write(buf, buflen, &used, datap);
+    if ((changed & GST_SET) != 0)
+	wire_gst_write(buf, buflen, &used, datap);
+    if ((changed & SATELLITE_SET) != 0)
+	wire_sky_write(buf, buflen, &used, datap);
+#ifdef COMPASS_ENABLE
+    if ((changed & ATTITUDE_SET) != 0)
+	wire_att_write(buf, buflen, &used, datap);
+#endif /* COMPASS_ENABLE */
+#ifdef AIVDM_ENABLE
+    if ((changed & AIS_SET) != 0)
+	wire_ais_write(buf, buflen, &used, datap);
+#endif /* AIVDM_ENABLE */
+    return used;
+}
+
+size_t wire_pps_report(const struct gps_device_t *session,
+		       const struct timedrift_t *td,
+		       /*@out@*/char *buf, size_t buflen)
+/* report a PPS drift sample as a binary frame, return the length */
+{
+    struct gps_wire_pps_t pps;
+    size_t used = 0;
+    void *record = wire_frame(buf, buflen, &used, GPS_WIRE_PPS, sizeof(pps));
+
+    if (record == NULL)
+	return 0;
+    memset(&pps, '\0', sizeof(pps));
+    /*@-type@*//* splint is confused about struct timespec */
+    pps.real_sec = (int64_t)td->real.tv_sec;
+    pps.real_nsec = (int64_t)td->real.tv_nsec;
+    pps.clock_sec = (int64_t)td->clock.tv_sec;
+    pps.clock_nsec = (int64_t)td->clock.tv_nsec;
+    /*@+type@*/
+    (void)strlcpy(pps.device, session->gpsdata.dev.path, sizeof(pps.device));
+    memcpy(record, &pps, sizeof(pps));
+    return used;
+}
+
+#endif /* SOCKET_EXPORT_ENABLE */
+
+/* gpsd_wire.c ends here */
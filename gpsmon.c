@@ -683,9 +683,7 @@ static void gpsmon_hook(struct gps_device_t *device, gps_mask_t changed UNUSED)
 	    /*@+type@*/
 
 	    (void)strlcpy(buf, PPSBAR, BUFSIZ);
-	    session.ppslast = noclobber.timedrift;
-	    /* coverity[missing_lock] */
-	    session.ppscount++;
+	    pps_thread_stash(&session, &noclobber.timedrift, "from the daemon");
 	}
     }
     else
@@ -1183,7 +1181,8 @@ int main(int argc, char **argv)
 		       "%s:%s", source.server, source.port);
     }
 
-    if (gpsd_activate(&session, O_PROBEONLY) == -1) {
+    if (gpsd_activate(&session, O_PROBEONLY) == -1
+	|| netconn_wait(&session) == -1) {
 	(void)fprintf(stderr,
 		      "gpsmon: activation of device %s failed, errno=%d (%s)\n",
 		      session.gpsdata.dev.path, errno, strerror(errno));
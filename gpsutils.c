@@ -346,6 +346,8 @@ timestamp_t iso8601_to_unix( /*@in@*/ char *isotime)
     double usec;
     struct tm tm;
 
+    /* strptime(3) leaves tm_isdst alone, and mktime(3) would honor it */
+    (void)memset(&tm, '\0', sizeof(tm));
     /*@i1@*/ dp = strptime(isotime, "%Y-%m-%dT%H:%M:%S", &tm);
     if (dp != NULL && *dp == '.')
 	usec = strtod(dp, NULL);
@@ -105,7 +105,8 @@ static void json_trace(int errlevel, const char *fmt, ...)
     }
 }
 
-# define json_debug_trace(args) (void) json_trace args
+/* test the level first, this is called for every character parsed */
+# define json_debug_trace(args) do { if (debuglevel > 0) (void) json_trace args; } while (0)
 #else
 # define json_debug_trace(args) /*@i1@*/do { } while (0)
 #endif /* CLIENTDEBUG_ENABLE */
@@ -158,6 +159,82 @@ static /*@null@*/ char *json_target_address(const struct json_attr_t *cursor,
 
 /*@-immediatetrans -dependenttrans +usereleased +compdef@*/
 
+/*
+ * Attribute-name index.  Template tables are mostly automatic arrays
+ * rebuilt on every call, so they can't be recognized by address; but
+ * their attribute names are string literals, so a fingerprint of the
+ * name pointers identifies a table layout across calls.  The first
+ * parse against a layout hashes its names into an open-addressed slot
+ * table, after which each attribute resolves with one probe rather
+ * than a strcmp() per template entry.  Misses fall back to the linear
+ * scan.  libgps may be called from several threads at once, so each
+ * thread keeps an index of its own and nothing is shared; without
+ * thread-local storage there is no index, just the scan.  A hit is
+ * still used only if it names the attribute and is the first spec of
+ * its same-name span, so a fingerprint collision, or a nested object's
+ * table taking over the slot mid-parse, only costs speed.
+ */
+#if defined(__GNUC__) && !defined(S_SPLINT_S)
+#define JSON_INDEX_ENABLE
+#endif /* defined(__GNUC__) && !defined(S_SPLINT_S) */
+#define JSON_INDEX_MIN		8	/* smaller tables are just scanned */
+#define JSON_INDEX_SLOTS	128	/* per table, power of 2, < 256 */
+#define JSON_INDEX_TABLES	64	/* layouts remembered, power of 2 */
+
+#ifdef JSON_INDEX_ENABLE
+struct json_index_t {
+    unsigned long fingerprint;		/* zero when unused */
+    int count;				/* entries in the table */
+    unsigned char slot[JSON_INDEX_SLOTS];	/* entry index + 1, or 0 */
+};
+static __thread struct json_index_t json_index[JSON_INDEX_TABLES];
+#endif /* JSON_INDEX_ENABLE */
+
+#define JSON_HASH_INIT	2166136261U
+#define JSON_HASH(h, c)	(((h) ^ (unsigned char)(c)) * 16777619U)
+
+static /*@null@*/ const unsigned char *json_index_get(const struct json_attr_t
+						  *attrs, int count,
+						  unsigned long fingerprint)
+/* return the name index for a table layout, building it if need be */
+{
+#ifdef JSON_INDEX_ENABLE
+    struct json_index_t *ip;
+    int i;
+
+    if (count < JSON_INDEX_MIN || count > JSON_INDEX_SLOTS / 2)
+	return NULL;
+    fingerprint |= 1;
+    ip = &json_index[(fingerprint ^ (fingerprint >> 16)) % JSON_INDEX_TABLES];
+    if (ip->fingerprint == fingerprint && ip->count == count)
+	return ip->slot;
+
+    memset(ip, '\0', sizeof(*ip));
+    for (i = 0; i < count; i++) {
+	const char *np;
+	unsigned int h = JSON_HASH_INIT;
+
+	for (np = attrs[i].attribute; *np != '\0'; np++)
+	    h = JSON_HASH(h, *np);
+	for (h &= JSON_INDEX_SLOTS - 1; ip->slot[h] != 0;
+	     h = (h + 1) & (JSON_INDEX_SLOTS - 1))
+	    if (strcmp(attrs[ip->slot[h] - 1].attribute,
+		       attrs[i].attribute) == 0)
+		break;
+	/* only the first spec of a same-name span goes in */
+	if (ip->slot[h] == 0)
+	    ip->slot[h] = (unsigned char)(i + 1);
+    }
+    ip->fingerprint = fingerprint;
+    ip->count = count;
+    json_debug_trace((1, "Indexed %d attributes (attributes begin with '%s').\n",
+		      count, attrs->attribute));
+    return ip->slot;
+#else
+    return NULL;
+#endif /* JSON_INDEX_ENABLE */
+}
+
 static int json_internal_read_object(const char *cp,
 				     const struct json_attr_t *attrs,
 				     /*@null@*/
@@ -185,6 +262,10 @@ static int json_internal_read_object(const char *cp,
     unsigned int u;
     const struct json_enum_t *mp;
     char *lptr;
+    /*@null@*/ const unsigned char *index;
+    int nattrs;
+    unsigned long fingerprint = 0;
+    unsigned int hash = JSON_HASH_INIT;
 
 #ifdef S_SPLINT_S
     /* prevents gripes about buffers not being completely defined */
@@ -196,7 +277,9 @@ static int json_internal_read_object(const char *cp,
 	*end = NULL;		/* give it a well-defined value on parse failure */
 
     /* stuff fields with defaults in case they're omitted in the JSON input */
-    for (cursor = attrs; cursor->attribute != NULL; cursor++)
+    for (cursor = attrs; cursor->attribute != NULL; cursor++) {
+	fingerprint = (fingerprint ^ (unsigned long)cursor->attribute)
+	    * 16777619UL;
 	if (!cursor->nodefault) {
 	    lptr = json_target_address(cursor, parent, offset);
 	    if (lptr != NULL)
@@ -232,6 +315,9 @@ static int json_internal_read_object(const char *cp,
 		    break;
 		}
 	}
+    }
+    nattrs = (int)(cursor - attrs);
+    index = json_index_get(attrs, nattrs, fingerprint);
 
     json_debug_trace((1, "JSON parse of '%s' begins.\n", cp));
 
@@ -261,6 +347,7 @@ static int json_internal_read_object(const char *cp,
 	    else if (*cp == '"') {
 		state = in_attr;
 		pattr = attrbuf;
+		hash = JSON_HASH_INIT;
 #ifndef JSON_MINIMAL
 		if (end != NULL)
 		    *end = cp;
@@ -284,12 +371,29 @@ static int json_internal_read_object(const char *cp,
 		*pattr++ = '\0';
 		json_debug_trace((1, "Collected attribute name %s\n",
 				  attrbuf));
-		for (cursor = attrs; cursor->attribute != NULL; cursor++) {
-		    json_debug_trace((2, "Checking against %s\n",
-				      cursor->attribute));
-		    if (strcmp(cursor->attribute, attrbuf) == 0)
-			break;
+		cursor = NULL;
+		if (index != NULL) {
+		    unsigned int h, probes;
+		    for (h = hash & (JSON_INDEX_SLOTS - 1), probes = 0;
+			 index[h] != 0 && probes < JSON_INDEX_SLOTS;
+			 h = (h + 1) & (JSON_INDEX_SLOTS - 1), probes++)
+			if (index[h] <= nattrs
+			    && strcmp(attrs[index[h] - 1].attribute,
+				      attrbuf) == 0
+			    && (index[h] == 1
+				|| strcmp(attrs[index[h] - 2].attribute,
+					  attrbuf) != 0)) {
+			    cursor = &attrs[index[h] - 1];
+			    break;
+			}
 		}
+		if (cursor == NULL)
+		    for (cursor = attrs; cursor->attribute != NULL; cursor++) {
+			json_debug_trace((2, "Checking against %s\n",
+					  cursor->attribute));
+			if (strcmp(cursor->attribute, attrbuf) == 0)
+			    break;
+		    }
 		if (cursor->attribute == NULL) {
 		    json_debug_trace((1,
 				      "Unknown attribute name '%s' (attributes begin with '%s').\n",
@@ -311,8 +415,10 @@ static int json_internal_read_object(const char *cp,
 		json_debug_trace((1, "Attribute name too long.\n"));
 		/* don't update end here, leave at attribute start */
 		return JSON_ERR_ATTRLEN;
-	    } else
+	    } else {
 		*pattr++ = *cp;
+		hash = JSON_HASH(hash, *cp);
+	    }
 	    break;
 	case await_value:
 	    if (isspace((unsigned char) *cp) || *cp == ':')
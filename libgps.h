@@ -24,6 +24,7 @@ extern int gps_shm_open(/*@out@*/struct gps_data_t *);
 extern void gps_shm_close(struct gps_data_t *);
 extern bool gps_shm_waiting(const struct gps_data_t *, int);
 extern int gps_shm_read(struct gps_data_t *);
+extern unsigned long gps_shm_dropped(const struct gps_data_t *);
 extern int gps_shm_mainloop(struct gps_data_t *, int,
 			      void (*)(struct gps_data_t *));
 
@@ -33,6 +34,7 @@ extern int gps_dbus_mainloop(struct gps_data_t *, int,
 
 extern int json_ais_read(const char *, char *, size_t, struct ais_t *,
 		  /*@null@*/const char **);
+extern gps_mask_t libgps_fix_mask(const struct gps_fix_t *);
 
 #define PRIVATE(gpsdata) ((struct privdata_t *)(gpsdata)->privdata)
 
@@ -235,6 +235,19 @@ bool gps_waiting(const struct gps_data_t *gpsdata CONDITIONALLY_UNUSED, int time
     return waiting;
 }
 
+unsigned long gps_dropped(const struct gps_data_t *gpsdata CONDITIONALLY_UNUSED)
+/* how many updates has this reader missed by falling behind? */
+{
+    unsigned long dropped = 0;
+
+#ifdef SHM_EXPORT_ENABLE
+    if ((intptr_t)(gpsdata->gps_fd) == SHM_PSEUDO_FD)
+	dropped = gps_shm_dropped(gpsdata);
+#endif /* SHM_EXPORT_ENABLE */
+
+    return dropped;
+}
+
 int gps_mainloop(struct gps_data_t *gpsdata CONDITIONALLY_UNUSED, 
 		 int timeout CONDITIONALLY_UNUSED, 
 		 void (*hook)(struct gps_data_t *gpsdata) CONDITIONALLY_UNUSED)
@@ -15,11 +15,13 @@ PERMISSIONS
 ***************************************************************************/
 
 #include <stdbool.h>
+#include <ctype.h>
 #include <math.h>
 #include <string.h>
 #include <stddef.h>
 
 #include "gpsd.h"
+#include "libgps.h"
 #ifdef SOCKET_EXPORT_ENABLE
 #include "gps_json.h"
 
@@ -115,17 +117,58 @@ static int json_noise_read(const char *buf, struct gps_data_t *gpsdata,
     return json_read_object(buf, json_attrs_1, endptr);
 }
 
+/* a SKY satellite entry as sent, which a delta report may mark gone */
+struct sky_entry_t {
+    int PRN, elevation, azimuth;
+    double ss;
+    bool used, gone;
+};
+
+static void sky_merge(struct gps_data_t *gpsdata,
+		      const struct sky_entry_t *ep)
+/* apply one satellite entry to the skyview */
+{
+    int i;
+
+    for (i = 0; i < gpsdata->satellites_visible; i++)
+	if (gpsdata->skyview[i].PRN == ep->PRN)
+	    break;
+    if (ep->gone) {
+	if (i < gpsdata->satellites_visible) {
+	    memmove(&gpsdata->skyview[i], &gpsdata->skyview[i + 1],
+		    (gpsdata->satellites_visible - i - 1)
+		    * sizeof(gpsdata->skyview[0]));
+	    gpsdata->satellites_visible--;
+	}
+	return;
+    }
+    if (i == gpsdata->satellites_visible) {
+	if (i == MAXCHANNELS)
+	    return;
+	gpsdata->satellites_visible++;
+    }
+    gpsdata->skyview[i].PRN = (short)ep->PRN;
+    gpsdata->skyview[i].elevation = (short)ep->elevation;
+    gpsdata->skyview[i].azimuth = (short)ep->azimuth;
+    gpsdata->skyview[i].ss = ep->ss;
+    gpsdata->skyview[i].used = ep->used;
+}
+
 static int json_sky_read(const char *buf, struct gps_data_t *gpsdata,
 			 /*@null@*/ const char **endptr)
 {
+    struct sky_entry_t entries[MAXCHANNELS];
+    int nentries = 0;
+    bool delta = false;
     /*@ -fullinitblock @*/
     const struct json_attr_t json_attrs_satellites[] = {
 	/* *INDENT-OFF* */
-	{"PRN",	   t_integer, STRUCTOBJECT(struct satellite_t, PRN)},
-	{"el",	   t_integer, STRUCTOBJECT(struct satellite_t, elevation)},
-	{"az",	   t_integer, STRUCTOBJECT(struct satellite_t, azimuth)},
-	{"ss",	   t_real,    STRUCTOBJECT(struct satellite_t, ss)},
-	{"used",   t_boolean, STRUCTOBJECT(struct satellite_t, used)},
+	{"PRN",	   t_integer, STRUCTOBJECT(struct sky_entry_t, PRN)},
+	{"el",	   t_integer, STRUCTOBJECT(struct sky_entry_t, elevation)},
+	{"az",	   t_integer, STRUCTOBJECT(struct sky_entry_t, azimuth)},
+	{"ss",	   t_real,    STRUCTOBJECT(struct sky_entry_t, ss)},
+	{"used",   t_boolean, STRUCTOBJECT(struct sky_entry_t, used)},
+	{"gone",   t_boolean, STRUCTOBJECT(struct sky_entry_t, gone)},
 	/* *INDENT-ON* */
 	{NULL},
     };
@@ -152,33 +195,39 @@ static int json_sky_read(const char *buf, struct gps_data_t *gpsdata,
 	                             .dflt.real = NAN},
 	{"gdop",       t_real,    .addr.real    = &gpsdata->dop.gdop,
 	                             .dflt.real = NAN},
+	{"delta",      t_boolean, .addr.boolean = &delta},
 	{"satellites", t_array,
-	                           STRUCTARRAY(gpsdata->skyview,
+	                           STRUCTARRAY(entries,
 					 json_attrs_satellites,
-					 &gpsdata->satellites_visible)},
+					 &nentries)},
 	{NULL},
 	/* *INDENT-ON* */
     };
     /*@ +fullinitblock @*/
-    int status, i, j;
-
-    for (i = 0; i < MAXCHANNELS; i++) {
-	gpsdata->skyview[i].PRN = 0;
-	gpsdata->skyview[i].used = false;
-    }
+    int status, i;
 
     status = json_read_object(buf, json_attrs_2, endptr);
     if (status != 0)
 	return status;
 
+    /*
+     * A full report replaces the skyview, a delta one (WATCH_SKYDELTA)
+     * updates it by PRN.  The daemon makes sure a client only gets a
+     * delta against the last SKY it was sent.
+     */
+    if (!delta)
+	gpsdata->satellites_visible = 0;
+    for (i = 0; i < nentries; i++)
+	if (entries[i].PRN > 0)
+	    sky_merge(gpsdata, &entries[i]);
+
     gpsdata->satellites_used = 0;
-    gpsdata->satellites_visible = 0;
-    for (i = j = 0; i < MAXCHANNELS; i++) {
-	if(gpsdata->skyview[i].PRN > 0)
-	    gpsdata->satellites_visible++;
-	if (gpsdata->skyview[i].used) {
+    for (i = 0; i < MAXCHANNELS; i++) {
+	if (i >= gpsdata->satellites_visible) {
+	    gpsdata->skyview[i].PRN = 0;
+	    gpsdata->skyview[i].used = false;
+	} else if (gpsdata->skyview[i].used)
 	    gpsdata->satellites_used++;
-	}
     }
 
     return 0;
@@ -386,88 +435,158 @@ int json_pps_read(const char *buf, struct gps_data_t *gpsdata,
     return status;
 }
 
+/* report classes a client can be sent */
+enum json_class {
+    CLASS_NONE,
+    CLASS_TPV, CLASS_GST, CLASS_SKY, CLASS_ATT, CLASS_DEVICES,
+    CLASS_DEVICE, CLASS_WATCH, CLASS_VERSION, CLASS_RTCM2, CLASS_RTCM3,
+    CLASS_AIS, CLASS_ERROR, CLASS_PPS,
+};
+
+#define CLASSATTR		"\"class\":\""
+#define STARTSWITH(str, prefix)	(strncmp(str, prefix, sizeof(prefix)-1) == 0)
+/* length, first and last character are unique across the class names */
+#define CLASSTAG(n, a, z)	((((unsigned int)n)<<16)|(((unsigned int)a)<<8)|(z))
+
+static enum json_class json_class_lookup(const char *classtag)
+/* map the value of a class attribute to its report class */
+{
+    static const char *names[] = {
+	[CLASS_TPV] = "TPV",		[CLASS_GST] = "GST",
+	[CLASS_SKY] = "SKY",		[CLASS_ATT] = "ATT",
+	[CLASS_DEVICES] = "DEVICES",	[CLASS_DEVICE] = "DEVICE",
+	[CLASS_WATCH] = "WATCH",	[CLASS_VERSION] = "VERSION",
+	[CLASS_RTCM2] = "RTCM2",	[CLASS_RTCM3] = "RTCM3",
+	[CLASS_AIS] = "AIS",		[CLASS_ERROR] = "ERROR",
+	[CLASS_PPS] = "PPS",
+    };
+    const char *close = strchr(classtag, '"');
+    size_t len;
+    enum json_class type;
+
+    if (close == NULL || close - classtag < 3)
+	return CLASS_NONE;
+    len = (size_t)(close - classtag);
+
+    /* *INDENT-OFF* */
+    switch (CLASSTAG(len, classtag[0], classtag[len - 1])) {
+    case CLASSTAG(3, 'T', 'V'): type = CLASS_TPV; break;
+    case CLASSTAG(3, 'G', 'T'): type = CLASS_GST; break;
+    case CLASSTAG(3, 'S', 'Y'): type = CLASS_SKY; break;
+    case CLASSTAG(3, 'A', 'T'): type = CLASS_ATT; break;
+    case CLASSTAG(7, 'D', 'S'): type = CLASS_DEVICES; break;
+    case CLASSTAG(6, 'D', 'E'): type = CLASS_DEVICE; break;
+    case CLASSTAG(5, 'W', 'H'): type = CLASS_WATCH; break;
+    case CLASSTAG(7, 'V', 'N'): type = CLASS_VERSION; break;
+    case CLASSTAG(5, 'R', '2'): type = CLASS_RTCM2; break;
+    case CLASSTAG(5, 'R', '3'): type = CLASS_RTCM3; break;
+    case CLASSTAG(3, 'A', 'S'): type = CLASS_AIS; break;
+    case CLASSTAG(5, 'E', 'R'): type = CLASS_ERROR; break;
+    case CLASSTAG(3, 'P', 'S'): type = CLASS_PPS; break;
+    default: return CLASS_NONE;
+    }
+    /* *INDENT-ON* */
+
+    /* the tag only picks a candidate, the name has to match in full */
+    return (memcmp(classtag, names[type], len) == 0) ? type : CLASS_NONE;
+}
+
+gps_mask_t libgps_fix_mask(const struct gps_fix_t *fix)
+/* the mask of fix members a TPV report delivered, from the NaNs it left */
+{
+    gps_mask_t mask = 0;
+
+    if (isnan(fix->time) == 0)
+	mask |= TIME_SET;
+    if (isnan(fix->ept) == 0)
+	mask |= TIMERR_SET;
+    if (isnan(fix->longitude) == 0)
+	mask |= LATLON_SET;
+    if (isnan(fix->altitude) == 0)
+	mask |= ALTITUDE_SET;
+    if (isnan(fix->epx) == 0 && isnan(fix->epy) == 0)
+	mask |= HERR_SET;
+    if (isnan(fix->epv) == 0)
+	mask |= VERR_SET;
+    if (isnan(fix->track) == 0)
+	mask |= TRACK_SET;
+    if (isnan(fix->speed) == 0)
+	mask |= SPEED_SET;
+    if (isnan(fix->climb) == 0)
+	mask |= CLIMB_SET;
+    if (isnan(fix->epd) == 0)
+	mask |= TRACKERR_SET;
+    if (isnan(fix->eps) == 0)
+	mask |= SPEEDERR_SET;
+    if (isnan(fix->epc) == 0)
+	mask |= CLIMBERR_SET;
+    if (fix->mode != MODE_NOT_SEEN)
+	mask |= MODE_SET;
+    return mask;
+}
+
 int libgps_json_unpack(const char *buf,
 		       struct gps_data_t *gpsdata, const char **end)
 /* the only entry point - unpack a JSON object into gpsdata_t substructures */
 {
     int status;
-    char *classtag = strstr(buf, "\"class\":");
-
-    if (classtag == NULL)
+    const char *classtag;
+
+    /* gpsd always sends the class first, so look there before searching */
+    for (classtag = buf; isspace((unsigned char)*classtag); classtag++)
+	continue;
+    if (*classtag == '{' && STARTSWITH(classtag + 1, CLASSATTR))
+	classtag += 1 + sizeof(CLASSATTR) - 1;
+    else if ((classtag = strstr(buf, CLASSATTR)) != NULL)
+	classtag += sizeof(CLASSATTR) - 1;
+    else
 	return -1;
-#define STARTSWITH(str, prefix)	strncmp(str, prefix, sizeof(prefix)-1)==0
-    if (STARTSWITH(classtag, "\"class\":\"TPV\"")) {
+
+    switch (json_class_lookup(classtag)) {
+    case CLASS_TPV:
 	status = json_tpv_read(buf, gpsdata, end);
 	gpsdata->status = STATUS_FIX;
-	gpsdata->set = STATUS_SET;
-	if (isnan(gpsdata->fix.time) == 0)
-	    gpsdata->set |= TIME_SET;
-	if (isnan(gpsdata->fix.ept) == 0)
-	    gpsdata->set |= TIMERR_SET;
-	if (isnan(gpsdata->fix.longitude) == 0)
-	    gpsdata->set |= LATLON_SET;
-	if (isnan(gpsdata->fix.altitude) == 0)
-	    gpsdata->set |= ALTITUDE_SET;
-	if (isnan(gpsdata->fix.epx) == 0 && isnan(gpsdata->fix.epy) == 0)
-	    gpsdata->set |= HERR_SET;
-	if (isnan(gpsdata->fix.epv) == 0)
-	    gpsdata->set |= VERR_SET;
-	if (isnan(gpsdata->fix.track) == 0)
-	    gpsdata->set |= TRACK_SET;
-	if (isnan(gpsdata->fix.speed) == 0)
-	    gpsdata->set |= SPEED_SET;
-	if (isnan(gpsdata->fix.climb) == 0)
-	    gpsdata->set |= CLIMB_SET;
-	if (isnan(gpsdata->fix.epd) == 0)
-	    gpsdata->set |= TRACKERR_SET;
-	if (isnan(gpsdata->fix.eps) == 0)
-	    gpsdata->set |= SPEEDERR_SET;
-	if (isnan(gpsdata->fix.epc) == 0)
-	    gpsdata->set |= CLIMBERR_SET;
-	if (isnan(gpsdata->fix.epc) == 0)
-	    gpsdata->set |= CLIMBERR_SET;
-	if (gpsdata->fix.mode != MODE_NOT_SEEN)
-	    gpsdata->set |= MODE_SET;
+	gpsdata->set = STATUS_SET | libgps_fix_mask(&gpsdata->fix);
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"GST\"")) {
+    case CLASS_GST:
 	status = json_noise_read(buf, gpsdata, end);
 	if (status == 0) {
 	    gpsdata->set &= ~UNION_SET;
 	    gpsdata->set |= GST_SET;
 	}
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"SKY\"")) {
+    case CLASS_SKY:
 	status = json_sky_read(buf, gpsdata, end);
 	if (status == 0)
 	    gpsdata->set |= SATELLITE_SET;
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"ATT\"")) {
+    case CLASS_ATT:
 	status = json_att_read(buf, gpsdata, end);
 	if (status == 0) {
 	    gpsdata->set &= ~UNION_SET;
 	    gpsdata->set |= ATTITUDE_SET;
 	}
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"DEVICES\"")) {
+    case CLASS_DEVICES:
 	status = json_devicelist_read(buf, gpsdata, end);
 	if (status == 0) {
 	    gpsdata->set &= ~UNION_SET;
 	    gpsdata->set |= DEVICELIST_SET;
 	}
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"DEVICE\"")) {
+    case CLASS_DEVICE:
 	status = json_device_read(buf, &gpsdata->dev, end);
 	if (status == 0)
 	    gpsdata->set |= DEVICE_SET;
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"WATCH\"")) {
+    case CLASS_WATCH:
 	status = json_watch_read(buf, &gpsdata->policy, end);
 	if (status == 0) {
 	    gpsdata->set &= ~UNION_SET;
 	    gpsdata->set |= POLICY_SET;
 	}
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"VERSION\"")) {
+    case CLASS_VERSION:
 	status = json_version_read(buf, gpsdata, end);
 	if (status ==  0) {
 	    gpsdata->set &= ~UNION_SET;
@@ -475,7 +594,7 @@ int libgps_json_unpack(const char *buf,
 	}
 	return status;
 #ifdef RTCM104V2_ENABLE
-    } else if (STARTSWITH(classtag, "\"class\":\"RTCM2\"")) {
+    case CLASS_RTCM2:
 	status = json_rtcm2_read(buf,
 				 gpsdata->dev.path, sizeof(gpsdata->dev.path),
 				 &gpsdata->rtcm2, end);
@@ -486,7 +605,7 @@ int libgps_json_unpack(const char *buf,
 	return status;
 #endif /* RTCM104V2_ENABLE */
 #ifdef RTCM104V3_ENABLE
-    } else if (STARTSWITH(classtag, "\"class\":\"RTCM3\"")) {
+    case CLASS_RTCM3:
 	status = json_rtcm3_read(buf,
 				 gpsdata->dev.path, sizeof(gpsdata->dev.path),
 				 &gpsdata->rtcm3, end);
@@ -497,7 +616,7 @@ int libgps_json_unpack(const char *buf,
 	return status;
 #endif /* RTCM104V3_ENABLE */
 #ifdef AIVDM_ENABLE
-    } else if (STARTSWITH(classtag, "\"class\":\"AIS\"")) {
+    case CLASS_AIS:
 	status = json_ais_read(buf,
 			       gpsdata->dev.path, sizeof(gpsdata->dev.path),
 			       &gpsdata->ais, end);
@@ -507,23 +626,23 @@ int libgps_json_unpack(const char *buf,
 	}
 	return status;
 #endif /* AIVDM_ENABLE */
-    } else if (STARTSWITH(classtag, "\"class\":\"ERROR\"")) {
+    case CLASS_ERROR:
 	status = json_error_read(buf, gpsdata, end);
 	if (status == 0) {
 	    gpsdata->set &= ~UNION_SET;
 	    gpsdata->set |= ERROR_SET;
 	}
 	return status;
-    } else if (STARTSWITH(classtag, "\"class\":\"PPS\"")) {
+    case CLASS_PPS:
 	status = json_pps_read(buf, gpsdata, end);
 	if (status == 0) {
 	    gpsdata->set &= ~UNION_SET;
 	    gpsdata->set |= TIMEDRIFT_SET;
 	}
 	return status;
-    } else
+    default:
 	return -1;
-#undef STARTSWITH
+    }
 }
 
 /*@+compdef@*/
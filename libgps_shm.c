@@ -25,6 +25,13 @@ PERMISSIONS
 #include <sys/time.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#ifdef HAVE_LINUX_FUTEX_H
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <time.h>
+#endif /* HAVE_LINUX_FUTEX_H */
 
 #include "gpsd.h"
 #include "libgps.h"
@@ -33,7 +40,8 @@ PERMISSIONS
 struct privdata_t
 {
     void *shmseg;
-    int tick;
+    unsigned int tick;		/* sequence number of the last update read */
+    unsigned long dropped;	/* updates overwritten before we got to them */
 };
 /*@+matchfields@*/
 
@@ -42,11 +50,12 @@ int gps_shm_open(/*@out@*/struct gps_data_t *gpsdata)
 /* open a shared-memory connection to the daemon */
 {
     int shmid;
+    volatile struct shmexport_t *shared;
 
     libgps_debug_trace((DEBUG_CALLS, "gps_shm_open()\n"));
 
     gpsdata->privdata = NULL;
-    shmid = shmget((key_t)GPSD_KEY, sizeof(struct gps_data_t), 0);
+    shmid = shmget((key_t)GPSD_RING_KEY, sizeof(struct shmexport_t), 0);
     if (shmid == -1) {
 	/* daemon isn't running or failed to create shared segment */
 	return -1;
@@ -56,10 +65,26 @@ int gps_shm_open(/*@out@*/struct gps_data_t *gpsdata)
 	return -1;
 
     PRIVATE(gpsdata)->shmseg = shmat(shmid, 0, 0);
-    if ((int)(long)gpsdata->privdata == -1) {
+    if ((int)(long)PRIVATE(gpsdata)->shmseg == -1) {
 	/* attach failed for sume unknown reason */
 	return -2;
     }
+    shared = (struct shmexport_t *)PRIVATE(gpsdata)->shmseg;
+    memory_barrier();
+    if (shared->magic != SHM_EXPORT_MAGIC
+	|| shared->version != SHM_EXPORT_VERSION
+	|| shared->size != (unsigned int)sizeof(struct shmexport_t)) {
+	/* a daemon with another layout, or one still setting up */
+	(void)shmdt((const void *)PRIVATE(gpsdata)->shmseg);
+	free(gpsdata->privdata);
+	gpsdata->privdata = NULL;
+	return -1;
+    }
+    /* start from the newest update, as a socket client would */
+    PRIVATE(gpsdata)->tick = shared->head;
+    if (PRIVATE(gpsdata)->tick != 0)
+	PRIVATE(gpsdata)->tick--;
+    PRIVATE(gpsdata)->dropped = 0;
 #ifndef USE_QT
     gpsdata->gps_fd = SHM_PSEUDO_FD;
 #else
@@ -68,86 +93,143 @@ int gps_shm_open(/*@out@*/struct gps_data_t *gpsdata)
     return 0;
 }
 
+#ifndef HAVE_LINUX_FUTEX_H
+#define SHM_POLL_INTERVAL	0.01	/* seconds between checks */
+#endif /* HAVE_LINUX_FUTEX_H */
+
 bool gps_shm_waiting(const struct gps_data_t *gpsdata, int timeout)
-/* check to see if new data has been written */
+/* wait up to timeout microseconds for new data to be written */
 {
     volatile struct shmexport_t *shared = (struct shmexport_t *)PRIVATE(gpsdata)->shmseg;
-    timestamp_t basetime = timestamp();
+    timestamp_t deadline = timestamp() + timeout / 1e6;
 
-    /* busy-waiting sucks, but there's not really an alternative */
     for (;;) {
-	bool newdata = false;
-	memory_barrier();
-	if (shared->bookend1 == shared->bookend2 && shared->bookend1 > PRIVATE(gpsdata)->tick)
-	    newdata = true;
+	unsigned int head;
+	timestamp_t nap;
+	struct timespec ts;
+
 	memory_barrier();
-	if (newdata || (timestamp() - basetime >= (double)timeout))
-	    break;
-    }
+	head = shared->head;
+	if (head != PRIVATE(gpsdata)->tick)
+	    return true;
 
-    return true;
+	nap = deadline - timestamp();
+	if (nap <= 0)
+	    return false;
+#ifdef HAVE_LINUX_FUTEX_H
+	/*
+	 * Sleep until shm_update() moves head on.  If it already has
+	 * since we looked, the kernel notices the mismatch and returns
+	 * at once, so no update can be missed between the check above
+	 * and the wait.
+	 */
+	ts.tv_sec = (time_t)nap;
+	ts.tv_nsec = (long)((nap - ts.tv_sec) * 1e9);
+	(void)__sync_fetch_and_add(&shared->waiters, 1);
+	(void)syscall(SYS_futex, &shared->head, FUTEX_WAIT,
+		      head, &ts, NULL, 0);
+	(void)__sync_fetch_and_sub(&shared->waiters, 1);
+#else
+	/* no way to be woken up, so look again at a modest rate */
+	if (nap > SHM_POLL_INTERVAL)
+	    nap = SHM_POLL_INTERVAL;
+	ts.tv_sec = (time_t)nap;
+	ts.tv_nsec = (long)((nap - ts.tv_sec) * 1e9);
+	(void)nanosleep(&ts, NULL);
+#endif /* HAVE_LINUX_FUTEX_H */
+    }
 }
 
 int gps_shm_read(struct gps_data_t *gpsdata)
-/* read an update from the shared-memory segment */
+/* read the next update from the shared-memory ring */
 {
     /*@ -compdestroy */
     if (gpsdata->privdata == NULL)
 	return -1;
     else
     {
-	int before, after;
 	void *private_save = gpsdata->privdata;
-	volatile struct shmexport_t *shared = (struct shmexport_t *)PRIVATE(gpsdata)->shmseg;
-	struct gps_data_t noclobber;
+	struct privdata_t *priv = PRIVATE(gpsdata);
+	volatile struct shmexport_t *shared = (struct shmexport_t *)priv->shmseg;
+	unsigned int next, before, after;
 
-	/*
-	 * Following block of instructions must not be reordered,
-	 * otherwise havoc will ensue.  The memory_barrier() call
-	 * should prevent reordering of the data accesses.
-	 *
-	 * This is a simple optimistic-concurrency technique.  We wrote
-	 * the second bookend first, then the data, then the first bookend.
-	 * Reader copies what it sees in normal order; that way, if we
-	 * start to write the segment during the read, the second bookend will
-	 * get clobbered first and the data can be detected as bad.
-	 */
-	before = shared->bookend1;
-	memory_barrier();
-	(void)memcpy((void *)&noclobber,
-		     (void *)&shared->gpsdata,
-		     sizeof(struct gps_data_t));
-	memory_barrier();
-	after = shared->bookend2;
+	for (;;) {
+	    unsigned int head, behind;
+	    volatile struct shmslot_t *slot;
 
-	if (before != after)
-	    return 0;
-	else {
+	    memory_barrier();
+	    head = shared->head;
+	    behind = head - priv->tick;
+	    if (behind == 0)
+		return 0;
+	    if ((int)behind < 0) {
+		/* the daemon started over on a fresh segment */
+		priv->tick = head;
+		if (head == 0)
+		    return 0;
+		priv->tick--;
+	    } else if (behind >= SHM_RING_SLOTS) {
+		/* the oldest of these have been overwritten already */
+		priv->dropped += behind - (SHM_RING_SLOTS - 1);
+		priv->tick = head - (SHM_RING_SLOTS - 1);
+	    }
+	    next = priv->tick + 1;
+	    slot = &shared->ring[next % SHM_RING_SLOTS];
+
+	    /*
+	     * Following block of instructions must not be reordered,
+	     * otherwise havoc will ensue.  The memory_barrier() call
+	     * should prevent reordering of the data accesses.
+	     *
+	     * This is a simple optimistic-concurrency technique.  We wrote
+	     * the second bookend first, then the data, then the first bookend.
+	     * Reader copies what it sees in normal order; that way, if we
+	     * start to write the slot during the read, the second bookend will
+	     * get clobbered first and the data can be detected as bad.  A
+	     * slot that no longer holds the update we wanted has been
+	     * lapped by the writer; go round again and catch up.
+	     */
+	    before = slot->bookend1;
+	    memory_barrier();
 	    (void)memcpy((void *)gpsdata,
-			 (void *)&noclobber,
+			 (void *)&slot->gpsdata,
 			 sizeof(struct gps_data_t));
+	    memory_barrier();
+	    after = slot->bookend2;
 	    /*@i1@*/gpsdata->privdata = private_save;
-	    PRIVATE(gpsdata)->tick = after;
-	    if ((gpsdata->set & REPORT_IS)!=0) {
-		if (gpsdata->fix.mode >= 2)
-		    gpsdata->status = STATUS_FIX;
-		else
-		    gpsdata->status = STATUS_NO_FIX;
-		gpsdata->set = STATUS_SET;
-	    }
-	    return (int)sizeof(struct gps_data_t);
+
+	    if (before == next && after == next)
+		break;
 	}
+
+	priv->tick = next;
+	if ((gpsdata->set & REPORT_IS)!=0) {
+	    if (gpsdata->fix.mode >= 2)
+		gpsdata->status = STATUS_FIX;
+	    else
+		gpsdata->status = STATUS_NO_FIX;
+	    gpsdata->set = STATUS_SET;
+	}
+	return (int)sizeof(struct gps_data_t);
     }
     /*@ +compdestroy */
 }
 
+unsigned long gps_shm_dropped(const struct gps_data_t *gpsdata)
+/* how many updates were overwritten before this reader got to them? */
+{
+    if (gpsdata->privdata == NULL)
+	return 0;
+    return PRIVATE(gpsdata)->dropped;
+}
+
 void gps_shm_close(struct gps_data_t *gpsdata)
 {
     if (PRIVATE(gpsdata)->shmseg != NULL)
 	(void)shmdt((const void *)PRIVATE(gpsdata)->shmseg);
 }
 
-int gps_shm_mainloop(struct gps_data_t *gpsdata, int timeout UNUSED,
+int gps_shm_mainloop(struct gps_data_t *gpsdata, int timeout,
 			 void (*hook)(struct gps_data_t *gpsdata))
 /* run a shm main loop with a specified handler */
 {
@@ -166,6 +248,241 @@ int gps_shm_mainloop(struct gps_data_t *gpsdata, int timeout UNUSED,
     //return 0;
 }
 
+/*
+ * The compact per-device export.  These handles are independent of
+ * any gps_data_t session; a reader may open as many as it likes.
+ */
+
+struct gps_shmdev_t
+{
+    volatile char *shmseg;
+    unsigned int incarnation;
+    unsigned int tick[SHMDEV_CLASSES];
+    unsigned long dropped[SHMDEV_CLASSES];
+};
+
+static const size_t shmdev_size[SHMDEV_CLASSES] = SHMDEV_SIZES;
+
+/*@null@*/static volatile struct shmdir_t *shmdir_attach(void)
+/* attach the daemon's directory of device segments */
+{
+    int shmid = shmget((key_t)GPSD_DIR_KEY, sizeof(struct shmdir_t), 0);
+    void *segment;
+
+    if (shmid == -1)
+	return NULL;
+    segment = shmat(shmid, 0, SHM_RDONLY);
+    if ((int)(long)segment == -1)
+	return NULL;
+    return (volatile struct shmdir_t *)segment;
+}
+
+static void shmdir_copy(volatile struct shmdir_t *dir,
+			/*@out@*/struct shmdir_t *copy)
+/* take a consistent snapshot of the directory */
+{
+    unsigned int before, after;
+
+    do {
+	before = dir->generation;
+	memory_barrier();
+	(void)memcpy((void *)copy, (void *)dir, sizeof(struct shmdir_t));
+	memory_barrier();
+	after = dir->generation;
+    } while (before != after || (before & 1) != 0);
+}
+
+int gps_shmdev_list(/*@out@*/char (*paths)[GPS_PATH_MAX], int max)
+/* list the devices with a compact export, return how many */
+{
+    volatile struct shmdir_t *dir = shmdir_attach();
+    struct shmdir_t copy;
+    int i, n = 0;
+
+    if (dir == NULL)
+	return -1;
+    shmdir_copy(dir, &copy);
+    (void)shmdt((const void *)dir);
+    for (i = 0; i < SHMDIR_ENTRIES; i++)
+	if (copy.device[i].path[0] != '\0') {
+	    if (n < max)
+		(void)strlcpy(paths[n], copy.device[i].path, GPS_PATH_MAX);
+	    n++;
+	}
+    return n;
+}
+
+/*@null@*/struct gps_shmdev_t *gps_shmdev_open(/*@null@*/const char *path)
+/* attach the compact export of a device, or of the first one if NULL */
+{
+    volatile struct shmdir_t *dir = shmdir_attach();
+    volatile struct shmdev_t *shared;
+    struct gps_shmdev_t *dev;
+    struct shmdir_t copy;
+    void *segment;
+    int i, entry, shmid;
+
+    libgps_debug_trace((DEBUG_CALLS, "gps_shmdev_open(%s)\n",
+			path != NULL ? path : "NULL"));
+
+    if (dir == NULL)
+	return NULL;
+    shmdir_copy(dir, &copy);
+    (void)shmdt((const void *)dir);
+    for (i = 0; i < SHMDIR_ENTRIES; i++)
+	if (copy.device[i].path[0] != '\0'
+	    && (path == NULL || strcmp(copy.device[i].path, path) == 0))
+	    break;
+    if (i == SHMDIR_ENTRIES)
+	return NULL;
+
+    entry = i;
+    if ((shmid = shmget(copy.device[entry].key, 0, 0)) == -1)
+	return NULL;
+    /* not read-only: sleeping readers count themselves in the segment */
+    segment = shmat(shmid, 0, 0);
+    if ((int)(long)segment == -1)
+	return NULL;
+    shared = (volatile struct shmdev_t *)segment;
+    for (i = 0; i < SHMDEV_CLASSES; i++)
+	if (shared->ring[i].size != (unsigned int)shmdev_size[i])
+	    break;
+    if (i < SHMDEV_CLASSES
+	|| shared->incarnation != copy.device[entry].incarnation) {
+	/* another daemon version, or the device went away meanwhile */
+	(void)shmdt(segment);
+	return NULL;
+    }
+    if ((dev = (struct gps_shmdev_t *)malloc(sizeof(*dev))) == NULL) {
+	(void)shmdt(segment);
+	return NULL;
+    }
+    dev->shmseg = (volatile char *)segment;
+    dev->incarnation = copy.device[entry].incarnation;
+    /* start from the newest record of each class */
+    for (i = 0; i < SHMDEV_CLASSES; i++) {
+	dev->tick[i] = shared->ring[i].head;
+	if (dev->tick[i] != 0)
+	    dev->tick[i]--;
+	dev->dropped[i] = 0;
+    }
+    return dev;
+}
+
+static bool shmdev_gone(const struct gps_shmdev_t *dev)
+/* has the device behind this handle been deactivated? */
+{
+    volatile struct shmdev_t *shared = (volatile struct shmdev_t *)dev->shmseg;
+
+    memory_barrier();
+    return shared->incarnation != dev->incarnation;
+}
+
+bool gps_shmdev_waiting(struct gps_shmdev_t *dev, unsigned int classes,
+			int timeout)
+/* wait up to timeout microseconds for a record of one of the classes */
+{
+    volatile struct shmdev_t *shared = (volatile struct shmdev_t *)dev->shmseg;
+    timestamp_t deadline = timestamp() + timeout / 1e6;
+
+    for (;;) {
+	unsigned int generation;
+	timestamp_t nap;
+	struct timespec ts;
+	int i;
+
+	memory_barrier();
+	generation = shared->generation;
+	memory_barrier();
+	/* report a vanished device as input, so the read can fail */
+	if (shmdev_gone(dev))
+	    return true;
+	for (i = 0; i < SHMDEV_CLASSES; i++)
+	    if ((classes & (1u << i)) != 0
+		&& shared->ring[i].head != dev->tick[i])
+		return true;
+
+	nap = deadline - timestamp();
+	if (nap <= 0)
+	    return false;
+#ifdef HAVE_LINUX_FUTEX_H
+	/* as in gps_shm_waiting(), but any class's record moves the word */
+	ts.tv_sec = (time_t)nap;
+	ts.tv_nsec = (long)((nap - ts.tv_sec) * 1e9);
+	(void)__sync_fetch_and_add(&shared->waiters, 1);
+	(void)syscall(SYS_futex, &shared->generation, FUTEX_WAIT,
+		      generation, &ts, NULL, 0);
+	(void)__sync_fetch_and_sub(&shared->waiters, 1);
+#else
+	if (nap > SHM_POLL_INTERVAL)
+	    nap = SHM_POLL_INTERVAL;
+	ts.tv_sec = (time_t)nap;
+	ts.tv_nsec = (long)((nap - ts.tv_sec) * 1e9);
+	(void)nanosleep(&ts, NULL);
+#endif /* HAVE_LINUX_FUTEX_H */
+    }
+}
+
+int gps_shmdev_read(struct gps_shmdev_t *dev, int class,
+		    /*@out@*/void *record, size_t len)
+/* copy out the next unread record of a class */
+{
+    volatile struct shmdev_t *shared = (volatile struct shmdev_t *)dev->shmseg;
+    volatile struct shmring_t *ring;
+    unsigned int next, before, after;
+
+    if (class < 0 || class >= SHMDEV_CLASSES || len < shmdev_size[class])
+	return -1;
+    ring = &shared->ring[class];
+
+    /* the ring discipline of gps_shm_read(), with smaller slots */
+    for (;;) {
+	unsigned int head, behind;
+	volatile char *slot;
+
+	if (shmdev_gone(dev))
+	    return -1;
+	memory_barrier();
+	head = ring->head;
+	behind = head - dev->tick[class];
+	if (behind == 0)
+	    return 0;
+	if (behind >= SHMDEV_SLOTS) {
+	    dev->dropped[class] += behind - (SHMDEV_SLOTS - 1);
+	    dev->tick[class] = head - (SHMDEV_SLOTS - 1);
+	}
+	next = dev->tick[class] + 1;
+	slot = dev->shmseg + ring->offset + (next % SHMDEV_SLOTS) * ring->stride;
+
+	before = *(volatile unsigned int *)slot;
+	memory_barrier();
+	(void)memcpy(record, (void *)(slot + SHMDEV_RECORD),
+		     shmdev_size[class]);
+	memory_barrier();
+	after = *(volatile unsigned int *)(slot + ring->stride - 8);
+	if (before == next && after == next)
+	    break;
+    }
+
+    dev->tick[class] = next;
+    return (int)shmdev_size[class];
+}
+
+unsigned long gps_shmdev_dropped(const struct gps_shmdev_t *dev, int class)
+/* how many records of a class were overwritten before we got to them? */
+{
+    if (class < 0 || class >= SHMDEV_CLASSES)
+	return 0;
+    return dev->dropped[class];
+}
+
+void gps_shmdev_close(/*@only@*/struct gps_shmdev_t *dev)
+/* detach from a device's compact export */
+{
+    (void)shmdt((const void *)dev->shmseg);
+    free(dev);
+}
+
 #endif /* SHM_EXPORT_ENABLE */
 
 /* end */
@@ -3,6 +3,7 @@
  * This file is Copyright (c) 2010 by the GPSD project
  * BSD terms apply: see the file COPYING in the distribution root for details.
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -45,7 +46,10 @@ struct privdata_t
 {
     bool newstyle;
     /* data buffered from the last read */
-    ssize_t waiting;
+    ssize_t waiting;		/* bytes in the buffer */
+    ssize_t start;		/* offset of the first unread response */
+    ssize_t scanned;		/* no newline between start and here */
+    ssize_t response;		/* offset of the response last returned */
     char buffer[GPS_JSON_RESPONSE_MAX * 2];
 #ifdef LIBGPS_DEBUG
     int waitcount;
@@ -89,6 +93,10 @@ int gps_sock_open(/*@null@*/const char *host, /*@null@*/const char *port,
 	return -1;
     PRIVATE(gpsdata)->newstyle = false;
     PRIVATE(gpsdata)->waiting = 0;
+    PRIVATE(gpsdata)->start = 0;
+    PRIVATE(gpsdata)->scanned = 0;
+    PRIVATE(gpsdata)->response = 0;
+    PRIVATE(gpsdata)->buffer[0] = '\0';
 
 #ifdef LIBGPS_DEBUG
     PRIVATE(gpsdata)->waitcount = 0;
@@ -97,6 +105,52 @@ int gps_sock_open(/*@null@*/const char *host, /*@null@*/const char *port,
 }
 /*@+branchstate@*/
 
+static ssize_t sock_response(const struct privdata_t *priv)
+/* length of the complete response at start, 0 if it isn't all in yet */
+{
+    const char *eol;
+
+    if (priv->waiting > priv->start
+	&& (unsigned char)priv->buffer[priv->start] == GPS_WIRE_MAGIC) {
+	struct gps_wire_header_t header;
+	size_t length;
+
+	/* binary frames carry their own length */
+	if ((size_t)(priv->waiting - priv->start) < sizeof(header))
+	    return 0;
+	memcpy(&header, priv->buffer + priv->start, sizeof(header));
+	/*
+	 * Another version may lay the header out differently, so its
+	 * length can't be trusted to find the next response.  A frame
+	 * from a daemon of the other byte order is still sized here,
+	 * with the length swapped, so that wire_unpack() can skip it.
+	 */
+	if (header.version != GPS_WIRE_VERSION)
+	    return -1;
+	if (header.order == GPS_WIRE_ORDER)
+	    length = (size_t)header.length;
+	else if (header.order == (uint16_t)((GPS_WIRE_ORDER >> 8)
+					    | (GPS_WIRE_ORDER << 8)))
+	    length = (size_t)(((header.length & 0xff) << 24)
+			      | ((header.length & 0xff00) << 8)
+			      | ((header.length >> 8) & 0xff00)
+			      | ((header.length >> 24) & 0xff));
+	else
+	    return -1;
+	length += sizeof(header);
+	if (length > sizeof(priv->buffer))
+	    return -1;
+	if ((size_t)(priv->waiting - priv->start) < length)
+	    return 0;
+	return (ssize_t)length;
+    }
+    eol = (const char *)memchr(priv->buffer + priv->scanned, '\n',
+			       (size_t)(priv->waiting - priv->scanned));
+    if (eol == NULL)
+	return 0;
+    return eol - (priv->buffer + priv->start) + 1;
+}
+
 bool gps_sock_waiting(const struct gps_data_t *gpsdata, int timeout)
 /* is there input waiting from the GPS? */
 {
@@ -105,7 +159,8 @@ bool gps_sock_waiting(const struct gps_data_t *gpsdata, int timeout)
     struct timeval tv;
 
     libgps_debug_trace((DEBUG_CALLS, "gps_waiting(%d): %d\n", timeout, PRIVATE(gpsdata)->waitcount++));
-    if (PRIVATE(gpsdata)->waiting > 0)
+    /* a complete response is already buffered */
+    if (sock_response(PRIVATE(gpsdata)) != 0)
 	return true;
 
     /* we might want to check for EINTR if this returns false */
@@ -147,38 +202,52 @@ int gps_sock_close(struct gps_data_t *gpsdata)
 int gps_sock_read(/*@out@*/struct gps_data_t *gpsdata)
 /* wait for and read data being streamed from the daemon */
 {
-    char *eol;
+    struct privdata_t *priv = PRIVATE(gpsdata);
     ssize_t response_length;
     int status = -1;
 
     gpsdata->set &= ~PACKET_SET;
-    for (eol = PRIVATE(gpsdata)->buffer;
-	 *eol != '\n' && eol < PRIVATE(gpsdata)->buffer + PRIVATE(gpsdata)->waiting; eol++)
-	continue;
-    if (*eol != '\n')
-	eol = NULL;
+    /*
+     * Responses are handed out in place, one per call, with start
+     * advancing past each; the newline search resumes where the last
+     * unsuccessful one stopped.  So a recv() full of responses costs
+     * one pass over the buffer rather than a rescan and a memmove()
+     * per response.  Binary frames are sized by their header instead.
+     */
+    response_length = sock_response(priv);
 
     errno = 0;
 
-    if (eol == NULL) {
+    if (response_length == 0) {
+	priv->scanned = priv->waiting;
+	/* only a partial response is left, slide it down to make room */
+	if (priv->start > 0) {
+	    /*@+matchanyintegral@*/
+	    memmove(priv->buffer, priv->buffer + priv->start,
+		    priv->waiting - priv->start);
+	    /*@-matchanyintegral@*/
+	    priv->waiting -= priv->start;
+	    priv->scanned -= priv->start;
+	    priv->start = 0;
+	}
 #ifndef USE_QT
 	/* read data: return -1 if no data waiting or buffered, 0 otherwise */
 	status = (int)recv(gpsdata->gps_fd,
-			   PRIVATE(gpsdata)->buffer + PRIVATE(gpsdata)->waiting,
-			   sizeof(PRIVATE(gpsdata)->buffer) - PRIVATE(gpsdata)->waiting, 0);
+			   priv->buffer + priv->waiting,
+			   sizeof(priv->buffer) - priv->waiting, 0);
 #else
 	status =
-	    ((QTcpSocket *) (gpsdata->gps_fd))->read(PRIVATE(gpsdata)->buffer +
-						     PRIVATE(gpsdata)->waiting,
-						     sizeof(PRIVATE(gpsdata)->buffer) -
-						     PRIVATE(gpsdata)->waiting);
+	    ((QTcpSocket *) (gpsdata->gps_fd))->read(priv->buffer +
+						     priv->waiting,
+						     sizeof(priv->buffer) -
+						     priv->waiting);
 #endif
 
 	/* if we just received data from the socket, it's in the buffer */
 	if (status > -1)
-	    PRIVATE(gpsdata)->waiting += status;
+	    priv->waiting += status;
 	/* buffer is empty - implies no data was read */
-	if (PRIVATE(gpsdata)->waiting == 0) {
+	if (priv->waiting == 0) {
 	    /*
 	     * If we received 0 bytes, other side of socket is closing.
 	     * Return -1 as end-of-data indication.
@@ -197,31 +266,234 @@ int gps_sock_read(/*@out@*/struct gps_data_t *gpsdata)
 		return -1;
 	}
 	/* there's buffered data waiting to be returned */
-	for (eol = PRIVATE(gpsdata)->buffer;
-	     *eol != '\n' && eol < PRIVATE(gpsdata)->buffer + PRIVATE(gpsdata)->waiting; eol++)
-	    continue;
-	if (*eol != '\n')
-	    eol = NULL;
-	if (eol == NULL)
+	response_length = sock_response(priv);
+	if (response_length == 0) {
+	    priv->scanned = priv->waiting;
+#ifndef USE_QT
+	    /*
+	     * The daemon hung up partway through a response; the rest
+	     * will never come, so drop the fragment and report the end
+	     * of data rather than asking to be called again.
+	     */
+	    if (status == 0
+		&& (size_t)priv->waiting < sizeof(priv->buffer)) {
+		priv->waiting = priv->scanned = priv->start = 0;
+		return -1;
+	    }
+#endif /* USE_QT */
 	    return 0;
+	}
     }
+    /* a frame we can't size, or too long to ever fit, garbles the stream */
+    if (response_length < 0)
+	return -1;
 
-    assert(eol != NULL);
-    *eol = '\0';
-    response_length = eol - PRIVATE(gpsdata)->buffer + 1;
+    /* JSON responses are handed out as strings, frames as they are */
+    if ((unsigned char)priv->buffer[priv->start] != GPS_WIRE_MAGIC)
+	priv->buffer[priv->start + response_length - 1] = '\0';
     gpsdata->online = timestamp();
-    status = gps_unpack(PRIVATE(gpsdata)->buffer, gpsdata);
-    /*@+matchanyintegral@*/
-    memmove(PRIVATE(gpsdata)->buffer,
-	    PRIVATE(gpsdata)->buffer + response_length, PRIVATE(gpsdata)->waiting - response_length);
-    /*@-matchanyintegral@*/
-    PRIVATE(gpsdata)->waiting -= response_length;
+    priv->response = priv->start;
+    priv->start += response_length;
+    priv->scanned = priv->start;
+    status = gps_unpack(priv->buffer + priv->response, gpsdata);
+    /* everything consumed, the next recv() can start at the bottom */
+    if (priv->start == priv->waiting)
+	priv->start = priv->scanned = priv->waiting = 0;
     gpsdata->set |= PACKET_SET;
 
     return (status == 0) ? (int)response_length : status;
 }
 /*@+compdef -usedef +uniondef@*/
 
+static void wire_unpack(const char *buf, struct gps_data_t *gpsdata)
+/* unpack a binary frame into the status structure */
+{
+    struct gps_wire_header_t header;
+    const char *record = buf + sizeof(header);
+    size_t length;
+
+    memcpy(&header, buf, sizeof(header));
+    if (header.version != GPS_WIRE_VERSION || header.order != GPS_WIRE_ORDER) {
+	libgps_debug_trace((DEBUG_CALLS,
+			    "wire frame version %u order 0x%04x ignored\n",
+			    header.version, header.order));
+	return;
+    }
+    length = (size_t)header.length;
+
+    switch (header.type) {
+    case GPS_WIRE_TPV:
+	{
+	    struct gps_wire_tpv_t tpv;
+
+	    if (length < sizeof(tpv))
+		break;
+	    memcpy(&tpv, record, sizeof(tpv));
+	    gpsdata->fix.time = tpv.time;
+	    gpsdata->fix.ept = tpv.ept;
+	    gpsdata->fix.latitude = tpv.latitude;
+	    gpsdata->fix.longitude = tpv.longitude;
+	    gpsdata->fix.altitude = tpv.altitude;
+	    gpsdata->fix.epx = tpv.epx;
+	    gpsdata->fix.epy = tpv.epy;
+	    gpsdata->fix.epv = tpv.epv;
+	    gpsdata->fix.track = tpv.track;
+	    gpsdata->fix.speed = tpv.speed;
+	    gpsdata->fix.climb = tpv.climb;
+	    gpsdata->fix.epd = tpv.epd;
+	    gpsdata->fix.eps = tpv.eps;
+	    gpsdata->fix.epc = tpv.epc;
+	    gpsdata->fix.mode = (int)tpv.mode;
+	    gpsdata->status = (int)tpv.status;
+	    tpv.device[sizeof(tpv.device) - 1] = '\0';
+	    (void)strlcpy(gpsdata->dev.path, tpv.device,
+			  sizeof(gpsdata->dev.path));
+	    gpsdata->set = STATUS_SET | libgps_fix_mask(&gpsdata->fix);
+	}
+	break;
+    case GPS_WIRE_SKY:
+	{
+	    struct gps_wire_sky_t sky;
+	    const size_t fixed = offsetof(struct gps_wire_sky_t, sat);
+	    int i;
+
+	    if (length < fixed)
+		break;
+	    memcpy(&sky, record, fixed);
+	    if (sky.satellites_visible < 0
+		|| sky.satellites_visible > MAXCHANNELS
+		|| length < fixed + sky.satellites_visible
+				    * sizeof(struct gps_wire_sat_t))
+		break;
+	    memcpy(sky.sat, record + fixed,
+		   sky.satellites_visible * sizeof(struct gps_wire_sat_t));
+	    gpsdata->skyview_time = sky.time;
+	    gpsdata->dop.xdop = sky.xdop;
+	    gpsdata->dop.ydop = sky.ydop;
+	    gpsdata->dop.vdop = sky.vdop;
+	    gpsdata->dop.tdop = sky.tdop;
+	    gpsdata->dop.hdop = sky.hdop;
+	    gpsdata->dop.pdop = sky.pdop;
+	    gpsdata->dop.gdop = sky.gdop;
+	    for (i = 0; i < MAXCHANNELS; i++) {
+		struct satellite_t *sp = &gpsdata->skyview[i];
+
+		if (i < sky.satellites_visible) {
+		    sp->ss = sky.sat[i].ss;
+		    sp->PRN = sky.sat[i].PRN;
+		    sp->elevation = sky.sat[i].elevation;
+		    sp->azimuth = sky.sat[i].azimuth;
+		    sp->used = sky.sat[i].used != 0;
+		} else {
+		    sp->PRN = 0;
+		    sp->used = false;
+		}
+	    }
+	    gpsdata->satellites_visible = (int)sky.satellites_visible;
+	    gpsdata->satellites_used = (int)sky.satellites_used;
+	    sky.device[sizeof(sky.device) - 1] = '\0';
+	    (void)strlcpy(gpsdata->dev.path, sky.device,
+			  sizeof(gpsdata->dev.path));
+	    gpsdata->set |= SATELLITE_SET;
+	}
+	break;
+    case GPS_WIRE_GST:
+	{
+	    struct gps_wire_gst_t gst;
+
+	    if (length < sizeof(gst))
+		break;
+	    memcpy(&gst, record, sizeof(gst));
+	    gpsdata->gst.utctime = gst.utctime;
+	    gpsdata->gst.rms_deviation = gst.rms_deviation;
+	    gpsdata->gst.smajor_deviation = gst.smajor_deviation;
+	    gpsdata->gst.sminor_deviation = gst.sminor_deviation;
+	    gpsdata->gst.smajor_orientation = gst.smajor_orientation;
+	    gpsdata->gst.lat_err_deviation = gst.lat_err_deviation;
+	    gpsdata->gst.lon_err_deviation = gst.lon_err_deviation;
+	    gpsdata->gst.alt_err_deviation = gst.alt_err_deviation;
+	    gst.device[sizeof(gst.device) - 1] = '\0';
+	    (void)strlcpy(gpsdata->dev.path, gst.device,
+			  sizeof(gpsdata->dev.path));
+	    gpsdata->set &= ~UNION_SET;
+	    gpsdata->set |= GST_SET;
+	}
+	break;
+    case GPS_WIRE_ATT:
+	{
+	    struct gps_wire_att_t wa;
+	    struct attitude_t *att = &gpsdata->attitude;
+
+	    if (length < sizeof(wa))
+		break;
+	    memcpy(&wa, record, sizeof(wa));
+	    att->heading = wa.heading;
+	    att->pitch = wa.pitch;
+	    att->roll = wa.roll;
+	    att->yaw = wa.yaw;
+	    att->dip = wa.dip;
+	    att->mag_len = wa.mag_len;
+	    att->mag_x = wa.mag_x;
+	    att->mag_y = wa.mag_y;
+	    att->mag_z = wa.mag_z;
+	    att->acc_len = wa.acc_len;
+	    att->acc_x = wa.acc_x;
+	    att->acc_y = wa.acc_y;
+	    att->acc_z = wa.acc_z;
+	    att->gyro_x = wa.gyro_x;
+	    att->gyro_y = wa.gyro_y;
+	    att->temp = wa.temp;
+	    att->depth = wa.depth;
+	    att->mag_st = wa.mag_st;
+	    att->pitch_st = wa.pitch_st;
+	    att->roll_st = wa.roll_st;
+	    att->yaw_st = wa.yaw_st;
+	    wa.device[sizeof(wa.device) - 1] = '\0';
+	    (void)strlcpy(gpsdata->dev.path, wa.device,
+			  sizeof(gpsdata->dev.path));
+	    gpsdata->set &= ~UNION_SET;
+	    gpsdata->set |= ATTITUDE_SET;
+	}
+	break;
+    case GPS_WIRE_PPS:
+	{
+	    struct gps_wire_pps_t pps;
+
+	    if (length < sizeof(pps))
+		break;
+	    memcpy(&pps, record, sizeof(pps));
+	    /*@-type@*//* splint is confused about struct timespec */
+	    gpsdata->timedrift.real.tv_sec = (time_t)pps.real_sec;
+	    gpsdata->timedrift.real.tv_nsec = (long)pps.real_nsec;
+	    gpsdata->timedrift.clock.tv_sec = (time_t)pps.clock_sec;
+	    gpsdata->timedrift.clock.tv_nsec = (long)pps.clock_nsec;
+	    /*@+type@*/
+	    pps.device[sizeof(pps.device) - 1] = '\0';
+	    (void)strlcpy(gpsdata->dev.path, pps.device,
+			  sizeof(gpsdata->dev.path));
+	    gpsdata->set &= ~UNION_SET;
+	    gpsdata->set |= TIMEDRIFT_SET;
+	}
+	break;
+#ifdef AIVDM_ENABLE
+    case GPS_WIRE_AIS:
+	/* struct ais_t is shipped as is, so the layouts have to agree */
+	if (length != sizeof(struct gps_wire_ais_t))
+	    break;
+	(void)strlcpy(gpsdata->dev.path, record,
+		      sizeof(gpsdata->dev.path));
+	memcpy(&gpsdata->ais, record + offsetof(struct gps_wire_ais_t, ais),
+	       sizeof(gpsdata->ais));
+	gpsdata->set &= ~UNION_SET;
+	gpsdata->set |= AIS_SET;
+	break;
+#endif /* AIVDM_ENABLE */
+    default:
+	/* a report class this library doesn't know yet */
+	break;
+    }
+}
+
 /*@ -branchstate -usereleased -mustfreefresh -nullstate -usedef @*/
 int gps_unpack(char *buf, struct gps_data_t *gpsdata)
 /* unpack a gpsd response into a status structure, buf must be writeable.
@@ -229,6 +501,13 @@ int gps_unpack(char *buf, struct gps_data_t *gpsdata)
  * return an error status, it must be < 0.
  */
 {
+    /* detect and process a binary frame */
+    if ((unsigned char)buf[0] == GPS_WIRE_MAGIC) {
+	libgps_debug_trace((DEBUG_CALLS, "gps_unpack(binary frame)\n"));
+	wire_unpack(buf, gpsdata);
+	return 0;
+    }
+
     libgps_debug_trace((DEBUG_CALLS, "gps_unpack(%s)\n", buf));
 
     /* detect and process a JSON response */
@@ -462,7 +741,7 @@ int gps_unpack(char *buf, struct gps_data_t *gpsdata)
 const char /*@observer@*/ *gps_sock_data(const struct gps_data_t *gpsdata)
 /* return the contents of the client data buffer */
 {
-    return PRIVATE(gpsdata)->buffer;
+    return PRIVATE(gpsdata)->buffer + PRIVATE(gpsdata)->response;
 }
 
 int gps_sock_send(struct gps_data_t *gpsdata, const char *buf)
@@ -517,6 +796,10 @@ int gps_sock_stream(struct gps_data_t *gpsdata, unsigned int flags,
 		(void)strlcat(buf, "\"split24\":false,", sizeof(buf));
 	    if (flags & WATCH_PPS)
 		(void)strlcat(buf, "\"pps\":false,", sizeof(buf));
+	    if (flags & WATCH_BINARY)
+		(void)strlcat(buf, "\"binary\":false,", sizeof(buf));
+	    if (flags & WATCH_SKYDELTA)
+		(void)strlcat(buf, "\"skydelta\":false,", sizeof(buf));
 	    if (buf[strlen(buf) - 1] == ',')
 		buf[strlen(buf) - 1] = '\0';
 	    (void)strlcat(buf, "};", sizeof(buf));
@@ -547,6 +830,10 @@ int gps_sock_stream(struct gps_data_t *gpsdata, unsigned int flags,
 		(void)strlcat(buf, "\"split24\":true,", sizeof(buf));
 	    if (flags & WATCH_PPS)
 		(void)strlcat(buf, "\"pps\":true,", sizeof(buf));
+	    if (flags & WATCH_BINARY)
+		(void)strlcat(buf, "\"binary\":true,", sizeof(buf));
+	    if (flags & WATCH_SKYDELTA)
+		(void)strlcat(buf, "\"skydelta\":true,", sizeof(buf));
 	    /*@-nullpass@*//* shouldn't be needed, splint has a bug */
 	    if (flags & WATCH_DEVICE)
 		(void)snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf),
@@ -42,6 +42,9 @@ ssize_t gpsd_write(struct gps_device_t *session,
 		   const size_t len)
 /* pass low-level data to devices straight through */
 {
+    /* a network source that is still connecting holds it for later */
+    if (netconn_pending(session))
+	return netconn_write(session, buf, len);
     return session->context->serial_write(session, buf, len);
 }
 
@@ -268,9 +271,11 @@ void gps_context_init(struct gps_context_t *context,
 #ifdef NTPSHM_ENABLE
 	.shmTime	= {0},
 	.shmTimeInuse   = {0},
+	.shmTimePath    = {{0}},
 #endif /* NTPSHM_ENABLE */
 #ifdef PPS_ENABLE
 	.pps_hook       = NULL,
+	.pps_wake       = -1,
 #endif /* PPS_ENABLE */
 #ifdef SHM_EXPORT_ENABLE
 	.shmexport      = NULL,
@@ -348,6 +353,8 @@ void gpsd_deactivate(struct gps_device_t *session)
 #endif /* RECONFIGURE_ENABLE */
     gpsd_report(&session->context->errout, LOG_INF, "closing GPS=%s (%d)\n",
 		session->gpsdata.dev.path, session->gpsdata.gps_fd);
+    /* drop any lookup or connect still in flight */
+    netconn_close(session);
 #if defined(NMEA2000_ENABLE)
     if (session->sourcetype == source_can)
         (void)nmea2000_close(session);
@@ -376,6 +383,8 @@ void gpsd_clear(struct gps_device_t *session)
 #endif /* SIRF_ENABLE */
     lexer_init(&session->lexer);
     session->lexer.errout = session->context->errout;
+    /* UDP feeds can hand the lexer several datagrams per wakeup */
+    session->lexer.datagrams = (session->sourcetype == source_udp);
     // session->gpsdata.online = 0;
     gps_clear_fix(&session->gpsdata.fix);
     session->gpsdata.status = STATUS_NO_FIX;
@@ -420,14 +429,14 @@ int gpsd_open(struct gps_device_t *session)
 	gpsd_report(&session->context->errout, LOG_INF,
 		    "opening TCP feed at %s, port %s.\n", server,
 		    port);
-	if ((dsock = netlib_connectsock(AF_UNSPEC, server, port, "tcp")) < 0) {
+	if ((dsock = netconn_open(session, server, port, "tcp")) < 0) {
 	    gpsd_report(&session->context->errout, LOG_ERROR,
 			"TCP device open error %s.\n",
 			netlib_errstr(dsock));
 	    return -1;
 	} else
 	    gpsd_report(&session->context->errout, LOG_SPIN, 
-			"TCP device opened on fd %d\n", dsock);
+			"TCP device opening on fd %d\n", dsock);
 	session->gpsdata.gps_fd = dsock;
 	session->sourcetype = source_tcp;
 	return session->gpsdata.gps_fd;
@@ -447,14 +456,14 @@ int gpsd_open(struct gps_device_t *session)
 	gpsd_report(&session->context->errout, LOG_INF,
 		    "opening UDP feed at %s, port %s.\n", server,
 		    port);
-	if ((dsock = netlib_connectsock(AF_UNSPEC, server, port, "udp")) < 0) {
+	if ((dsock = netconn_open(session, server, port, "udp")) < 0) {
 	    gpsd_report(&session->context->errout, LOG_ERROR,
 			"UDP device open error %s.\n",
 			netlib_errstr(dsock));
 	    return -1;
 	} else
 	    gpsd_report(&session->context->errout, LOG_SPIN,
-			"UDP device opened on fd %d\n", dsock);
+			"UDP device opening on fd %d\n", dsock);
 	session->gpsdata.gps_fd = dsock;
 	session->sourcetype = source_udp;
 	return session->gpsdata.gps_fd;
@@ -474,14 +483,14 @@ int gpsd_open(struct gps_device_t *session)
 	gpsd_report(&session->context->errout, LOG_INF,
 		    "opening remote gpsd feed at %s, port %s.\n",
 		    server, port);
-	if ((dsock = netlib_connectsock(AF_UNSPEC, server, port, "tcp")) < 0) {
+	if ((dsock = netconn_open(session, server, port, "tcp")) < 0) {
 	    gpsd_report(&session->context->errout, LOG_ERROR,
 			"remote gpsd device open error %s.\n",
 			netlib_errstr(dsock));
 	    return -1;
 	} else
 	    gpsd_report(&session->context->errout, LOG_SPIN,
-			"remote gpsd feed opened on fd %d\n", dsock);
+			"remote gpsd feed opening on fd %d\n", dsock);
 	/*@+branchstate +nullpass@*/
 	/* watch to remote is issued when WATCH is */
 	session->gpsdata.gps_fd = dsock;
@@ -1444,23 +1453,34 @@ int gpsd_multipoll(const bool data_ready,
 	gpsd_report(&device->context->errout, LOG_RAW + 1, 
 		    "polling %d\n", device->gpsdata.gps_fd);
 
+	/*
+	 * A network source may still be looking up its host or waiting
+	 * for its connect to finish.  Move that along; the caller will
+	 * rewatch the descriptor for whatever the next stage waits on.
+	 */
+	if (netconn_pending(device)) {
+	    if (netconn_step(device) < 0)
+		return DEVICE_ERROR;
+	    return DEVICE_READY;
+	}
+
 #ifdef NETFEED_ENABLE
 	/*
-	 * Strange special case - the opening transaction on an NTRIP connection
-	 * may not yet be completed.  Try to ratchet things forward.
+	 * An NTRIP connection may still be reading the sourcetable or
+	 * waiting for the stream to start.  Take it a step further; once
+	 * the stream is on, whatever came with the reply is read below.
 	 */
 	if (device->servicetype == service_ntrip
 	    && device->ntrip.conn_state != ntrip_conn_established) {
+	    int status = ntrip_step(device);
 
-	    (void)ntrip_open(device, "");
-	    if (device->ntrip.conn_state == ntrip_conn_err) {
+	    if (status < 0) {
 		gpsd_report(&device->context->errout, LOG_WARN,
 			    "connection to ntrip server failed\n");
 		device->ntrip.conn_state = ntrip_conn_init;
 		return DEVICE_ERROR;
-	    } else {
+	    } else if (status == 0)
 		return DEVICE_READY;
-	    }
 	}
 #endif /* NETFEED_ENABLE */
 
@@ -1552,6 +1572,12 @@ int gpsd_multipoll(const bool data_ready,
 	    if (device->lexer.type != BAD_PACKET)
 		/*@i1@*/handler(device, changed);
 
+	    /* the handler may have given the session up meanwhile */
+	    if (device->poll_stop) {
+		device->poll_stop = false;
+		return DEVICE_UNCHANGED;
+	    }
+
 #ifdef __future__
 	    /*
 	     * Bernd Ocklin suggests:
@@ -1607,8 +1633,6 @@ void gpsd_zero_satellites( /*@out@*/ struct gps_data_t *out)
 void ntpshm_latch(struct gps_device_t *device, struct timedrift_t /*@out@*/*td)
 /* latch the fact that we've saved a fix */
 {
-    double fix_time, integral, fractional;
-
 #ifdef HAVE_CLOCK_GETTIME
     /*@i2@*/(void)clock_gettime(CLOCK_REALTIME, &td->clock);
 #else
@@ -1616,23 +1640,21 @@ void ntpshm_latch(struct gps_device_t *device, struct timedrift_t /*@out@*/*td)
     (void)gettimeofday(&clock_tv, NULL);
     TVTOTS(&td->clock, &clock_tv);
 #endif /* HAVE_CLOCK_GETTIME */
-    fix_time = device->newdata.time;
-    /* assume zero when there's no offset method */
-    if (device->device_type == NULL
-	|| device->device_type->time_offset == NULL)
-	fix_time += 0.0;
-    else
-	fix_time += device->device_type->time_offset(device);
-    /* it's ugly but timestamp_t is double */
-    fractional = modf(fix_time, &integral);
     /*@-type@*/ /* splint is confused about struct timespec */
-    td->real.tv_sec = (time_t)integral;
-    td->real.tv_nsec = (long)(fractional * 1e+9);
+    gpsd_fixtime(device, &td->real);
+    device->last_fixtime.real = td->real;
+    device->last_fixtime.clock = td->clock;
+    /* assume zero when there's no offset method */
+    if (device->device_type != NULL
+	&& device->device_type->time_offset != NULL) {
+	struct timespec offset;
+	/* small enough to convert without loss */
+	DTOTS(&offset, device->device_type->time_offset(device));
+	td->real.tv_sec += offset.tv_sec;
+	td->real.tv_nsec += offset.tv_nsec;
+	TS_NORM(&td->real);
+    }
     /*@+type@*/
-    device->last_fixtime.real = device->newdata.time;
-#ifndef S_SPLINT_S
-    device->last_fixtime.clock = td->clock.tv_sec + td->clock.tv_nsec / 1e9;
-#endif /* S_SPLINT_S */
 }
 #endif /* NTPSHM_ENABLE */
 
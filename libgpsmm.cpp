@@ -8,6 +8,10 @@
 
 #ifndef S_SPLINT_S
 #include <cstdlib>
+#include <cerrno>
+#ifndef USE_QT
+#include <poll.h>
+#endif /* USE_QT */
 #include "libgpsmm.h"
 #include "gpsd_config.h"
 
@@ -59,6 +63,51 @@ struct gps_data_t* gpsmm::read(void)
     }
 }
 
+static void deliver(const struct gps_data_t *state, gpsmm_handler &handler)
+// pass each report in a freshly read response to its handler member
+{
+    if (state->set & STATUS_SET)
+	handler.on_tpv(state->fix);
+    if (state->set & SATELLITE_SET)
+	handler.on_sky(*state);
+    if (state->set & GST_SET)
+	handler.on_gst(state->gst);
+    if (state->set & ATTITUDE_SET)
+	handler.on_att(state->attitude);
+    if (state->set & AIS_SET)
+	handler.on_ais(state->ais);
+    if (state->set & RTCM2_SET)
+	handler.on_rtcm2(state->rtcm2);
+    if (state->set & RTCM3_SET)
+	handler.on_rtcm3(state->rtcm3);
+    if (state->set & DEVICE_SET)
+	handler.on_device(state->dev);
+    if (state->set & DEVICELIST_SET)
+	handler.on_devices(*state);
+    if (state->set & VERSION_SET)
+	handler.on_version(state->version);
+    if (state->set & POLICY_SET)
+	handler.on_watch(state->policy);
+    if (state->set & TIMEDRIFT_SET)
+	handler.on_pps(state->timedrift);
+    if (state->set & ERROR_SET)
+	handler.on_error(state->error);
+}
+
+int gpsmm::dispatch(gpsmm_handler &handler)
+{
+    struct gps_data_t *state = gps_state();
+    int status;
+
+    if (to_user == NULL)
+	return -1;
+    // start from an empty mask, so that it says what this read delivered
+    state->set = 0;
+    if ((status = gps_read(state)) > 0)
+	deliver(state, handler);
+    return status;
+}
+
 bool gpsmm::waiting(int timeout)
 {
     return gps_waiting(gps_state(), timeout);
@@ -89,6 +138,23 @@ bool gpsmm::is_open(void)
 	return to_user != NULL;
 }
 
+#if __cplusplus >= 201103L
+gpsmm &gpsmm::operator=(gpsmm &&other)
+{
+    if (this != &other) {
+	if (to_user != NULL) {
+	    gps_close(gps_state());
+	    delete to_user;
+	}
+	to_user = other.to_user;
+	_gps_state = other._gps_state;
+	other.to_user = NULL;
+	other._gps_state.privdata = NULL;
+    }
+    return *this;
+}
+#endif
+
 gpsmm::~gpsmm()
 {
     if ( to_user != NULL ) {
@@ -96,4 +162,169 @@ gpsmm::~gpsmm()
 	delete to_user;
     }
 }
+
+#ifndef USE_QT
+/* backoff bounds for reconnecting, in seconds */
+#define POOL_BACKOFF_MIN	1.0
+#define POOL_BACKOFF_MAX	64.0
+/* responses taken from one source before the others get a turn */
+#define POOL_DRAIN_MAX		64
+
+gpsmm_pool::~gpsmm_pool()
+{
+    for (size_t i = 0; i < sources.size(); i++)
+	remove((int)i);
+}
+
+int gpsmm_pool::add(const char *host, const char *port,
+		    gpsmm_handler &handler, int flags)
+{
+    source_t *src = new source_t;
+
+    src->host = host;
+    src->port = port;
+    src->flags = flags;
+    src->handler = &handler;
+    src->open = false;
+    src->pending = false;
+    src->backoff = POOL_BACKOFF_MIN;
+    src->retry = 0;
+    sources.push_back(src);
+    connect(src);
+    return (int)sources.size() - 1;
+}
+
+void gpsmm_pool::remove(int source)
+{
+    if (source < 0 || (size_t)source >= sources.size()
+	|| sources[source] == NULL)
+	return;
+    if (sources[source]->open)
+	(void)gps_close(&sources[source]->state);
+    delete sources[source];
+    // source numbers aren't reused, so the slot stays
+    sources[source] = NULL;
+}
+
+bool gpsmm_pool::is_open(int source) const
+{
+    return source >= 0 && (size_t)source < sources.size()
+	&& sources[source] != NULL && sources[source]->open;
+}
+
+void gpsmm_pool::connect(source_t *src)
+// try to open a source, scheduling the next try if that fails
+{
+    if (gps_open(src->host.c_str(), src->port.c_str(), &src->state) == 0) {
+	if (gps_stream(&src->state, src->flags, NULL) == 0) {
+	    src->open = true;
+	    src->backoff = POOL_BACKOFF_MIN;
+	    src->handler->on_connect();
+	    return;
+	}
+	(void)gps_close(&src->state);
+    }
+    src->retry = timestamp() + src->backoff;
+    src->backoff *= 2;
+    if (src->backoff > POOL_BACKOFF_MAX)
+	src->backoff = POOL_BACKOFF_MAX;
+}
+
+void gpsmm_pool::disconnect(source_t *src)
+// drop a source's connection, to be retried after the backoff
+{
+    (void)gps_close(&src->state);
+    src->open = false;
+    src->pending = false;
+    src->retry = timestamp() + src->backoff;
+    src->handler->on_disconnect();
+}
+
+int gpsmm_pool::drain(int source)
+// dispatch the responses a source has waiting, up to a fair share
+{
+    int handled = 0;
+
+    for (;;) {
+	source_t *src = sources[source];
+	int status;
+
+	src->state.set = 0;
+	status = gps_read(&src->state);
+	if (status < 0) {
+	    disconnect(src);
+	    break;
+	}
+	if (status == 0)
+	    break;
+	handled++;
+	deliver(&src->state, *src->handler);
+	// the handler may have removed its own source
+	if (sources[source] == NULL || !sources[source]->open)
+	    break;
+	// more complete responses may be buffered where poll() can't see them
+	if (!gps_waiting(&src->state, 0))
+	    break;
+	if (handled == POOL_DRAIN_MAX) {
+	    src->pending = true;
+	    break;
+	}
+    }
+    return handled;
+}
+
+int gpsmm_pool::run(int timeout)
+{
+    std::vector<struct pollfd> fds;
+    std::vector<int> which;
+    timestamp_t now = timestamp();
+    int handled = 0;
+    size_t i;
+
+    for (i = 0; i < sources.size(); i++) {
+	source_t *src = sources[i];
+
+	if (src == NULL)
+	    continue;
+	if (!src->open && now >= src->retry)
+	    connect(src);
+	if (src->open) {
+	    struct pollfd pfd;
+
+	    pfd.fd = src->state.gps_fd;
+	    pfd.events = POLLIN;
+	    pfd.revents = 0;
+	    fds.push_back(pfd);
+	    which.push_back((int)i);
+	    if (src->pending)
+		timeout = 0;
+	} else {
+	    // a negative timeout waits forever, short of a retry deadline
+	    int until = (int)((src->retry - now) * 1000000);
+
+	    if (until < 0)
+		until = 0;
+	    if (timeout < 0 || until < timeout)
+		timeout = until;
+	}
+    }
+
+    // poll(2) counts milliseconds; round up so we don't spin
+    if (poll(fds.empty() ? NULL : &fds[0], (nfds_t)fds.size(),
+	     timeout < 0 ? -1 : (timeout + 999) / 1000) == -1 && errno != EINTR)
+	return -1;
+
+    for (i = 0; i < fds.size(); i++) {
+	source_t *src = sources[which[i]];
+
+	if (src == NULL || !src->open)
+	    continue;
+	if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0 || src->pending) {
+	    src->pending = false;
+	    handled += drain(which[i]);
+	}
+    }
+    return handled;
+}
+#endif /* USE_QT */
 #endif /* S_SPLINT_S */
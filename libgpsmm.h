@@ -9,8 +9,39 @@
  *
  */
 #include <sys/types.h>
+#ifndef USE_QT
+#include <string>
+#include <vector>
+#endif
 #include "gps.h" //the C library we are going to wrap
 
+/*
+ * Receiver for gpsmm::dispatch(); override the reports you care about.
+ * The arguments refer into the gpsmm object's own state, so nothing is
+ * copied, but they are only good until the next call on that object.
+ * Copy out whatever you need to keep.
+ */
+class gpsmm_handler {
+	public:
+		virtual ~gpsmm_handler() {}
+		virtual void on_tpv(const struct gps_fix_t &) {}
+		virtual void on_sky(const struct gps_data_t &) {} // skyview and dop
+		virtual void on_gst(const struct gst_t &) {}
+		virtual void on_att(const struct attitude_t &) {}
+		virtual void on_ais(const struct ais_t &) {}
+		virtual void on_rtcm2(const struct rtcm2_t &) {}
+		virtual void on_rtcm3(const struct rtcm3_t &) {}
+		virtual void on_device(const struct devconfig_t &) {}
+		virtual void on_devices(const struct gps_data_t &) {} // devices member
+		virtual void on_version(const struct version_t &) {}
+		virtual void on_watch(const struct policy_t &) {}
+		virtual void on_pps(const struct timedrift_t &) {}
+		virtual void on_error(const char *) {}
+		// only called by gpsmm_pool, as a source's connection comes and goes
+		virtual void on_connect(void) {}
+		virtual void on_disconnect(void) {}
+};
+
 #ifndef USE_QT
 class gpsmm {
 #else
@@ -36,17 +67,29 @@ class LIBQGPSMMSHARED_EXPORT gpsmm {
 		{
 		        gps_inner_open("localhost", DEFAULT_GPSD_PORT);
 		}
+#endif
+#if __cplusplus >= 201103L
+		// ownership of the connection can move, but not be shared
+		gpsmm(gpsmm &&other) : to_user(other.to_user), _gps_state(other._gps_state) {
+			other.to_user = NULL;
+			other._gps_state.privdata = NULL;
+		}
+		gpsmm &operator=(gpsmm &&other);
 #endif
 		virtual ~gpsmm();
 		struct gps_data_t* send(const char *request); //put a command to gpsd and return the updated struct
 		struct gps_data_t* stream(int); //set watcher and policy flags
 		struct gps_data_t* read(void); //block until gpsd returns new data, then return the updated struct
+		int dispatch(gpsmm_handler &); //block until gpsd returns new data, then pass it to the handler uncopied
+		const struct gps_data_t &view(void) const { return _gps_state; } //the internal structure, read-only and uncopied
 		const char *data(void);	// return the client data buffer
 		bool waiting(int);	// blocking check for data waiting
 		void clear_fix(void);
 		void enable_debug(int, FILE*);
 		bool is_open(void);	// check for constructor success
 	private:
+		gpsmm(const gpsmm &);		// copies would share one connection
+		gpsmm &operator=(const gpsmm &);
 		struct gps_data_t *to_user;	//we return the user a copy of the internal structure. This way she can modify it without
 						//integrity loss for the entire class
 		struct gps_data_t* gps_inner_open(const char *host,
@@ -55,4 +98,46 @@ class LIBQGPSMMSHARED_EXPORT gpsmm {
 		struct gps_data_t * gps_state() { return &_gps_state; }
 		struct gps_data_t* backup(void) { *to_user=*gps_state(); return to_user;}; //return the backup copy
 };
+
+#ifndef USE_QT
+/*
+ * Follows any number of gpsd instances from one thread.  Each source
+ * has its own gpsmm_handler, which is what tags its reports; run()
+ * waits on all the connections at once with poll(2) and dispatches
+ * whatever arrives, uncopied, as gpsmm::dispatch() does.  A source
+ * that can't be reached or drops its connection is retried with
+ * exponential backoff.  For more throughput, give each of a few
+ * threads its own pool.
+ */
+class gpsmm_pool {
+	public:
+		gpsmm_pool() {}
+		virtual ~gpsmm_pool();
+		// follow another daemon; returns its source number
+		int add(const char *host, const char *port, gpsmm_handler &handler,
+			int flags = WATCH_ENABLE | WATCH_JSON);
+		void remove(int source);	// stop following a source
+		bool is_open(int source) const;	// is the source connected now?
+		// wait up to timeout microseconds (forever if negative)
+		// for data, dispatch it; returns the number of responses handled
+		int run(int timeout);
+	private:
+		gpsmm_pool(const gpsmm_pool &);
+		gpsmm_pool &operator=(const gpsmm_pool &);
+		struct source_t {
+			std::string host, port;
+			int flags;
+			gpsmm_handler *handler;
+			bool open;
+			bool pending;		// stopped reading with input left over
+			double backoff;		// seconds until the next retry
+			timestamp_t retry;	// when to try reconnecting
+			struct gps_data_t state;
+		};
+		std::vector<source_t *> sources;
+		void connect(source_t *);
+		void disconnect(source_t *);
+		int drain(int);
+};
+#endif /* USE_QT */
 #endif // _GPSD_GPSMM_H_
@@ -0,0 +1,464 @@
+/* net_connect.c -- open network data sources without stalling the daemon
+ *
+ * netlib_connectsock() looks the host up and connects in line, which
+ * suits a client but would hold up every other device and client of
+ * the daemon for as long as a slow resolver or an unreachable caster
+ * takes to give up.  Here the lookup runs on a short-lived helper
+ * thread and the connect is non-blocking.  Both stages finish through
+ * the device's descriptor, so the main loop needs no new machinery:
+ *
+ *   resolving   gps_fd is the read end of a pipe the helper writes
+ *               to once getaddrinfo(3) has returned;
+ *   connecting  gps_fd is the socket, which goes writable when the
+ *               connect(2) has succeeded or failed;
+ *   connected   gps_fd is the socket, ready for data.
+ *
+ * The socket is moved onto the pipe's descriptor number with dup2(2),
+ * so gps_fd keeps one number from netconn_open() until the device is
+ * closed, and stays open after a failure for the usual close path.
+ * Keeping the number is not enough for epoll, though: the dup2(2)
+ * closes the file the number was registered with, and that silently
+ * drops the registration.  Every step therefore ends with multipoll
+ * returning DEVICE_READY, so that watch_device() adds the descriptor
+ * back for whatever the new stage waits on.
+ *
+ * gpsd_multipoll() calls netconn_step() when the descriptor of a
+ * source in the first two states goes ready.  Output written before
+ * the connection is up, such as a DGPSIP greeting or a WATCH for a
+ * remote gpsd, is held and sent once it is.  Tools without an event
+ * loop, such as gpsmon, finish the connection in line with
+ * netconn_wait().
+ *
+ * This file is Copyright (c) 2014 by the GPSD project
+ * BSD terms apply: see the file COPYING in the distribution root for details.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#ifndef S_SPLINT_S
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#endif /* S_SPLINT_S */
+
+#include "gpsd.h"
+
+/*
+ * Lookups in flight.  A slot stays busy until its resolver returns,
+ * even if the device has given up on it in the meantime, so this
+ * bounds the number of helper threads a dead DNS server can pile up.
+ */
+#define NETCONN_LOOKUPS	8
+
+struct netconn_lookup_t {
+    bool busy;
+    struct gps_device_t *device;
+    unsigned int generation;
+    char host[256];
+    char service[32];
+    int socktype;
+};
+
+static pthread_mutex_t netconn_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct netconn_lookup_t lookups[NETCONN_LOOKUPS];
+static unsigned int netconn_generation;
+
+static void netconn_fail(struct gps_device_t *session, const char *reason)
+/* record a failed attempt */
+{
+    (void)strlcpy(session->netconn.reason, reason,
+		  sizeof(session->netconn.reason));
+    session->netconn.state = netconn_failed;
+    gpsd_report(&session->context->errout, LOG_ERROR,
+		"%s: can't connect to %s port %s: %s\n",
+		session->gpsdata.dev.path,
+		session->netconn.host, session->netconn.service, reason);
+}
+
+static void netconn_free(struct gps_device_t *session)
+/* let go of the lookup result */
+{
+    if (session->netconn.addrs != NULL) {
+#ifndef S_SPLINT_S
+	freeaddrinfo(session->netconn.addrs);
+#endif /* S_SPLINT_S */
+	session->netconn.addrs = session->netconn.next = NULL;
+    }
+}
+
+static void *netconn_lookup(void *arg)
+/* helper thread: resolve a host and hand the result to its device */
+{
+    struct netconn_lookup_t *lookup = (struct netconn_lookup_t *)arg;
+    struct gps_device_t *session;
+    struct addrinfo hints, *result = NULL;
+    int err;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = lookup->socktype;
+    if (lookup->socktype == SOCK_DGRAM)
+	hints.ai_flags = AI_PASSIVE;
+    err = getaddrinfo(lookup->host, lookup->service, &hints, &result);
+
+    (void)pthread_mutex_lock(&netconn_mutex);
+    session = lookup->device;
+    /* the device may have been closed or reopened while we waited */
+    if (session->netconn.generation == lookup->generation) {
+	session->netconn.resolved = true;
+	if (err == 0) {
+	    session->netconn.addrs = session->netconn.next = result;
+	    result = NULL;
+	} else
+	    (void)strlcpy(session->netconn.reason, gai_strerror(err),
+			  sizeof(session->netconn.reason));
+	if (write(session->netconn.notify[1], "", 1) == -1) {
+	    /* the pipe is full, so the main loop is awake already */
+	}
+    }
+    lookup->busy = false;
+    (void)pthread_mutex_unlock(&netconn_mutex);
+    if (result != NULL)
+	freeaddrinfo(result);
+    return NULL;
+}
+
+static void netconn_established(struct gps_device_t *session, socket_t s)
+/* the socket is connected; tune it and send what was held */
+{
+    int one = 1;
+
+    netconn_free(session);
+#ifdef IPTOS_LOWDELAY
+    {
+	int opt = IPTOS_LOWDELAY;
+	/*@ -unrecog @*/
+	(void)setsockopt(s, IPPROTO_IP, IP_TOS, &opt, sizeof(opt));
+#ifdef IPV6_TCLASS
+	(void)setsockopt(s, IPPROTO_IPV6, IPV6_TCLASS, &opt, sizeof(opt));
+#endif
+	/*@ +unrecog @*/
+    }
+#endif
+#ifdef TCP_NODELAY
+    if (session->netconn.socktype == SOCK_STREAM)
+	(void)setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *)&one,
+			 sizeof(one));
+#endif
+    session->netconn.state = netconn_connected;
+    session->netconn.reason[0] = '\0';
+    gpsd_report(&session->context->errout, LOG_INF,
+		"%s: connected to %s port %s on fd %d\n",
+		session->gpsdata.dev.path,
+		session->netconn.host, session->netconn.service, s);
+    if (session->netconn.heldlen > 0) {
+	ssize_t sent = write(s, session->netconn.held,
+			     session->netconn.heldlen);
+	if (sent != (ssize_t)session->netconn.heldlen)
+	    gpsd_report(&session->context->errout, LOG_ERROR,
+			"%s: write of held output failed\n",
+			session->gpsdata.dev.path);
+	else
+	    gpsd_report(&session->context->errout, LOG_IO,
+			"%s: sent %zd held bytes\n",
+			session->gpsdata.dev.path, sent);
+	session->netconn.heldlen = 0;
+    }
+}
+
+static void netconn_adopt(struct gps_device_t *session, socket_t s)
+/* move a new socket onto the number gps_fd already has */
+{
+    /*
+     * Under epoll this drops gps_fd's registration along with the file
+     * it replaces; the DEVICE_READY that gpsd_multipoll() returns after
+     * netconn_step() is what gets the number watched again.
+     */
+    if (dup2(s, session->gpsdata.gps_fd) == -1) {
+	/* unlikely; the caller rewatches whatever number we end up with */
+	(void)close(session->gpsdata.gps_fd);
+	session->gpsdata.gps_fd = s;
+	return;
+    }
+    (void)close(s);
+    (void)fcntl(session->gpsdata.gps_fd, F_SETFD, FD_CLOEXEC);
+}
+
+static int netconn_next(struct gps_device_t *session, const char *reason)
+/* start connecting to the next address; 1 if done, 0 if waiting, -1 */
+{
+    struct addrinfo *rp;
+    int one = 1;
+
+    /* try addresses in the order getaddrinfo(3) ranked them */
+    while ((rp = session->netconn.next) != NULL) {
+	socket_t s;
+
+	session->netconn.next = rp->ai_next;
+	if ((s = socket(rp->ai_family, rp->ai_socktype,
+			rp->ai_protocol)) == -1) {
+	    reason = strerror(errno);
+	    continue;
+	}
+	netconn_adopt(session, s);
+	s = session->gpsdata.gps_fd;
+	(void)fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+	if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char *)&one,
+		       sizeof(one)) == -1) {
+	    reason = strerror(errno);
+	    continue;
+	}
+	if (rp->ai_socktype == SOCK_DGRAM) {
+	    /* a UDP feed listens on the address rather than calling it */
+	    if (bind(s, rp->ai_addr, rp->ai_addrlen) == 0) {
+		netconn_established(session, s);
+		return 1;
+	    }
+	} else if (connect(s, rp->ai_addr, rp->ai_addrlen) == 0) {
+	    netconn_established(session, s);
+	    return 1;
+	} else if (errno == EINPROGRESS) {
+	    session->netconn.state = netconn_connecting;
+	    gpsd_report(&session->context->errout, LOG_PROG,
+			"%s: connecting to %s port %s on fd %d\n",
+			session->gpsdata.dev.path,
+			session->netconn.host, session->netconn.service, s);
+	    return 0;
+	}
+	reason = strerror(errno);
+    }
+    netconn_free(session);
+    netconn_fail(session, reason);
+    return -1;
+}
+
+/*@ -branchstate @*/
+socket_t netconn_open(struct gps_device_t *session,
+		      const char *host, const char *service,
+		      const char *protocol)
+/* start a non-blocking connection; return the descriptor to watch */
+{
+    struct netconn_lookup_t *lookup;
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all, old;
+    int i, err;
+
+    netconn_close(session);
+    (void)strlcpy(session->netconn.host, host,
+		  sizeof(session->netconn.host));
+    (void)strlcpy(session->netconn.service, service,
+		  sizeof(session->netconn.service));
+    session->netconn.socktype =
+	(strcmp(protocol, "udp") == 0) ? SOCK_DGRAM : SOCK_STREAM;
+    session->netconn.heldlen = 0;
+    session->netconn.reason[0] = '\0';
+
+    if (pipe(session->netconn.notify) == -1) {
+	netconn_fail(session, strerror(errno));
+	return NL_NOSOCK;
+    }
+    for (i = 0; i < 2; i++) {
+	(void)fcntl(session->netconn.notify[i], F_SETFD, FD_CLOEXEC);
+	(void)fcntl(session->netconn.notify[i], F_SETFL,
+		    fcntl(session->netconn.notify[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    (void)pthread_mutex_lock(&netconn_mutex);
+    for (lookup = lookups; lookup < lookups + NETCONN_LOOKUPS; lookup++)
+	if (!lookup->busy)
+	    break;
+    if (lookup == lookups + NETCONN_LOOKUPS) {
+	(void)pthread_mutex_unlock(&netconn_mutex);
+	(void)close(session->netconn.notify[0]);
+	(void)close(session->netconn.notify[1]);
+	netconn_fail(session, "too many host lookups in progress");
+	return NL_NOHOST;
+    }
+    /* zero never matches, so a closed device ignores late results */
+    if (++netconn_generation == 0)
+	++netconn_generation;
+    session->netconn.generation = netconn_generation;
+    session->netconn.resolved = false;
+    session->netconn.state = netconn_resolving;
+    lookup->busy = true;
+    lookup->device = session;
+    lookup->generation = netconn_generation;
+    (void)strlcpy(lookup->host, host, sizeof(lookup->host));
+    (void)strlcpy(lookup->service, service, sizeof(lookup->service));
+    lookup->socktype = session->netconn.socktype;
+    (void)pthread_mutex_unlock(&netconn_mutex);
+
+    /* signals belong to the main loop */
+    (void)sigfillset(&all);
+    (void)pthread_sigmask(SIG_BLOCK, &all, &old);
+    (void)pthread_attr_init(&attr);
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&thread, &attr, netconn_lookup, (void *)lookup);
+    (void)pthread_attr_destroy(&attr);
+    (void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+	(void)pthread_mutex_lock(&netconn_mutex);
+	lookup->busy = false;
+	(void)pthread_mutex_unlock(&netconn_mutex);
+	(void)close(session->netconn.notify[0]);
+	(void)close(session->netconn.notify[1]);
+	session->netconn.state = netconn_idle;
+	netconn_fail(session, strerror(err));
+	return NL_NOHOST;
+    }
+    gpsd_report(&session->context->errout, LOG_PROG,
+		"%s: looking up %s port %s\n",
+		session->gpsdata.dev.path, host, service);
+    return session->netconn.notify[0];
+}
+/*@ +branchstate @*/
+
+int netconn_step(struct gps_device_t *session)
+/* move a pending connection along; 1 if connected, 0 if waiting, -1 */
+{
+    switch (session->netconn.state) {
+    case netconn_resolving:
+	{
+	    char drain[16];
+	    bool resolved;
+
+	    while (read(session->netconn.notify[0], drain, sizeof(drain)) > 0)
+		continue;
+	    (void)pthread_mutex_lock(&netconn_mutex);
+	    resolved = session->netconn.resolved;
+	    (void)pthread_mutex_unlock(&netconn_mutex);
+	    if (!resolved)
+		return 0;
+	    /* the pipe's read end stays as gps_fd until a socket replaces it */
+	    (void)close(session->netconn.notify[1]);
+	    if (session->netconn.addrs == NULL) {
+		char reason[sizeof(session->netconn.reason)];
+		(void)strlcpy(reason, session->netconn.reason, sizeof(reason));
+		netconn_fail(session, reason);
+		return -1;
+	    }
+	    return netconn_next(session, "no usable address");
+	}
+    case netconn_connecting:
+	{
+	    struct pollfd pfd;
+	    int err = 0;
+	    socklen_t errlen = sizeof(err);
+
+	    pfd.fd = session->gpsdata.gps_fd;
+	    pfd.events = POLLOUT;
+	    pfd.revents = 0;
+	    if (poll(&pfd, 1, 0) == 0)
+		return 0;
+	    if (getsockopt(session->gpsdata.gps_fd, SOL_SOCKET, SO_ERROR,
+			   &err, &errlen) == -1)
+		err = errno;
+	    if (err == 0) {
+		netconn_established(session, session->gpsdata.gps_fd);
+		return 1;
+	    }
+	    gpsd_report(&session->context->errout, LOG_PROG,
+			"%s: connect on fd %d failed: %s\n",
+			session->gpsdata.dev.path,
+			session->gpsdata.gps_fd, strerror(err));
+	    return netconn_next(session, strerror(err));
+	}
+    case netconn_connected:
+	return 1;
+    default:
+	return -1;
+    }
+}
+
+int netconn_wait(struct gps_device_t *session)
+/* finish a pending connection in line, for tools without an event loop */
+{
+    while (netconn_pending(session)) {
+	struct pollfd pfd;
+	int status;
+
+	pfd.fd = session->gpsdata.gps_fd;
+	pfd.events = POLLIN | (netconn_connect_pending(session) ? POLLOUT : 0);
+	pfd.revents = 0;
+	if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+	    return -1;
+	if ((status = netconn_step(session)) != 0)
+	    return status;
+    }
+    return session->netconn.state == netconn_failed ? -1 : 1;
+}
+
+bool netconn_pending(const struct gps_device_t *session)
+/* is this source still looking up its host or connecting? */
+{
+    return session->netconn.state == netconn_resolving
+	|| session->netconn.state == netconn_connecting;
+}
+
+bool netconn_connect_pending(const struct gps_device_t *session)
+/* is the event loop waiting for this source's socket to go writable? */
+{
+    return session->netconn.state == netconn_connecting;
+}
+
+ssize_t netconn_write(struct gps_device_t *session,
+		      const char *buf, size_t len)
+/* write to a network source, holding the output until it connects */
+{
+    if (!netconn_pending(session))
+	return write(session->gpsdata.gps_fd, buf, len);
+    if (session->netconn.heldlen + len > sizeof(session->netconn.held)) {
+	gpsd_report(&session->context->errout, LOG_ERROR,
+		    "%s: too much output before connect, %zd bytes dropped\n",
+		    session->gpsdata.dev.path, len);
+	return -1;
+    }
+    memcpy(session->netconn.held + session->netconn.heldlen, buf, len);
+    session->netconn.heldlen += len;
+    return (ssize_t)len;
+}
+
+void netconn_close(struct gps_device_t *session)
+/* abandon a pending connection; the caller still closes gps_fd */
+{
+    (void)pthread_mutex_lock(&netconn_mutex);
+    session->netconn.generation = 0;
+    (void)pthread_mutex_unlock(&netconn_mutex);
+    if (session->netconn.state == netconn_resolving)
+	(void)close(session->netconn.notify[1]);
+    netconn_free(session);
+    session->netconn.heldlen = 0;
+    /* keep a failure around so DEVICES can still say what went wrong */
+    if (session->netconn.state != netconn_failed)
+	session->netconn.state = netconn_idle;
+}
+
+const char *netconn_state_name(const struct gps_device_t *session)
+/* connection state as reported in DEVICE responses */
+{
+    switch (session->netconn.state) {
+    case netconn_resolving:
+	return "resolving";
+    case netconn_connecting:
+	return "connecting";
+    case netconn_connected:
+	return "connected";
+    case netconn_failed:
+	return "failed";
+    default:
+	return "idle";
+    }
+}
+
+/* net_connect.c ends here */
@@ -22,7 +22,6 @@ int dgpsip_open(struct gps_device_t *device, const char *dgpsserver)
 /* open a connection to a DGPSIP server */
 {
     char *colon, *dgpsport = "rtcm-sc104";
-    int opts;
 
     device->dgpsip.reported = false;
     if ((colon = strchr(dgpsserver, ':')) != NULL) {
@@ -32,19 +31,19 @@ int dgpsip_open(struct gps_device_t *device, const char *dgpsserver)
     if (!getservbyname(dgpsport, "tcp"))
 	dgpsport = DEFAULT_RTCM_PORT;
 
-    device->gpsdata.gps_fd =
-	netlib_connectsock(AF_UNSPEC, dgpsserver, dgpsport, "tcp");
+    device->gpsdata.gps_fd = netconn_open(device, dgpsserver, dgpsport, "tcp");
     // cppcheck-suppress pointerPositive
     if (device->gpsdata.gps_fd >= 0) {
 	char hn[256], buf[BUFSIZ];
 	gpsd_report(&device->context->errout, LOG_PROG,
-		    "connection to DGPS server %s established.\n",
+		    "connection to DGPS server %s started.\n",
 		    dgpsserver);
 	(void)gethostname(hn, sizeof(hn));
 	/* greeting required by some RTCM104 servers; others will ignore it */
 	(void)snprintf(buf, sizeof(buf), "HELO %s gpsd %s\r\nR\r\n", hn,
 		       VERSION);
-	if (write(device->gpsdata.gps_fd, buf, strlen(buf)) != (ssize_t) strlen(buf))
+	/* held until the connect completes */
+	if (netconn_write(device, buf, strlen(buf)) != (ssize_t) strlen(buf))
 	    gpsd_report(&device->context->errout, LOG_ERROR,
 			"hello to DGPS server %s failed\n",
 			dgpsserver);
@@ -52,10 +51,6 @@ int dgpsip_open(struct gps_device_t *device, const char *dgpsserver)
 	gpsd_report(&device->context->errout, LOG_ERROR,
 		    "can't connect to DGPS server %s, netlib error %d.\n",
 		    dgpsserver, device->gpsdata.gps_fd);
-    opts = fcntl(device->gpsdata.gps_fd, F_GETFL);
-
-    if (opts >= 0)
-	(void)fcntl(device->gpsdata.gps_fd, F_SETFL, opts | O_NONBLOCK);
     device->servicetype = service_dgpsip;
     return device->gpsdata.gps_fd;
 }
@@ -79,7 +74,7 @@ void dgpsip_report(struct gps_context_t *context,
 			   gps->gpsdata.fix.latitude,
 			   gps->gpsdata.fix.longitude,
 			   gps->gpsdata.fix.altitude);
-	    if (write(dgpsip->gpsdata.gps_fd, buf, strlen(buf)) ==
+	    if (netconn_write(dgpsip, buf, strlen(buf)) ==
 		(ssize_t) strlen(buf))
 		gpsd_report(&context->errout, LOG_IO, "=> dgps %s\n", buf);
 	    else
@@ -1,4 +1,16 @@
 /* net_ntrip.c -- gather and dispatch DGNSS data from Ntrip broadcasters
+ *
+ * Getting a stream takes two requests.  The first fetches the caster's
+ * sourcetable, which tells us the stream's format and authentication
+ * method or, when no mountpoint was given, lets us pick the one nearest
+ * the receiver.  The second asks for the stream itself.  Each stage
+ * runs when the device's descriptor goes ready, so neither holds up the
+ * daemon; gpsd_multipoll() calls ntrip_step() until the stream is on.
+ *
+ * Both NTRIP 1.0 and 2.0 casters are understood.  The latter speak
+ * HTTP/1.1 and may send the sourcetable and the stream in chunked
+ * transfer coding, which is stripped before the data reaches the
+ * sourcetable parser or the packet lexer.
  *
  * This file is Copyright (c) 2010 by the GPSD project
  * BSD terms apply: see the file COPYING in the distribution root for details.
@@ -16,321 +28,415 @@
 #include <sys/stat.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #endif /* S_SPLINT_S */
 
 #include "gpsd.h"
 #include "bsd_base64.h"
 
-#define NTRIP_SOURCETABLE	"SOURCETABLE 200 OK\r\n"
+#define NTRIP_SOURCETABLE	"SOURCETABLE 200 OK"
 #define NTRIP_ENDSOURCETABLE	"ENDSOURCETABLE"
 #define NTRIP_CAS		"CAS;"
 #define NTRIP_NET		"NET;"
 #define NTRIP_STR		"STR;"
-#define NTRIP_BR		"\r\n"
-#define NTRIP_QSC		"\";\""
 #define NTRIP_ICY		"ICY 200 OK"
+#define NTRIP_HTTP		"HTTP/1."
+#define NTRIP_OK		" 200 "
 #define NTRIP_UNAUTH		"401 Unauthorized"
-
-/*@ -temptrans -mustfreefresh @*/
-static /*@null@*/ char *ntrip_field_iterate( /*@null@ */ char *start,
-					     /*@null@*/ char *prev,
-					     const char *eol,
-					     const struct gpsd_errout_t *errout)
+#define NTRIP_GNSS_TABLE	"gnss/sourcetable"
+#define NTRIP_ENCODING		"Transfer-Encoding:"
+
+/* reconnect pacing: double the wait after each failure, up to a cap */
+#define NTRIP_RETRY_MIN		2	/* seconds */
+#define NTRIP_RETRY_MAX		300	/* seconds */
+/* drop a stream that has been silent this long and ask again */
+#define NTRIP_STALL_TIMEOUT	60	/* seconds */
+/* let TCP notice a caster that vanished without a word */
+#define NTRIP_KEEPIDLE		30	/* seconds */
+#define NTRIP_KEEPINTVL		10	/* seconds */
+#define NTRIP_KEEPCNT		3
+
+/* fields of a sourcetable STR record, in order */
+enum {
+    str_mountpoint, str_identifier, str_format, str_format_details,
+    str_carrier, str_nav_system, str_network, str_country,
+    str_latitude, str_longitude, str_nmea, str_solution, str_generator,
+    str_compr_encryp, str_authentication, str_fee, str_bitrate,
+    str_fields
+};
+
+static int ntrip_format(const char *s)
+/* map a sourcetable format name to the stream format */
 {
-    char *s, *t, *u;
-
-    if (start)
-	s = start;
-    else {
-	if (!prev)
-	    return NULL;
-	s = prev + strlen(prev) + 1;
-	if (s >= eol)
-	    return NULL;
-    }
-
-    /* ignore any quoted ; chars as they are part of the field content */
-    t = s;
-    while ((u = strstr(t, NTRIP_QSC)))
-	t = u + strlen(NTRIP_QSC);
-
-    if ((t = strstr(t, ";")))
-	*t = '\0';
-
-    gpsd_report(errout, LOG_RAW, "Next Ntrip source table field %s\n", s);
-
-    return s;
+    if (strcasecmp("RTCM 2", s) == 0)
+	return fmt_rtcm2;
+    else if (strcasecmp("RTCM 2.0", s) == 0)
+	return fmt_rtcm2_0;
+    else if (strcasecmp("RTCM 2.1", s) == 0)
+	return fmt_rtcm2_1;
+    else if (strcasecmp("RTCM 2.2", s) == 0)
+	return fmt_rtcm2_2;
+    else if (strcasecmp("RTCM 2.3", s) == 0)
+	return fmt_rtcm2_3;
+    /* required for the SAPOS derver in Gemany, confirmed as RTCM2.3 */
+    else if (strcasecmp("RTCM1_", s) == 0)
+	return fmt_rtcm2_3;
+    /* RTCM 3.0 through 3.3 all go through the same lexer and driver */
+    else if (strncasecmp("RTCM 3", s, 6) == 0)
+	return fmt_rtcm3;
+    else
+	return fmt_unknown;
 }
 
-/*@ +temptrans +mustfreefresh @*/
-
 /*@ -mustfreefresh @*/
-static void ntrip_str_parse(char *str, size_t len,
+static void ntrip_str_parse(char *str,
 			    /*@out@*/ struct ntrip_stream_t *hold,
 			    const struct gpsd_errout_t *errout)
+/* unpack a sourcetable STR record, splitting it in place */
 {
-    char *s, *eol = str + len;
+    char *field[str_fields];
+    char *s;
+    int n = 0;
+    bool quoted = false;
 
     memset(hold, 0, sizeof(*hold));
 
-    /* <mountpoint> */
-    if ((s = ntrip_field_iterate(str, NULL, eol, errout)))
-	(void)strlcpy(hold->mountpoint, s, sizeof(hold->mountpoint));
-    /* <identifier> */
-    s = ntrip_field_iterate(NULL, s, eol, errout);
-    /* <format> */
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout))) {
-	if (strcasecmp("RTCM 2", s) == 0)
-	    hold->format = fmt_rtcm2;
-	else if (strcasecmp("RTCM 2.0", s) == 0)
-	    hold->format = fmt_rtcm2_0;
-	else if (strcasecmp("RTCM 2.1", s) == 0)
-	    hold->format = fmt_rtcm2_1;
-	else if (strcasecmp("RTCM 2.2", s) == 0)
-	    hold->format = fmt_rtcm2_2;
-	else if (strcasecmp("RTCM 2.3", s) == 0)
-	    hold->format = fmt_rtcm2_3;
-	/* required for the SAPOS derver in Gemany, confirmed as RTCM2.3 */
-	else if (strcasecmp("RTCM1_", s) == 0)
-	    hold->format = fmt_rtcm2_3;
-	else if (strcasecmp("RTCM 3.0", s) == 0)
-	    hold->format = fmt_rtcm3;
-	else
-	    hold->format = fmt_unknown;
+    /* a quoted ; is part of the field content, not a separator */
+    field[n++] = str;
+    for (s = str; *s != '\0'; s++) {
+	if (*s == '"')
+	    quoted = !quoted;
+	else if (*s == ';' && !quoted) {
+	    *s = '\0';
+	    if (n < str_fields)
+		field[n++] = s + 1;
+	}
     }
-    /* <format-details> */
-    s = ntrip_field_iterate(NULL, s, eol, errout);
-    /* <carrier> */
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout)))
-	hold->carrier = atoi(s);
-    /* <nav-system> */
-    s = ntrip_field_iterate(NULL, s, eol, errout);
-    /* <network> */
-    s = ntrip_field_iterate(NULL, s, eol, errout);
-    /* <country> */
-    s = ntrip_field_iterate(NULL, s, eol, errout);
-    /* <latitude> */
+    /* missing trailing fields read as empty */
+    while (n < str_fields)
+	field[n++] = s;
+
+    (void)strlcpy(hold->mountpoint, field[str_mountpoint],
+		  sizeof(hold->mountpoint));
+    hold->format = ntrip_format(field[str_format]);
+    hold->carrier = atoi(field[str_carrier]);
     hold->latitude = NAN;
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout)))
-	hold->latitude = atof(s);
-    /* <longitude> */
+    if (field[str_latitude][0] != '\0')
+	hold->latitude = atof(field[str_latitude]);
     hold->longitude = NAN;
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout)))
-	hold->longitude = atof(s);
-    /* <nmea> */
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout))) {
-	hold->nmea = atoi(s);
+    if (field[str_longitude][0] != '\0')
+	hold->longitude = atof(field[str_longitude]);
+    hold->nmea = atoi(field[str_nmea]);
+    if (field[str_compr_encryp][0] == '\0'
+	|| strcasecmp("none", field[str_compr_encryp]) == 0)
+	hold->compr_encryp = cmp_enc_none;
+    else
+	hold->compr_encryp = cmp_enc_unknown;
+    if (field[str_authentication][0] == '\0'
+	|| strcasecmp("N", field[str_authentication]) == 0)
+	hold->authentication = auth_none;
+    else if (strcasecmp("B", field[str_authentication]) == 0)
+	hold->authentication = auth_basic;
+    else if (strcasecmp("D", field[str_authentication]) == 0)
+	hold->authentication = auth_digest;
+    else
+	hold->authentication = auth_unknown;
+    hold->fee = atoi(field[str_fee]);
+    hold->bitrate = atoi(field[str_bitrate]);
+
+    gpsd_report(errout, LOG_RAW,
+		"Ntrip stream %s: format %d at %f %f, nmea %d, auth %d\n",
+		hold->mountpoint, (int)hold->format,
+		hold->latitude, hold->longitude,
+		hold->nmea, (int)hold->authentication);
+}
+/*@ +mustfreefresh @*/
+
+static bool ntrip_stream_usable(const struct gps_device_t *device,
+				const struct ntrip_stream_t *hold,
+				int loglevel)
+/* can we use this stream?  If not, say why at the given level */
+{
+    const struct gpsd_errout_t *errout = &device->context->errout;
+
+    /* todo: support for SBAS (WAAS, EGNOS), ... */
+    if (hold->format == fmt_unknown) {
+	gpsd_report(errout, loglevel,
+		    "Ntrip stream %s format not supported\n",
+		    hold->mountpoint);
+	return false;
     }
-    /* <solution> */
-    s = ntrip_field_iterate(NULL, s, eol, errout);
-    /* <generator> */
-    s = ntrip_field_iterate(NULL, s, eol, errout);
-    /* <compr-encryp> */
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout))) {
-	if (strcasecmp("none", s) == 0)
-	    hold->compr_encryp = cmp_enc_none;
-	else
-	    hold->compr_encryp = cmp_enc_unknown;
+    /* todo: support encryption and compression algorithms */
+    if (hold->compr_encryp != cmp_enc_none) {
+	gpsd_report(errout, loglevel,
+		    "Ntrip stream %s compression/encryption algorithm not supported\n",
+		    hold->mountpoint);
+	return false;
     }
-    /* <authentication> */
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout))) {
-	if (strcasecmp("N", s) == 0)
-	    hold->authentication = auth_none;
-	else if (strcasecmp("B", s) == 0)
-	    hold->authentication = auth_basic;
-	else if (strcasecmp("D", s) == 0)
-	    hold->authentication = auth_digest;
-	else
-	    hold->authentication = auth_unknown;
+    /* todo: support digest authentication */
+    if (hold->authentication != auth_none
+	    && hold->authentication != auth_basic) {
+	gpsd_report(errout, loglevel,
+		    "Ntrip stream %s authentication method not supported\n",
+		    hold->mountpoint);
+	return false;
     }
-    /* <fee> */
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout))) {
-	hold->fee = atoi(s);
+    if (hold->authentication == auth_basic
+	    && device->ntrip.stream.credentials[0] == '\0') {
+	gpsd_report(errout, loglevel,
+		    "Ntrip stream %s needs a user-ID and password\n",
+		    hold->mountpoint);
+	return false;
     }
-    /* <bitrate> */
-    if ((s = ntrip_field_iterate(NULL, s, eol, errout))) {
-	hold->bitrate = atoi(s);
+    return true;
+}
+
+static void ntrip_stream_adopt(struct ntrip_stream_t *stream,
+			       const struct ntrip_stream_t *hold)
+/* take a sourcetable entry, keeping our caster address and credentials */
+{
+    (void)strlcpy(stream->mountpoint, hold->mountpoint,
+		  sizeof(stream->mountpoint));
+    stream->format = hold->format;
+    stream->carrier = hold->carrier;
+    stream->latitude = hold->latitude;
+    stream->longitude = hold->longitude;
+    stream->nmea = hold->nmea;
+    stream->compr_encryp = hold->compr_encryp;
+    stream->authentication = hold->authentication;
+    stream->fee = hold->fee;
+    stream->bitrate = hold->bitrate;
+    stream->set = true;
+}
+
+static bool ntrip_chunked(const char *line)
+/* is this the header line announcing chunked transfer coding? */
+{
+    return strncasecmp(line, NTRIP_ENCODING, strlen(NTRIP_ENCODING)) == 0
+	&& strstr(line, "chunked") != NULL;
+}
+
+static int ntrip_sourcetable_end(struct gps_device_t *device)
+/* the table is complete; 1 if it gave us a stream, else -1 */
+{
+    const struct ntrip_stream_t *stream = &device->ntrip.stream;
+
+    if (stream->set) {
+	gpsd_report(&device->context->errout, LOG_INF,
+		    "nearest Ntrip stream is %s/%s, %d km away\n",
+		    stream->url, stream->mountpoint,
+		    (int)(device->ntrip.nearest / 1000));
+	return 1;
     }
-    /* ...<misc> */
-    while ((s = ntrip_field_iterate(NULL, s, eol, errout)));
+    if (device->ntrip.autoconnect)
+	gpsd_report(&device->context->errout, LOG_ERROR,
+		    "no usable Ntrip stream with a location at %s\n",
+		    stream->url);
+    else
+	gpsd_report(&device->context->errout, LOG_ERROR,
+		    "Ntrip stream %s not in the sourcetable of %s\n",
+		    stream->mountpoint, stream->url);
+    return -1;
 }
 
-static int ntrip_sourcetable_parse(struct gps_device_t *device)
+static int ntrip_sourcetable_line(struct gps_device_t *device, char *line,
+				  size_t len)
+/* digest a line of the probe reply; 1 once we have a stream, 0, or -1 */
 {
+    const struct gpsd_errout_t *errout = &device->context->errout;
     struct ntrip_stream_t hold;
-    ssize_t llen, len = 0;
-    char *line;
-    bool sourcetable = false;
-    bool match = false;
-    char buf[BUFSIZ];
-    size_t blen = BUFSIZ;
+    double dist;
+
+    gpsd_report(errout, LOG_DATA,
+		"next Ntrip source table line %s\n", line);
+
+    if (!device->ntrip.sourcetable_parse) {
+	/* NTRIP 1.0 has a status line of its own, 2.0 speaks HTTP */
+	if (strncmp(line, NTRIP_SOURCETABLE, strlen(NTRIP_SOURCETABLE)) == 0
+		|| (strncmp(line, NTRIP_HTTP, strlen(NTRIP_HTTP)) == 0
+		    && strstr(line, NTRIP_OK) != NULL)) {
+	    device->ntrip.sourcetable_parse = true;
+	    device->ntrip.headers = true;
+	    return 0;
+	}
+	gpsd_report(errout, LOG_WARN,
+		    "Received unexpected Ntrip reply %s.\n", line);
+	return -1;
+    }
+
+    if (device->ntrip.headers) {
+	if (len == 0) {
+	    device->ntrip.headers = false;
+	    return 0;
+	}
+	if (ntrip_chunked(line)) {
+	    device->ntrip.chunked = true;
+	    return 0;
+	}
+	/* some 1.0 casters go straight from the status line to the table */
+	if (strncmp(line, NTRIP_STR, strlen(NTRIP_STR)) != 0
+		&& strncmp(line, NTRIP_CAS, strlen(NTRIP_CAS)) != 0
+		&& strncmp(line, NTRIP_NET, strlen(NTRIP_NET)) != 0)
+	    return 0;
+	device->ntrip.headers = false;
+    }
+
+    if (strncmp(line, NTRIP_ENDSOURCETABLE, strlen(NTRIP_ENDSOURCETABLE)) == 0)
+	return ntrip_sourcetable_end(device);
+
+    /* todo: parse CAS and NET */
+    if (strncmp(line, NTRIP_STR, strlen(NTRIP_STR)) != 0)
+	return 0;
+
+    ntrip_str_parse(line + strlen(NTRIP_STR), &hold, errout);
+    if (!device->ntrip.autoconnect) {
+	if (strcmp(device->ntrip.stream.mountpoint, hold.mountpoint) != 0)
+	    return 0;
+	if (!ntrip_stream_usable(device, &hold, LOG_ERROR))
+	    return -1;
+	ntrip_stream_adopt(&device->ntrip.stream, &hold);
+	/* found it, so don't wait for the rest of the table */
+	return 1;
+    }
+
+    /* casters list streams with no fixed location as 0/0 */
+    if (isnan(hold.latitude) || isnan(hold.longitude)
+	    || (hold.latitude == 0 && hold.longitude == 0))
+	return 0;
+    if (!ntrip_stream_usable(device, &hold, LOG_DATA))
+	return 0;
+    dist = earth_distance(device->ntrip.fix_latitude,
+			  device->ntrip.fix_longitude,
+			  hold.latitude, hold.longitude);
+    if (dist < device->ntrip.nearest) {
+	device->ntrip.nearest = dist;
+	ntrip_stream_adopt(&device->ntrip.stream, &hold);
+    }
+    return 0;
+}
+
+static int ntrip_sourcetable_feed(struct gps_device_t *device,
+				  char *buf, size_t len)
+/* split freshly read probe reply into lines; 1 when done, 0, or -1 */
+{
+    char *p = buf, *end = buf + len;
+
+    if (!device->ntrip.headers && device->ntrip.chunked)
+	end = buf + packet_dechunk(&device->ntrip.chunk,
+				   (unsigned char *)buf, len);
+    if (device->ntrip.chunk.state == chunk_error) {
+	gpsd_report(&device->context->errout, LOG_WARN,
+		    "bad chunk length in ntrip sourcetable\n");
+	return -1;
+    }
+    while (p < end) {
+	char c = *p++;
+	bool headers;
+	int status;
+
+	if (c != '\n') {
+	    /* overlong lines keep their head, which has the fields we use */
+	    if (device->ntrip.linelen < sizeof(device->ntrip.line) - 1)
+		device->ntrip.line[device->ntrip.linelen++] = c;
+	    continue;
+	}
+	if (device->ntrip.linelen > 0
+		&& device->ntrip.line[device->ntrip.linelen - 1] == '\r')
+	    device->ntrip.linelen--;
+	device->ntrip.line[device->ntrip.linelen] = '\0';
+	headers = device->ntrip.headers;
+	status = ntrip_sourcetable_line(device, device->ntrip.line,
+					device->ntrip.linelen);
+	device->ntrip.linelen = 0;
+	if (status != 0)
+	    return status;
+	/* past the headers, the rest of what we read may be chunked */
+	if (headers && !device->ntrip.headers && device->ntrip.chunked) {
+	    end = p + packet_dechunk(&device->ntrip.chunk,
+				     (unsigned char *)p, (size_t)(end - p));
+	    if (device->ntrip.chunk.state == chunk_error) {
+		gpsd_report(&device->context->errout, LOG_WARN,
+			    "bad chunk length in ntrip sourcetable\n");
+		return -1;
+	    }
+	}
+    }
+    return 0;
+}
+
+static int ntrip_sourcetable_parse(struct gps_device_t *device)
+/* take what the caster has sent of its sourcetable; 1 when done, 0, or -1 */
+{
     int fd = device->gpsdata.gps_fd;
 
     for (;;) {
-	char *eol;
+	char buf[BUFSIZ];
 	ssize_t rlen;
+	int status;
 
-	memset(&buf[len], 0, (size_t) (blen - len));
-	rlen = read(fd, &buf[len], (size_t) (blen - 1 - len));
+	rlen = read(fd, buf, sizeof(buf));
 	if (rlen == -1) {
-	    if (errno == EINTR) {
+	    if (errno == EINTR)
 		continue;
-	    }
-	    if (sourcetable && !match && errno == EAGAIN) { // we have not yet found a match, but there currently is no more data
+	    /* nothing more for now; we'll be called again when there is */
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
 		return 0;
-	    }
-	    if (match) {
-		return 1;
-	    }
-	    gpsd_report(&device->context->errout, LOG_ERROR, 
+	    gpsd_report(&device->context->errout, LOG_ERROR,
 			"ntrip stream read error %d on fd %d\n",
 			errno, fd);
 	    return -1;
-	} else if (rlen == 0) { // server closed the connection
+	} else if (rlen == 0) {
+	    /* a table cut short is still worth choosing from */
+	    if (device->ntrip.sourcetable_parse && !device->ntrip.headers
+		    && device->ntrip.autoconnect)
+		return ntrip_sourcetable_end(device);
 	    gpsd_report(&device->context->errout, LOG_ERROR,
 			"ntrip stream unexpected close %d on fd %d during sourcetable read\n",
 			errno, fd);
 	    return -1;
 	}
 
-	line = buf;
-	rlen = len += rlen;
-
 	gpsd_report(&device->context->errout, LOG_RAW,
-		    "Ntrip source table buffer %s\n", buf);
-
-	sourcetable = device->ntrip.sourcetable_parse;
-	if (!sourcetable) {
-	    /* parse SOURCETABLE */
-	    if (strncmp(line, NTRIP_SOURCETABLE, strlen(NTRIP_SOURCETABLE)) ==
-		    0) {
-		sourcetable = true;
-		device->ntrip.sourcetable_parse = true;
-		llen = (ssize_t) strlen(NTRIP_SOURCETABLE);
-		line += llen;
-		len -= llen;
-	    } else {
-		gpsd_report(&device->context->errout, LOG_WARN,
-			    "Received unexpexted Ntrip reply %s.\n",
-			    buf);
-		return -1;
-	    }
-	}
-
-	while (len > 0) {
-	    /* parse ENDSOURCETABLE */
-	    if (strncmp
-		    (line, NTRIP_ENDSOURCETABLE,
-		     strlen(NTRIP_ENDSOURCETABLE)) == 0)
-		goto done;
-
-	    /* coverity[string_null] - nul-terminated by previous memset */
-	    if (!(eol = strstr(line, NTRIP_BR)))
-		break;
-
-	    gpsd_report(&device->context->errout, LOG_DATA,
-			"next Ntrip source table line %s\n", line);
-
-	    *eol = '\0';
-	    llen = (ssize_t) (eol - line);
-
-	    /* todo: parse headers */
-
-	    /* parse STR */
-	    if (strncmp(line, NTRIP_STR, strlen(NTRIP_STR)) == 0) {
-		ntrip_str_parse(line + strlen(NTRIP_STR),
-				(size_t) (llen - strlen(NTRIP_STR)), 
-				&hold, &device->context->errout);
-		if (strcmp(device->ntrip.stream.mountpoint, hold.mountpoint) == 0) {
-		    /* todo: support for RTCM 3.0, SBAS (WAAS, EGNOS), ... */
-		    if (hold.format == fmt_unknown) {
-			gpsd_report(&device->context->errout, LOG_ERROR,
-				"Ntrip stream %s format not supported\n",
-				line);
-			return -1;
-		    }
-		    /* todo: support encryption and compression algorithms */
-		    if (hold.compr_encryp != cmp_enc_none) {
-			gpsd_report(&device->context->errout, LOG_ERROR,
-				"Ntrip stream %s compression/encryption algorithm not supported\n",
-				line);
-			return -1;
-		    }
-		    /* todo: support digest authentication */
-		    if (hold.authentication != auth_none
-			    && hold.authentication != auth_basic) {
-			gpsd_report(&device->context->errout, LOG_ERROR,
-				"Ntrip stream %s authentication method not supported\n",
-				line);
-			return -1;
-		    }
-		    /* no memcpy, so we can keep the other infos */
-		    device->ntrip.stream.format = hold.format;
-		    device->ntrip.stream.carrier = hold.carrier;
-		    device->ntrip.stream.latitude = hold.latitude;
-		    device->ntrip.stream.longitude = hold.longitude;
-		    device->ntrip.stream.nmea = hold.nmea;
-		    device->ntrip.stream.compr_encryp = hold.compr_encryp;
-		    device->ntrip.stream.authentication = hold.authentication;
-		    device->ntrip.stream.fee = hold.fee;
-		    device->ntrip.stream.bitrate = hold.bitrate;
-		    device->ntrip.stream.set = true;
-		    match = true;
-		}
-		/* todo: compare stream location to own location to
-		 * find nearest stream if user hasn't provided one */
-	    }
-	    /* todo: parse CAS */
-	    /* else if (strncmp(line, NTRIP_CAS, strlen(NTRIP_CAS))==0); */
-
-	    /* todo: parse NET */
-	    /* else if (strncmp(line, NTRIP_NET, strlen(NTRIP_NET))==0); */
-
-	    llen += strlen(NTRIP_BR);
-	    line += llen;
-	    len -= llen;
-	    gpsd_report(&device->context->errout, LOG_RAW,
-		    "Remaining Ntrip source table buffer %zd %s\n", len,
-		    line);
-	}
-	/* message too big to fit into buffer */
-	if ((size_t)len == blen - 1)
-	    return -1;
-
-	if (len > 0)
-	    memmove(buf, &buf[rlen - len], (size_t) len);
+		    "Ntrip source table read %zd bytes\n", rlen);
+	if ((status = ntrip_sourcetable_feed(device, buf, (size_t)rlen)) != 0)
+	    return status;
     }
-
-done:
-    return match ? 1 : -1;
 }
 
-static int ntrip_stream_req_probe(const struct ntrip_stream_t *stream,
-				  struct gpsd_errout_t *errout)
+static int ntrip_stream_req_probe(struct gps_device_t *device)
+/* ask the caster for its sourcetable */
 {
+    const struct ntrip_stream_t *stream = &device->ntrip.stream;
+    struct gpsd_errout_t *errout = &device->context->errout;
     int dsock;
     ssize_t r;
     char buf[BUFSIZ];
 
-    dsock = netlib_connectsock(AF_UNSPEC, stream->url, stream->port, "tcp");
+    dsock = netconn_open(device, stream->url, stream->port, "tcp");
     if (dsock < 0) {
 	gpsd_report(errout, LOG_ERROR, "ntrip stream connect error %d in req probe\n", dsock);
 	return -1;
     }
-    gpsd_report(errout, LOG_SPIN, "ntrip stream for req probe connected on fd %d\n", dsock);
+    device->gpsdata.gps_fd = dsock;
+    gpsd_report(errout, LOG_SPIN, "ntrip stream for req probe opening on fd %d\n", dsock);
     (void)snprintf(buf, sizeof(buf),
 	    "GET / HTTP/1.1\r\n"
+	    "Ntrip-Version: Ntrip/2.0\r\n"
 	    "User-Agent: NTRIP gpsd/%s\r\n"
 	    "Host: %s\r\n"
 	    "Connection: close\r\n"
 	    "\r\n", VERSION, stream->url);
-    r = write(dsock, buf, strlen(buf));
+    /* held until the connect completes */
+    r = netconn_write(device, buf, strlen(buf));
     if (r != (ssize_t)strlen(buf)) {
-	gpsd_report(errout, LOG_ERROR, 
+	gpsd_report(errout, LOG_ERROR,
 		    "ntrip stream write error %d on fd %d during probe request %zd\n",
 		    errno, dsock, r);
+	netconn_close(device);
 	(void)close(dsock);
+	INVALIDATE_SOCKET(device->gpsdata.gps_fd);
 	return -1;
     }
     /* coverity[leaked_handle] This is an intentional allocation */
@@ -363,228 +469,353 @@ static int ntrip_auth_encode(const struct ntrip_stream_t *stream,
 
 /* *INDENT-ON* */
 
-static int ntrip_stream_get_req(const struct ntrip_stream_t *stream,
-				const struct gpsd_errout_t *errout)
+static int ntrip_stream_get_req(struct gps_device_t *device)
+/* start a connection asking for the stream; gps_fd is left alone */
 {
+    const struct ntrip_stream_t *stream = &device->ntrip.stream;
+    const struct gpsd_errout_t *errout = &device->context->errout;
     int dsock;
     char buf[BUFSIZ];
 
-    dsock = netlib_connectsock(AF_UNSPEC, stream->url, stream->port, "tcp");
-    if (BAD_SOCKET(dsock)) {
+    dsock = netconn_open(device, stream->url, stream->port, "tcp");
+    if (dsock < 0) {
 	gpsd_report(errout, LOG_ERROR,
 		    "ntrip stream connect error %d\n", dsock);
 	return -1;
     }
 
     gpsd_report(errout, LOG_SPIN,
-		"netlib_connectsock() returns socket on fd %d\n",
+		"netconn_open() returns pending socket on fd %d\n",
 		dsock);
 
     (void)snprintf(buf, sizeof(buf),
 	    "GET /%s HTTP/1.1\r\n"
+	    "Ntrip-Version: Ntrip/2.0\r\n"
 	    "User-Agent: NTRIP gpsd/%s\r\n"
 	    "Host: %s\r\n"
 	    "Accept: rtk/rtcm, dgps/rtcm\r\n"
 	    "%s"
 	    "Connection: close\r\n"
 	    "\r\n", stream->mountpoint, VERSION, stream->url, stream->authStr);
-    if (write(dsock, buf, strlen(buf)) != (ssize_t) strlen(buf)) {
-	gpsd_report(errout, LOG_ERROR,
-		    "ntrip stream write error %d on fd %d during get request\n", errno,
-		    dsock);
-	(void)close(dsock);
-	return -1;
-    }
+    /* held until the connect completes, so this can't come up short */
+    (void)netconn_write(device, buf, strlen(buf));
     return dsock;
 }
 
-static int ntrip_stream_get_parse(const struct ntrip_stream_t *stream,
-				  const int dsock, 
-				  const struct gpsd_errout_t *errout)
+static void ntrip_keepalive(int dsock)
+/* have TCP probe an idle stream, so a vanished caster shows up as an error */
+{
+    int opt = 1;
+
+    (void)setsockopt(dsock, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+#ifdef TCP_KEEPIDLE
+    opt = NTRIP_KEEPIDLE;
+    (void)setsockopt(dsock, IPPROTO_TCP, TCP_KEEPIDLE, &opt, sizeof(opt));
+    opt = NTRIP_KEEPINTVL;
+    (void)setsockopt(dsock, IPPROTO_TCP, TCP_KEEPINTVL, &opt, sizeof(opt));
+    opt = NTRIP_KEEPCNT;
+    (void)setsockopt(dsock, IPPROTO_TCP, TCP_KEEPCNT, &opt, sizeof(opt));
+#endif /* TCP_KEEPIDLE */
+}
+
+static int ntrip_stream_get_parse(struct gps_device_t *device)
+/* read the caster's reply to our GET; 1 if the stream is on, 0, or -1 */
 {
 /*@-nullpass@*/
-    char buf[BUFSIZ];
-    int opts;
-    memset(buf, 0, sizeof(buf));
-    while (read(dsock, buf, sizeof(buf) - 1) == -1) {
-	if (errno == EINTR)
-	    continue;
-	gpsd_report(errout, LOG_ERROR, 
-		    "ntrip stream read error %d on fd %d during get rsp\n", errno,
-		    dsock);
-	goto close;
+    const struct ntrip_stream_t *stream = &device->ntrip.stream;
+    const struct gpsd_errout_t *errout = &device->context->errout;
+    int dsock = device->gpsdata.gps_fd;
+    char *buf = device->ntrip.line, *eoh = NULL, *line;
+    struct gps_lexer_t *lexer = &device->lexer;
+    unsigned char *held;
+    size_t hlen, extra;
+    bool chunked = false;
+
+    /*
+     * Take what has arrived rather than peeking at it, so a reply that
+     * comes in pieces doesn't keep the descriptor readable meanwhile.
+     */
+    while (eoh == NULL) {
+	ssize_t rlen;
+
+	if (device->ntrip.linelen >= sizeof(device->ntrip.line) - 1) {
+	    gpsd_report(errout, LOG_ERROR,
+			"overlong reply from Ntrip service %s:%s/%s\n",
+			stream->url, stream->port, stream->mountpoint);
+	    return -1;
+	}
+	rlen = read(dsock, buf + device->ntrip.linelen,
+		    sizeof(device->ntrip.line) - 1 - device->ntrip.linelen);
+	if (rlen == -1) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	    gpsd_report(errout, LOG_ERROR,
+			"ntrip stream read error %d on fd %d during get rsp\n",
+			errno, dsock);
+	    return -1;
+	}
+	if (rlen == 0) {
+	    gpsd_report(errout, LOG_ERROR,
+			"Ntrip service %s:%s/%s closed without replying\n",
+			stream->url, stream->port, stream->mountpoint);
+	    return -1;
+	}
+	device->ntrip.linelen += (size_t)rlen;
+	buf[device->ntrip.linelen] = '\0';
+
+	/* a 1.0 reply is a status line, a 2.0 one a full HTTP header */
+	if (strncmp(buf, NTRIP_HTTP, strlen(NTRIP_HTTP)) == 0) {
+	    if ((eoh = strstr(buf, "\r\n\r\n")) != NULL)
+		eoh += 4;
+	} else if ((eoh = strstr(buf, "\r\n")) != NULL)
+	    eoh += 2;
     }
+    hlen = (size_t)(eoh - buf);
+    extra = device->ntrip.linelen - hlen;
+    device->ntrip.linelen = 0;
+    /* stream data that came in with the reply goes to the lexer */
+    held = lexer->inbuffer + lexer->inbuflen;
+    if (extra > (size_t)(lexer->inbufstore + sizeof(lexer->inbufstore) - held))
+	extra = 0;	/* can't happen on a fresh connection */
+    (void)memcpy(held, eoh, extra);
+    buf[hlen] = '\0';
+    gpsd_report(errout, LOG_IO, "Ntrip reply: %s\n", buf);
 
     /* parse 401 Unauthorized */
-    /* coverity[string_null] - guaranteed terminated by the memset above */
     if (strstr(buf, NTRIP_UNAUTH)!=NULL) {
 	gpsd_report(errout, LOG_ERROR,
 		"not authorized for Ntrip stream %s/%s\n", stream->url,
 		stream->mountpoint);
-	goto close;
+	return -1;
     }
     /* parse SOURCETABLE */
-    if (strstr(buf, NTRIP_SOURCETABLE)!=NULL) {
+    if (strncmp(buf, NTRIP_SOURCETABLE, strlen(NTRIP_SOURCETABLE)) == 0
+	    || strstr(buf, NTRIP_GNSS_TABLE) != NULL) {
 	gpsd_report(errout, LOG_ERROR,
 		"Broadcaster doesn't recognize Ntrip stream %s:%s/%s\n",
 		stream->url, stream->port, stream->mountpoint);
-	goto close;
+	return -1;
     }
-    /* parse ICY 200 OK */
-    if (strstr(buf, NTRIP_ICY)==NULL) {
+    /* parse ICY 200 OK, or its HTTP equivalent */
+    if (strncmp(buf, NTRIP_ICY, strlen(NTRIP_ICY)) != 0
+	    && (strncmp(buf, NTRIP_HTTP, strlen(NTRIP_HTTP)) != 0
+		|| strstr(buf, NTRIP_OK) == NULL)) {
 	gpsd_report(errout, LOG_ERROR,
 		"Unknown reply %s from Ntrip service %s:%s/%s\n", buf,
 		stream->url, stream->port, stream->mountpoint);
-	goto close;
+	return -1;
+    }
+    for (line = buf; line != NULL && *line != '\0'; ) {
+	if (ntrip_chunked(line))
+	    chunked = true;
+	if ((line = strstr(line, "\r\n")) != NULL)
+	    line += 2;
     }
-    opts = fcntl(dsock, F_GETFL);
-
-    if (opts >= 0)
-	(void)fcntl(dsock, F_SETFL, opts | O_NONBLOCK);
 
-    return dsock;
-close:
-    (void)close(dsock);
-    return -1;
+    /* the lexer strips the chunk framing from here on */
+    lexer->chunked = chunked;
+    lexer->chunk.state = chunk_size;
+    lexer->chunk.left = 0;
+    if (chunked)
+	extra = packet_dechunk(&lexer->chunk, held, extra);
+    lexer->inbuflen += extra;
+    ntrip_keepalive(dsock);
+    return 1;
 /*@+nullpass@*/
 }
 
 /*@ -branchstate -nullpass @*/
-int ntrip_open(struct gps_device_t *device, char *caster)
-    /* open a connection to a Ntrip broadcaster */
+static int ntrip_parse_url(struct gps_device_t *device, const char *caster)
+/* split [user:passwd@]host[:port][/stream] into the stream state */
 {
     char *amp, *colon, *slash;
     char *auth = NULL;
     char *port = NULL;
-    char *stream = NULL;
-    char *url = NULL;
-    int ret = -1;
+    char *stream = "";
     char t[strlen(caster) + 1];
     char *tmp = t;
 
-    switch (device->ntrip.conn_state) {
-	case ntrip_conn_init:
-	    /* this has to be done here, because it is needed for multi-stage connection */
-	    device->servicetype = service_ntrip;
-	    device->ntrip.works = false;
-	    device->ntrip.sourcetable_parse = false;
-	    device->ntrip.stream.set = false;
-	    (void)strlcpy(tmp, caster, strlen(caster) + 1);
-
-	    /*@ -boolops @*/
-	    if ((amp = strchr(tmp, '@')) != NULL) {
-		if (((colon = strchr(tmp, ':')) != NULL) && colon < amp) {
-		    auth = tmp;
-		    *amp = '\0';
-		    tmp = amp + 1;
-		    url = tmp;
-		} else {
-		    gpsd_report(&device->context->errout, LOG_ERROR,
-			    "can't extract user-ID and password from %s\n",
-			    caster);
-		    device->ntrip.conn_state = ntrip_conn_err;
-		    return -1;
-		}
-	    }
-	    /*@ +boolops @*/
-	    if ((slash = strchr(tmp, '/')) != NULL) {
-		*slash = '\0';
-		stream = slash + 1;
-	    } else {
-		/* todo: add autoconnect like in dgpsip.c */
-		gpsd_report(&device->context->errout, LOG_ERROR,
-			    "can't extract Ntrip stream from %s\n",
-			    caster);
-		device->ntrip.conn_state = ntrip_conn_err;
-		return -1;
-	    }
-	    if ((colon = strchr(tmp, ':')) != NULL) {
-		port = colon + 1;
-		*colon = '\0';
-	    }
-	    if (!port) {
-		port = "rtcm-sc104";
-		if (!getservbyname(port, "tcp"))
-		    port = DEFAULT_RTCM_PORT;
-	    }
+    (void)strlcpy(tmp, caster, sizeof(t));
 
-	    (void)strlcpy(device->ntrip.stream.mountpoint,
-		    stream,
-		    sizeof(device->ntrip.stream.mountpoint));
-	    if (auth != NULL)
-		(void)strlcpy(device->ntrip.stream.credentials,
-			      auth,
-			      sizeof(device->ntrip.stream.credentials));
-	    /*
-	     * Semantically url and port ought to be non-NULL by now,
-	     * but just in case...this code appeases Coverity.
-	     */
-	    if (url != NULL)
-		(void)strlcpy(device->ntrip.stream.url,
-			      url,
-			      sizeof(device->ntrip.stream.url));
-	    if (port != NULL)
-		(void)strlcpy(device->ntrip.stream.port,
-			      port,
-			      sizeof(device->ntrip.stream.port));
-
-	    ret = ntrip_stream_req_probe(&device->ntrip.stream,
-					 &device->context->errout);
-	    if (ret == -1) {
-		device->ntrip.conn_state = ntrip_conn_err;
-		return -1;
-	    }
-	    device->gpsdata.gps_fd = ret;
-	    device->ntrip.conn_state = ntrip_conn_sent_probe;
-	    return ret;
-	case ntrip_conn_sent_probe:
-	    ret = ntrip_sourcetable_parse(device);
-	    if (ret == -1) {
-		device->ntrip.conn_state = ntrip_conn_err;
-		return -1;
-	    }
-	    if (ret == 0 && device->ntrip.stream.set == false) {
-		return ret;
-	    }
-	    (void)close(device->gpsdata.gps_fd);
-	    if (ntrip_auth_encode(&device->ntrip.stream, device->ntrip.stream.credentials, device->ntrip.stream.authStr, 128) != 0) {
-		device->ntrip.conn_state = ntrip_conn_err;
-		return -1;
-	    }
-	    ret = ntrip_stream_get_req(&device->ntrip.stream,
-				       &device->context->errout);
-	    if (ret == -1) {
-		device->ntrip.conn_state = ntrip_conn_err;
-		return -1;
-	    }
-	    device->gpsdata.gps_fd = ret;
-	    device->ntrip.conn_state = ntrip_conn_sent_get;
-	    break;
-	case ntrip_conn_sent_get:
-	    ret = ntrip_stream_get_parse(&device->ntrip.stream,
-					 device->gpsdata.gps_fd,
-					 &device->context->errout);
-	    if (ret == -1) {
-		device->ntrip.conn_state = ntrip_conn_err;
-		return -1;
-	    }
-	    device->ntrip.conn_state = ntrip_conn_established;
-	    device->ntrip.works = true; // we know, this worked.
-	    break;
-	case ntrip_conn_established:
-	case ntrip_conn_err:
+    /*@ -boolops @*/
+    if ((amp = strchr(tmp, '@')) != NULL) {
+	if (((colon = strchr(tmp, ':')) != NULL) && colon < amp) {
+	    auth = tmp;
+	    *amp = '\0';
+	    tmp = amp + 1;
+	} else {
+	    gpsd_report(&device->context->errout, LOG_ERROR,
+		    "can't extract user-ID and password from %s\n",
+		    caster);
 	    return -1;
+	}
+    }
+    /*@ +boolops @*/
+    /* no stream means we pick the nearest once we know where we are */
+    if ((slash = strchr(tmp, '/')) != NULL) {
+	*slash = '\0';
+	stream = slash + 1;
+    }
+    if ((colon = strchr(tmp, ':')) != NULL) {
+	port = colon + 1;
+	*colon = '\0';
+    }
+    if (!port) {
+	port = "rtcm-sc104";
+	if (!getservbyname(port, "tcp"))
+	    port = DEFAULT_RTCM_PORT;
+    }
+
+    (void)strlcpy(device->ntrip.stream.mountpoint,
+	    stream,
+	    sizeof(device->ntrip.stream.mountpoint));
+    (void)strlcpy(device->ntrip.stream.credentials,
+		  auth != NULL ? auth : "",
+		  sizeof(device->ntrip.stream.credentials));
+    (void)strlcpy(device->ntrip.stream.url,
+		  tmp,
+		  sizeof(device->ntrip.stream.url));
+    (void)strlcpy(device->ntrip.stream.port,
+		  port,
+		  sizeof(device->ntrip.stream.port));
+    device->ntrip.autoconnect = (stream[0] == '\0');
+    return 0;
+}
+
+int ntrip_open(struct gps_device_t *device, char *caster)
+    /* open a connection to a Ntrip broadcaster */
+{
+    int ret, wait;
+
+    device->servicetype = service_ntrip;
+    device->ntrip.works = false;
+    device->ntrip.stream.set = false;
+    if (ntrip_parse_url(device, caster) != 0) {
+	device->ntrip.conn_state = ntrip_conn_err;
+	return -1;
+    }
+    if (device->ntrip.autoconnect && !device->ntrip.have_fix) {
+	gpsd_report(&device->context->errout, LOG_PROG,
+		    "waiting for a fix to pick the nearest Ntrip stream at %s\n",
+		    device->ntrip.stream.url);
+	device->ntrip.conn_state = ntrip_conn_init;
+	return -1;
     }
+
+    /* if this one fails too, wait twice as long before the next */
+    wait = NTRIP_RETRY_MAX;
+    if (device->ntrip.failures < 8
+	    && (NTRIP_RETRY_MIN << device->ntrip.failures) < NTRIP_RETRY_MAX)
+	wait = NTRIP_RETRY_MIN << device->ntrip.failures;
+    device->ntrip.retry_at = timestamp() + wait;
+    device->ntrip.failures++;
+
+    device->ntrip.sourcetable_parse = false;
+    device->ntrip.headers = false;
+    device->ntrip.chunked = false;
+    device->ntrip.chunk.state = chunk_size;
+    device->ntrip.chunk.left = 0;
+    device->ntrip.linelen = 0;
+    device->ntrip.nearest = HUGE_VAL;
+
+    ret = ntrip_stream_req_probe(device);
+    if (ret == -1) {
+	device->ntrip.conn_state = ntrip_conn_err;
+	return -1;
+    }
+    device->ntrip.conn_state = ntrip_conn_sent_probe;
     return ret;
 }
 /*@ +branchstate +nullpass @*/
 
+int ntrip_step(struct gps_device_t *device)
+/* move the connection along when its descriptor is ready; 1 when streaming */
+{
+    int status, probe, dsock;
+
+    switch (device->ntrip.conn_state) {
+    case ntrip_conn_sent_probe:
+	if ((status = ntrip_sourcetable_parse(device)) == 0)
+	    return 0;
+	if (status < 0
+		|| ntrip_auth_encode(&device->ntrip.stream,
+				     device->ntrip.stream.credentials,
+				     device->ntrip.stream.authStr,
+				     sizeof(device->ntrip.stream.authStr)) != 0)
+	    break;
+	/* on failure gps_fd is still the probe, closed with the device */
+	probe = device->gpsdata.gps_fd;
+	if ((dsock = ntrip_stream_get_req(device)) < 0)
+	    break;
+	(void)close(probe);
+	device->gpsdata.gps_fd = dsock;
+	device->ntrip.linelen = 0;
+	device->ntrip.conn_state = ntrip_conn_sent_get;
+	return 0;
+    case ntrip_conn_sent_get:
+	if ((status = ntrip_stream_get_parse(device)) == 0)
+	    return 0;
+	if (status < 0)
+	    break;
+	gpsd_report(&device->context->errout, LOG_PROG,
+		    "Ntrip stream %s/%s is on, fd %d\n",
+		    device->ntrip.stream.url, device->ntrip.stream.mountpoint,
+		    device->gpsdata.gps_fd);
+	device->ntrip.conn_state = ntrip_conn_established;
+	device->ntrip.works = true; // we know, this worked.
+	device->ntrip.failures = 0;
+	device->ntrip.heard = timestamp();
+	return 1;
+    case ntrip_conn_established:
+	return 1;
+    default:
+	break;
+    }
+    device->ntrip.conn_state = ntrip_conn_err;
+    return -1;
+}
+
+bool ntrip_reconnect_due(const struct gps_device_t *device)
+/* has this caster's reconnect pacing run out? */
+{
+    if (device->servicetype != service_ntrip)
+	return true;
+    if (device->ntrip.autoconnect && !device->ntrip.have_fix)
+	return false;
+    return timestamp() >= device->ntrip.retry_at;
+}
+
+bool ntrip_stalled(struct gps_device_t *device)
+/* has an established stream gone quiet for too long? */
+{
+    if (device->servicetype != service_ntrip
+	    || device->ntrip.conn_state != ntrip_conn_established
+	    || BAD_SOCKET(device->gpsdata.gps_fd))
+	return false;
+    if (device->gpsdata.online > device->ntrip.heard)
+	device->ntrip.heard = device->gpsdata.online;
+    if (timestamp() - device->ntrip.heard < NTRIP_STALL_TIMEOUT)
+	return false;
+    gpsd_report(&device->context->errout, LOG_WARN,
+		"Ntrip stream %s/%s silent for %d seconds\n",
+		device->ntrip.stream.url, device->ntrip.stream.mountpoint,
+		NTRIP_STALL_TIMEOUT);
+    return true;
+}
+
 void ntrip_report(struct gps_context_t *context,
 		  struct gps_device_t *gps,
 		  struct gps_device_t *caster)
     /* may be time to ship a usage report to the Ntrip caster */
 {
     static int count;
+
+    /* remember where we are, should we have a mountpoint to choose */
+    caster->ntrip.fix_latitude = gps->gpsdata.fix.latitude;
+    caster->ntrip.fix_longitude = gps->gpsdata.fix.longitude;
+    caster->ntrip.have_fix = true;
     /*
      * 10 is an arbitrary number, the point is to have gotten several good
      * fixes before reporting usage to our Ntrip caster.
@@ -593,11 +824,12 @@ void ntrip_report(struct gps_context_t *context,
      * was needed here
      */
     count ++;
-    if (caster->ntrip.stream.nmea != 0 && context->fixcnt > 10 && (count % 5)==0) {
+    if (caster->ntrip.stream.nmea != 0 && context->fixcnt > 10 && (count % 5)==0
+	    && caster->ntrip.conn_state == ntrip_conn_established) {
 	if (caster->gpsdata.gps_fd > -1) {
 	    char buf[BUFSIZ];
 	    gpsd_position_fix_dump(gps, buf, sizeof(buf));
-	    if (write(caster->gpsdata.gps_fd, buf, strlen(buf)) ==
+	    if (netconn_write(caster, buf, strlen(buf)) ==
 		    (ssize_t) strlen(buf)) {
 		gpsd_report(&context->errout, LOG_IO, "=> dgps %s\n", buf);
 	    } else {
@@ -87,10 +87,20 @@ struct shmTime
  * does not matter.
  *
  * For each GPS module gpsd controls, it will use the attached ntpshm
- * segments in pairs (for coarse clock and pps source, respectively)
- * starting from the first found segments.  I.e. started as root, one
- * GPS will deliver data on segments 0 and 1, and as non-root data
- * will be delivered on segments 2 and 3.
+ * segments in pairs (for coarse clock and pps source, respectively),
+ * always an even segment and the odd one after it.  I.e. started as
+ * root, the first GPS will deliver data on segments 0 and 1, and as
+ * non-root data will be delivered on segments 2 and 3.  There are
+ * NTPSHMSEGS segments, two for every device gpsd can hold at once and
+ * two more, so that every device still gets a pair when segments 0
+ * and 1 are out of reach.
+ *
+ * A pair is kept for a device path from the time the device is added,
+ * whether or not it has been opened, until gpsd exits; pairs are only
+ * taken back when a new path finds none left.  So the devices named on
+ * the command line get their pairs in command-line order, however they
+ * come up, and a receiver that is unplugged and plugged back in gets
+ * the same ntpd units again.
  *
  * to debug, try looking at the live segments this way
  *
@@ -175,33 +185,31 @@ void ntpshm_context_init(struct gps_context_t *context)
     memset(context->shmTimeInuse, 0, sizeof(context->shmTimeInuse));
 }
 
-static int ntpshm_alloc(struct gps_context_t *context)
+static int ntpshm_alloc(struct gps_context_t *context, int segment)
 /* allocate NTP SHM segment.  return its segment number, or -1 */
 {
-    int i;
+    if (segment < 0 || segment >= NTPSHMSEGS
+	|| context->shmTime[segment] == NULL
+	|| context->shmTimeInuse[segment])
+	return -1;
 
-    for (i = 0; i < NTPSHMSEGS; i++)
-	if (context->shmTime[i] != NULL && !context->shmTimeInuse[i]) {
-	    context->shmTimeInuse[i] = true;
-
-	    /*
-	     * In case this segment gets sent to ntpd before an
-	     * ephemeris is available, the LEAP_NOTINSYNC value will
-	     * tell ntpd that this source is in a "clock alarm" state
-	     * and should be ignored.  The goal is to prevent ntpd
-	     * from declaring the GPS a falseticker before it gets
-	     * all its marbles together.
-	     */
-	    memset((void *)context->shmTime[i], 0, sizeof(struct shmTime));
-	    context->shmTime[i]->mode = 1;
-	    context->shmTime[i]->leap = LEAP_NOTINSYNC;
-	    context->shmTime[i]->precision = -1;	/* initially 0.5 sec */
-	    context->shmTime[i]->nsamples = 3;	/* stages of median filter */
+    context->shmTimeInuse[segment] = true;
 
-	    return i;
-	}
+    /*
+     * In case this segment gets sent to ntpd before an
+     * ephemeris is available, the LEAP_NOTINSYNC value will
+     * tell ntpd that this source is in a "clock alarm" state
+     * and should be ignored.  The goal is to prevent ntpd
+     * from declaring the GPS a falseticker before it gets
+     * all its marbles together.
+     */
+    memset((void *)context->shmTime[segment], 0, sizeof(struct shmTime));
+    context->shmTime[segment]->mode = 1;
+    context->shmTime[segment]->leap = LEAP_NOTINSYNC;
+    context->shmTime[segment]->precision = -1;	/* initially 0.5 sec */
+    context->shmTime[segment]->nsamples = 3;	/* stages of median filter */
 
-    return -1;
+    return segment;
 }
 
 static bool ntpshm_free(struct gps_context_t * context, int segment)
@@ -214,6 +222,43 @@ static bool ntpshm_free(struct gps_context_t * context, int segment)
     return true;
 }
 
+static int ntpshm_pair(struct gps_context_t *context, const char *path)
+/* find the segment pair kept for a device path, or keep one for it */
+{
+    int i, spare = -1;
+
+    for (i = 0; i < NTPSHMSEGS / 2; i++) {
+	if (context->shmTime[2 * i] == NULL)
+	    continue;
+	if (strcmp(context->shmTimePath[i], path) == 0)
+	    return i;
+	if (spare == -1 && context->shmTimePath[i][0] == '\0')
+	    spare = i;
+    }
+
+    if (spare == -1) {
+	/* every pair is spoken for, take one whose device is gone */
+	for (i = 0; i < NTPSHMSEGS / 2; i++)
+	    if (context->shmTime[2 * i] != NULL
+		&& !context->shmTimeInuse[2 * i]
+		&& !context->shmTimeInuse[2 * i + 1]) {
+		gpsd_report(&context->errout, LOG_WARN,
+			    "NTPD segments %d and %d pass from %s to %s\n",
+			    2 * i, 2 * i + 1, context->shmTimePath[i], path);
+		spare = i;
+		break;
+	    }
+	if (spare == -1)
+	    return -1;
+    }
+
+    (void)strlcpy(context->shmTimePath[spare], path, GPS_PATH_MAX);
+    gpsd_report(&context->errout, LOG_PROG,
+		"NTPD segments %d and %d kept for %s\n",
+		2 * spare, 2 * spare + 1, path);
+    return spare;
+}
+
 void ntpshm_session_init(struct gps_device_t *session)
 {
 #ifdef NTPSHM_ENABLE
@@ -223,6 +268,8 @@ void ntpshm_session_init(struct gps_device_t *session)
 #ifdef PPS_ENABLE
     session->shmIndexPPS = -1;
 #endif	/* PPS_ENABLE */
+    /* settle which segments the device will use before any is opened */
+    (void)ntpshm_pair(session->context, session->gpsdata.dev.path);
 }
 
 int ntpshm_put(struct gps_device_t *session, int shmIndex, struct timedrift_t *td)
@@ -283,6 +330,11 @@ int ntpshm_put(struct gps_device_t *session, int shmIndex, struct timedrift_t *t
     shmTime->count++;
     shmTime->valid = 1;
 
+#ifdef PPS_ENABLE
+    /* PPS puts come from the PPS thread; pps_thread_drain() logs those */
+    if (shmIndex == session->shmIndexPPS)
+	return 1;
+#endif	/* PPS_ENABLE */
     /*@-type@*/ /* splint is confused about struct timespec */
     gpsd_report(&session->context->errout, LOG_RAW,
 		"NTP ntpshm_put(%d) %lu.%09lu @ %lu.%09lu\n",
@@ -347,9 +399,10 @@ static void init_hook(struct gps_device_t *session)
 
 /* td is the real time and clock time of the edge */
 /* offset is actual_ts - clock_ts */
-static void chrony_send(struct gps_device_t *session, struct timedrift_t *td)
+void chrony_send(struct gps_device_t *session, struct timedrift_t *td)
 {
     struct sock_sample sample;
+    struct timespec sent, offset;
 
     /* chrony expects tv-sec since Jan 1970 */
     sample.pulse = 0;
@@ -357,23 +410,23 @@ static void chrony_send(struct gps_device_t *session, struct timedrift_t *td)
     sample.magic = SOCK_MAGIC;
     /*@-type@*//* splint is confused about struct timespec */
     TSTOTV(&sample.tv, &td->clock);
+    /*
+     * Measure the offset from the clock time as sent, rounded to the
+     * microsecond, so chrony gets the edge back to the nanosecond.
+     * The difference is small enough for a double to keep that.
+     */
+    TVTOTS(&sent, &sample.tv);
     /*@-compdef@*/
-    sample.offset = timespec_diff_ns(td->real, td->clock) / 1e9;
+    TS_SUB(&offset, &td->real, &sent);
+    sample.offset = TSTONS(&offset);
     /*@+compdef@*/
 #ifdef __COVERITY__
     sample._pad = 0;
 #endif /* __COVERITY__ */
     /*@+type@*/
 
-    /*@-type@*/ /* splint is confused about struct timespec */
-    gpsd_report(&session->context->errout, LOG_RAW,
-		"PPS chrony_send %lu.%09lu @ %lu.%09lu Offset: %0.9f\n",
-		(unsigned long)td->real.tv_sec,
-		(unsigned long)td->real.tv_nsec,
-		(unsigned long)td->clock.tv_sec,
-		(unsigned long)td->clock.tv_nsec,
-                sample.offset);
-    /*@+type@*/
+    /* no logging: this is the PPS thread, pps_thread_drain() reports it */
+    pps_thread_shipped(session, sample.offset);
     (void)send(session->chronyfd, &sample, sizeof (sample), 0);
 }
 
@@ -420,39 +473,41 @@ void ntpshm_link_deactivate(struct gps_device_t *session)
 {
     (void)ntpshm_free(session->context, session->shmIndex);
 #if defined(PPS_ENABLE)
-    if (session->shmIndexPPS != -1) {
+    if (session->thread_report_hook == report_hook)
 	pps_thread_deactivate(session);
-	(void)ntpshm_free(session->context, session->shmIndexPPS);
-    }
+    (void)ntpshm_free(session->context, session->shmIndexPPS);
 #endif	/* PPS_ENABLE */
 }
 
 void ntpshm_link_activate(struct gps_device_t *session)
 /* set up ntpshm storage for a session */
 {
+    int pair = ntpshm_pair(session->context, session->gpsdata.dev.path);
+
     /* allocate a shared-memory segment for "NMEA" time data */
-    session->shmIndex = ntpshm_alloc(session->context);
+    session->shmIndex = ntpshm_alloc(session->context, 2 * pair);
 
     if (0 > session->shmIndex) {
 	gpsd_report(&session->context->errout, LOG_INF, 
                     "NTPD ntpshm_alloc() failed\n");
+    }
 #if defined(PPS_ENABLE)
-    } else if (session->sourcetype == source_usb || session->sourcetype == source_rs232) {
+    if (session->sourcetype == source_usb || session->sourcetype == source_rs232) {
 	/* We also have the 1pps capability, allocate a shared-memory segment
 	 * for the 1pps time data and launch a thread to capture the 1pps
-	 * transitions
+	 * transitions.  The thread runs even if ntpd gets no segment, as
+	 * chrony and clients can use the edges without one.
 	 */
-	if ((session->shmIndexPPS = ntpshm_alloc(session->context)) < 0) {
+	if ((session->shmIndexPPS = ntpshm_alloc(session->context, 2 * pair + 1)) < 0) {
 	    gpsd_report(&session->context->errout, LOG_INF, 
                         "NTPD ntpshm_alloc(1) failed\n");
-	} else {
-	    init_hook(session);
-	    session->thread_report_hook = report_hook;
-	    session->thread_wrap_hook = wrap_hook;
-	    pps_thread_activate(session);
 	}
-#endif /* PPS_ENABLE */
+	init_hook(session);
+	session->thread_report_hook = report_hook;
+	session->thread_wrap_hook = wrap_hook;
+	pps_thread_activate(session);
     }
+#endif /* PPS_ENABLE */
 }
 
 #endif /* NTPSHM_ENABLE */
@@ -37,8 +37,17 @@ PERMISSIONS
 #include <netinet/in.h>
 #include <arpa/inet.h>		/* for htons() */
 #include <unistd.h>
+#ifdef HAVE_RECVMMSG
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif /* HAVE_RECVMMSG */
 #endif /* S_SPLINT_S */
 
+/* recvmmsg() is only declared under _GNU_SOURCE; Python builds lack it */
+#if defined(HAVE_RECVMMSG) && defined(MSG_WAITFORONE)
+#define DATAGRAM_BATCH_ENABLE
+#endif /* HAVE_RECVMMSG && MSG_WAITFORONE */
+
 #include "bits.h"
 #include "gpsd.h"
 #include "crc24q.h"
@@ -1409,11 +1418,11 @@ static void packet_accept(struct gps_lexer_t *lexer, int packet_type)
 }
 
 static void packet_discard(struct gps_lexer_t *lexer)
-/* shift the input buffer to discard all data up to current input pointer */
+/* advance the packet start to discard all data up to current input pointer */
 {
     size_t discard = lexer->inbufptr - lexer->inbuffer;
     size_t remaining = lexer->inbuflen - discard;
-    lexer->inbufptr = memmove(lexer->inbuffer, lexer->inbufptr, remaining);
+    lexer->inbuffer = lexer->inbufptr;
     lexer->inbuflen = remaining;
     if (lexer->errout.debug >= LOG_RAW+1) {
 	char scratchbuf[MAX_PACKET_LENGTH*2+1];
@@ -1426,10 +1435,13 @@ static void packet_discard(struct gps_lexer_t *lexer)
 }
 
 static void character_discard(struct gps_lexer_t *lexer)
-/* shift the input buffer to discard one character and reread data */
+/* advance the packet start to discard one character and reread data */
 {
-    memmove(lexer->inbuffer, lexer->inbuffer + 1, (size_t)-- lexer->inbuflen);
+    lexer->inbuffer++;
+    lexer->inbuflen--;
+    /*@ -modobserver @*/
     lexer->inbufptr = lexer->inbuffer;
+    /*@ +modobserver @*/
     if (lexer->errout.debug >= LOG_RAW+1) {
 	char scratchbuf[MAX_PACKET_LENGTH*2+1];
 	gpsd_report(&lexer->errout, LOG_RAW + 1,
@@ -1440,6 +1452,92 @@ static void character_discard(struct gps_lexer_t *lexer)
     }
 }
 
+static void garbage_skip(struct gps_lexer_t *lexer)
+/* run the machine over a stretch of garbage, then discard it all at once */
+{
+    unsigned char *end = lexer->inbuffer + lexer->inbuflen;
+    unsigned char *here = lexer->inbuffer;
+
+    /*
+     * Entered with the first byte of the buffer already consumed and
+     * found to be garbage.  Each following byte still has to go through
+     * nextstate() because the ISGPS bit-sync logic watches every one of
+     * them, but there is no reason to discard them one at a time.
+     */
+    /*@ -modobserver @*/
+    while (lexer->state == GROUND_STATE && lexer->inbufptr < end) {
+	here = lexer->inbufptr;
+	nextstate(lexer, *lexer->inbufptr++);
+	lexer->char_counter++;
+    }
+    /*@ +modobserver @*/
+
+    /* everything before the byte that ended the run is garbage */
+    if (here > lexer->inbuffer) {
+	size_t discard = (size_t)(here - lexer->inbuffer);
+	lexer->inbuffer = here;
+	lexer->inbuflen -= discard;
+	if (lexer->errout.debug >= LOG_RAW+1) {
+	    char scratchbuf[MAX_PACKET_LENGTH*2+1];
+	    gpsd_report(&lexer->errout, LOG_RAW + 1,
+			"Garbage discard of %zu, buffer %zu chars = %s\n",
+			discard, lexer->inbuflen,
+			gpsd_packetdump(scratchbuf, sizeof(scratchbuf),
+					(char *)lexer->inbuffer,
+					lexer->inbuflen));
+	}
+    }
+}
+
+static void body_skip(struct gps_lexer_t *lexer)
+/* consume a run of packet-body bytes that cannot change the machine state */
+{
+    /*@ -modobserver @*/
+    unsigned char *cp = lexer->inbufptr;
+    unsigned char *end = lexer->inbuffer + lexer->inbuflen;
+
+    switch (lexer->state) {
+#ifdef NMEA_ENABLE
+    case NMEA_LEADER_END:
+	/* anything printable but '$' leaves us in the sentence body */
+	while (cp < end && *cp != '$' && isprint(*cp))
+	    cp++;
+	break;
+#endif /* NMEA_ENABLE */
+#ifdef UBLOX_ENABLE
+    case UBX_PAYLOAD:
+	/* all payload bytes but the last are opaque */
+	if (lexer->length > 1) {
+	    size_t len = lexer->length - 1;
+	    if (len > (size_t)(end - cp))
+		len = (size_t)(end - cp);
+	    cp += len;
+	    lexer->length -= len;
+	}
+	break;
+#endif /* UBLOX_ENABLE */
+    default:
+	break;
+    }
+    lexer->char_counter += cp - lexer->inbufptr;
+    lexer->inbufptr = cp;
+    /*@ +modobserver @*/
+}
+
+static void packet_compact(struct gps_lexer_t *lexer)
+/* move the held input back to the front of the store */
+{
+    size_t parsed = lexer->inbufptr - lexer->inbuffer;
+
+    if (lexer->inbuffer != lexer->inbufstore) {
+	memmove(lexer->inbufstore, lexer->inbuffer, lexer->inbuflen);
+	lexer->inbuffer = lexer->inbufstore;
+	/*@ -modobserver @*/
+	lexer->inbufptr = lexer->inbuffer + parsed;
+	/*@ +modobserver @*/
+    }
+}
+
 /* get 0-origin big-endian words relative to start of packet buffer */
 #define getword(i) (short)(lexer->inbuffer[2*(i)] | (lexer->inbuffer[2*(i)+1] << 8))
 
@@ -1449,6 +1547,10 @@ void lexer_init( /*@out@*/ struct gps_lexer_t *lexer)
 {
     lexer->char_counter = 0;
     lexer->retry_counter = 0;
+    lexer->datagrams = false;
+    lexer->chunked = false;
+    lexer->chunk.state = chunk_size;
+    lexer->chunk.left = 0;
 #ifdef PASSTHROUGH_ENABLE
     lexer->json_depth = 0;
 #endif /* PASSTHROUGH_ENABLE */
@@ -1462,21 +1564,35 @@ void lexer_init( /*@out@*/ struct gps_lexer_t *lexer)
 void packet_parse(struct gps_lexer_t *lexer)
 /* grab a packet from the input buffer */
 {
+    static char *state_table[] = {
+#include "packet_names.h"
+    };
+    /* the bulk-scan paths skip the per-character trace */
+    bool bulk = lexer->errout.debug < LOG_RAW + 2;
+
     lexer->outbuflen = 0;
     while (packet_buffered_input(lexer) > 0) {
+	unsigned char c;
+
+	if (bulk) {
+	    body_skip(lexer);
+	    if (packet_buffered_input(lexer) <= 0)
+		break;
+	}
 	/*@ -modobserver @*/
-	unsigned char c = *lexer->inbufptr++;
+	c = *lexer->inbufptr++;
 	/*@ +modobserver @*/
-	char *state_table[] = {
-#include "packet_names.h"
-	};
 	nextstate(lexer, c);
-	gpsd_report(&lexer->errout, LOG_RAW + 2,
-		    "%08ld: character '%c' [%02x], new state: %s\n",
-		    lexer->char_counter, (isprint(c) ? c : '.'), c,
-		    state_table[lexer->state]);
+	if (!bulk)
+	    gpsd_report(&lexer->errout, LOG_RAW + 2,
+			"%08ld: character '%c' [%02x], new state: %s\n",
+			lexer->char_counter, (isprint(c) ? c : '.'), c,
+			state_table[lexer->state]);
 	lexer->char_counter++;
 
+	if (bulk && lexer->state == GROUND_STATE
+	    && lexer->inbufptr == lexer->inbuffer + 1)
+	    garbage_skip(lexer);
 	if (lexer->state == GROUND_STATE) {
 	    character_discard(lexer);
 	} else if (lexer->state == COMMENT_RECOGNIZED) {
@@ -2083,15 +2199,159 @@ void packet_parse(struct gps_lexer_t *lexer)
 
 #undef getword
 
+#ifdef DATAGRAM_BATCH_ENABLE
+/* enough datagrams per call to fill the store with typical AIS traffic */
+#define DATAGRAM_BATCH	16
+
+static ssize_t datagram_read(int fd, unsigned char *end, size_t room)
+/* receive as many queued datagrams as will fit, with one system call */
+{
+    struct mmsghdr msgs[DATAGRAM_BATCH];
+    struct iovec iov[DATAGRAM_BATCH];
+    /* each slot gets what a single read() used to be offered */
+    const size_t slot = MAX_PACKET_LENGTH*2+1;
+    size_t i, nslots, len;
+    int got;
+
+    nslots = room / slot;
+    if (nslots > DATAGRAM_BATCH)
+	nslots = DATAGRAM_BATCH;
+    if (nslots < 2)
+	return read(fd, end, room);
+
+    memset(msgs, '\0', sizeof(msgs));
+    for (i = 0; i < nslots; i++) {
+	iov[i].iov_base = end + i * slot;
+	iov[i].iov_len = slot;
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    got = recvmmsg(fd, msgs, (unsigned int)nslots, MSG_DONTWAIT, NULL);
+    if (got <= 0)
+	return (ssize_t)got;
+
+    /* close up the gaps so the datagrams lie back to back */
+    len = (size_t)msgs[0].msg_len;
+    for (i = 1; i < (size_t)got; i++) {
+	memmove(end + len, end + i * slot, (size_t)msgs[i].msg_len);
+	len += (size_t)msgs[i].msg_len;
+    }
+    return (ssize_t)len;
+}
+#endif /* DATAGRAM_BATCH_ENABLE */
+
+/* a chunk longer than this is line noise, not a caster's framing */
+#define CHUNK_MAX	0x1000000
+
+size_t packet_dechunk(struct chunk_decoder_t *chunk,
+		      unsigned char *buf, size_t len)
+/* strip HTTP/1.1 chunked transfer coding in place, return what's left */
+{
+    unsigned char *in = buf, *out = buf, *end = buf + len;
+
+    while (in < end) {
+	unsigned char c;
+
+	if (chunk->state == chunk_data) {
+	    size_t n = (size_t)(end - in);
+
+	    if (n > chunk->left)
+		n = chunk->left;
+	    memmove(out, in, n);
+	    out += n;
+	    in += n;
+	    if ((chunk->left -= n) == 0)
+		chunk->state = chunk_data_end;
+	    continue;
+	} else if (chunk->state == chunk_trailer
+		   || chunk->state == chunk_error)
+	    /* the body is over, or the framing is lost; nothing to pass on */
+	    break;
+
+	c = *in++;
+	switch (chunk->state) {
+	case chunk_size:
+	    if (isxdigit(c)) {
+		chunk->left = chunk->left * 16
+		    + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+		if (chunk->left > CHUNK_MAX)
+		    chunk->state = chunk_error;
+		break;
+	    }
+	    chunk->state = chunk_extension;
+	    /*@fallthrough@*/
+	case chunk_extension:
+	    if (c == '\n')
+		chunk->state = (chunk->left > 0) ? chunk_data : chunk_trailer;
+	    break;
+	case chunk_data_end:
+	    if (c == '\n') {
+		chunk->state = chunk_size;
+		chunk->left = 0;
+	    }
+	    break;
+	default:
+	    break;
+	}
+    }
+    return (size_t)(out - buf);
+}
+
+static void packet_parse_checked(struct gps_lexer_t *lexer)
+/* run the lexer over buffered input, dropping a runaway packet */
+{
+    /* coverity[tainted_data] */
+    packet_parse(lexer);
+
+    /* if the packet in progress has outgrown any real packet, discard */
+    if ((size_t)(lexer->inbufptr - lexer->inbuffer) >= MAX_PACKET_LENGTH*2+1) {
+	/* coverity[tainted_data] */
+	packet_discard(lexer);
+	lexer->state = GROUND_STATE;
+    }
+}
+
 ssize_t packet_get(int fd, struct gps_lexer_t *lexer)
 /* grab a packet; return -1=>I/O error, 0=>EOF, or a length */
 {
     ssize_t recvd;
+    unsigned char *end;
+
+    /*
+     * A previous read may have left whole packets in the store.  Hand
+     * those out before going back to the device, so that a burst costs
+     * one read() rather than one per packet.
+     */
+    if (packet_buffered_input(lexer) > 0) {
+	packet_parse_checked(lexer);
+	if (lexer->outbuflen > 0)
+	    return (ssize_t) lexer->outbuflen;
+    }
+
+    /*
+     * Consumed packets only advance the packet start, so the held
+     * input creeps towards the end of the store.  Move it back down
+     * when there may no longer be room behind it for a whole packet;
+     * this is a no-op copy when everything has been consumed.
+     */
+    end = lexer->inbuffer + lexer->inbuflen;
+    if (lexer->inbuflen == 0
+	|| (size_t)(lexer->inbufstore + sizeof(lexer->inbufstore) - end)
+	   < MAX_PACKET_LENGTH*2+1) {
+	packet_compact(lexer);
+	end = lexer->inbuffer + lexer->inbuflen;
+    }
 
     /*@ -modobserver @*/
     errno = 0;
-    recvd = read(fd, lexer->inbuffer + lexer->inbuflen,
-		 sizeof(lexer->inbuffer) - (lexer->inbuflen));
+#ifdef DATAGRAM_BATCH_ENABLE
+    if (lexer->datagrams)
+	recvd = datagram_read(fd, end,
+		(size_t)(lexer->inbufstore + sizeof(lexer->inbufstore) - end));
+    else
+#endif /* DATAGRAM_BATCH_ENABLE */
+	recvd = read(fd, end,
+		(size_t)(lexer->inbufstore + sizeof(lexer->inbufstore) - end));
     /*@ +modobserver @*/
     if (recvd == -1) {
 	if ((errno == EAGAIN) || (errno == EINTR)) {
@@ -2104,13 +2364,24 @@ ssize_t packet_get(int fd, struct gps_lexer_t *lexer)
 	    return -1;
 	}
     } else {
+	/* an NTRIP 2.0 caster may frame the stream in HTTP chunks */
+	if (lexer->chunked) {
+	    recvd = (ssize_t)packet_dechunk(&lexer->chunk, end, (size_t)recvd);
+	    if (lexer->chunk.state == chunk_error) {
+		/* waiting for the stall timer would only delay the reconnect */
+		gpsd_report(&lexer->errout, LOG_WARN,
+			    "HTTP chunk length over %d, dropping the stream\n",
+			    CHUNK_MAX);
+		return -1;
+	    }
+	}
 	if (lexer->errout.debug >= LOG_RAW+1) {
 	    char scratchbuf[MAX_PACKET_LENGTH*2+1];
 	    gpsd_report(&lexer->errout, LOG_RAW + 1,
 			"Read %zd chars to buffer offset %zd (total %zd): %s\n",
 			recvd, lexer->inbuflen, lexer->inbuflen + recvd,
 			gpsd_packetdump(scratchbuf, sizeof(scratchbuf),
-			    (char *)lexer->inbufptr, (size_t) recvd));
+			    (char *)end, (size_t) recvd));
 	}
 	lexer->inbuflen += recvd;
     }
@@ -2127,15 +2398,7 @@ ssize_t packet_get(int fd, struct gps_lexer_t *lexer)
 	return recvd;
 
     /* Otherwise, consume from the packet input buffer */
-    /* coverity[tainted_data] */
-    packet_parse(lexer);
-
-    /* if input buffer is full, discard */
-    if (sizeof(lexer->inbuffer) == (lexer->inbuflen)) {
-	/* coverity[tainted_data] */
-	packet_discard(lexer);
-	lexer->state = GROUND_STATE;
-    }
+    packet_parse_checked(lexer);
 
     /*
      * If we gathered a packet, return its length; it will have been
@@ -2171,6 +2434,7 @@ void packet_reset( /*@out@*/ struct gps_lexer_t *lexer)
 {
     lexer->type = BAD_PACKET;
     lexer->state = GROUND_STATE;
+    lexer->inbuffer = lexer->inbufstore;
     lexer->inbuflen = 0;
     lexer->inbufptr = lexer->inbuffer;
 #ifdef BINARY_ENABLE
@@ -2183,6 +2447,7 @@ void packet_reset( /*@out@*/ struct gps_lexer_t *lexer)
 void packet_pushback(struct gps_lexer_t *lexer)
 /* push back the last packet grabbed */
 {
+    packet_compact(lexer);
     if (lexer->outbuflen + lexer->inbuflen < MAX_PACKET_LENGTH) {
 	memmove(lexer->inbuffer + lexer->outbuflen,
 		lexer->inbuffer, lexer->inbuflen);
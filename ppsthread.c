@@ -28,10 +28,23 @@
  * with PPS or KPPS.
  *
  * To use the thread manager, you need to first fill in the two
- * thread_* methods in the session structure and/or the pps_hook in
- * the context structure.  Then you can call pps_thread_activate() and
- * the thread will launch.  It is OK to do this before the device is
- * open, the thread will wait on that.
+ * thread_* methods in the session structure, and the pps_hook in the
+ * context structure if the main loop wants the edges too.  Then you
+ * can call pps_thread_activate() and the thread will launch.  It is OK
+ * to do this before the device is open, the thread will wait on that.
+ * The thread runs until thread_report_hook is cleared, which is what
+ * pps_thread_deactivate() does; other devices' threads are unaffected.
+ *
+ * Each accepted edge goes into the session's ppsring first, and is
+ * passed to the pps_hook when the main loop calls pps_thread_drain().
+ * If context->pps_wake is a descriptor, the thread writes a byte to it
+ * after every edge so the main loop knows to do that.  Only then does
+ * the thread_report_hook run, on the PPS thread, so it must not block,
+ * though a slow one no longer holds up the main loop's copy of the
+ * edge.  Handing an edge over takes no lock, so neither a slow client
+ * nor a busy log can make the thread wait; for the same reason the
+ * per-edge log lines, down to what the thread_report_hook made of the
+ * edge and the offset it shipped, are written by the drain.
  *
  * This file is Copyright (c) 2013 by the GPSD project. BSD terms
  * apply: see the file COPYING in the distribution root for details.
@@ -56,6 +69,8 @@
 #define PPS_MAX_OFFSET	100000	/* microseconds the PPS can 'pull' */
 #define PUT_MAX_OFFSET	1000000	/* microseconds for lost lock */
 
+static void pps_thread_noted(struct gps_device_t *, /*@null@*/const char *);
+
 /*
  * Warning: This is a potential portability problem.
  * It's needed so that TIOCMIWAIT will be defined and the plain PPS
@@ -73,8 +88,6 @@
 #include <glob.h>
 #endif
 
-static pthread_mutex_t ppslast_mutex;
-
 #if defined(HAVE_SYS_TIMEPPS_H)
 /*@-compdestroy -nullpass -unrecog@*/
 static int init_kernel_pps(struct gps_device_t *session)
@@ -239,7 +252,7 @@ static int init_kernel_pps(struct gps_device_t *session)
 static /*@null@*/ void *gpsd_ppsmonitor(void *arg)
 {
     struct gps_device_t *session = (struct gps_device_t *)arg;
-    double last_fixtime_real = 0, last_fixtime_clock = 0;
+    struct timespec last_fixtime_real = {0, 0}, last_fixtime_clock = {0, 0};
 #ifndef HAVE_CLOCK_GETTIME
     struct timeval  clock_tv = {0, 0};
 #endif /* HAVE_CLOCK_GETTIME */
@@ -281,8 +294,7 @@ static /*@null@*/ void *gpsd_ppsmonitor(void *arg)
      * ntpshm and chrony_send
      */
 
-    while (session->thread_report_hook != NULL 
-           || session->context->pps_hook != NULL) {
+    while (session->thread_report_hook != NULL) {
 	bool ok = false;
 #if defined(HAVE_SYS_TIMEPPS_H)
 	// cppcheck-suppress variableScope
@@ -544,22 +556,19 @@ static /*@null@*/ void *gpsd_ppsmonitor(void *arg)
 	    log = "Too long for 0.5Hz\n";
 	}
 #endif /* TIOCMIWAIT */
-	if ( ok && last_second_used >= last_fixtime_real ) {
+	if ( ok && last_second_used >= last_fixtime_real.tv_sec ) {
 		/* uh, oh, this second already handled */
 		ok = 0;
 		log = "this second already handled\n";
 	}
 
 	if (ok) {
-	    /* offset is the skew from expected to observed pulse time */
-	    double offset;
 	    /* delay after last fix */
 	    double delay;
+	    struct timespec since;
 	    char *log1 = NULL;
 	    /* drift.real is the time we think the pulse represents  */
 	    struct timedrift_t drift;
-	    gpsd_report(&session->context->errout, LOG_RAW,
-			"PPS edge accepted %.100s", log);
 #if defined(HAVE_SYS_TIMEPPS_H)
             if ( 0 <= session->kernelpps_handle && ok_kpps) {
 		/* use KPPS time */
@@ -584,58 +593,32 @@ static /*@null@*/ void *gpsd_ppsmonitor(void *arg)
              */
 
 	    /*@+relaxtypes@*/
-	    drift.real.tv_sec = (time_t)trunc(last_fixtime_real) + 1;
+	    drift.real.tv_sec = last_fixtime_real.tv_sec + 1;
 	    drift.real.tv_nsec = 0;  /* need to be fixed for 5Hz */
 	    drift.clock = clock_ts;
 	    /*@-relaxtypes@*/
 
 	    /* check to see if we have a fresh timestamp from the
 	     * GPS serial input then use that */
-	    offset = (drift.real.tv_sec - drift.clock.tv_sec);
-	    offset += ((drift.real.tv_nsec - drift.clock.tv_nsec) / 1e9);
-	    delay = (drift.clock.tv_sec + drift.clock.tv_nsec / 1e9) - last_fixtime_clock;
+	    TS_SUB(&since, &drift.clock, &last_fixtime_clock);
+	    delay = TSTONS(&since);
 	    if (0.0 > delay || 1.0 < delay) {
 		gpsd_report(&session->context->errout, LOG_RAW,
 			    "PPS: no current GPS seconds: %f\n",
 			    delay);
-		log1 = "timestamp out of range";
 	    } else {
 		/*@-compdef@*/
-		last_second_used = last_fixtime_real;
+		last_second_used = last_fixtime_real.tv_sec;
+		/* publish first, so a slow hook can't hold the edge back */
+		pps_thread_stash(session, &drift, log);
 		if (session->thread_report_hook != NULL) 
 		    log1 = session->thread_report_hook(session, &drift);
 		else
 		    log1 = "no report hook";
-		if (session->context->pps_hook != NULL)
-		    session->context->pps_hook(session, &drift);
-		/*@ -unrecog  (splint has no pthread declarations as yet) @*/
-		(void)pthread_mutex_lock(&ppslast_mutex);
-		/*@ +unrecog @*/
-		/*@-type@*/ /* splint is confused about struct timespec */
-		session->ppslast = drift;
-		/*@+type@*/
-		session->ppscount++;
-		/*@ -unrecog (splint has no pthread declarations as yet) @*/
-		(void)pthread_mutex_unlock(&ppslast_mutex);
-		/*@ +unrecog @*/
+		/* the main loop logs it, so the log lock isn't taken here */
+		pps_thread_noted(session, log1);
 		/*@+compdef@*/
-		/*@-type@*/ /* splint is confused about struct timespec */
-		gpsd_report(&session->context->errout, LOG_INF,
-			    "PPS hooks called with %.20s %lu.%09lu offset %.9f\n",
-			    log1,
-			    (unsigned long)clock_ts.tv_sec,
-			    (unsigned long)clock_ts.tv_nsec,
-			    offset);
-		/*@+type@*/
             }
-	    /*@-type@*/ /* splint is confused about struct timespec */
-	    gpsd_report(&session->context->errout, LOG_PROG,
-		    "PPS edge %.20s %lu.%09lu offset %.9f\n",
-		    log1,
-		    (unsigned long)clock_ts.tv_sec,
-		    (unsigned long)clock_ts.tv_nsec,
-		    offset);
-	    /*@+type@*/
 	} else {
 	    gpsd_report(&session->context->errout, LOG_RAW,
 			"PPS edge rejected %.100s", log);
@@ -685,25 +668,150 @@ void pps_thread_deactivate(struct gps_device_t *session)
 {
     /*@-nullstate -mustfreeonly@*/
     session->thread_report_hook = NULL;
-    session->context->pps_hook = NULL;
     /*@+nullstate +mustfreeonly@*/
 }
 
-int pps_thread_lastpps(struct gps_device_t *session, struct timedrift_t *td)
+void pps_thread_stash(struct gps_device_t *session,
+		      const struct timedrift_t *td, const char *why)
+/* publish the drift at an edge; only the PPS thread may call this */
+{
+    struct pps_ring_t *ring = &session->ppsring;
+    unsigned long head = ring->head;
+    struct pps_note_t *note = &ring->note[head % PPS_RING_SIZE];
+
+    /*@-type@*/ /* splint is confused about struct timespec */
+    ring->edge[head % PPS_RING_SIZE] = *td;
+    note->why = why;
+    note->verdict = NULL;
+    note->offset = (td->real.tv_sec - td->clock.tv_sec);
+    note->offset += ((td->real.tv_nsec - td->clock.tv_nsec) / 1e9);
+    /*@+type@*/
+    /* the edge has to be whole before a reader can see it */
+    memory_barrier();
+    ring->head = head + 1;
+    if (session->context->pps_wake >= 0
+	&& write(session->context->pps_wake, "", 1) == -1) {
+	/* the pipe is full, so the main loop is awake already */
+    }
+}
+
+void pps_thread_shipped(struct gps_device_t *session, double offset)
+/* record the offset a thread_report_hook sent for the edge it was given */
+{
+    struct pps_ring_t *ring = &session->ppsring;
+
+    ring->note[(ring->head - 1) % PPS_RING_SIZE].offset = offset;
+}
+
+static void pps_thread_noted(struct gps_device_t *session,
+			     /*@null@*/const char *verdict)
+/* the thread_report_hook is done with the newest edge; let it be logged */
+{
+    struct pps_ring_t *ring = &session->ppsring;
+    unsigned long head = ring->head;
+
+    ring->note[(head - 1) % PPS_RING_SIZE].verdict = verdict;
+    memory_barrier();
+    /* no wakeup; the note is logged along with the next edge if need be */
+    ring->noted = head;
+}
+
+static void pps_thread_log(struct gps_device_t *session)
+/* log the edges the thread_report_hook has finished with */
+{
+    struct pps_ring_t *ring = &session->ppsring;
+
+    for (;;) {
+	unsigned long noted = ring->noted;
+	struct timespec clock;
+	struct pps_note_t note;
+
+	memory_barrier();
+	if (ring->logged == noted)
+	    break;
+	/* as in pps_thread_drain(); a lost note just goes unlogged */
+	if (ring->head - ring->logged >= PPS_RING_SIZE)
+	    ring->logged = ring->head - (PPS_RING_SIZE - 1);
+	if (ring->logged >= noted)
+	    break;
+	/*@-type@*/ /* splint is confused about struct timespec */
+	clock = ring->edge[ring->logged % PPS_RING_SIZE].clock;
+	/*@+type@*/
+	note = ring->note[ring->logged % PPS_RING_SIZE];
+	memory_barrier();
+	if (ring->head - ring->logged >= PPS_RING_SIZE)
+	    continue;	/* overwritten while we copied it */
+	ring->logged++;
+	gpsd_report(&session->context->errout, LOG_RAW,
+		    "PPS edge accepted %.100s", note.why);
+	/*@-type@*/ /* splint is confused about struct timespec */
+	gpsd_report(&session->context->errout, LOG_INF,
+		    "PPS hooks called with %.20s %lu.%09lu offset %.9f\n",
+		    note.verdict,
+		    (unsigned long)clock.tv_sec,
+		    (unsigned long)clock.tv_nsec,
+		    note.offset);
+	/*@+type@*/
+    }
+}
+
+void pps_thread_drain(struct gps_device_t *session)
+/* pass the edges published since the last call to the pps_hook */
+{
+    struct pps_ring_t *ring = &session->ppsring;
+
+    for (;;) {
+	unsigned long head = ring->head;
+	struct timedrift_t td;
+
+	memory_barrier();
+	if (ring->tail == head)
+	    break;
+	/*
+	 * The thread writes the slot of edge n + PPS_RING_SIZE while
+	 * head is still n + PPS_RING_SIZE, so edge n can be read
+	 * safely only while head - n < PPS_RING_SIZE.
+	 */
+	if (head - ring->tail >= PPS_RING_SIZE) {
+	    unsigned long skip = head - ring->tail - (PPS_RING_SIZE - 1);
+	    ring->tail += skip;
+	    ring->lost += skip;
+	    gpsd_report(&session->context->errout, LOG_WARN,
+			"PPS main loop fell behind, %lu edges lost\n", skip);
+	}
+	/*@-type@*/ /* splint is confused about struct timespec */
+	td = ring->edge[ring->tail % PPS_RING_SIZE];
+	/*@+type@*/
+	memory_barrier();
+	if (ring->head - ring->tail >= PPS_RING_SIZE)
+	    continue;	/* overwritten while we copied it */
+	ring->tail++;
+	if (session->context->pps_hook != NULL)
+	    session->context->pps_hook(session, &td);
+    }
+    pps_thread_log(session);
+}
+
+int pps_thread_lastpps(const struct gps_device_t *session,
+		       /*@out@*/struct timedrift_t *td)
 /* return a copy of the drift at the time of the last PPS */
 {
-    volatile int ret;
-
-    /*@ -unrecog  (splint has no pthread declarations as yet) @*/
-    (void)pthread_mutex_lock(&ppslast_mutex);
-    /*@ +unrecog @*/
-    *td = session->ppslast;
-    ret = session->ppscount;
-    /*@ -unrecog (splint has no pthread declarations as yet) @*/
-    (void)pthread_mutex_unlock(&ppslast_mutex);
-    /*@ +unrecog @*/
-
-    return ret;
+    const struct pps_ring_t *ring = &session->ppsring;
+    unsigned long head;
+
+    do {
+	head = ring->head;
+	memory_barrier();
+	if (head == 0)
+	    return 0;
+	/*@-type@*/ /* splint is confused about struct timespec */
+	*td = ring->edge[(head - 1) % PPS_RING_SIZE];
+	/*@+type@*/
+	memory_barrier();
+	/* the thread may have come round to that slot meanwhile */
+    } while (ring->head - (head - 1) >= PPS_RING_SIZE);
+
+    return (int)head;
 }
 
 #endif /* PPS_ENABLE */
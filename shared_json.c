@@ -54,6 +54,9 @@ int json_device_read(const char *buf,
 				        .dflt.real = NAN},
 	{"mincycle",   t_real,       .addr.real = &dev->mincycle,
 				        .dflt.real = NAN},
+	/* network connection progress, for display only */
+	{"connection", t_ignore},
+	{"reason",     t_ignore},
 	{NULL},
     };
     /* *INDENT-ON* */
@@ -97,6 +100,8 @@ int json_watch_read(const char *buf,
 	{"scaled",         t_boolean,  .addr.boolean = &ccp->scaled},
 	{"timing",         t_boolean,  .addr.boolean = &ccp->timing},
 	{"split24",        t_boolean,  .addr.boolean = &ccp->split24},
+	{"binary",         t_boolean,  .addr.boolean = &ccp->binary},
+	{"skydelta",       t_boolean,  .addr.boolean = &ccp->skydelta},
 	{"device",         t_string,   .addr.string = ccp->devpath,
 	                                  .len = sizeof(ccp->devpath)},
 	{"remote",         t_string,   .addr.string = ccp->remote,
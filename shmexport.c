@@ -24,34 +24,114 @@ PERMISSIONS
 #include <sys/time.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#ifdef HAVE_LINUX_FUTEX_H
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif /* HAVE_LINUX_FUTEX_H */
 
 #include "gpsd.h"
 #include "libgps.h" /* for SHM_PSEUDO_FD */
 
 /*@ -mustfreeonly -nullstate -mayaliasunique @*/
 
-bool shm_acquire(struct gps_context_t *context)
-/* initialize the shared-memory segment to be used for export */
+/*@null@*/static volatile char *shm_get(struct gps_context_t *context,
+				      key_t key, size_t size)
+/* create or attach a segment of at least the given size */
 {
     int shmid;
+    volatile char *segment;
 
-    shmid = shmget((key_t)GPSD_KEY, sizeof(struct gps_data_t), (int)(IPC_CREAT|0666));
+    shmid = shmget(key, size, (int)(IPC_CREAT|0666));
+    if (shmid == -1 && errno == EINVAL) {
+	/* left over from an older daemon with a smaller layout; replace it */
+	shmid = shmget(key, 0, 0);
+	if (shmid != -1 && shmctl(shmid, IPC_RMID, NULL) == 0) {
+	    gpsd_report(&context->errout, LOG_WARN,
+			"removed stale shared-memory segment %d\n", shmid);
+	    shmid = shmget(key, size, (int)(IPC_CREAT|0666));
+	} else
+	    errno = EINVAL;
+    }
     if (shmid == -1) {
 	gpsd_report(&context->errout, LOG_ERROR,
 		    "shmget(%ld, %zd, 0666) failed: %s\n",
-		    (long int)GPSD_KEY,
-		    sizeof(struct gps_data_t),
-		    strerror(errno));
-	return false;
+		    (long int)key, size, strerror(errno));
+	return NULL;
     }
-    context->shmexport = (char *)shmat(shmid, 0, 0);
-    if ((int)(long)context->shmexport == -1) {
+    segment = (char *)shmat(shmid, 0, 0);
+    if ((int)(long)segment == -1) {
 	gpsd_report(&context->errout, LOG_ERROR, "shmat failed: %s\n", strerror(errno));
-	context->shmexport = NULL;
-	return false;
+	return NULL;
     }
     gpsd_report(&context->errout, LOG_PROG,
 		"shmat() succeeded, segment %d\n", shmid);
+    return segment;
+}
+
+#ifdef HAVE_LINUX_FUTEX_H
+#define CONDITIONALLY_UNUSED
+#else
+#define CONDITIONALLY_UNUSED UNUSED
+#endif /* HAVE_LINUX_FUTEX_H */
+static void shm_wake(volatile unsigned int *word CONDITIONALLY_UNUSED,
+		     volatile int *waiters CONDITIONALLY_UNUSED)
+/* wake the readers sleeping on a word we've just changed */
+{
+#ifdef HAVE_LINUX_FUTEX_H
+    /*
+     * Readers sleeping in gps_shm_waiting() announce themselves in
+     * the waiters count before they block on the word, so the wakeup
+     * system call is skipped entirely when nobody is listening.  The
+     * barrier orders the caller's store before the count is read; a
+     * reader that registers after this point will find the word
+     * already changed and the kernel won't let it sleep.
+     */
+    memory_barrier();
+    if (*waiters > 0)
+	(void)syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif /* HAVE_LINUX_FUTEX_H */
+}
+
+bool shm_acquire(struct gps_context_t *context)
+/* initialize the shared-memory segment to be used for export */
+{
+    volatile struct shmexport_t *shared;
+    int shmid;
+
+    /*
+     * A segment under the old key is a frozen fix from an older daemon;
+     * take it away so clients built for that layout fail to open
+     * instead of reading it forever.
+     */
+    if ((shmid = shmget((key_t)GPSD_KEY, 0, 0)) != -1
+	&& shmctl(shmid, IPC_RMID, NULL) == 0)
+	gpsd_report(&context->errout, LOG_WARN,
+		    "removed old-layout shared-memory segment %d\n", shmid);
+
+    context->shmexport = shm_get(context, (key_t)GPSD_RING_KEY,
+				 sizeof(struct shmexport_t));
+    if (context->shmexport == NULL)
+	return false;
+    shared = (struct shmexport_t *)context->shmexport;
+    if (shared->magic != SHM_EXPORT_MAGIC
+	|| shared->version != SHM_EXPORT_VERSION
+	|| shared->size != (unsigned int)sizeof(struct shmexport_t)) {
+	/* not ours to continue from; readers check magic, so it goes last */
+	shared->magic = 0;
+	memory_barrier();
+	memset((void *)shared, '\0', sizeof(struct shmexport_t));
+	shared->version = SHM_EXPORT_VERSION;
+	shared->size = (unsigned int)sizeof(struct shmexport_t);
+	memory_barrier();
+	shared->magic = SHM_EXPORT_MAGIC;
+    }
+    /* the compact export is optional; the main one works without it */
+    context->shmdir = shm_get(context, (key_t)GPSD_DIR_KEY,
+			      sizeof(struct shmdir_t));
+    if (context->shmdir != NULL)
+	memset((void *)context->shmdir, '\0', sizeof(struct shmdir_t));
     return true;
 }
 
@@ -60,6 +140,20 @@ void shm_release(struct gps_context_t *context)
 {
     if (context->shmexport != NULL)
 	(void)shmdt((const void *)context->shmexport);
+    if (context->shmdir != NULL) {
+	volatile struct shmdir_t *dir = (struct shmdir_t *)context->shmdir;
+	int i;
+
+	/* the devices are detached by now; leave no stale entries behind */
+	dir->generation++;
+	memory_barrier();
+	for (i = 0; i < SHMDIR_ENTRIES; i++)
+	    dir->device[i].path[0] = '\0';
+	memory_barrier();
+	dir->generation++;
+	(void)shmdt((const void *)context->shmdir);
+    }
+    context->shmexport = context->shmdir = NULL;
 }
 
 void shm_update(struct gps_context_t *context, struct gps_data_t *gpsdata)
@@ -67,34 +161,177 @@ void shm_update(struct gps_context_t *context, struct gps_data_t *gpsdata)
 {
     if (context->shmexport != NULL)
     {
-	static int tick;
 	volatile struct shmexport_t *shared = (struct shmexport_t *)context->shmexport;
+	/* continue from the segment's count, so restarts don't rewind it */
+	unsigned int seq = shared->head + 1;
+	volatile struct shmslot_t *slot = &shared->ring[seq % SHM_RING_SLOTS];
 
-	++tick;
 	/*
 	 * Following block of instructions must not be reordered, otherwise
 	 * havoc will ensue.
 	 *
-	 * This is a simple optimistic-concurrency technique.  We write
-	 * the second bookend first, then the data, then the first bookend.
-	 * Reader copies what it sees in normal order; that way, if we
-	 * start to write the segment during the read, the second bookend will
-	 * get clobbered first and the data can be detected as bad.
+	 * Each update goes into the next slot of the ring, so readers can
+	 * consume every one in order rather than only the latest.  Within
+	 * a slot this is a simple optimistic-concurrency technique.  We
+	 * write the second bookend first, then the data, then the first
+	 * bookend.  Reader copies what it sees in normal order; that way,
+	 * if we start to overwrite the slot during the read, the second
+	 * bookend will get clobbered first and the data can be detected
+	 * as bad.  Only when the slot is complete does head move on to it.
 	 */
-	shared->bookend2 = tick;
+	slot->bookend2 = seq;
 	memory_barrier();
-	memcpy((void *)(context->shmexport + offsetof(struct shmexport_t, gpsdata)),
-	       (void *)gpsdata,
+	memcpy((void *)&slot->gpsdata, (void *)gpsdata,
 	       sizeof(struct gps_data_t));
 	memory_barrier();
 #ifndef USE_QT
-	shared->gpsdata.gps_fd = SHM_PSEUDO_FD;
+	slot->gpsdata.gps_fd = SHM_PSEUDO_FD;
 #else
-	shared->gpsdata.gps_fd = (void *)(intptr_t)SHM_PSEUDO_FD;
+	slot->gpsdata.gps_fd = (void *)(intptr_t)SHM_PSEUDO_FD;
 #endif /* USE_QT */
 	memory_barrier();
-	shared->bookend1 = tick;
+	slot->bookend1 = seq;
+	memory_barrier();
+	shared->head = seq;
+	shm_wake(&shared->head, &shared->waiters);
+    }
+}
+
+static const size_t shmdev_size[SHMDEV_CLASSES] = SHMDEV_SIZES;
+
+static size_t shm_device_layout(/*@out@*/struct shmring_t *ring)
+/* lay out the per-class rings of a device segment, return its size */
+{
+    size_t offset = sizeof(struct shmdev_t);
+    int i;
+
+    for (i = 0; i < SHMDEV_CLASSES; i++) {
+	/* keep the records, which hold doubles, 8-byte aligned */
+	offset = (offset + 7) & ~(size_t)7;
+	ring[i].head = 0;
+	ring[i].size = (unsigned int)shmdev_size[i];
+	ring[i].offset = (unsigned int)offset;
+	ring[i].stride = (unsigned int)(SHMDEV_RECORD
+					 + ((shmdev_size[i] + 7) & ~(size_t)7)
+					 + 8);
+	offset += ring[i].stride * SHMDEV_SLOTS;
+    }
+    return offset;
+}
+
+void shm_device_attach(struct gps_context_t *context,
+		       struct gps_device_t *device, int index)
+/* give a newly activated device a compact export segment */
+{
+    volatile struct shmdir_t *dir = (struct shmdir_t *)context->shmdir;
+    volatile struct shmdev_t *shared;
+    struct shmring_t ring[SHMDEV_CLASSES];
+    unsigned int incarnation;
+    size_t size;
+
+    if (device->shmdev != NULL || dir == NULL)
+	return;
+    if (index < 0 || index >= SHMDIR_ENTRIES) {
+	gpsd_report(&context->errout, LOG_WARN,
+		    "no shared-memory directory entry for %s\n",
+		    device->gpsdata.dev.path);
+	return;
+    }
+    size = shm_device_layout(ring);
+    device->shmdev = shm_get(context, (key_t)GPSD_DEV_KEY(index), size);
+    if (device->shmdev == NULL)
+	return;
+    device->shmdevIndex = index;
+
+    /* readers still attached from an earlier device see incarnation move */
+    shared = (struct shmdev_t *)device->shmdev;
+    incarnation = shared->incarnation + 1;
+    memset((void *)device->shmdev, '\0', size);
+    memcpy((void *)shared->ring, ring, sizeof(ring));
+    shared->incarnation = incarnation;
+
+    /* odd generation tells directory readers an entry is in flux */
+    dir->generation++;
+    memory_barrier();
+    dir->device[index].key = (key_t)GPSD_DEV_KEY(index);
+    dir->device[index].incarnation = incarnation;
+    (void)strlcpy((char *)dir->device[index].path, device->gpsdata.dev.path,
+		  sizeof(dir->device[index].path));
+    memory_barrier();
+    dir->generation++;
+}
+
+void shm_device_detach(struct gps_context_t *context,
+		       struct gps_device_t *device)
+/* withdraw a deactivated device's compact export */
+{
+    volatile struct shmdir_t *dir = (struct shmdir_t *)context->shmdir;
+    volatile struct shmdev_t *shared = (struct shmdev_t *)device->shmdev;
+
+    if (shared == NULL)
+	return;
+    if (dir != NULL) {
+	dir->generation++;
+	memory_barrier();
+	dir->device[device->shmdevIndex].path[0] = '\0';
+	memory_barrier();
+	dir->generation++;
+    }
+    /* tell attached readers the device is gone, and wake them to see it */
+    shared->incarnation++;
+    memory_barrier();
+    (void)__sync_fetch_and_add(&shared->generation, 1);
+    shm_wake(&shared->generation, &shared->waiters);
+    (void)shmdt((const void *)device->shmdev);
+    device->shmdev = NULL;
+}
+
+void shm_device_put(struct gps_device_t *device, int class, const void *record)
+/* publish one record of the given class in the device's segment */
+{
+    volatile struct shmdev_t *shared = (struct shmdev_t *)device->shmdev;
+
+    if (shared != NULL) {
+	volatile struct shmring_t *ring = &shared->ring[class];
+	unsigned int seq = ring->head + 1;
+	volatile char *slot = device->shmdev + ring->offset
+	    + (seq % SHMDEV_SLOTS) * ring->stride;
+
+	/* the same bookend discipline as shm_update(), on a smaller scale */
+	*(volatile unsigned int *)(slot + ring->stride - 8) = seq;
+	memory_barrier();
+	memcpy((void *)(slot + SHMDEV_RECORD), record, ring->size);
+	memory_barrier();
+	*(volatile unsigned int *)slot = seq;
+	memory_barrier();
+	ring->head = seq;
+	/* detach bumps it too; atomic so readers never see it torn */
+	(void)__sync_fetch_and_add(&shared->generation, 1);
+	shm_wake(&shared->generation, &shared->waiters);
+    }
+}
+
+void shm_device_update(struct gps_device_t *device, gps_mask_t changed)
+/* publish the classes an update touched in the compact export */
+{
+    struct gps_data_t *gpsdata = &device->gpsdata;
+
+    if (device->shmdev == NULL)
+	return;
+    if ((changed & REPORT_IS) != 0)
+	shm_device_put(device, SHMDEV_TPV, &gpsdata->fix);
+    if ((changed & SATELLITE_SET) != 0) {
+	struct shmsky_t sky;
+
+	sky.time = gpsdata->skyview_time;
+	sky.satellites_visible = gpsdata->satellites_visible;
+	sky.satellites_used = gpsdata->satellites_used;
+	sky.dop = gpsdata->dop;
+	memcpy(sky.skyview, gpsdata->skyview, sizeof(sky.skyview));
+	shm_device_put(device, SHMDEV_SKY, &sky);
     }
+    if ((changed & AIS_SET) != 0)
+	shm_device_put(device, SHMDEV_AIS, &gpsdata->ais);
 }
 
 /*@ +mustfreeonly +nullstate +mayaliasunique @*/
@@ -6,13 +6,44 @@
  *
  */
 
-/* This simple program shows the basic functionality of the C++ wrapper class */
+/*
+ * This simple program shows the basic functionality of the C++ wrapper class.
+ *
+ * With -b it is instead a benchmark: the JSON reports in the files
+ * named on the command line are replayed from a loopback server, and
+ * the client rate is measured both through read(), which copies the
+ * whole gps_data_t out on every report, and through dispatch(), which
+ * hands each report to a gpsmm_handler in place.
+ *
+ * With -p it follows every daemon given as host:port on the command
+ * line through one gpsmm_pool, printing a line per report.
+ *
+ * With -r it checks that a gpsmm_pool recovers from a daemon that
+ * drops the connection in the middle of a response.
+ */
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <ctime>
+#include <csignal>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "libgpsmm.h"
+#include "benchmark.h"
 
 using namespace std;
 
+/* sent after the replay, so the client knows where it ends */
+#define BENCH_END	"{\"class\":\"ERROR\",\"message\":\"end of replay\"}\n"
+
 /*
  * We should get libgps_dump_state() from the client library, but
  * scons has a bug; we can't get it to add -lgps to the link line,
@@ -74,9 +105,9 @@ static void libgps_dump_state(struct gps_data_t *collect)
 		      collect->satellites_visible);
 	for (i = 0; i < collect->satellites_visible; i++) {
 	    (void)fprintf(stdout, "    %2.2d: %2.2d %3.3d %3.0f %c\n",
-			  collect->PRN[i], collect->elevation[i],
-			  collect->azimuth[i], collect->ss[i],
-			  collect->used[i] ? 'Y' : 'N');
+			  collect->skyview[i].PRN, collect->skyview[i].elevation,
+			  collect->skyview[i].azimuth, collect->skyview[i].ss,
+			  collect->skyview[i].used ? 'Y' : 'N');
 	}
     }
     if (collect->set & DEVICE_SET)
@@ -100,8 +131,291 @@ static void libgps_dump_state(struct gps_data_t *collect)
 }
 
 
-int main(void)
+/* counts reports without touching the data */
+class bench_handler : public gpsmm_handler {
+    public:
+	bench_handler() : reports(0), done(false) {}
+	unsigned long reports;
+	bool done;
+	void on_tpv(const struct gps_fix_t &) { reports++; }
+	void on_sky(const struct gps_data_t &) { reports++; }
+	void on_gst(const struct gst_t &) { reports++; }
+	void on_att(const struct attitude_t &) { reports++; }
+	void on_ais(const struct ais_t &) { reports++; }
+	void on_rtcm2(const struct rtcm2_t &) { reports++; }
+	void on_rtcm3(const struct rtcm3_t &) { reports++; }
+	void on_device(const struct devconfig_t &) { reports++; }
+	void on_devices(const struct gps_data_t &) { reports++; }
+	void on_version(const struct version_t &) { reports++; }
+	void on_watch(const struct policy_t &) { reports++; }
+	void on_pps(const struct timedrift_t &) { reports++; }
+	void on_error(const char *) { done = true; }
+};
+
+static void replay(int listener, const string &reports, int rounds, int clients)
+/* serve the reports to each client in turn, then the end marker */
+{
+    for (; clients > 0; clients--) {
+	int i, fd = accept(listener, NULL, NULL);
+
+	if (fd == -1)
+	    exit(EXIT_FAILURE);
+	for (i = 0; i < rounds; i++)
+	    if (write(fd, reports.data(), reports.size()) != (ssize_t)reports.size())
+		exit(EXIT_FAILURE);
+	(void)write(fd, BENCH_END, strlen(BENCH_END));
+	(void)close(fd);
+    }
+    exit(EXIT_SUCCESS);
+}
+
+static int open_listener(char *port, size_t portlen)
+/* listen on a loopback port of the kernel's choosing */
+{
+    struct sockaddr_in sa;
+    socklen_t salen = sizeof(sa);
+    int listener, one = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listener = socket(AF_INET, SOCK_STREAM, 0)) == -1
+	|| setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1
+	|| bind(listener, (struct sockaddr *)&sa, sizeof(sa)) == -1
+	|| listen(listener, 2) == -1
+	|| getsockname(listener, (struct sockaddr *)&sa, &salen) == -1) {
+	cerr << "test_gpsmm: can't set up the replay server\n";
+	return -1;
+    }
+    (void)snprintf(port, portlen, "%d", ntohs(sa.sin_port));
+    return listener;
+}
+
+static int benchmark(int argc, char *argv[], const struct benchmark_t &bench)
+/* time read() against dispatch() over replayed reports */
 {
+    struct benchmark_t copied = bench, handed = bench;
+    string reports;
+    unsigned long count = 0;
+    char port[16];
+    int i, listener;
+    pid_t server;
+
+    for (i = 0; i < argc; i++) {
+	FILE *fp = fopen(argv[i], "r");
+	char buf[BUFSIZ];
+
+	if (fp == NULL) {
+	    cerr << "test_gpsmm: can't open " << argv[i] << "\n";
+	    return 1;
+	}
+	while (fgets(buf, (int)sizeof(buf), fp) != NULL)
+	    if (strncmp(buf, "{\"class\":", 9) == 0) {
+		reports += buf;
+		count++;
+	    }
+	(void)fclose(fp);
+    }
+    if (count == 0) {
+	cerr << "test_gpsmm: no JSON reports found\n";
+	return 1;
+    }
+
+    if ((listener = open_listener(port, sizeof(port))) == -1)
+	return 1;
+    if ((server = fork()) == 0)
+	replay(listener, reports, bench.rounds, 2);
+    (void)close(listener);
+
+    {
+	gpsmm gps_rec("127.0.0.1", port);
+	unsigned long seen = 0;
+
+	benchmark_start(&copied);
+	while (gps_rec.is_open()) {
+	    struct gps_data_t *newdata = gps_rec.read();
+	    if (newdata == NULL)
+		continue;	/* partial report, keep reading */
+	    if ((newdata->set & ERROR_SET) != 0)
+		break;
+	    seen++;
+	}
+	benchmark_stop(&copied, seen);
+    }
+    {
+	gpsmm gps_rec("127.0.0.1", port);
+	bench_handler handler;
+
+	benchmark_start(&handed);
+	while (gps_rec.is_open() && !handler.done)
+	    if (gps_rec.dispatch(handler) == -1)
+		break;
+	benchmark_stop(&handed, handler.reports);
+    }
+    (void)waitpid(server, NULL, 0);
+    if (benchmark_report(&copied, "read():     ", "reports") != EXIT_SUCCESS)
+	return 1;
+    return benchmark_report(&handed, "dispatch(): ", "reports");
+}
+
+/* prints the reports from one source of a pool, tagged with its name */
+class pool_handler : public gpsmm_handler {
+    public:
+	explicit pool_handler(const string &name) : source(name) {}
+	string source;
+	void on_tpv(const struct gps_fix_t &fix) {
+	    (void)printf("%s: TPV mode %d lat %f lon %f\n", source.c_str(),
+			 fix.mode, fix.latitude, fix.longitude);
+	}
+	void on_sky(const struct gps_data_t &sky) {
+	    (void)printf("%s: SKY %d visible, %d used\n", source.c_str(),
+			 sky.satellites_visible, sky.satellites_used);
+	}
+	void on_ais(const struct ais_t &ais) {
+	    (void)printf("%s: AIS type %u from %09u\n", source.c_str(),
+			 ais.type, ais.mmsi);
+	}
+	void on_version(const struct version_t &version) {
+	    (void)printf("%s: VERSION %s\n", source.c_str(), version.release);
+	}
+	void on_connect(void) {
+	    (void)printf("%s: connected\n", source.c_str());
+	}
+	void on_disconnect(void) {
+	    (void)printf("%s: disconnected\n", source.c_str());
+	}
+};
+
+#define RECONNECT_VERSION "{\"class\":\"VERSION\",\"release\":\"3.12\"," \
+			  "\"rev\":\"3.12\",\"proto_major\":3,\"proto_minor\":10}\r\n"
+#define RECONNECT_TPV	"{\"class\":\"TPV\",\"device\":\"/dev/ttyUSB0\"," \
+			"\"mode\":3,\"lat\":46.498,\"lon\":7.568}\r\n"
+
+/* counts what a pool source goes through */
+class reconnect_handler : public gpsmm_handler {
+    public:
+	reconnect_handler() : connects(0), disconnects(0), fixes(0) {}
+	int connects, disconnects, fixes;
+	void on_tpv(const struct gps_fix_t &) { fixes++; }
+	void on_connect(void) { connects++; }
+	void on_disconnect(void) { disconnects++; }
+};
+
+static int reconnect_test(void)
+/* a daemon that hangs up mid-response must be dropped and redialed */
+{
+    char port[16];
+    int listener;
+    pid_t server;
+    reconnect_handler handler;
+    timestamp_t start;
+    clock_t cpu;
+    bool ok;
+
+    if ((listener = open_listener(port, sizeof(port))) == -1)
+	return 1;
+    if ((server = fork()) == 0) {
+	int fd;
+	char buf[BUFSIZ];
+
+	/* first time, hang up halfway through a report */
+	if ((fd = accept(listener, NULL, NULL)) == -1
+	    || write(fd, RECONNECT_VERSION RECONNECT_TPV,
+		     strlen(RECONNECT_VERSION) + strlen(RECONNECT_TPV) / 2) == -1)
+	    exit(EXIT_FAILURE);
+	(void)close(fd);
+	/* then behave, and stay up until the client is done */
+	if ((fd = accept(listener, NULL, NULL)) == -1
+	    || write(fd, RECONNECT_VERSION RECONNECT_TPV,
+		     strlen(RECONNECT_VERSION RECONNECT_TPV)) == -1)
+	    exit(EXIT_FAILURE);
+	while (read(fd, buf, sizeof(buf)) > 0)
+	    continue;
+	exit(EXIT_SUCCESS);
+    }
+    (void)close(listener);
+
+    start = timestamp();
+    cpu = clock();
+    {
+	gpsmm_pool pool;
+
+	(void)pool.add("127.0.0.1", port, handler);
+	/* no timeout: only the retry deadline should wake us */
+	while (handler.fixes == 0 && timestamp() - start < 10)
+	    if (pool.run(-1) == -1)
+		break;
+    }
+    cpu = clock() - cpu;
+    /* on failure the server may still be waiting for the redial */
+    (void)kill(server, SIGTERM);
+    (void)waitpid(server, NULL, 0);
+
+    ok = handler.connects == 2 && handler.disconnects == 1
+	&& handler.fixes == 1 && cpu < CLOCKS_PER_SEC / 2;
+    (void)printf("pool reconnection test %s: %d connects, %d disconnects, "
+		 "%d fixes, %.3f sec CPU\n",
+		 ok ? "succeeded" : "FAILED",
+		 handler.connects, handler.disconnects, handler.fixes,
+		 (double)cpu / CLOCKS_PER_SEC);
+    return ok ? 0 : 1;
+}
+
+static int follow(int argc, char *argv[])
+/* follow several daemons at once */
+{
+    gpsmm_pool pool;
+    vector<pool_handler *> handlers;
+    int i;
+
+    for (i = 0; i < argc; i++) {
+	string name(argv[i]);
+	size_t colon = name.rfind(':');
+	string host = (colon == string::npos) ? name : name.substr(0, colon);
+	string port = (colon == string::npos) ? DEFAULT_GPSD_PORT : name.substr(colon + 1);
+
+	handlers.push_back(new pool_handler(name));
+	(void)pool.add(host.c_str(), port.c_str(), *handlers.back());
+    }
+    for (;;) {
+	if (pool.run(5000000) == -1) {
+	    cerr << "Poll error.\n";
+	    return 1;
+	}
+	(void)fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct benchmark_t timing;
+    int option;
+    bool bench = false, pool = false;
+
+    benchmark_init(&timing, "test_gpsmm", 20);
+    while ((option = getopt(argc, argv, "bn:pr")) != -1) {
+	switch (option) {
+	case 'b':
+	    bench = true;
+	    break;
+	case 'n':
+	    benchmark_rounds(&timing, optarg);
+	    break;
+	case 'p':
+	    pool = true;
+	    break;
+	case 'r':
+	    return reconnect_test();
+	default:
+	    cerr << "usage: test_gpsmm [-b [-n rounds] file...] [-p host:port...] [-r]\n";
+	    return 1;
+	}
+    }
+    if (bench)
+	return benchmark(argc - optind, argv + optind, timing);
+    if (pool)
+	return follow(argc - optind, argv + optind);
+
     gpsmm gps_rec("localhost", DEFAULT_GPSD_PORT);
 
     if (gps_rec.stream(WATCH_ENABLE|WATCH_JSON) == NULL) {
@@ -106,6 +106,15 @@ static const char *json_str2 = "{\"class\":\"SKY\",\
          {\"PRN\":27,\"el\":16,\"az\":66,\"ss\":39,\"used\":true},\
          {\"PRN\":21,\"el\":10,\"az\":301,\"ss\":0,\"used\":false}]}";
 
+/* ...and a delta SKY report against it */
+
+static const char *json_str2_delta = "{\"class\":\"SKY\",\
+         \"time\":\"2005-06-19T12:12:43.03Z\",\"delta\":true,   \
+         \"satellites\":[\
+         {\"PRN\":21,\"el\":11,\"az\":301,\"ss\":22,\"used\":true},\
+         {\"PRN\":5,\"el\":3,\"az\":12,\"ss\":0,\"used\":false},\
+         {\"PRN\":29,\"gone\":true}]}";
+
 /* Case 3: String list syntax */
 
 static const char *json_str3 = "[\"foo\",\"bar\",\"baz\"]";
@@ -151,6 +160,13 @@ static const char *json_str5 = "{\"class\":\"DEVICE\",\
            \"driver\":\"Foonly\",\"subtype\":\"Foonly Frob\"\
            }";
 
+/* ...and a network source that couldn't connect */
+
+static const char *json_str5_net = "{\"class\":\"DEVICE\",\
+           \"path\":\"tcp://caster:2101\",\
+           \"connection\":\"failed\",\"reason\":\"Connection refused\"\
+           }";
+
 /* Case 6: test parsing of subobject list into array of structures */
 
 static const char *json_str6 = "{\"parts\":[\
@@ -291,6 +307,16 @@ static void jsontest(int i)
 	assert_integer("az[6]", gpsdata.skyview[6].azimuth, 301);
 	assert_real("ss[6]", gpsdata.skyview[6].ss, 0);
 	assert_boolean("used[6]", gpsdata.skyview[6].used, false);
+	status = libgps_json_unpack(json_str2_delta, &gpsdata, NULL);
+	assert_case(2, status);
+	assert_integer("visible", gpsdata.satellites_visible, 7);
+	assert_integer("used", gpsdata.satellites_used, 6);
+	assert_integer("PRN[1]", gpsdata.skyview[1].PRN, 28);
+	assert_integer("PRN[5]", gpsdata.skyview[5].PRN, 21);
+	assert_integer("el[5]", gpsdata.skyview[5].elevation, 11);
+	assert_boolean("used[5]", gpsdata.skyview[5].used, true);
+	assert_integer("PRN[6]", gpsdata.skyview[6].PRN, 5);
+	assert_integer("PRN[7]", gpsdata.skyview[7].PRN, 0);
 	break;
 
     case 3:
@@ -318,6 +344,9 @@ static void jsontest(int i)
 	assert_string("path", gpsdata.dev.path, "/dev/ttyUSB0");
 	assert_integer("flags", gpsdata.dev.flags, 5);
 	assert_string("driver", gpsdata.dev.driver, "Foonly");
+	status = libgps_json_unpack(json_str5_net, &gpsdata, NULL);
+	assert_case(5, status);
+	assert_string("path", gpsdata.dev.path, "tcp://caster:2101");
 	break;
 
     case 6:
@@ -401,27 +430,93 @@ static void jsontest(int i)
     }
 }
 
+static void benchmark(const char *path, int rounds)
+/* time libgps_json_unpack() over the JSON reports in a file */
+{
+    FILE *fp;
+    char buf[GPS_JSON_RESPONSE_MAX];
+    char **reports = NULL;
+    size_t i, nreports = 0, maxreports = 0;
+    unsigned long parsed = 0;
+    timestamp_t start, elapsed;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	(void)fprintf(stderr, "test_json: can't open %s\n", path);
+	exit(EXIT_FAILURE);
+    }
+    while (fgets(buf, (int)sizeof(buf), fp) != NULL) {
+	if (buf[0] != '{')
+	    continue;
+	if (nreports == maxreports) {
+	    maxreports = maxreports ? maxreports * 2 : 256;
+	    reports = realloc(reports, maxreports * sizeof(char *));
+	    if (reports == NULL) {
+		(void)fputs("test_json: out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	    }
+	}
+	if ((reports[nreports++] = strdup(buf)) == NULL) {
+	    (void)fputs("test_json: out of memory\n", stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+    (void)fclose(fp);
+    if (nreports == 0) {
+	(void)fprintf(stderr, "test_json: no JSON reports in %s\n", path);
+	exit(EXIT_FAILURE);
+    }
+
+    start = timestamp();
+    while (rounds-- > 0)
+	for (i = 0; i < nreports; i++) {
+	    int status = libgps_json_unpack(reports[i], &gpsdata, NULL);
+	    if (status != 0) {
+		(void)fprintf(stderr, "test_json: %s: %s",
+			      json_error_string(status), reports[i]);
+		exit(EXIT_FAILURE);
+	    }
+	    parsed++;
+	}
+    elapsed = timestamp() - start;
+
+    (void)printf("%lu reports in %.3f sec: %.0f reports/sec\n",
+		 parsed, elapsed, parsed / elapsed);
+}
+
 int main(int argc UNUSED, char *argv[]UNUSED)
 {
     int option;
-    int individual = 0;
+    int individual = 0, rounds = 1000;
+    char *benchfile = NULL;
 
-    while ((option = getopt(argc, argv, "hn:D:?")) != -1) {
+    while ((option = getopt(argc, argv, "b:hn:r:D:?")) != -1) {
 	switch (option) {
+	case 'b':
+	    benchfile = optarg;
+	    break;
 	case 'D':
 	    gps_enable_debug(atoi(optarg), stdout);
 	    break;
 	case 'n':
 	    individual = atoi(optarg);
 	    break;
+	case 'r':
+	    rounds = atoi(optarg);
+	    break;
 	case '?':
 	case 'h':
 	default:
-	    (void)fputs("usage: test_json [-D lvl]\n", stderr);
+	    (void)fputs("usage: test_json [-D lvl] [-b file [-r rounds]]\n",
+			stderr);
 	    exit(EXIT_FAILURE);
 	}
     }
 
+    if (benchfile != NULL) {
+	benchmark(benchfile, rounds);
+	exit(EXIT_SUCCESS);
+    }
+
     (void)fprintf(stderr, "JSON unit test ");
 
     if (individual)
@@ -0,0 +1,100 @@
+/*
+ * NMEA 0183 sentence-parsing benchmark.
+ *
+ * Loads every NMEA sentence from the logfiles named on the command line
+ * (typically the regression logs under test/daemon), then feeds them to
+ * nmea_parse() over and over and reports the sustained rate in
+ * sentences per second.
+ * Lexer and I/O costs are deliberately left out.
+ *
+ * This file is Copyright (c) 2014 by the GPSD project
+ * BSD terms apply: see the file COPYING in the distribution root for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef S_SPLINT_S
+#include <unistd.h>
+#endif /* S_SPLINT_S */
+
+#include "gpsd.h"
+#include "benchmark.h"
+
+#ifdef NMEA_ENABLE
+static struct gps_context_t context;
+
+static char **sentences;
+static size_t nsentences, maxsentences;
+
+static void load(const char *path)
+/* collect the NMEA sentences in one logfile */
+{
+    FILE *fp;
+    char buf[NMEA_BIG_BUF];
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	(void)fprintf(stderr, "test_nmea: can't open %s\n", path);
+	exit(EXIT_FAILURE);
+    }
+    while (fgets(buf, (int)sizeof(buf), fp) != NULL) {
+	if (buf[0] != '$' || strlen(buf) > NMEA_MAX)
+	    continue;
+	if (nsentences == maxsentences) {
+	    maxsentences = maxsentences ? maxsentences * 2 : 1024;
+	    sentences = realloc(sentences, maxsentences * sizeof(char *));
+	    if (sentences == NULL) {
+		(void)fputs("test_nmea: out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	    }
+	}
+	sentences[nsentences++] = strdup(buf);
+    }
+    (void)fclose(fp);
+}
+#endif /* NMEA_ENABLE */
+
+int main(int argc, char *argv[])
+{
+#ifdef NMEA_ENABLE
+    struct gps_device_t session;
+    struct benchmark_t bench;
+    int option, round;
+    size_t i;
+
+    benchmark_init(&bench, "test_nmea", 100);
+    while ((option = getopt(argc, argv, "n:")) != -1) {
+	switch (option) {
+	case 'n':
+	    benchmark_rounds(&bench, optarg);
+	    break;
+	default:
+	    (void)fputs("usage: test_nmea [-n rounds] logfile...\n", stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+    for (; optind < argc; optind++)
+	load(argv[optind]);
+    if (nsentences == 0) {
+	(void)fputs("test_nmea: no NMEA sentences found\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+
+    gps_context_init(&context, "test_nmea");
+    gpsd_time_init(&context, time(NULL));
+    context.readonly = true;
+    gpsd_init(&session, &context, NULL);
+    gpsd_clear(&session);
+
+    benchmark_start(&bench);
+    for (round = 0; round < bench.rounds; round++)
+	for (i = 0; i < nsentences; i++)
+	    (void)nmea_parse(sentences[i], &session);
+    benchmark_stop(&bench, (unsigned long)bench.rounds * nsentences);
+
+    exit(benchmark_report(&bench, "", "sentences"));
+#else
+    (void)fputs("test_nmea: NMEA 0183 support is not compiled in\n", stderr);
+    exit(EXIT_FAILURE);
+#endif /* NMEA_ENABLE */
+}
@@ -301,6 +301,56 @@ static void runon_test(struct map *mp)
 }
 /*@ +compdef +uniondef +usedef +formatcode +compdestroy@*/
 
+/*@ -compdef -uniondef -usedef -formatcode -compdestroy @*/
+static int chunked_test(void)
+/* feed a sentence through the lexer in HTTP chunks, split awkwardly */
+{
+    static const char *pieces[] = {
+	"$GPVTG,", "308.74,T,,M,0.00,N,0.0,K", "*68\r\n",
+    };
+    const char *sentence = "$GPVTG,308.74,T,,M,0.00,N,0.0,K*68\r\n";
+    struct gps_lexer_t lexer;
+    char coded[BUFSIZ];
+    size_t i, len = 0;
+    int fds[2];
+    bool found = false;
+
+    for (i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+	len += (size_t)snprintf(coded + len, sizeof(coded) - len, "%zx%s\r\n%s\r\n",
+			strlen(pieces[i]), i == 1 ? ";ext=1" : "", pieces[i]);
+    len += (size_t)snprintf(coded + len, sizeof(coded) - len, "0\r\n\r\n");
+
+    if (pipe(fds) == -1)
+	return 1;
+    lexer_init(&lexer);
+    lexer.errout.debug = verbose;
+    lexer.chunked = true;
+    for (i = 0; i < len; i += 5) {
+	size_t n = (len - i < 5) ? len - i : 5;
+	if (write(fds[1], coded + i, n) != (ssize_t)n)
+	    break;
+	if (packet_get(fds[0], &lexer) > 0 && lexer.type == NMEA_PACKET
+	    && strcmp((char *)lexer.outbuffer, sentence) == 0)
+	    found = true;
+    }
+    /* a chunk length past any sane one has to fail the read at once */
+    lexer_init(&lexer);
+    lexer.errout.debug = verbose;
+    lexer.chunked = true;
+    if (write(fds[1], "10000000\r\n", 10) != 10
+	|| packet_get(fds[0], &lexer) != -1)
+	found = false;
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+    if (!found) {
+	(void)puts("Chunked transfer test FAILED.");
+	return 1;
+    }
+    (void)puts("Chunked transfer test succeeded.");
+    return 0;
+}
+/*@ +compdef +uniondef +usedef +formatcode +compdestroy@*/
+
 static int property_check(void)
 {
     const struct gps_type_t **dp;
@@ -406,6 +456,8 @@ int main(int argc, char *argv[])
 	    failcount += packet_test(mp);
 	(void)fputs("=== EOF with buffer nonempty test ===\n", stdout);
 	runon_test(&runontests[0]);
+	(void)fputs("=== Chunked transfer test ===\n", stdout);
+	failcount += chunked_test();
     }
     exit(failcount > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
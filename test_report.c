@@ -0,0 +1,123 @@
+/*
+ * JSON report-generation benchmark.
+ *
+ * Decodes the logfiles named on the command line (typically the
+ * regression logs under test/daemon) the way gpsdecode does, and each
+ * time a packet yields something reportable, renders its JSON report
+ * with json_data_report() a number of times.  Only the rendering is
+ * timed; the sustained rate is reported in reports per second.  With
+ * -b the reports are rendered the way a "binary":true watcher gets
+ * them, as wire frames with JSON only for the remaining classes.
+ *
+ * This file is Copyright (c) 2014 by the GPSD project
+ * BSD terms apply: see the file COPYING in the distribution root for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#ifndef S_SPLINT_S
+#include <unistd.h>
+#endif /* S_SPLINT_S */
+
+#include "gpsd.h"
+#include "gps_json.h"
+#include "benchmark.h"
+
+/* the mask gpsdecode reports on */
+#define REPORT_MASK	(REPORT_IS|GST_SET|SATELLITE_SET|SUBFRAME_SET|ATTITUDE_SET|RTCM2_SET|RTCM3_SET|AIS_SET)
+
+#ifdef SOCKET_EXPORT_ENABLE
+static struct gps_context_t context;
+static struct benchmark_t bench;
+
+static void render(const char *path, bool scaled, bool binary)
+/* decode one logfile, timing the JSON rendering of each report */
+{
+    struct gps_device_t session;
+    struct policy_t policy;
+    char buf[GPS_JSON_RESPONSE_MAX * 4];
+    int fd, i;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+	(void)fprintf(stderr, "test_report: can't open %s\n", path);
+	exit(EXIT_FAILURE);
+    }
+    memset(&policy, '\0', sizeof(policy));
+    policy.json = true;
+    policy.scaled = scaled;
+    gpsd_init(&session, &context, NULL);
+    gpsd_clear(&session);
+    session.gpsdata.gps_fd = fd;
+    session.gpsdata.dev.baudrate = 38400;     /* hack to enable subframes */
+    (void)strlcpy(session.gpsdata.dev.path, path,
+		  sizeof(session.gpsdata.dev.path));
+
+    for (;;) {
+	gps_mask_t changed = gpsd_poll(&session);
+
+	if (changed == ERROR_SET || changed == NODATA_IS)
+	    break;
+	if (session.lexer.type == COMMENT_PACKET)
+	    gpsd_set_century(&session);
+	if ((changed & REPORT_MASK) == 0)
+	    continue;
+	benchmark_start(&bench);
+	for (i = 0; i < bench.rounds; i++)
+	    if (binary) {
+		size_t used = wire_data_report(changed, &session,
+					       buf, sizeof(buf));
+		json_data_report(changed & ~WIRE_DATA_MASK, &session, &policy,
+				 buf + used, sizeof(buf) - used);
+	    } else
+		json_data_report(changed, &session, &policy, buf, sizeof(buf));
+	benchmark_stop(&bench, (unsigned long)bench.rounds);
+    }
+    (void)close(fd);
+}
+#endif /* SOCKET_EXPORT_ENABLE */
+
+int main(int argc, char *argv[])
+{
+#ifdef SOCKET_EXPORT_ENABLE
+    int option;
+    bool scaled = false, binary = false;
+
+    benchmark_init(&bench, "test_report", 100);
+    while ((option = getopt(argc, argv, "bn:s")) != -1) {
+	switch (option) {
+	case 'b':
+	    binary = true;
+	    break;
+	case 'n':
+	    benchmark_rounds(&bench, optarg);
+	    break;
+	case 's':
+	    scaled = true;
+	    break;
+	default:
+	    (void)fputs("usage: test_report [-b] [-n rounds] [-s] logfile...\n",
+			stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+    if (optind >= argc) {
+	(void)fputs("test_report: no logfiles given\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+
+    gps_context_init(&context, "test_report");
+    gpsd_time_init(&context, time(NULL));
+    context.readonly = true;
+    /* the decoders' complaints about old logs would swamp the result */
+    context.errout.debug = LOG_ERROR - 1;
+    for (; optind < argc; optind++)
+	render(argv[optind], scaled, binary);
+
+    exit(benchmark_report(&bench, "", "reports"));
+#else
+    (void)fputs("test_report: JSON export is not compiled in\n", stderr);
+    exit(EXIT_FAILURE);
+#endif /* SOCKET_EXPORT_ENABLE */
+}
@@ -0,0 +1,281 @@
+/*
+ * Check that fix times survive the trip from the drivers' time
+ * resolution to ntpd and chrony to the nanosecond.  A double holds
+ * only about a quarter of a microsecond at current Unix times, so
+ * every stage must carry seconds and nanoseconds separately.
+ *
+ * This file is Copyright (c) 2014 by the GPSD project
+ * BSD terms apply: see the file COPYING in the distribution root for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifndef S_SPLINT_S
+#include <sys/socket.h>
+#include <unistd.h>
+#endif /* S_SPLINT_S */
+
+#include "gpsd.h"
+
+/* as ntpd lays out its SHM refclock segment */
+struct shmTime
+{
+    int mode;
+    volatile int count;
+    time_t clockTimeStampSec;
+    int clockTimeStampUSec;
+    time_t receiveTimeStampSec;
+    int receiveTimeStampUSec;
+    int leap;
+    int precision;
+    int nsamples;
+    volatile int valid;
+    unsigned clockTimeStampNSec;
+    unsigned receiveTimeStampNSec;
+    int dummy[8];
+};
+
+/* as chrony lays out a SOCK refclock sample */
+struct sock_sample {
+    struct timeval tv;
+    double offset;
+    int pulse;
+    int leap;
+    int _pad;
+    int magic;
+};
+
+static struct gps_context_t context;
+static struct gps_device_t session;
+static bool failed = false;
+
+static void check(const char *what, const struct timespec *got,
+		  time_t sec, long nsec)
+/* complain if a time came through altered */
+{
+    if (got->tv_sec != sec || got->tv_nsec != nsec) {
+	failed = true;
+	(void)printf("%s: expected %ld.%09ld, got %ld.%09ld\n",
+		     what, (long)sec, nsec,
+		     (long)got->tv_sec, got->tv_nsec);
+    }
+}
+
+static void gpstime_test(void)
+/* GPS week and time of week, as the binary drivers pass them */
+{
+    static const unsigned short weeks[] = {1024, 1811, 2047, 3000};
+    unsigned int i;
+    long ms;
+    struct timespec ts;
+
+    context.leap_seconds = 16;
+    for (i = 0; i < sizeof(weeks) / sizeof(weeks[0]); i++) {
+	context.gps_week = weeks[i];
+	/* every millisecond of the last second of the week */
+	for (ms = 604799000; ms < 604800000; ms++) {
+	    session.newdata.time =
+		gpsd_gpstime_resolve(&session, weeks[i], ms / 1000.0);
+	    gpsd_fixtime(&session, &ts);
+	    check("gpsd_gpstime_resolve", &ts,
+		  GPS_EPOCH + (time_t)weeks[i] * SECS_PER_WEEK
+		  + ms / 1000 - 16, (ms % 1000) * 1000000);
+	}
+    }
+
+    /* receivers that report time of week in nanoseconds */
+    context.gps_week = 1811;
+    session.newdata.time = gpsd_gpstime_resolve(&session, 1811,
+						345600.000000123);
+    gpsd_fixtime(&session, &ts);
+    check("gpsd_gpstime_resolve", &ts,
+	  GPS_EPOCH + 1811 * SECS_PER_WEEK + 345600 - 16, 123);
+}
+
+#ifdef NMEA_ENABLE
+static void utctime_test(void)
+/* NMEA UTC times, through the parser */
+{
+    static const struct {
+	const char *hhmmss;
+	long nsec;
+    } tests[] = {
+	{"123519", 0},
+	{"123519.5", 500000000},
+	{"123519.05", 50000000},
+	{"123519.123456", 123456000},
+	{"123519.987654321", 987654321},
+	{"123519.9999999999", 999999999},	/* digits past ns dropped */
+    };
+    unsigned int i;
+    struct timespec ts;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+	char sentence[NMEA_MAX];
+
+	(void)snprintf(sentence, sizeof(sentence),
+		       "$GPZDA,%s,16,10,2014,00,00*", tests[i].hhmmss);
+	nmea_add_checksum(sentence);
+	(void)nmea_parse(sentence, &session);
+	gpsd_fixtime(&session, &ts);
+	check(tests[i].hhmmss, &ts, 1413462919, tests[i].nsec);
+    }
+}
+#endif /* NMEA_ENABLE */
+
+#ifdef NTPSHM_ENABLE
+static void ntpshm_test(void)
+/* the fix time as ntpd finds it in its SHM segment */
+{
+    static struct shmTime segment;
+    struct timedrift_t td;
+    struct timespec ts;
+    long ms;
+
+    context.shmTime[0] = &segment;
+    session.shmIndex = 0;
+    session.device_type = NULL;
+    context.leap_seconds = 16;
+    for (ms = 0; ms < 1000; ms++) {
+	session.newdata.time = gpsd_gpstime_resolve(&session, 1811,
+						    345600 + ms / 1000.0);
+	ntpshm_latch(&session, &td);
+	(void)ntpshm_put(&session, 0, &td);
+	ts.tv_sec = segment.clockTimeStampSec;
+	ts.tv_nsec = (long)segment.clockTimeStampNSec;
+	check("ntpshm_put", &ts,
+	      GPS_EPOCH + 1811 * SECS_PER_WEEK + 345600 - 16, ms * 1000000);
+    }
+    context.shmTime[0] = NULL;
+}
+
+static void unit_check(const char *what, int got, int expected)
+/* complain if a device landed on the wrong ntpd unit */
+{
+    if (got != expected) {
+	failed = true;
+	(void)printf("%s: expected segment %d, got %d\n",
+		     what, expected, got);
+    }
+}
+
+static void ntpshm_units_test(void)
+/* which ntpd units devices get, as they come, go and come back */
+{
+    static struct shmTime segments[NTPSHMSEGS];
+    static struct gps_device_t devices[MAXDEVICES + 2];
+    char path[GPS_PATH_MAX];
+    int i;
+
+    /* as a daemon not started as root finds them, without 0 and 1 */
+    for (i = 2; i < NTPSHMSEGS; i++)
+	context.shmTime[i] = &segments[i];
+
+    /* pairs go by the order devices are named, not the order they open */
+    for (i = 0; i < MAXDEVICES; i++) {
+	(void)snprintf(path, sizeof(path), "/dev/ttyUSB%d", i);
+	gpsd_init(&devices[i], &context, path);
+	devices[i].sourcetype = source_tcp;	/* no PPS thread */
+	ntpshm_session_init(&devices[i]);
+    }
+    for (i = MAXDEVICES - 1; i >= 0; i--)
+	ntpshm_link_activate(&devices[i]);
+    for (i = 0; i < MAXDEVICES; i++)
+	unit_check(devices[i].gpsdata.dev.path, devices[i].shmIndex,
+		   2 * (i + 1));
+
+    /* unplugged and plugged back in, the first device gets its units */
+    ntpshm_link_deactivate(&devices[0]);
+    gpsd_init(&devices[MAXDEVICES], &context, "/dev/ttyUSB0");
+    devices[MAXDEVICES].sourcetype = source_tcp;
+    ntpshm_session_init(&devices[MAXDEVICES]);
+    ntpshm_link_activate(&devices[MAXDEVICES]);
+    unit_check("replugged /dev/ttyUSB0", devices[MAXDEVICES].shmIndex, 2);
+
+    /* a newcomer takes over the pair of a device that is gone... */
+    ntpshm_link_deactivate(&devices[MAXDEVICES]);
+    gpsd_init(&devices[MAXDEVICES + 1], &context, "/dev/ttyACM0");
+    devices[MAXDEVICES + 1].sourcetype = source_tcp;
+    ntpshm_session_init(&devices[MAXDEVICES + 1]);
+    ntpshm_link_activate(&devices[MAXDEVICES + 1]);
+    unit_check("/dev/ttyACM0", devices[MAXDEVICES + 1].shmIndex, 2);
+
+    /* ...and while it holds it, the old owner has none to come back to */
+    ntpshm_session_init(&devices[MAXDEVICES]);
+    ntpshm_link_activate(&devices[MAXDEVICES]);
+    unit_check("/dev/ttyUSB0 while taken", devices[MAXDEVICES].shmIndex, -1);
+    ntpshm_link_deactivate(&devices[MAXDEVICES]);
+
+    for (i = 1; i < MAXDEVICES; i++)
+	ntpshm_link_deactivate(&devices[i]);
+    ntpshm_link_deactivate(&devices[MAXDEVICES + 1]);
+    memset(context.shmTime, '\0', sizeof(context.shmTime));
+    memset(context.shmTimePath, '\0', sizeof(context.shmTimePath));
+}
+
+#ifdef PPS_ENABLE
+static void chrony_test(void)
+/* a PPS edge as chrony rebuilds it from a SOCK sample */
+{
+    int fds[2];
+    long nsec;
+    struct timedrift_t td;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == -1) {
+	(void)printf("chrony_send: no socketpair\n");
+	failed = true;
+	return;
+    }
+    session.chronyfd = fds[0];
+    td.real.tv_sec = 1413462920;
+    td.real.tv_nsec = 0;
+    /* clock readings that don't sit on a microsecond */
+    for (nsec = 999000000; nsec < 999999999; nsec += 4321) {
+	struct sock_sample sample;
+	struct timespec ts;
+	long long ns;
+
+	td.clock.tv_sec = 1413462919;
+	td.clock.tv_nsec = nsec;
+	chrony_send(&session, &td);
+	if (recv(fds[1], &sample, sizeof(sample), 0) != sizeof(sample)) {
+	    (void)printf("chrony_send: short sample\n");
+	    failed = true;
+	    break;
+	}
+	ns = (long long)sample.tv.tv_usec * 1000 + llround(sample.offset * 1e9);
+	ts.tv_sec = sample.tv.tv_sec + (time_t)(ns / 1000000000);
+	ts.tv_nsec = (long)(ns % 1000000000);
+	TS_NORM(&ts);
+	check("chrony_send", &ts, td.real.tv_sec, td.real.tv_nsec);
+    }
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+}
+#endif /* PPS_ENABLE */
+#endif /* NTPSHM_ENABLE */
+
+int main(int argc UNUSED, char *argv[] UNUSED)
+{
+    gps_context_init(&context, "test_timespec");
+    context.readonly = true;
+    gpsd_init(&session, &context, NULL);
+    gpsd_clear(&session);
+
+    gpstime_test();
+#ifdef NMEA_ENABLE
+    utctime_test();
+#endif /* NMEA_ENABLE */
+#ifdef NTPSHM_ENABLE
+    ntpshm_test();
+    ntpshm_units_test();
+#ifdef PPS_ENABLE
+    chrony_test();
+#endif /* PPS_ENABLE */
+#endif /* NTPSHM_ENABLE */
+
+    return (int)failed;
+}
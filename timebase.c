@@ -193,6 +193,7 @@ BSD terms apply: see the file COPYING in the distribution root for details.
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 
 #include "gpsd.h"
 #include "timebase.h"
@@ -273,8 +274,9 @@ timestamp_t gpsd_utc_resolve(/*@in@*/struct gps_device_t *session)
      */
     timestamp_t t;
 
-    t = (timestamp_t)mkgmtime(&session->nmea.date) +
-	session->nmea.subseconds;
+    session->newtime.tv_sec = mkgmtime(&session->nmea.date);
+    session->newtime.tv_nsec = session->nmea.subseconds;
+    t = (timestamp_t)TSTONS(&session->newtime);
     session->context->valid &=~ GPS_TIME_VALID;
 
     /*
@@ -328,7 +330,7 @@ void gpsd_century_update(/*@in@*/struct gps_device_t *session, int century)
 timestamp_t gpsd_gpstime_resolve(/*@in@*/struct gps_device_t *session,
 			 unsigned short week, double tow)
 {
-    timestamp_t t;
+    struct timespec t;
 
     /*
      * This code detects and compensates for week counter rollovers that
@@ -354,14 +356,35 @@ timestamp_t gpsd_gpstime_resolve(/*@in@*/struct gps_device_t *session,
     if (week < 1024)
 	week += session->context->rollovers * 1024;
 
-    t = GPS_EPOCH + (week * SECS_PER_WEEK) + tow;
-    t -= session->context->leap_seconds;
+    /*
+     * Split the time of week while it is small enough for a double to
+     * hold nanoseconds; added to the epoch first, it would only keep
+     * a few hundred.
+     */
+    DTOTS(&t, tow);
+    t.tv_sec += GPS_EPOCH + ((time_t)week * SECS_PER_WEEK);
+    t.tv_sec -= session->context->leap_seconds;
+    session->newtime = t;
 
     session->context->gps_week = week;
     session->context->gps_tow = tow;
     session->context->valid |= GPS_TIME_VALID;
 
-    return t;
+    return (timestamp_t)TSTONS(&t);
+}
+
+void gpsd_fixtime(/*@in@*/struct gps_device_t *session,
+		  /*@out@*/struct timespec *ts)
+/* the time of the fix in hand, exact when a resolver supplied it */
+{
+    if (isnan(session->newdata.time)) {
+	ts->tv_sec = 0;
+	ts->tv_nsec = 0;
+    } else if ((timestamp_t)TSTONS(&session->newtime) == session->newdata.time)
+	*ts = session->newtime;
+    else
+	/* drivers that build newdata.time themselves only have the double */
+	DTOTS(ts, session->newdata.time);
 }
 
 /* end */